@@ -0,0 +1,57 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "alloc-counter.h"
+
+#if defined(__GLIBC__)
+
+// glibc lets an executable replace malloc and friends. These forward to its allocator,
+// so memory from either side can be freed by the other, and only count the calls.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static uint64_t allocations;
+
+void *malloc(size_t size)
+{
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	*ptr = __libc_memalign(alignment, size);
+	return *ptr ? 0 : ENOMEM;
+}
+
+bool bench_count_allocations(uint64_t *count)
+{
+	*count = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+	return true;
+}
+
+#else
+
+bool bench_count_allocations(uint64_t *count)
+{
+	*count = 0;
+	return false;
+}
+
+#endif
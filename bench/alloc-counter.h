@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reads the number of heap allocations made so far by any thread, FFmpeg included.
+// Returns false where allocations can't be counted (only glibc is supported).
+bool bench_count_allocations(uint64_t *count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,149 @@
+// Compares the hand-vectorised colour conversion kernels against sws_scale
+// for the formats MoQ Source converts to RGBA.
+//
+// Usage: obs-moq-convert-bench [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#include "color-convert.h"
+
+struct bench_size {
+	const char *name;
+	int width;
+	int height;
+};
+
+static const bench_size sizes[] = {
+	{"720p", 1280, 720},
+	{"1080p", 1920, 1080},
+	{"4K", 3840, 2160},
+};
+
+static const AVPixelFormat formats[] = {
+	AV_PIX_FMT_NV12,
+	AV_PIX_FMT_YUV420P,
+	AV_PIX_FMT_P010LE,
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+static double elapsed_ms(bench_clock::time_point start, int iterations)
+{
+	std::chrono::duration<double, std::milli> total = bench_clock::now() - start;
+	return total.count() / iterations;
+}
+
+// Deterministic noise so every run converts the same picture
+static void fill_plane(uint8_t *data, int linesize, int rows, uint32_t seed)
+{
+	for (int row = 0; row < rows; row++) {
+		for (int i = 0; i < linesize; i++) {
+			seed = seed * 1664525u + 1013904223u;
+			data[(size_t)row * linesize + i] = (uint8_t)(seed >> 24);
+		}
+	}
+}
+
+static int max_difference(const uint8_t *a, const uint8_t *b, size_t size)
+{
+	int worst = 0;
+	for (size_t i = 0; i < size; i++) {
+		int diff = abs((int)a[i] - (int)b[i]);
+		if (diff > worst) {
+			worst = diff;
+		}
+	}
+	return worst;
+}
+
+static void bench_format(AVPixelFormat pix_fmt, const bench_size &size, int iterations)
+{
+	uint8_t *src[4] = {};
+	int src_linesize[4] = {};
+	if (av_image_alloc(src, src_linesize, size.width, size.height, pix_fmt, 64) < 0) {
+		fprintf(stderr, "Failed to allocate %s %s source\n", av_get_pix_fmt_name(pix_fmt), size.name);
+		return;
+	}
+
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+	int chroma_rows = (size.height + (1 << desc->log2_chroma_h) - 1) >> desc->log2_chroma_h;
+	for (int plane = 0; plane < 4 && src[plane]; plane++) {
+		fill_plane(src[plane], src_linesize[plane], plane == 0 ? size.height : chroma_rows, 17 + plane);
+	}
+
+	int dst_linesize = size.width * 4;
+	size_t dst_size = (size_t)dst_linesize * size.height;
+	uint8_t *reference = (uint8_t *)av_malloc(dst_size);
+	uint8_t *dst = (uint8_t *)av_malloc(dst_size);
+
+	// Same flags MoQ Source used before the kernels existed
+	struct SwsContext *sws = sws_getContext(size.width, size.height, pix_fmt, size.width, size.height,
+						AV_PIX_FMT_RGBA, SWS_BILINEAR, NULL, NULL, NULL);
+	uint8_t *dst_data[4] = {reference, NULL, NULL, NULL};
+	int dst_linesizes[4] = {dst_linesize, 0, 0, 0};
+
+	auto start = bench_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		sws_scale(sws, (const uint8_t *const *)src, src_linesize, 0, size.height, dst_data, dst_linesizes);
+	}
+	double sws_ms = elapsed_ms(start, iterations);
+	printf("%-10s %-6s %-8s %8.3f ms %7.2fx\n", av_get_pix_fmt_name(pix_fmt), size.name, "swscale", sws_ms,
+	       1.0);
+
+	struct moq_yuv_coeffs coeffs;
+	moq_yuv_coeffs_init(&coeffs, pix_fmt, AVCOL_SPC_UNSPECIFIED, AVCOL_RANGE_UNSPECIFIED);
+
+	for (int isa = 0; isa < MOQ_CONVERT_ISA_COUNT; isa++) {
+		moq_convert_func convert = moq_convert_find_isa(pix_fmt, (moq_convert_isa)isa);
+		if (!convert) {
+			continue;
+		}
+
+		start = bench_clock::now();
+		for (int i = 0; i < iterations; i++) {
+			convert(src, src_linesize, dst, dst_linesize, size.width, 0, size.height, &coeffs);
+		}
+		double ms = elapsed_ms(start, iterations);
+
+		// Rounding differs from swscale, so report the worst channel difference instead of asserting
+		printf("%-10s %-6s %-8s %8.3f ms %7.2fx  max diff vs swscale: %d\n", av_get_pix_fmt_name(pix_fmt),
+		       size.name, moq_convert_isa_name((moq_convert_isa)isa), ms, sws_ms / ms,
+		       max_difference(reference, dst, dst_size));
+	}
+
+	sws_freeContext(sws);
+	av_free(dst);
+	av_free(reference);
+	av_freep(&src[0]);
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100;
+	if (iterations <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	printf("Best kernel on this CPU: %s, %d iterations per case\n\n",
+	       moq_convert_isa_name(moq_convert_best_isa()), iterations);
+
+	for (const bench_size &size : sizes) {
+		for (AVPixelFormat pix_fmt : formats) {
+			bench_format(pix_fmt, size, iterations);
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
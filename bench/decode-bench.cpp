@@ -0,0 +1,319 @@
+// Drives the MoQ Source video path from a recorded clip, without OBS or a relay: each frame is
+// gathered into a pooled packet, decoded, converted to RGBA across the worker pool and handed to a
+// stub obs_source_output_video. Reports frames/s, per-stage latency percentiles and heap
+// allocations per frame, so regressions in the hot path show up as numbers.
+//
+// The clip can be anything libavformat demuxes: raw H.264/HEVC elementary streams (.h264, .hevc),
+// AV1 in .obu or .ivf, or MP4/MKV. Packets are read into memory up front, so disk I/O isn't timed.
+//
+// Usage: obs-moq-bench <clip> [loops] [--low-latency]
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "alloc-counter.h"
+#include "decoder-cache.h"
+#include "frame-converter.h"
+#include "packet-builder.h"
+#include "worker-pool.h"
+
+enum bench_stage {
+	STAGE_GATHER,
+	STAGE_DECODE,
+	STAGE_CONVERT,
+	STAGE_OUTPUT,
+	STAGE_COUNT,
+};
+
+static const char *stage_names[STAGE_COUNT] = {"gather", "decode", "convert", "output"};
+
+struct bench_packet {
+	std::vector<uint8_t> data;
+	int64_t pts_us;
+	bool keyframe;
+};
+
+struct bench {
+	AVCodecContext *codec_ctx;
+	AVPacket *packet;
+	AVFrame *frame;
+	struct moq_packet_builder packet_builder;
+
+	// Output, set up on the first decoded frame like a MoQ Source pipeline
+	struct moq_frame_converter converter;
+	enum AVPixelFormat pix_fmt;
+	struct obs_source_frame output;
+	uint8_t *buffer;
+
+	uint64_t frames;
+	uint64_t output_checksum;
+	std::vector<uint64_t> stage_ns[STAGE_COUNT];
+	std::vector<uint64_t> total_ns;
+};
+
+// Stands in for obs_source_output_video: reads the frame the way OBS's copy into its cache would
+// touch it, without the cost of libobs
+static void bench_output_video(struct bench *b, const struct obs_source_frame *frame)
+{
+	for (uint32_t row = 0; row < frame->height; row += 64) {
+		b->output_checksum += frame->data[0][(size_t)row * frame->linesize[0]];
+	}
+	b->frames++;
+}
+
+static bool read_clip(const char *path, std::vector<bench_packet> &packets, AVCodecParameters *par)
+{
+	AVFormatContext *fmt_ctx = NULL;
+	if (avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	if (avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		fprintf(stderr, "Failed to read stream info from %s\n", path);
+		avformat_close_input(&fmt_ctx);
+		return false;
+	}
+	int stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (stream_index < 0) {
+		fprintf(stderr, "No video stream in %s\n", path);
+		avformat_close_input(&fmt_ctx);
+		return false;
+	}
+	AVStream *stream = fmt_ctx->streams[stream_index];
+	avcodec_parameters_copy(par, stream->codecpar);
+
+	AVPacket *packet = av_packet_alloc();
+	int64_t next_pts_us = 0;
+	while (av_read_frame(fmt_ctx, packet) >= 0) {
+		if (packet->stream_index == stream_index) {
+			bench_packet entry;
+			entry.data.assign(packet->data, packet->data + packet->size);
+			entry.keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+			// Raw elementary streams carry no timestamps
+			entry.pts_us = packet->pts != AV_NOPTS_VALUE
+					       ? av_rescale_q(packet->pts, stream->time_base, AVRational{1, 1000000})
+					       : next_pts_us;
+			next_pts_us = entry.pts_us + 33333;
+			packets.push_back(std::move(entry));
+		}
+		av_packet_unref(packet);
+	}
+	av_packet_free(&packet);
+	avformat_close_input(&fmt_ctx);
+
+	// Decoding has to start on a keyframe, as it does after a MoQ Source subscribes
+	auto first_key = std::find_if(packets.begin(), packets.end(),
+				      [](const bench_packet &entry) { return entry.keyframe; });
+	packets.erase(packets.begin(), first_key);
+	if (packets.empty()) {
+		fprintf(stderr, "No keyframe in %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+// Opened by moq_source_open_decoder's helper, with the stream's extradata as the catalog description
+static AVCodecContext *open_decoder(const AVCodecParameters *par, bool low_latency)
+{
+	struct moq_decoder_key key = {};
+	key.codec_id = par->codec_id;
+	key.extradata_size = par->extradata ? (size_t)par->extradata_size : 0;
+	key.width = par->width;
+	key.height = par->height;
+	key.low_latency = low_latency;
+	return moq_decoder_open(&key, par->extradata);
+}
+
+// Same steps as moq_pipeline_prepare_output, without thumbnails
+static bool prepare_output(struct bench *b, const AVFrame *frame)
+{
+	moq_frame_converter_free(&b->converter);
+	if (!moq_frame_converter_init(&b->converter, frame->width, frame->height, frame->width, frame->height,
+				      (enum AVPixelFormat)frame->format)) {
+		fprintf(stderr, "Failed to create converters for %s\n",
+			av_get_pix_fmt_name((enum AVPixelFormat)frame->format));
+		return false;
+	}
+	bfree(b->buffer);
+	b->buffer = (uint8_t *)bmalloc((size_t)frame->width * frame->height * 4);
+	b->pix_fmt = (enum AVPixelFormat)frame->format;
+	b->output.width = frame->width;
+	b->output.height = frame->height;
+	b->output.linesize[0] = frame->width * 4;
+	b->output.data[0] = b->buffer;
+	b->output.format = VIDEO_FORMAT_RGBA;
+	return true;
+}
+
+// Receives one frame if the decoder has one ready and sends it through conversion and output.
+// gather_ns is the time spent gathering the packet that produced it, decoded from decode_start.
+static bool receive_frame(struct bench *b, uint64_t gather_ns, uint64_t decode_start)
+{
+	int ret = avcodec_receive_frame(b->codec_ctx, b->frame);
+	uint64_t decoded = os_gettime_ns();
+	if (ret < 0) {
+		return false;
+	}
+
+	if (b->converter.slice_count == 0 || b->frame->format != b->pix_fmt ||
+	    (uint32_t)b->frame->width != b->output.width || (uint32_t)b->frame->height != b->output.height) {
+		if (!prepare_output(b, b->frame)) {
+			av_frame_unref(b->frame);
+			return false;
+		}
+	}
+	moq_frame_converter_run(&b->converter, b->frame, b->buffer, (int)b->output.linesize[0], NULL, b, 0);
+	uint64_t converted = os_gettime_ns();
+
+	b->output.timestamp = (uint64_t)b->frame->pts;
+	bench_output_video(b, &b->output);
+	av_frame_unref(b->frame);
+	uint64_t output_done = os_gettime_ns();
+
+	b->stage_ns[STAGE_GATHER].push_back(gather_ns);
+	b->stage_ns[STAGE_DECODE].push_back(decoded - decode_start);
+	b->stage_ns[STAGE_CONVERT].push_back(converted - decoded);
+	b->stage_ns[STAGE_OUTPUT].push_back(output_done - converted);
+	b->total_ns.push_back(gather_ns + output_done - decode_start);
+	return true;
+}
+
+static void run_loop(struct bench *b, const std::vector<bench_packet> &packets)
+{
+	for (const bench_packet &entry : packets) {
+		uint64_t start = os_gettime_ns();
+		if (!moq_packet_builder_copy(&b->packet_builder, entry.data.data(), entry.data.size(), b->packet)) {
+			continue;
+		}
+		b->packet->pts = entry.pts_us;
+		b->packet->dts = entry.pts_us;
+		if (entry.keyframe) {
+			b->packet->flags |= AV_PKT_FLAG_KEY;
+		}
+		uint64_t decode_start = os_gettime_ns();
+
+		// One frame per packet at most, as MoQ Source does
+		int ret = avcodec_send_packet(b->codec_ctx, b->packet);
+		av_packet_unref(b->packet);
+		if (ret >= 0) {
+			receive_frame(b, decode_start - start, decode_start);
+		}
+	}
+
+	// Drain what frame threads still hold, so every loop outputs the whole clip
+	avcodec_send_packet(b->codec_ctx, NULL);
+	while (receive_frame(b, 0, os_gettime_ns())) {
+	}
+	avcodec_flush_buffers(b->codec_ctx);
+}
+
+static void print_stage(const char *name, std::vector<uint64_t> &samples)
+{
+	if (samples.empty()) {
+		return;
+	}
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) {
+		return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))] / 1000000.0;
+	};
+	printf("%-8s %9.3f %9.3f %9.3f %9.3f\n", name, percentile(0.5), percentile(0.9), percentile(0.99),
+	       samples.back() / 1000000.0);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = NULL;
+	int loops = 5;
+	bool low_latency = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--low-latency") == 0) {
+			low_latency = true;
+		} else if (!path) {
+			path = argv[i];
+		} else {
+			loops = atoi(argv[i]);
+		}
+	}
+	if (!path || loops <= 0) {
+		fprintf(stderr, "usage: %s <clip> [loops] [--low-latency]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<bench_packet> packets;
+	AVCodecParameters *par = avcodec_parameters_alloc();
+	if (!read_clip(path, packets, par)) {
+		avcodec_parameters_free(&par);
+		return 1;
+	}
+
+	struct bench b = {};
+	b.codec_ctx = open_decoder(par, low_latency);
+	if (!b.codec_ctx) {
+		avcodec_parameters_free(&par);
+		return 1;
+	}
+	b.packet = av_packet_alloc();
+	b.frame = av_frame_alloc();
+	b.pix_fmt = AV_PIX_FMT_NONE;
+	moq_packet_builder_init(&b.packet_builder);
+
+	printf("%s: %s %dx%d, %zu packets, %d loops, low latency %s, %d conversion threads\n\n", path,
+	       avcodec_get_name(par->codec_id), par->width, par->height, packets.size(), loops,
+	       low_latency ? "on" : "off", moq_worker_pool_concurrency());
+
+	// The first pass sizes the packet pool, decoder buffers and converters; only the rest are timed
+	run_loop(&b, packets);
+	b.frames = 0;
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		b.stage_ns[stage].clear();
+		b.stage_ns[stage].reserve(packets.size() * loops);
+	}
+	b.total_ns.clear();
+	b.total_ns.reserve(packets.size() * loops);
+
+	uint64_t allocations_before = 0;
+	bool count_allocations = bench_count_allocations(&allocations_before);
+	uint64_t start = os_gettime_ns();
+	for (int i = 0; i < loops; i++) {
+		run_loop(&b, packets);
+	}
+	double seconds = (os_gettime_ns() - start) / 1000000000.0;
+	uint64_t allocations_after = 0;
+	bench_count_allocations(&allocations_after);
+
+	printf("%llu frames in %.3f s: %.1f frames/s\n", (unsigned long long)b.frames, seconds,
+	       b.frames / seconds);
+	if (count_allocations && b.frames) {
+		printf("%.2f allocations per frame\n", (double)(allocations_after - allocations_before) / b.frames);
+	} else {
+		printf("allocations per frame: not available on this platform\n");
+	}
+
+	printf("\n%-8s %9s %9s %9s %9s\n", "stage", "p50 ms", "p90 ms", "p99 ms", "max ms");
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		print_stage(stage_names[stage], b.stage_ns[stage]);
+	}
+	print_stage("total", b.total_ns);
+
+	moq_frame_converter_free(&b.converter);
+	bfree(b.buffer);
+	moq_packet_builder_free(&b.packet_builder);
+	av_frame_free(&b.frame);
+	av_packet_free(&b.packet);
+	avcodec_free_context(&b.codec_ctx);
+	avcodec_parameters_free(&par);
+	moq_worker_pool_shutdown();
+	return 0;
+}
@@ -0,0 +1,358 @@
+// Replays recorded encoder packets into MoQOutput::Data, without OBS encoding live, to measure
+// what publishing costs: time per Data() call, how far the outputs fall behind the packets' own
+// timing, memory growth while libmoq queues what the network hasn't taken yet, and sustained
+// throughput, across any number of parallel outputs.
+//
+// The input is any file libavformat demuxes with H.264/HEVC video and optional AAC/Opus audio. An
+// OBS recording to MKV holds the encoder packets verbatim, so it replays what OBS would have sent.
+// Length-prefixed H.264/HEVC (MP4, MKV) is converted to the Annex B that OBS encoders emit.
+//
+// Usage: obs-moq-publish-bench <file> [--url URL] [--outputs N] [--seconds S] [--fast]
+//
+// Without --url the outputs publish into an in-process loopback origin, so nothing but MoQOutput
+// and libmoq is measured. --fast sends packets as fast as Data() accepts them instead of in real time.
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
+#include <libavformat/avformat.h>
+}
+
+#include "moq-output.h"
+#include "loopback.h"
+
+struct replay_packet {
+	std::vector<uint8_t> data;
+	int64_t pts;
+	int64_t dts;
+	int64_t dts_ns; // From the start of the clip, for pacing
+	bool keyframe;
+	enum obs_encoder_type type;
+};
+
+struct replay_track {
+	const char *codec; // OBS codec name
+	std::vector<uint8_t> extra_data;
+	AVRational time_base;
+};
+
+struct replay_clip {
+	replay_track video;
+	replay_track audio;
+	bool has_audio;
+	std::vector<replay_packet> packets; // In dts order, as an output receives them
+	int64_t duration_ns;
+};
+
+struct replay_stats {
+	std::vector<uint64_t> video_ns; // Time spent in each Data() call
+	std::vector<uint64_t> audio_ns;
+	uint64_t packets;
+	uint64_t bytes;
+	int64_t max_lag_ns; // Furthest Data() was called behind a packet's due time
+	bool connected;
+};
+
+static std::atomic<bool> stopping(false);
+
+static const char *obs_codec_name(enum AVCodecID codec_id)
+{
+	switch (codec_id) {
+	case AV_CODEC_ID_H264:
+		return "h264";
+	case AV_CODEC_ID_HEVC:
+		return "hevc";
+	case AV_CODEC_ID_AAC:
+		return "aac";
+	case AV_CODEC_ID_OPUS:
+		return "opus";
+	default:
+		return NULL;
+	}
+}
+
+static int64_t to_ns(int64_t ts, AVRational time_base)
+{
+	return av_rescale_q(ts, time_base, AVRational{1, 1000000000});
+}
+
+static bool read_clip(const char *path, replay_clip &clip)
+{
+	AVFormatContext *fmt_ctx = NULL;
+	if (avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0 || avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		avformat_close_input(&fmt_ctx);
+		return false;
+	}
+
+	int video_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	int audio_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, video_index, NULL, 0);
+	AVStream *video_stream = video_index >= 0 ? fmt_ctx->streams[video_index] : NULL;
+	AVStream *audio_stream = audio_index >= 0 ? fmt_ctx->streams[audio_index] : NULL;
+	if (!video_stream || !obs_codec_name(video_stream->codecpar->codec_id)) {
+		fprintf(stderr, "%s has no H.264 or HEVC video\n", path);
+		avformat_close_input(&fmt_ctx);
+		return false;
+	}
+	clip.has_audio = audio_stream && obs_codec_name(audio_stream->codecpar->codec_id);
+
+	// OBS encoders emit Annex B with the parameter sets in extra data and in front of keyframes
+	AVBSFContext *bsf = NULL;
+	const AVCodecParameters *video_par = video_stream->codecpar;
+	if (video_par->extradata_size > 0 && video_par->extradata[0] == 1) {
+		const char *name = video_par->codec_id == AV_CODEC_ID_HEVC ? "hevc_mp4toannexb" : "h264_mp4toannexb";
+		if (av_bsf_alloc(av_bsf_get_by_name(name), &bsf) < 0 ||
+		    avcodec_parameters_copy(bsf->par_in, video_par) < 0 || av_bsf_init(bsf) < 0) {
+			fprintf(stderr, "Failed to set up %s\n", name);
+			av_bsf_free(&bsf);
+			avformat_close_input(&fmt_ctx);
+			return false;
+		}
+		video_par = bsf->par_out;
+	}
+
+	clip.video.codec = obs_codec_name(video_par->codec_id);
+	clip.video.extra_data.assign(video_par->extradata, video_par->extradata + video_par->extradata_size);
+	clip.video.time_base = video_stream->time_base;
+	if (clip.has_audio) {
+		const AVCodecParameters *audio_par = audio_stream->codecpar;
+		clip.audio.codec = obs_codec_name(audio_par->codec_id);
+		clip.audio.extra_data.assign(audio_par->extradata, audio_par->extradata + audio_par->extradata_size);
+		clip.audio.time_base = audio_stream->time_base;
+	}
+
+	AVPacket *packet = av_packet_alloc();
+	int64_t first_dts_ns = INT64_MIN;
+	auto add_packet = [&clip, &first_dts_ns](const AVPacket *pkt, const replay_track &track,
+						 enum obs_encoder_type type) {
+		replay_packet entry;
+		entry.data.assign(pkt->data, pkt->data + pkt->size);
+		entry.pts = pkt->pts;
+		entry.dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+		entry.keyframe = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+		entry.type = type;
+		entry.dts_ns = to_ns(entry.dts, track.time_base);
+		if (first_dts_ns == INT64_MIN) {
+			first_dts_ns = entry.dts_ns;
+		}
+		entry.dts_ns -= first_dts_ns;
+		clip.packets.push_back(std::move(entry));
+	};
+
+	while (av_read_frame(fmt_ctx, packet) >= 0) {
+		if (packet->pts == AV_NOPTS_VALUE) {
+			// Raw elementary streams have no timing to replay
+		} else if (packet->stream_index == video_index && bsf) {
+			if (av_bsf_send_packet(bsf, packet) >= 0) {
+				while (av_bsf_receive_packet(bsf, packet) >= 0) {
+					add_packet(packet, clip.video, OBS_ENCODER_VIDEO);
+					av_packet_unref(packet);
+				}
+			}
+		} else if (packet->stream_index == video_index) {
+			add_packet(packet, clip.video, OBS_ENCODER_VIDEO);
+		} else if (packet->stream_index == audio_index && clip.has_audio) {
+			add_packet(packet, clip.audio, OBS_ENCODER_AUDIO);
+		}
+		av_packet_unref(packet);
+	}
+	av_packet_free(&packet);
+	av_bsf_free(&bsf);
+	avformat_close_input(&fmt_ctx);
+
+	std::stable_sort(clip.packets.begin(), clip.packets.end(),
+			 [](const replay_packet &a, const replay_packet &b) { return a.dts_ns < b.dts_ns; });
+
+	// Publishing starts at a keyframe, as it does when an output starts
+	auto first_key = std::find_if(clip.packets.begin(), clip.packets.end(), [](const replay_packet &entry) {
+		return entry.type == OBS_ENCODER_VIDEO && entry.keyframe;
+	});
+	clip.packets.erase(clip.packets.begin(), first_key);
+	if (clip.packets.empty()) {
+		fprintf(stderr, "No timed video keyframe in %s\n", path);
+		return false;
+	}
+
+	// A frame's worth past the last packet, so loops don't overlap
+	clip.duration_ns = clip.packets.back().dts_ns - clip.packets.front().dts_ns + 33333333;
+	return true;
+}
+
+// One output, fed on its own thread like an OBS output fed by its encoders
+static void run_output(const replay_clip &clip, const std::string &url, int index, int64_t seconds, bool fast,
+		       replay_stats *stats)
+{
+	MoQOutput output(NULL, NULL);
+	stats->connected = output.Connect(url, "bench/" + std::to_string(index));
+	if (!stats->connected || !output.InitTrack(OBS_ENCODER_VIDEO, clip.video.codec, clip.video.extra_data.data(),
+						   clip.video.extra_data.size())) {
+		stats->connected = false;
+		return;
+	}
+	if (clip.has_audio) {
+		output.InitTrack(OBS_ENCODER_AUDIO, clip.audio.codec, clip.audio.extra_data.data(),
+				 clip.audio.extra_data.size());
+	}
+
+	int64_t base_dts_ns = clip.packets.front().dts_ns;
+	uint64_t start_ns = os_gettime_ns();
+	for (int64_t loop = 0; !stopping; loop++) {
+		// In real time, --seconds is stream time; --fast runs until main() stops it
+		int64_t loop_offset_ns = loop * clip.duration_ns;
+		if (!fast && loop > 0 && loop_offset_ns >= seconds * 1000000000LL) {
+			break;
+		}
+
+		for (const replay_packet &entry : clip.packets) {
+			if (stopping) {
+				break;
+			}
+			uint64_t due_ns = start_ns + (uint64_t)(loop_offset_ns + entry.dts_ns - base_dts_ns);
+			uint64_t now_ns = os_gettime_ns();
+			if (!fast && due_ns > now_ns) {
+				os_sleepto_ns(due_ns);
+				now_ns = os_gettime_ns();
+			}
+			if (!fast) {
+				stats->max_lag_ns = std::max(stats->max_lag_ns, (int64_t)(now_ns - due_ns));
+			}
+
+			// Later loops carry on from where the previous one ended
+			const replay_track &track = entry.type == OBS_ENCODER_VIDEO ? clip.video : clip.audio;
+			int64_t offset = av_rescale_q(loop_offset_ns, AVRational{1, 1000000000}, track.time_base);
+
+			struct encoder_packet packet = {};
+			packet.data = (uint8_t *)entry.data.data();
+			packet.size = entry.data.size();
+			packet.pts = entry.pts + offset;
+			packet.dts = entry.dts + offset;
+			packet.timebase_num = track.time_base.num;
+			packet.timebase_den = track.time_base.den;
+			packet.type = entry.type;
+			packet.keyframe = entry.keyframe;
+			packet.sys_dts_usec = (int64_t)(now_ns / 1000);
+			packet.dts_usec = packet.sys_dts_usec;
+
+			uint64_t call_start = os_gettime_ns();
+			output.Data(&packet);
+			uint64_t elapsed = os_gettime_ns() - call_start;
+
+			(entry.type == OBS_ENCODER_VIDEO ? stats->video_ns : stats->audio_ns).push_back(elapsed);
+			stats->packets++;
+			stats->bytes += entry.data.size();
+		}
+	}
+
+	output.Stop(false);
+}
+
+static void print_calls(const char *name, std::vector<uint64_t> &samples)
+{
+	if (samples.empty()) {
+		return;
+	}
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) {
+		return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))] / 1000.0;
+	};
+	printf("%-6s %10zu %9.1f %9.1f %9.1f %9.1f\n", name, samples.size(), percentile(0.5), percentile(0.9),
+	       percentile(0.99), samples.back() / 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = NULL;
+	std::string url = MOQ_LOOPBACK_SCHEME "bench";
+	int outputs = 1;
+	int64_t seconds = 30;
+	bool fast = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--url") == 0 && i + 1 < argc) {
+			url = argv[++i];
+		} else if (strcmp(argv[i], "--outputs") == 0 && i + 1 < argc) {
+			outputs = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+			seconds = atoll(argv[++i]);
+		} else if (strcmp(argv[i], "--fast") == 0) {
+			fast = true;
+		} else if (!path && argv[i][0] != '-') {
+			path = argv[i];
+		} else {
+			path = NULL;
+			break;
+		}
+	}
+	if (!path || outputs <= 0 || seconds <= 0) {
+		fprintf(stderr, "usage: %s <file> [--url URL] [--outputs N] [--seconds S] [--fast]\n", argv[0]);
+		return 1;
+	}
+
+	replay_clip clip;
+	if (!read_clip(path, clip)) {
+		return 1;
+	}
+
+	printf("%s: %s%s%s, %zu packets over %.1f s, replayed by %d output(s) to %s for %lld s%s\n\n", path,
+	       clip.video.codec, clip.has_audio ? " + " : "", clip.has_audio ? clip.audio.codec : "",
+	       clip.packets.size(), clip.duration_ns / 1e9, outputs, url.c_str(), (long long)seconds,
+	       fast ? " as fast as possible" : " in real time");
+
+	uint64_t rss_before = os_get_proc_resident_size();
+	std::vector<replay_stats> stats(outputs);
+	std::vector<std::thread> threads;
+	uint64_t start_ns = os_gettime_ns();
+	for (int i = 0; i < outputs; i++) {
+		threads.emplace_back(run_output, std::cref(clip), std::cref(url), i, seconds, fast, &stats[i]);
+	}
+
+	// Memory held by libmoq for data not yet sent shows up as growth while the outputs run
+	uint64_t rss_peak = rss_before;
+	uint64_t deadline_ns = start_ns + (uint64_t)seconds * 1000000000ULL;
+	while (os_gettime_ns() < deadline_ns) {
+		os_sleep_ms(100);
+		rss_peak = std::max(rss_peak, os_get_proc_resident_size());
+	}
+	if (fast) {
+		stopping = true;
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+	double elapsed = (os_gettime_ns() - start_ns) / 1e9;
+
+	replay_stats total = {};
+	int connected = 0;
+	for (replay_stats &s : stats) {
+		connected += s.connected ? 1 : 0;
+		total.packets += s.packets;
+		total.bytes += s.bytes;
+		total.max_lag_ns = std::max(total.max_lag_ns, s.max_lag_ns);
+		total.video_ns.insert(total.video_ns.end(), s.video_ns.begin(), s.video_ns.end());
+		total.audio_ns.insert(total.audio_ns.end(), s.audio_ns.begin(), s.audio_ns.end());
+	}
+
+	printf("%d/%d outputs published, %llu packets in %.2f s: %.0f packets/s, %.2f Mbit/s\n", connected, outputs,
+	       (unsigned long long)total.packets, elapsed, total.packets / elapsed, total.bytes * 8 / elapsed / 1e6);
+	if (!fast) {
+		// Data() taking longer than the stream allows; in OBS the packets would queue up instead
+		printf("Max lag behind real time: %.1f ms\n", total.max_lag_ns / 1e6);
+	}
+	printf("Resident memory: %.1f MB before, %.1f MB peak\n\n", rss_before / 1e6, rss_peak / 1e6);
+
+	printf("%-6s %10s %9s %9s %9s %9s\n", "Data()", "calls", "p50 us", "p90 us", "p99 us", "max us");
+	print_calls("video", total.video_ns);
+	print_calls("audio", total.audio_ns);
+	return connected == outputs ? 0 : 1;
+}
@@ -0,0 +1,1049 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "moq.h"
+#include "moq-fake.h"
+
+// Returned for a bad handle or argument, and reported when a scripted disconnect drops a session
+#define FAKE_ERROR -1
+
+struct fake_config {
+	uint32_t latency_ms = 0;
+	uint32_t jitter_ms = 0;
+	double reorder = 0.0;
+	double loss = 0.0;
+	uint32_t threads = 1;
+	size_t chunk_size = 0;
+	uint32_t connect_ms = 0;
+	int32_t connect_error = 0;
+	uint32_t disconnect_after_ms = 0;
+	uint32_t seed = 1;
+	std::string clip;
+	std::string clip_codec = "avc3";
+	double clip_fps = 30.0;
+};
+
+struct fake_frame {
+	std::shared_ptr<const std::vector<uint8_t>> payload;
+	uint64_t timestamp_us;
+	bool keyframe;
+	size_t chunk_size; // 0 = one chunk
+};
+
+// A published media track
+struct fake_track {
+	std::string name;
+	std::string format;
+	std::vector<uint8_t> init;
+	bool video;
+	std::vector<fake_frame> group;       // Since the latest keyframe, replayed to new subscribers
+	std::vector<int32_t> subscriptions;
+};
+
+struct fake_broadcast {
+	std::vector<std::shared_ptr<fake_track>> tracks;
+	uint32_t version; // Bumped whenever tracks change, so subscribers get a new catalog
+};
+
+// Origins hold broadcasts by path. The relay behind each URL is an origin too.
+struct fake_origin {
+	std::map<std::string, std::shared_ptr<fake_broadcast>> broadcasts;
+	std::vector<int32_t> consume_sessions; // Linked sessions whose relay this origin consumes from
+};
+
+struct fake_session {
+	std::string url;
+	int32_t publish_origin;
+	int32_t consume_origin;
+	void (*on_status)(void *user_data, int32_t code);
+	void *user_data;
+	bool linked;
+	std::vector<std::string> relayed; // Paths this session published to the relay
+	uint32_t thread;
+};
+
+struct fake_consume {
+	int32_t origin;
+	std::string path;
+};
+
+struct fake_catalog_sub {
+	int32_t consume;
+	void (*on_catalog)(void *user_data, int32_t catalog);
+	void *user_data;
+	std::weak_ptr<fake_broadcast> broadcast; // Last delivered
+	uint32_t version;
+	uint32_t thread;
+};
+
+// Snapshot of a broadcast's tracks handed to on_catalog
+struct fake_catalog {
+	std::vector<std::shared_ptr<fake_track>> video;
+	std::vector<std::shared_ptr<fake_track>> audio;
+	int32_t session; // Session the broadcast was reached through, 0 = none
+};
+
+struct fake_subscription {
+	std::shared_ptr<fake_track> track;
+	void (*on_frame)(void *user_data, int32_t frame);
+	void *user_data;
+	int32_t session;
+	uint32_t thread;
+	uint64_t last_due_ns;
+	bool holding; // A frame held back to be delivered after the next one
+	fake_frame held;
+};
+
+struct fake_media {
+	std::shared_ptr<fake_broadcast> broadcast;
+	std::shared_ptr<fake_track> track;
+};
+
+// Runs callbacks at their due time on its own thread
+struct fake_dispatcher {
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::multimap<uint64_t, std::function<void()>> events; // Equal due times run in insertion order
+};
+
+static std::mutex fake_mutex;
+static fake_config config;
+static std::mt19937 rng;
+static int32_t next_handle = 1;
+static uint32_t next_thread = 0;
+static std::atomic<bool> shutting_down(false);
+
+static std::map<int32_t, std::shared_ptr<fake_origin>> origins;
+static std::map<std::string, std::shared_ptr<fake_origin>> relays; // By URL
+static std::map<int32_t, std::shared_ptr<fake_broadcast>> broadcasts;
+static std::map<int32_t, fake_media> medias;
+static std::map<int32_t, std::shared_ptr<fake_session>> sessions;
+static std::map<int32_t, fake_consume> consumes;
+static std::map<int32_t, std::shared_ptr<fake_catalog_sub>> catalog_subs;
+static std::map<int32_t, fake_catalog> catalogs;
+static std::map<int32_t, std::shared_ptr<fake_subscription>> subscriptions;
+static std::map<int32_t, fake_frame> frames;
+static std::map<std::string, std::shared_ptr<fake_broadcast>> generated; // Clip broadcasts by path
+
+static std::vector<std::unique_ptr<fake_dispatcher>> dispatchers;
+static std::vector<std::thread> generators;
+
+static uint64_t now_ns(void)
+{
+	auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+static bool parse_number(const std::string &text, double *value)
+{
+	char *end = NULL;
+	*value = strtod(text.c_str(), &end);
+	return !text.empty() && *end == '\0';
+}
+
+static bool parse_config(const char *spec, fake_config *out)
+{
+	fake_config parsed = *out;
+	std::string rest = spec ? spec : "";
+	while (!rest.empty()) {
+		size_t comma = rest.find(',');
+		std::string item = rest.substr(0, comma);
+		rest = comma == std::string::npos ? "" : rest.substr(comma + 1);
+		if (item.empty()) {
+			continue;
+		}
+
+		size_t equals = item.find('=');
+		if (equals == std::string::npos) {
+			fprintf(stderr, "[moq-fake] Expected key=value: '%s'\n", item.c_str());
+			return false;
+		}
+		std::string key = item.substr(0, equals);
+		std::string text = item.substr(equals + 1);
+		if (key == "clip") {
+			parsed.clip = text;
+			continue;
+		}
+		if (key == "clip_codec") {
+			parsed.clip_codec = text;
+			continue;
+		}
+
+		double value;
+		if (!parse_number(text, &value) || (value < 0 && key != "connect_error")) {
+			fprintf(stderr, "[moq-fake] Bad value for %s: '%s'\n", key.c_str(), text.c_str());
+			return false;
+		}
+		if (key == "latency_ms") {
+			parsed.latency_ms = (uint32_t)value;
+		} else if (key == "jitter_ms") {
+			parsed.jitter_ms = (uint32_t)value;
+		} else if (key == "reorder") {
+			parsed.reorder = value;
+		} else if (key == "loss") {
+			parsed.loss = value;
+		} else if (key == "threads") {
+			parsed.threads = value >= 1 ? (uint32_t)value : 1;
+		} else if (key == "chunk_size") {
+			parsed.chunk_size = (size_t)value;
+		} else if (key == "connect_ms") {
+			parsed.connect_ms = (uint32_t)value;
+		} else if (key == "connect_error") {
+			parsed.connect_error = (int32_t)value;
+		} else if (key == "disconnect_after_ms") {
+			parsed.disconnect_after_ms = (uint32_t)value;
+		} else if (key == "seed") {
+			parsed.seed = (uint32_t)value;
+		} else if (key == "clip_fps") {
+			parsed.clip_fps = value > 0 ? value : 30.0;
+		} else {
+			fprintf(stderr, "[moq-fake] Unknown key: '%s'\n", key.c_str());
+			return false;
+		}
+	}
+	*out = parsed;
+	return true;
+}
+
+static void fake_init(void)
+{
+	static std::once_flag once;
+	std::call_once(once, [] {
+		std::lock_guard<std::mutex> lock(fake_mutex);
+		const char *spec = getenv("MOQ_FAKE");
+		if (spec && !parse_config(spec, &config)) {
+			fprintf(stderr, "[moq-fake] Ignoring MOQ_FAKE\n");
+		}
+		rng.seed(config.seed);
+	});
+}
+
+static void dispatcher_thread(fake_dispatcher *dispatcher)
+{
+	std::unique_lock<std::mutex> lock(dispatcher->mutex);
+	while (true) {
+		if (shutting_down) {
+			return;
+		}
+		if (dispatcher->events.empty()) {
+			dispatcher->cond.wait(lock);
+			continue;
+		}
+		uint64_t due_ns = dispatcher->events.begin()->first;
+		uint64_t now = now_ns();
+		if (due_ns > now) {
+			dispatcher->cond.wait_for(lock, std::chrono::nanoseconds(due_ns - now));
+			continue;
+		}
+
+		std::function<void()> event = std::move(dispatcher->events.begin()->second);
+		dispatcher->events.erase(dispatcher->events.begin());
+		lock.unlock();
+		event();
+		lock.lock();
+	}
+}
+
+// NOTE: Caller must hold fake_mutex
+static uint32_t pick_thread_locked(void)
+{
+	while (dispatchers.size() < config.threads) {
+		dispatchers.push_back(std::make_unique<fake_dispatcher>());
+		dispatchers.back()->thread = std::thread(dispatcher_thread, dispatchers.back().get());
+	}
+	return next_thread++ % config.threads;
+}
+
+// NOTE: Caller must hold fake_mutex
+static void schedule_locked(uint32_t thread, uint64_t due_ns, std::function<void()> event)
+{
+	fake_dispatcher *dispatcher = dispatchers[thread].get();
+	std::lock_guard<std::mutex> lock(dispatcher->mutex);
+	dispatcher->events.emplace(due_ns, std::move(event));
+	dispatcher->cond.notify_one();
+}
+
+// NOTE: Caller must hold fake_mutex
+static double random_unit_locked(void)
+{
+	return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+}
+
+static bool is_audio_format(const std::string &format)
+{
+	return format == "opus" || format == "aac" || format.compare(0, 4, "mp4a") == 0;
+}
+
+// Annex B start code at or after pos: sets where it starts and where the NAL unit after it starts
+static bool find_start_code(const uint8_t *data, size_t size, size_t pos, size_t *code_start, size_t *nal_start)
+{
+	for (size_t i = pos; i + 3 <= size; i++) {
+		if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+			*code_start = i > pos && data[i - 1] == 0 ? i - 1 : i;
+			*nal_start = i + 3;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool is_key_nal(bool hevc, uint8_t header)
+{
+	int type = hevc ? (header >> 1) & 0x3f : header & 0x1f;
+	return hevc ? type >= 16 && type <= 21 : type == 5;
+}
+
+// Reads the keyframe flag from the bitstream, as libmoq does, so publishers don't have to pass it
+static bool is_keyframe(const std::string &format, const uint8_t *data, size_t size)
+{
+	if (is_audio_format(format) || size == 0) {
+		return true;
+	}
+
+	bool h264 = format.compare(0, 4, "avc1") == 0 || format.compare(0, 4, "avc3") == 0;
+	bool hevc = format.compare(0, 4, "hev1") == 0 || format.compare(0, 4, "hvc1") == 0;
+	if (h264 || hevc) {
+		size_t code_start;
+		size_t nal;
+		if (size >= 4 && find_start_code(data, size, 0, &code_start, &nal) && code_start == 0) {
+			for (size_t pos = 0; find_start_code(data, size, pos, &code_start, &nal); pos = nal) {
+				if (nal < size && is_key_nal(hevc, data[nal])) {
+					return true;
+				}
+			}
+			return false;
+		}
+		// Length-prefixed
+		for (size_t pos = 0; pos + 4 < size;) {
+			size_t length = ((size_t)data[pos] << 24) | ((size_t)data[pos + 1] << 16) |
+					((size_t)data[pos + 2] << 8) | data[pos + 3];
+			if (is_key_nal(hevc, data[pos + 4])) {
+				return true;
+			}
+			pos += 4 + length;
+		}
+		return false;
+	}
+
+	if (format.compare(0, 4, "av01") == 0 || format == "av1") {
+		// Encoders repeat the sequence header OBU on keyframes
+		for (size_t pos = 0; pos < size;) {
+			uint8_t header = data[pos];
+			if (((header >> 3) & 0x0f) == 1) {
+				return true;
+			}
+			size_t offset = pos + 1 + ((header & 0x04) ? 1 : 0);
+			if (!(header & 0x02)) {
+				break;
+			}
+			size_t length = 0;
+			for (int i = 0; i < 8 && offset < size; i++) {
+				uint8_t byte = data[offset++];
+				length |= (size_t)(byte & 0x7f) << (7 * i);
+				if (!(byte & 0x80)) {
+					break;
+				}
+			}
+			pos = offset + length;
+		}
+		return false;
+	}
+	if (format.compare(0, 4, "vp09") == 0) {
+		// frame_marker, profile, show_existing_frame, frame_type (0 = key)
+		return (data[0] & 0x0c) == 0;
+	}
+	if (format.compare(0, 4, "vp08") == 0) {
+		return (data[0] & 0x01) == 0;
+	}
+	return true;
+}
+
+// NOTE: Caller must hold fake_mutex
+static void deliver_locked(int32_t sub_id, fake_subscription *sub, const fake_frame &frame, bool scripted)
+{
+	if (scripted && config.loss > 0 && random_unit_locked() < config.loss) {
+		return;
+	}
+
+	uint64_t due_ns = now_ns() + config.latency_ms * 1000000ULL;
+	if (scripted && config.jitter_ms > 0) {
+		due_ns += (uint64_t)(random_unit_locked() * config.jitter_ms * 1000000.0);
+	}
+	// Ordered delivery: jitter delays frames but never lets one overtake another
+	if (due_ns < sub->last_due_ns) {
+		due_ns = sub->last_due_ns;
+	}
+	sub->last_due_ns = due_ns;
+
+	if (scripted && !sub->holding && config.reorder > 0 && random_unit_locked() < config.reorder) {
+		sub->held = frame;
+		sub->holding = true;
+		return;
+	}
+
+	auto deliver = [sub_id](fake_frame delivered) {
+		std::unique_lock<std::mutex> lock(fake_mutex);
+		auto it = subscriptions.find(sub_id);
+		if (it == subscriptions.end()) {
+			return;
+		}
+		int32_t frame_id = next_handle++;
+		frames[frame_id] = delivered;
+		auto on_frame = it->second->on_frame;
+		void *user_data = it->second->user_data;
+		lock.unlock();
+		on_frame(user_data, frame_id);
+	};
+
+	fake_frame copy = frame;
+	copy.chunk_size = config.chunk_size;
+	schedule_locked(sub->thread, due_ns, [deliver, copy] { deliver(copy); });
+	if (sub->holding) {
+		fake_frame held = sub->held;
+		held.chunk_size = config.chunk_size;
+		schedule_locked(sub->thread, due_ns, [deliver, held] { deliver(held); });
+		sub->holding = false;
+	}
+}
+
+// NOTE: Caller must hold fake_mutex
+static void publish_frame_locked(const std::shared_ptr<fake_track> &track, const uint8_t *payload, size_t size,
+				 uint64_t timestamp_us)
+{
+	fake_frame frame;
+	frame.payload = std::make_shared<const std::vector<uint8_t>>(payload, payload + size);
+	frame.timestamp_us = timestamp_us;
+	frame.keyframe = is_keyframe(track->format, payload, size);
+	frame.chunk_size = 0;
+
+	if (frame.keyframe) {
+		track->group.clear();
+	}
+	if (!track->group.empty() || frame.keyframe) {
+		track->group.push_back(frame);
+	}
+
+	for (int32_t sub_id : track->subscriptions) {
+		auto it = subscriptions.find(sub_id);
+		if (it != subscriptions.end()) {
+			deliver_locked(sub_id, it->second.get(), frame, true);
+		}
+	}
+}
+
+// Splits an Annex B stream into access units, each starting with its parameter sets or first slice
+static std::vector<std::vector<uint8_t>> split_access_units(const std::vector<uint8_t> &stream, bool hevc)
+{
+	std::vector<std::vector<uint8_t>> units;
+	const uint8_t *data = stream.data();
+	size_t size = stream.size();
+	size_t unit_start = 0;
+	bool unit_has_slice = false;
+
+	size_t code_start;
+	size_t nal;
+	for (size_t pos = 0; find_start_code(data, size, pos, &code_start, &nal); pos = nal) {
+		if (nal + 2 >= size) {
+			break;
+		}
+		int type = hevc ? (data[nal] >> 1) & 0x3f : data[nal] & 0x1f;
+		bool slice = hevc ? type < 32 : type >= 1 && type <= 5;
+		// first_mb_in_slice == 0 / first_slice_segment_in_pic_flag is the first bit of the slice header
+		bool first_slice = slice && (data[nal + (hevc ? 2 : 1)] & 0x80);
+		bool prefix = hevc ? (type >= 32 && type <= 35) || type == 39 : type >= 6 && type <= 9;
+		if (unit_has_slice && (prefix || first_slice)) {
+			units.emplace_back(data + unit_start, data + code_start);
+			unit_start = code_start;
+			unit_has_slice = false;
+		}
+		unit_has_slice = unit_has_slice || slice;
+	}
+	if (unit_has_slice) {
+		units.emplace_back(data + unit_start, data + size);
+	}
+	return units;
+}
+
+static void generator_thread(std::shared_ptr<fake_track> track, std::vector<std::vector<uint8_t>> units,
+			     double fps)
+{
+	uint64_t start_ns = now_ns();
+	for (uint64_t index = 0;; index++) {
+		uint64_t due_ns = start_ns + (uint64_t)(index * 1000000000.0 / fps);
+		// Short sleeps, so unloading doesn't wait out a slow clip_fps
+		for (uint64_t now = now_ns(); now < due_ns; now = now_ns()) {
+			uint64_t sleep_ns = std::min<uint64_t>(due_ns - now, 5000000);
+			std::this_thread::sleep_for(std::chrono::nanoseconds(sleep_ns));
+		}
+
+		std::lock_guard<std::mutex> lock(fake_mutex);
+		if (shutting_down) {
+			return;
+		}
+		const std::vector<uint8_t> &unit = units[index % units.size()];
+		publish_frame_locked(track, unit.data(), unit.size(), (due_ns - start_ns) / 1000);
+	}
+}
+
+// Serves the configured clip at path, starting its generator on first use. NULL without a clip.
+// NOTE: Caller must hold fake_mutex
+static std::shared_ptr<fake_broadcast> generated_broadcast_locked(const std::string &path)
+{
+	auto existing = generated.find(path);
+	if (existing != generated.end()) {
+		return existing->second;
+	}
+	if (config.clip.empty()) {
+		return NULL;
+	}
+
+	std::ifstream file(config.clip, std::ios::binary);
+	std::vector<uint8_t> stream((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	bool hevc = config.clip_codec.compare(0, 4, "hev1") == 0 || config.clip_codec.compare(0, 4, "hvc1") == 0;
+	std::vector<std::vector<uint8_t>> units = split_access_units(stream, hevc);
+	if (units.empty()) {
+		fprintf(stderr, "[moq-fake] No access units in clip '%s'\n", config.clip.c_str());
+		generated[path] = NULL;
+		return NULL;
+	}
+
+	auto track = std::make_shared<fake_track>();
+	track->name = "video";
+	track->format = config.clip_codec;
+	track->video = true;
+	auto broadcast = std::make_shared<fake_broadcast>();
+	broadcast->tracks.push_back(track);
+	broadcast->version = 1;
+	generated[path] = broadcast;
+	generators.emplace_back(generator_thread, track, std::move(units), config.clip_fps);
+	fprintf(stderr, "[moq-fake] Serving '%s' as '%s'\n", config.clip.c_str(), path.c_str());
+	return broadcast;
+}
+
+// Finds what a consumer of path on origin would receive, and the session it comes through
+// NOTE: Caller must hold fake_mutex
+static std::shared_ptr<fake_broadcast> resolve_locked(const fake_consume &consume, int32_t *session_id)
+{
+	*session_id = 0;
+	auto origin = origins.find(consume.origin);
+	if (origin == origins.end()) {
+		return NULL;
+	}
+	auto local = origin->second->broadcasts.find(consume.path);
+	if (local != origin->second->broadcasts.end()) {
+		return local->second;
+	}
+
+	for (int32_t id : origin->second->consume_sessions) {
+		auto session = sessions.find(id);
+		if (session == sessions.end() || !session->second->linked) {
+			continue;
+		}
+		std::shared_ptr<fake_origin> &relay = relays[session->second->url];
+		auto remote = relay->broadcasts.find(consume.path);
+		if (remote != relay->broadcasts.end()) {
+			*session_id = id;
+			return remote->second;
+		}
+		// Nobody published it to the relay: the clip stands in for the publisher
+		std::shared_ptr<fake_broadcast> clip = generated_broadcast_locked(consume.path);
+		if (clip) {
+			*session_id = id;
+			return clip;
+		}
+	}
+	return NULL;
+}
+
+// Hands every catalog subscriber whose broadcast appeared or changed a fresh catalog
+// NOTE: Caller must hold fake_mutex
+static void refresh_catalogs_locked(void)
+{
+	for (auto &entry : catalog_subs) {
+		int32_t sub_id = entry.first;
+		fake_catalog_sub *sub = entry.second.get();
+		auto consume = consumes.find(sub->consume);
+		if (consume == consumes.end()) {
+			continue;
+		}
+		int32_t session_id;
+		std::shared_ptr<fake_broadcast> broadcast = resolve_locked(consume->second, &session_id);
+		if (!broadcast || broadcast->tracks.empty() ||
+		    (broadcast == sub->broadcast.lock() && broadcast->version == sub->version)) {
+			continue;
+		}
+		sub->broadcast = broadcast;
+		sub->version = broadcast->version;
+
+		fake_catalog catalog;
+		for (const std::shared_ptr<fake_track> &track : broadcast->tracks) {
+			(track->video ? catalog.video : catalog.audio).push_back(track);
+		}
+		catalog.session = session_id;
+		int32_t catalog_id = next_handle++;
+		catalogs[catalog_id] = catalog;
+
+		schedule_locked(sub->thread, now_ns() + config.latency_ms * 1000000ULL, [sub_id, catalog_id] {
+			std::unique_lock<std::mutex> lock(fake_mutex);
+			auto it = catalog_subs.find(sub_id);
+			if (it == catalog_subs.end()) {
+				catalogs.erase(catalog_id);
+				return;
+			}
+			auto on_catalog = it->second->on_catalog;
+			void *user_data = it->second->user_data;
+			lock.unlock();
+			on_catalog(user_data, catalog_id);
+		});
+	}
+}
+
+// Makes the session's published broadcasts visible on its relay and lets its consume origin read them
+// NOTE: Caller must hold fake_mutex
+static void link_session_locked(int32_t id, fake_session *session)
+{
+	std::shared_ptr<fake_origin> &relay = relays[session->url];
+	if (!relay) {
+		relay = std::make_shared<fake_origin>();
+	}
+	auto publish = origins.find(session->publish_origin);
+	if (publish != origins.end()) {
+		for (auto &entry : publish->second->broadcasts) {
+			relay->broadcasts[entry.first] = entry.second;
+			session->relayed.push_back(entry.first);
+		}
+	}
+	auto consume = origins.find(session->consume_origin);
+	if (consume != origins.end()) {
+		consume->second->consume_sessions.push_back(id);
+	}
+	session->linked = true;
+	refresh_catalogs_locked();
+}
+
+// NOTE: Caller must hold fake_mutex
+static void unlink_session_locked(int32_t id, fake_session *session)
+{
+	if (!session->linked) {
+		return;
+	}
+	session->linked = false;
+
+	std::shared_ptr<fake_origin> &relay = relays[session->url];
+	auto publish = origins.find(session->publish_origin);
+	for (const std::string &path : session->relayed) {
+		auto relayed = relay->broadcasts.find(path);
+		if (relayed != relay->broadcasts.end() && publish != origins.end() &&
+		    publish->second->broadcasts[path] == relayed->second) {
+			relay->broadcasts.erase(relayed);
+		}
+	}
+	session->relayed.clear();
+
+	auto consume = origins.find(session->consume_origin);
+	if (consume != origins.end()) {
+		std::vector<int32_t> &linked = consume->second->consume_sessions;
+		linked.erase(std::remove(linked.begin(), linked.end(), id), linked.end());
+	}
+
+	// Subscriptions through the session end with it
+	for (auto it = subscriptions.begin(); it != subscriptions.end();) {
+		it = it->second->session == id ? subscriptions.erase(it) : std::next(it);
+	}
+}
+
+extern "C" {
+
+bool moq_fake_configure(const char *spec)
+{
+	fake_init();
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	if (!parse_config(spec, &config)) {
+		return false;
+	}
+	rng.seed(config.seed);
+	return true;
+}
+
+int32_t moq_log_level(const char *, size_t)
+{
+	fake_init();
+	return 0;
+}
+
+int32_t moq_session_connect(const char *url, size_t url_len, uint32_t origin_publish, uint32_t origin_consume,
+			    void (*on_status)(void *user_data, int32_t code), void *user_data)
+{
+	fake_init();
+	if (!url || !on_status) {
+		return FAKE_ERROR;
+	}
+
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto session = std::make_shared<fake_session>();
+	session->url.assign(url, url_len);
+	session->publish_origin = (int32_t)origin_publish;
+	session->consume_origin = (int32_t)origin_consume;
+	session->on_status = on_status;
+	session->user_data = user_data;
+	session->linked = false;
+	session->thread = pick_thread_locked();
+	int32_t id = next_handle++;
+	sessions[id] = session;
+
+	int32_t code = config.connect_error;
+	uint64_t connect_ns = now_ns() + config.connect_ms * 1000000ULL;
+	schedule_locked(session->thread, connect_ns, [id, code] {
+		std::unique_lock<std::mutex> lock(fake_mutex);
+		auto it = sessions.find(id);
+		if (it == sessions.end()) {
+			return;
+		}
+		if (code == 0) {
+			link_session_locked(id, it->second.get());
+		}
+		auto callback = it->second->on_status;
+		void *callback_data = it->second->user_data;
+		lock.unlock();
+		callback(callback_data, code);
+	});
+
+	if (code == 0 && config.disconnect_after_ms > 0) {
+		schedule_locked(session->thread, connect_ns + config.disconnect_after_ms * 1000000ULL, [id] {
+			std::unique_lock<std::mutex> lock(fake_mutex);
+			auto it = sessions.find(id);
+			if (it == sessions.end() || !it->second->linked) {
+				return;
+			}
+			unlink_session_locked(id, it->second.get());
+			auto callback = it->second->on_status;
+			void *callback_data = it->second->user_data;
+			lock.unlock();
+			callback(callback_data, FAKE_ERROR);
+		});
+	}
+	return id;
+}
+
+int32_t moq_session_close(uint32_t session)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = sessions.find((int32_t)session);
+	if (it == sessions.end()) {
+		return FAKE_ERROR;
+	}
+	unlink_session_locked(it->first, it->second.get());
+	sessions.erase(it);
+	return 0;
+}
+
+int32_t moq_origin_create(void)
+{
+	fake_init();
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	int32_t id = next_handle++;
+	origins[id] = std::make_shared<fake_origin>();
+	return id;
+}
+
+int32_t moq_origin_publish(uint32_t origin, const char *path, size_t path_len, uint32_t broadcast)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto origin_it = origins.find((int32_t)origin);
+	auto broadcast_it = broadcasts.find((int32_t)broadcast);
+	if (origin_it == origins.end() || broadcast_it == broadcasts.end() || !path) {
+		return FAKE_ERROR;
+	}
+	std::string key(path, path_len);
+	origin_it->second->broadcasts[key] = broadcast_it->second;
+
+	for (auto &entry : sessions) {
+		fake_session *session = entry.second.get();
+		if (session->linked && session->publish_origin == (int32_t)origin) {
+			relays[session->url]->broadcasts[key] = broadcast_it->second;
+			session->relayed.push_back(key);
+		}
+	}
+	refresh_catalogs_locked();
+	return 0;
+}
+
+int32_t moq_origin_consume(uint32_t origin, const char *path, size_t path_len)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	if (origins.find((int32_t)origin) == origins.end() || !path) {
+		return FAKE_ERROR;
+	}
+	int32_t id = next_handle++;
+	consumes[id] = {(int32_t)origin, std::string(path, path_len)};
+	return id;
+}
+
+int32_t moq_origin_close(uint32_t origin)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	return origins.erase((int32_t)origin) ? 0 : FAKE_ERROR;
+}
+
+int32_t moq_publish_create(void)
+{
+	fake_init();
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	int32_t id = next_handle++;
+	auto broadcast = std::make_shared<fake_broadcast>();
+	broadcast->version = 0;
+	broadcasts[id] = broadcast;
+	return id;
+}
+
+int32_t moq_publish_close(uint32_t broadcast)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = broadcasts.find((int32_t)broadcast);
+	if (it == broadcasts.end()) {
+		return FAKE_ERROR;
+	}
+	std::shared_ptr<fake_broadcast> closed = it->second;
+	broadcasts.erase(it);
+
+	// Unannounced everywhere it was published
+	auto unpublish = [&closed](fake_origin *origin) {
+		for (auto entry = origin->broadcasts.begin(); entry != origin->broadcasts.end();) {
+			entry = entry->second == closed ? origin->broadcasts.erase(entry) : std::next(entry);
+		}
+	};
+	for (auto &entry : origins) {
+		unpublish(entry.second.get());
+	}
+	for (auto &entry : relays) {
+		unpublish(entry.second.get());
+	}
+	return 0;
+}
+
+int32_t moq_publish_media_ordered(uint32_t broadcast, const char *format, size_t format_len, const uint8_t *init,
+				  size_t init_size)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = broadcasts.find((int32_t)broadcast);
+	if (it == broadcasts.end() || !format) {
+		return FAKE_ERROR;
+	}
+
+	auto track = std::make_shared<fake_track>();
+	track->format.assign(format, format_len);
+	track->video = !is_audio_format(track->format);
+	track->name = (track->video ? "video" : "audio") + std::to_string(it->second->tracks.size());
+	if (init && init_size > 0) {
+		track->init.assign(init, init + init_size);
+	}
+	it->second->tracks.push_back(track);
+	it->second->version++;
+
+	int32_t id = next_handle++;
+	medias[id] = {it->second, track};
+	refresh_catalogs_locked();
+	return id;
+}
+
+int32_t moq_publish_media_frame(uint32_t media, const uint8_t *payload, size_t payload_size, uint64_t timestamp_us)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = medias.find((int32_t)media);
+	if (it == medias.end() || (!payload && payload_size > 0)) {
+		return FAKE_ERROR;
+	}
+	publish_frame_locked(it->second.track, payload, payload_size, timestamp_us);
+	return 0;
+}
+
+int32_t moq_publish_media_close(uint32_t media)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = medias.find((int32_t)media);
+	if (it == medias.end()) {
+		return FAKE_ERROR;
+	}
+	std::vector<std::shared_ptr<fake_track>> &tracks = it->second.broadcast->tracks;
+	tracks.erase(std::remove(tracks.begin(), tracks.end(), it->second.track), tracks.end());
+	it->second.broadcast->version++;
+	medias.erase(it);
+	refresh_catalogs_locked();
+	return 0;
+}
+
+int32_t moq_consume_catalog(uint32_t broadcast, void (*on_catalog)(void *user_data, int32_t catalog),
+			    void *user_data)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	if (consumes.find((int32_t)broadcast) == consumes.end() || !on_catalog) {
+		return FAKE_ERROR;
+	}
+	auto sub = std::make_shared<fake_catalog_sub>();
+	sub->consume = (int32_t)broadcast;
+	sub->on_catalog = on_catalog;
+	sub->user_data = user_data;
+	sub->version = 0;
+	sub->thread = pick_thread_locked();
+	int32_t id = next_handle++;
+	catalog_subs[id] = sub;
+	refresh_catalogs_locked();
+	return id;
+}
+
+int32_t moq_consume_catalog_close(uint32_t catalog)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	return catalogs.erase((int32_t)catalog) ? 0 : FAKE_ERROR;
+}
+
+int32_t moq_consume_video_config(uint32_t catalog, uint32_t index, moq_video_config *dst)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = catalogs.find((int32_t)catalog);
+	if (it == catalogs.end() || index >= it->second.video.size() || !dst) {
+		return FAKE_ERROR;
+	}
+	const fake_track *track = it->second.video[index].get();
+	*dst = {};
+	dst->name = track->name.c_str();
+	dst->name_len = track->name.size();
+	dst->codec = track->format.c_str();
+	dst->codec_len = track->format.size();
+	dst->description = track->init.empty() ? NULL : track->init.data();
+	dst->description_len = track->init.size();
+	return 0;
+}
+
+int32_t moq_consume_audio_config(uint32_t catalog, uint32_t index, moq_audio_config *dst)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = catalogs.find((int32_t)catalog);
+	if (it == catalogs.end() || index >= it->second.audio.size() || !dst) {
+		return FAKE_ERROR;
+	}
+	const fake_track *track = it->second.audio[index].get();
+	*dst = {};
+	dst->codec = track->format.c_str();
+	dst->codec_len = track->format.size();
+	dst->description = track->init.empty() ? NULL : track->init.data();
+	dst->description_len = track->init.size();
+	return 0;
+}
+
+int32_t moq_consume_video_ordered(uint32_t catalog, uint32_t index, uint64_t, void (*on_frame)(void *, int32_t),
+				  void *user_data)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = catalogs.find((int32_t)catalog);
+	if (it == catalogs.end() || index >= it->second.video.size() || !on_frame) {
+		return FAKE_ERROR;
+	}
+
+	auto sub = std::make_shared<fake_subscription>();
+	sub->track = it->second.video[index];
+	sub->on_frame = on_frame;
+	sub->user_data = user_data;
+	sub->session = it->second.session;
+	sub->thread = pick_thread_locked();
+	sub->last_due_ns = 0;
+	sub->holding = false;
+	int32_t id = next_handle++;
+	subscriptions[id] = sub;
+	sub->track->subscriptions.push_back(id);
+
+	// A relay starts a new subscriber at the latest group
+	for (const fake_frame &frame : sub->track->group) {
+		deliver_locked(id, sub.get(), frame, false);
+	}
+	return id;
+}
+
+int32_t moq_consume_video_close(uint32_t track)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = subscriptions.find((int32_t)track);
+	if (it == subscriptions.end()) {
+		return FAKE_ERROR;
+	}
+	std::vector<int32_t> &subs = it->second->track->subscriptions;
+	subs.erase(std::remove(subs.begin(), subs.end(), it->first), subs.end());
+	subscriptions.erase(it);
+	return 0;
+}
+
+int32_t moq_consume_frame_chunk(uint32_t frame, uint32_t index, moq_frame *dst)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	auto it = frames.find((int32_t)frame);
+	if (it == frames.end() || !dst) {
+		return FAKE_ERROR;
+	}
+	const fake_frame &entry = it->second;
+	size_t size = entry.payload->size();
+	size_t chunk_size = entry.chunk_size ? entry.chunk_size : size;
+	size_t offset = (size_t)index * chunk_size;
+	if (index > 0 && offset >= size) {
+		return FAKE_ERROR;
+	}
+	dst->payload = entry.payload->data() + offset;
+	dst->payload_size = std::min(chunk_size, size - offset);
+	dst->timestamp_us = entry.timestamp_us;
+	dst->keyframe = entry.keyframe;
+	return 0;
+}
+
+int32_t moq_consume_frame_close(uint32_t frame)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	return frames.erase((int32_t)frame) ? 0 : FAKE_ERROR;
+}
+
+int32_t moq_consume_close(uint32_t consume)
+{
+	std::lock_guard<std::mutex> lock(fake_mutex);
+	if (!consumes.erase((int32_t)consume)) {
+		return FAKE_ERROR;
+	}
+	for (auto it = catalog_subs.begin(); it != catalog_subs.end();) {
+		it = it->second->consume == (int32_t)consume ? catalog_subs.erase(it) : std::next(it);
+	}
+	return 0;
+}
+
+} // extern "C"
+
+// Stops the callback and clip threads when the plugin is unloaded, before the state they use goes away
+static struct fake_shutdown {
+	~fake_shutdown()
+	{
+		shutting_down = true;
+		for (std::unique_ptr<fake_dispatcher> &dispatcher : dispatchers) {
+			{
+				std::lock_guard<std::mutex> lock(dispatcher->mutex);
+				dispatcher->cond.notify_all();
+			}
+			dispatcher->thread.join();
+		}
+		for (std::thread &thread : generators) {
+			thread.join();
+		}
+	}
+} fake_shutdown_on_exit;
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The fake behaves like a relay shared by every session in the process: broadcasts published
+// through a session to a URL can be consumed through any other session to the same URL, and an
+// origin used without a session serves its own broadcasts, as with the real library.
+//
+// Its behaviour is scripted with comma-separated key=value pairs, read from the MOQ_FAKE
+// environment variable on first use or passed to moq_fake_configure:
+//
+//   latency_ms=N           Delay from a frame being published to its callback (default 0)
+//   jitter_ms=N            Random extra delay of up to N ms per frame; frames stay in order
+//   reorder=P              Probability a frame is held back and delivered after the next one
+//   loss=P                 Probability a frame is never delivered
+//   threads=N              Threads callbacks are spread across; each subscription stays on one (default 1)
+//   chunk_size=N           Split frames into chunks of N bytes, 0 = one chunk (default)
+//   connect_ms=N           Time before a session reports its status (default 0)
+//   connect_error=N        Fail every session with this (negative) code instead of connecting
+//   disconnect_after_ms=N  Drop each session with code -1 after N ms, to exercise reconnects
+//   seed=N                 Seed for every random choice, so runs are reproducible (default 1)
+//   clip=PATH              Serve this Annex B H.264/HEVC file, looped, to any consumer whose
+//                          broadcast nobody publishes
+//   clip_codec=avc3|hev1   Codec of clip (default avc3)
+//   clip_fps=N             Frame rate clip is served at (default 30)
+//
+// For example MOQ_FAKE="latency_ms=80,jitter_ms=30,threads=4,clip=/tmp/1080p.h264".
+// Returns false, leaving the configuration unchanged, if spec has an unknown key or bad value.
+// Changes apply to sessions, subscriptions and frames created afterwards.
+bool moq_fake_configure(const char *spec);
+
+#ifdef __cplusplus
+}
+#endif
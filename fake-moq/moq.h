@@ -0,0 +1,73 @@
+// Fake libmoq: the subset of the libmoq 0.2 C API used by obs-moq, implemented in-process
+// without a network. Built and linked instead of the real library with -DENABLE_FAKE_MOQ=ON.
+// See moq-fake.h for what can be scripted.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct moq_video_config {
+	const char *name;
+	size_t name_len;
+	const char *codec;
+	size_t codec_len;
+	const uint8_t *description;
+	size_t description_len;
+	const uint32_t *coded_width;
+	const uint32_t *coded_height;
+} moq_video_config;
+
+typedef struct moq_audio_config {
+	const char *codec;
+	size_t codec_len;
+	const uint8_t *description;
+	size_t description_len;
+	uint32_t sample_rate;
+	uint32_t channel_count;
+} moq_audio_config;
+
+typedef struct moq_frame {
+	const uint8_t *payload;
+	size_t payload_size;
+	uint64_t timestamp_us;
+	bool keyframe;
+} moq_frame;
+
+int32_t moq_log_level(const char *level, size_t level_len);
+
+int32_t moq_session_connect(const char *url, size_t url_len, uint32_t origin_publish, uint32_t origin_consume,
+			    void (*on_status)(void *user_data, int32_t code), void *user_data);
+int32_t moq_session_close(uint32_t session);
+
+int32_t moq_origin_create(void);
+int32_t moq_origin_publish(uint32_t origin, const char *path, size_t path_len, uint32_t broadcast);
+int32_t moq_origin_consume(uint32_t origin, const char *path, size_t path_len);
+int32_t moq_origin_close(uint32_t origin);
+
+int32_t moq_publish_create(void);
+int32_t moq_publish_close(uint32_t broadcast);
+int32_t moq_publish_media_ordered(uint32_t broadcast, const char *format, size_t format_len, const uint8_t *init,
+				  size_t init_size);
+int32_t moq_publish_media_frame(uint32_t media, const uint8_t *payload, size_t payload_size, uint64_t timestamp_us);
+int32_t moq_publish_media_close(uint32_t media);
+
+int32_t moq_consume_catalog(uint32_t broadcast, void (*on_catalog)(void *user_data, int32_t catalog),
+			    void *user_data);
+int32_t moq_consume_catalog_close(uint32_t catalog);
+int32_t moq_consume_video_config(uint32_t catalog, uint32_t index, moq_video_config *dst);
+int32_t moq_consume_audio_config(uint32_t catalog, uint32_t index, moq_audio_config *dst);
+int32_t moq_consume_video_ordered(uint32_t catalog, uint32_t index, uint64_t max_latency_ms,
+				  void (*on_frame)(void *user_data, int32_t frame), void *user_data);
+int32_t moq_consume_video_close(uint32_t track);
+int32_t moq_consume_frame_chunk(uint32_t frame, uint32_t index, moq_frame *dst);
+int32_t moq_consume_frame_close(uint32_t frame);
+int32_t moq_consume_close(uint32_t consume);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,422 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "bwtest.h"
+#include "histogram.h"
+#include "loopback.h"
+#include "logger.h"
+
+extern "C" {
+#include "moq.h"
+}
+
+// Rate of the first step; each one after is 1/4 higher, up to the last
+#define MOQ_BWTEST_START_BPS 1000000ULL
+#define MOQ_BWTEST_MAX_BPS 200000000ULL
+#define MOQ_BWTEST_STEP_NS 2000000000ULL
+// Fails the test if no frame has come back this long after the first was sent
+#define MOQ_BWTEST_START_TIMEOUT_NS 10000000000ULL
+// A step holds if it is received at 9/10 of the rate sent or better, with a median round trip no
+// more than this above the lowest seen
+#define MOQ_BWTEST_QUEUE_LIMIT_US 100000ULL
+// Longest gap between frames that gets filled, so a stalled encoder doesn't cause one huge frame
+#define MOQ_BWTEST_MAX_GAP_NS 100000000ULL
+// Send times kept for frames that haven't come back
+#define MOQ_BWTEST_PENDING_FRAMES 1024
+
+struct moq_bwtest {
+	std::string url;
+	std::string path;
+	std::atomic<bool> stopped;
+	std::atomic<uint32_t> callbacks_in_flight;
+
+	std::mutex mutex; // Guards everything below
+	int32_t origin;
+	int32_t session;
+	int32_t consume;
+	int32_t catalog;
+	int32_t track;
+	std::map<uint64_t, uint64_t> sent_ns; // By timestamp_us
+
+	enum moq_bwtest_state state;
+	uint64_t target_bps;
+	uint64_t first_sent_ns;
+	uint64_t last_sent_ns;
+	uint64_t frames_received;
+	uint64_t step_start_ns;
+	uint64_t step_sent_bytes;
+	uint64_t step_received_bytes;
+	struct moq_histogram step_rtt_us;
+	uint64_t min_rtt_us;
+	uint64_t received_bps;
+	uint64_t sustained_bps;
+	uint64_t loaded_rtt_us;
+};
+
+static void moq_bwtest_on_status(void *user_data, int32_t code);
+static void moq_bwtest_on_catalog(void *user_data, int32_t catalog);
+static void moq_bwtest_on_frame(void *user_data, int32_t frame_id);
+
+static void moq_bwtest_fail(struct moq_bwtest *bt, const char *message, int32_t code)
+{
+	std::lock_guard<std::mutex> lock(bt->mutex);
+	if (bt->state == MOQ_BWTEST_RUNNING) {
+		LOG_ERROR("Bandwidth test failed: %s (%d)", message, code);
+		bt->state = MOQ_BWTEST_FAILED;
+	}
+}
+
+// Subscribes to the catalog of the test broadcast, once the origin can reach it
+static void moq_bwtest_consume(struct moq_bwtest *bt)
+{
+	std::unique_lock<std::mutex> lock(bt->mutex);
+	int32_t origin = bt->origin;
+	lock.unlock();
+	if (origin < 0) {
+		return;
+	}
+
+	int32_t consume = moq_origin_consume(origin, bt->path.data(), bt->path.size());
+	if (consume < 0) {
+		moq_bwtest_fail(bt, "can't consume the test broadcast", consume);
+		return;
+	}
+
+	lock.lock();
+	if (bt->stopped.load()) {
+		lock.unlock();
+		moq_consume_close(consume);
+		return;
+	}
+	bt->consume = consume;
+	lock.unlock();
+
+	int32_t result = moq_consume_catalog(consume, moq_bwtest_on_catalog, bt);
+	if (result < 0) {
+		moq_bwtest_fail(bt, "can't subscribe to the test broadcast's catalog", result);
+	}
+}
+
+struct moq_bwtest *moq_bwtest_create(const char *url, const char *path)
+{
+	struct moq_bwtest *bt = new moq_bwtest();
+	bt->url = url;
+	bt->path = path;
+	bt->stopped = false;
+	bt->callbacks_in_flight = 0;
+	bt->origin = -1;
+	bt->session = -1;
+	bt->consume = -1;
+	bt->catalog = -1;
+	bt->track = -1;
+	bt->state = MOQ_BWTEST_RUNNING;
+	bt->target_bps = MOQ_BWTEST_START_BPS;
+	bt->first_sent_ns = 0;
+	bt->last_sent_ns = 0;
+	bt->frames_received = 0;
+	bt->step_start_ns = 0;
+	bt->step_sent_bytes = 0;
+	bt->step_received_bytes = 0;
+	moq_histogram_reset(&bt->step_rtt_us);
+	bt->min_rtt_us = UINT64_MAX;
+	bt->received_bps = 0;
+	bt->sustained_bps = 0;
+	bt->loaded_rtt_us = 0;
+
+	// Like MoQ Source: a loopback origin is consumed directly, a relay through a session of its own
+	const char *loopback = moq_loopback_name(url);
+	bt->origin = loopback ? moq_loopback_acquire(loopback) : moq_origin_create();
+	if (bt->origin < 0) {
+		moq_bwtest_fail(bt, "can't create the receiving origin", bt->origin);
+		return bt;
+	}
+
+	LOG_INFO("Bandwidth test: receiving %s from %s", path, url);
+	if (loopback) {
+		moq_bwtest_consume(bt);
+		return bt;
+	}
+
+	int32_t session = moq_session_connect(bt->url.data(), bt->url.size(), 0, bt->origin, moq_bwtest_on_status, bt);
+	if (session < 0) {
+		moq_bwtest_fail(bt, "can't connect the receiving session", session);
+		return bt;
+	}
+	std::lock_guard<std::mutex> lock(bt->mutex);
+	bt->session = session;
+	return bt;
+}
+
+void moq_bwtest_stop(struct moq_bwtest *bt)
+{
+	if (!bt || bt->stopped.exchange(true)) {
+		return;
+	}
+
+	// Closed outside the lock, which the callbacks take
+	std::unique_lock<std::mutex> lock(bt->mutex);
+	int32_t track = bt->track;
+	int32_t catalog = bt->catalog;
+	int32_t consume = bt->consume;
+	int32_t session = bt->session;
+	int32_t origin = bt->origin;
+	bt->track = bt->catalog = bt->consume = bt->session = bt->origin = -1;
+	lock.unlock();
+
+	if (track >= 0) {
+		moq_consume_video_close(track);
+	}
+	if (catalog >= 0) {
+		moq_consume_catalog_close(catalog);
+	}
+	if (consume >= 0) {
+		moq_consume_close(consume);
+	}
+	if (session >= 0) {
+		moq_session_close(session);
+	}
+	if (origin >= 0) {
+		moq_loopback_release(origin);
+	}
+
+	while (bt->callbacks_in_flight.load() != 0) {
+		os_sleep_ms(1);
+	}
+}
+
+void moq_bwtest_destroy(struct moq_bwtest *bt)
+{
+	if (!bt) {
+		return;
+	}
+	moq_bwtest_stop(bt);
+
+	// As in moq_source_destroy: callbacks libmoq had already queued for the closed handles see
+	// stopped and return, given a margin to run before the memory goes
+	os_sleep_ms(100);
+	delete bt;
+}
+
+static void moq_bwtest_on_status(void *user_data, int32_t code)
+{
+	struct moq_bwtest *bt = (struct moq_bwtest *)user_data;
+	bt->callbacks_in_flight.fetch_add(1);
+	if (!bt->stopped.load()) {
+		if (code == 0) {
+			moq_bwtest_consume(bt);
+		} else {
+			moq_bwtest_fail(bt, "receiving session closed", code);
+		}
+	}
+	bt->callbacks_in_flight.fetch_sub(1);
+}
+
+static void moq_bwtest_on_catalog(void *user_data, int32_t catalog)
+{
+	struct moq_bwtest *bt = (struct moq_bwtest *)user_data;
+	bt->callbacks_in_flight.fetch_add(1);
+
+	// The first catalog with video is enough: the test track never changes
+	std::unique_lock<std::mutex> lock(bt->mutex);
+	bool wanted = catalog >= 0 && !bt->stopped.load() && bt->catalog < 0;
+	lock.unlock();
+	if (!wanted) {
+		if (catalog >= 0) {
+			moq_consume_catalog_close(catalog);
+		}
+		bt->callbacks_in_flight.fetch_sub(1);
+		return;
+	}
+
+	int32_t track = moq_consume_video_ordered(catalog, 0, 0, moq_bwtest_on_frame, bt);
+	if (track < 0) {
+		moq_consume_catalog_close(catalog);
+		moq_bwtest_fail(bt, "can't subscribe to the test track", track);
+		bt->callbacks_in_flight.fetch_sub(1);
+		return;
+	}
+
+	lock.lock();
+	if (bt->stopped.load() || bt->catalog >= 0) {
+		lock.unlock();
+		moq_consume_video_close(track);
+		moq_consume_catalog_close(catalog);
+	} else {
+		bt->catalog = catalog;
+		bt->track = track;
+	}
+	bt->callbacks_in_flight.fetch_sub(1);
+}
+
+static void moq_bwtest_on_frame(void *user_data, int32_t frame_id)
+{
+	if (frame_id < 0) {
+		return;
+	}
+
+	struct moq_bwtest *bt = (struct moq_bwtest *)user_data;
+	bt->callbacks_in_flight.fetch_add(1);
+	if (bt->stopped.load()) {
+		moq_consume_frame_close(frame_id);
+		bt->callbacks_in_flight.fetch_sub(1);
+		return;
+	}
+
+	uint64_t now_ns = os_gettime_ns();
+	struct moq_frame chunk;
+	uint64_t timestamp_us = 0;
+	uint64_t size = 0;
+	for (uint32_t index = 0; moq_consume_frame_chunk(frame_id, index, &chunk) >= 0; index++) {
+		if (index == 0) {
+			timestamp_us = chunk.timestamp_us;
+		}
+		size += chunk.payload_size;
+	}
+	moq_consume_frame_close(frame_id);
+
+	std::unique_lock<std::mutex> lock(bt->mutex);
+	bt->frames_received++;
+	bt->step_received_bytes += size;
+	auto sent = bt->sent_ns.find(timestamp_us);
+	if (sent != bt->sent_ns.end()) {
+		uint64_t rtt_us = (now_ns - sent->second) / 1000;
+		moq_histogram_record(&bt->step_rtt_us, rtt_us);
+		if (rtt_us < bt->min_rtt_us) {
+			bt->min_rtt_us = rtt_us;
+		}
+		bt->sent_ns.erase(sent);
+	}
+	lock.unlock();
+	bt->callbacks_in_flight.fetch_sub(1);
+}
+
+// Judges the step that just ended and moves to the next rate, or ends the test
+// NOTE: Caller must hold bt->mutex
+static void moq_bwtest_end_step_locked(struct moq_bwtest *bt, uint64_t now_ns)
+{
+	uint64_t elapsed_ns = now_ns - bt->step_start_ns;
+	uint64_t sent_bps = bt->step_sent_bytes * 8 * 1000000000ULL / elapsed_ns;
+	bt->received_bps = bt->step_received_bytes * 8 * 1000000000ULL / elapsed_ns;
+	uint64_t rtt_us = moq_histogram_percentile(&bt->step_rtt_us, 0.5);
+	bool held = bt->received_bps * 10 >= sent_bps * 9 && rtt_us <= bt->min_rtt_us + MOQ_BWTEST_QUEUE_LIMIT_US;
+
+	LOG_INFO("Bandwidth test: sent %llu kbps, received %llu kbps, round trip %.1f ms%s",
+		 (unsigned long long)(sent_bps / 1000), (unsigned long long)(bt->received_bps / 1000),
+		 rtt_us / 1000.0, held ? "" : ", saturated");
+
+	if (held) {
+		bt->sustained_bps = bt->received_bps;
+		bt->loaded_rtt_us = rtt_us;
+	} else if (!bt->sustained_bps) {
+		// Saturated from the first step: what did get through is the best estimate
+		bt->sustained_bps = bt->received_bps;
+		bt->loaded_rtt_us = rtt_us;
+	}
+
+	if (!held || bt->target_bps >= MOQ_BWTEST_MAX_BPS) {
+		bt->state = MOQ_BWTEST_DONE;
+		LOG_INFO("Bandwidth test done: %llu kbps sustained, round trip %.1f ms idle, %.1f ms loaded",
+			 (unsigned long long)(bt->sustained_bps / 1000), bt->min_rtt_us / 1000.0,
+			 bt->loaded_rtt_us / 1000.0);
+		return;
+	}
+
+	bt->target_bps = std::min<uint64_t>(bt->target_bps + bt->target_bps / 4, MOQ_BWTEST_MAX_BPS);
+	bt->step_start_ns = now_ns;
+	bt->step_sent_bytes = 0;
+	bt->step_received_bytes = 0;
+	moq_histogram_reset(&bt->step_rtt_us);
+}
+
+size_t moq_bwtest_next_frame(struct moq_bwtest *bt, size_t size, uint64_t timestamp_us)
+{
+	uint64_t now_ns = os_gettime_ns();
+	std::lock_guard<std::mutex> lock(bt->mutex);
+	if (bt->state != MOQ_BWTEST_RUNNING) {
+		return 0;
+	}
+
+	if (!bt->first_sent_ns) {
+		bt->first_sent_ns = now_ns;
+	}
+	if (!bt->frames_received) {
+		// Steps start once frames come back, the sessions and subscription take a while to set up
+		if (now_ns - bt->first_sent_ns >= MOQ_BWTEST_START_TIMEOUT_NS) {
+			LOG_ERROR("Bandwidth test failed: no frames came back from %s", bt->url.c_str());
+			bt->state = MOQ_BWTEST_FAILED;
+			return 0;
+		}
+		bt->step_start_ns = now_ns;
+		bt->step_sent_bytes = 0;
+		bt->step_received_bytes = 0;
+		moq_histogram_reset(&bt->step_rtt_us);
+	} else if (now_ns - bt->step_start_ns >= MOQ_BWTEST_STEP_NS) {
+		moq_bwtest_end_step_locked(bt, now_ns);
+		if (bt->state != MOQ_BWTEST_RUNNING) {
+			return 0;
+		}
+	}
+
+	// Enough to carry the target rate over the time since the previous frame
+	uint64_t gap_ns = bt->last_sent_ns ? std::min<uint64_t>(now_ns - bt->last_sent_ns, MOQ_BWTEST_MAX_GAP_NS) : 0;
+	bt->last_sent_ns = now_ns;
+	uint64_t wanted = bt->target_bps / 8 * gap_ns / 1000000000ULL;
+	size_t filler = wanted > size + MOQ_BWTEST_FILLER_MIN ? (size_t)(wanted - size) : 0;
+
+	bt->step_sent_bytes += size + filler;
+	bt->sent_ns[timestamp_us] = now_ns;
+	while (bt->sent_ns.size() > MOQ_BWTEST_PENDING_FRAMES) {
+		bt->sent_ns.erase(bt->sent_ns.begin());
+	}
+	return filler;
+}
+
+void moq_bwtest_write_filler(bool hevc, size_t size, uint8_t *out)
+{
+	// Start code, then the NAL header: filler data is type 12 in H.264, 38 (FD_NUT) in HEVC
+	size_t pos = 0;
+	out[pos++] = 0;
+	out[pos++] = 0;
+	out[pos++] = 0;
+	out[pos++] = 1;
+	if (hevc) {
+		out[pos++] = 38 << 1;
+		out[pos++] = 1;
+	} else {
+		out[pos++] = 12;
+	}
+
+	// 0xFF bytes, then the RBSP stop bit; nothing here needs emulation prevention
+	memset(out + pos, 0xff, size - pos - 1);
+	out[size - 1] = 0x80;
+}
+
+enum moq_bwtest_state moq_bwtest_get_state(struct moq_bwtest *bt)
+{
+	std::lock_guard<std::mutex> lock(bt->mutex);
+	return bt->state;
+}
+
+void moq_bwtest_get_stats(struct moq_bwtest *bt, obs_data_t *data)
+{
+	static const char *state_names[] = {"running", "done", "failed"};
+
+	std::lock_guard<std::mutex> lock(bt->mutex);
+	obs_data_set_string(data, "state", state_names[bt->state]);
+	obs_data_set_int(data, "target_kbps", (long long)(bt->target_bps / 1000));
+	obs_data_set_int(data, "received_kbps", (long long)(bt->received_bps / 1000));
+	obs_data_set_int(data, "sustained_kbps", (long long)(bt->sustained_bps / 1000));
+	if (bt->min_rtt_us != UINT64_MAX) {
+		obs_data_set_double(data, "rtt_ms", bt->min_rtt_us / 1000.0);
+	}
+	if (bt->loaded_rtt_us) {
+		obs_data_set_double(data, "loaded_rtt_ms", bt->loaded_rtt_us / 1000.0);
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <obs-module.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bandwidth test, the service's "bwtest" setting: MoQ Output publishes to a throwaway path instead of
+// the stream key and pads its video frames with filler NAL units (which decoders skip) at a rising
+// rate. A second session subscribes to that path through the same relay, so every frame's round trip
+// is measured in this process. libmoq takes frames without blocking and reports nothing about the
+// connection, so what comes back is the only measure of what the path sustains. The ramp stops at the
+// first step the relay can't deliver in full without queueing, and the rate of the step before it is
+// the result.
+enum moq_bwtest_state {
+	MOQ_BWTEST_RUNNING,
+	MOQ_BWTEST_DONE,
+	MOQ_BWTEST_FAILED, // Nothing came back, or the receiving session failed
+};
+
+// Smallest filler moq_bwtest_write_filler writes
+#define MOQ_BWTEST_FILLER_MIN 8
+
+struct moq_bwtest;
+
+// Starts receiving path from url (a relay, or a loopback origin). The publishing side must publish
+// the broadcast there itself.
+struct moq_bwtest *moq_bwtest_create(const char *url, const char *path);
+
+// Closes the receiving side; the results stay readable. Safe to call more than once.
+void moq_bwtest_stop(struct moq_bwtest *bt);
+void moq_bwtest_destroy(struct moq_bwtest *bt);
+
+// Called by the publishing thread for each video frame of size bytes, just before it is published
+// with timestamp_us. Returns how many bytes of filler to append so the track carries the rate the test
+// is at, 0 for none.
+size_t moq_bwtest_next_frame(struct moq_bwtest *bt, size_t size, uint64_t timestamp_us);
+
+// Writes a filler data NAL unit of exactly size bytes (at least MOQ_BWTEST_FILLER_MIN), start code
+// included, to append to an H.264 or HEVC access unit in Annex B format
+void moq_bwtest_write_filler(bool hevc, size_t size, uint8_t *out);
+
+enum moq_bwtest_state moq_bwtest_get_state(struct moq_bwtest *bt);
+
+// Sets "state", "target_kbps", "received_kbps" (of the last step), "sustained_kbps", "rtt_ms" (the
+// lowest round trip seen) and "loaded_rtt_ms" (the median at the sustained rate) in data
+void moq_bwtest_get_stats(struct moq_bwtest *bt, obs_data_t *data);
@@ -0,0 +1,452 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "moq.h"
+}
+
+#include "capture.h"
+#include "io-queue.h"
+#include "loopback.h"
+#include "logger.h"
+
+// File header, the format version being its last two characters
+#define MOQ_CAPTURE_MAGIC "MOQCAP01"
+#define MOQ_CAPTURE_MAGIC_SIZE 8
+// Records are a type byte and a 32-bit body size, then the body. Integers are little-endian.
+#define MOQ_CAPTURE_RECORD_HEADER 5
+#define MOQ_CAPTURE_CATALOG 'C'
+#define MOQ_CAPTURE_FRAME 'F'
+// Frame body: track (4), keyframe (1), timestamp_us (8), arrival_us since the capture started (8), payload
+#define MOQ_CAPTURE_FRAME_HEADER 21
+// Upper bound on video tracks recorded from one catalog
+#define MOQ_CAPTURE_MAX_TRACKS 64
+// Bytes gathered before each write to the file
+#define MOQ_CAPTURE_IO_BUFFER (4 * 1024 * 1024)
+// Record bytes that may wait for the I/O thread, seconds of video even at high bitrates
+#define MOQ_CAPTURE_MAX_QUEUED (64 * 1024 * 1024)
+// Gap between the last frame of a pass and the first of the next when the captured one can't tell
+#define MOQ_REPLAY_DEFAULT_GAP_US 33333
+
+struct moq_capture {
+	std::string path;
+	uint64_t start_ns;
+	struct moq_io_queue *queue; // Of whole records, each a std::vector<uint8_t>
+	std::atomic<bool> failed;   // A write failed, the rest of the capture is dropped
+
+	// Guarded by mutex, which also keeps records in the order their drop was decided
+	std::mutex mutex;
+	bool dropping; // Skipping to the next keyframe after the queue overflowed
+	uint64_t dropped;
+
+	// I/O thread only
+	FILE *file;
+};
+
+struct moq_replay {
+	std::string url;
+	std::string broadcast_path;
+	bool max_speed;
+	FILE *file;
+	int32_t origin;
+	int32_t broadcast;
+
+	// Replay thread only
+	std::vector<int32_t> tracks;
+	std::vector<uint8_t> catalog; // Body of the catalog record tracks were created from
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool stopping;
+	std::thread thread;
+};
+
+static void moq_capture_put(std::vector<uint8_t> &out, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++) {
+		out.push_back((uint8_t)(value >> (8 * i)));
+	}
+}
+
+static void moq_capture_put_le(uint8_t *out, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++) {
+		out[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+static uint64_t moq_capture_get_le(const uint8_t *data, int bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++) {
+		value |= (uint64_t)data[i] << (8 * i);
+	}
+	return value;
+}
+
+static void moq_capture_write_record(void *opaque, void *item)
+{
+	struct moq_capture *cap = (struct moq_capture *)opaque;
+	std::vector<uint8_t> *record = (std::vector<uint8_t> *)item;
+	if (!cap->failed && fwrite(record->data(), 1, record->size(), cap->file) != record->size()) {
+		LOG_ERROR("Failed to write capture file, capture stopped: %s", cap->path.c_str());
+		cap->failed = true;
+	}
+	delete record;
+}
+
+static void moq_capture_finish(void *opaque)
+{
+	struct moq_capture *cap = (struct moq_capture *)opaque;
+	if (fclose(cap->file) != 0 && !cap->failed) {
+		LOG_ERROR("Failed to finish capture file: %s", cap->path.c_str());
+	}
+	if (cap->dropped) {
+		LOG_WARNING("Capture: %llu frames dropped in total", (unsigned long long)cap->dropped);
+	}
+	delete cap;
+}
+
+static const struct moq_io_callbacks moq_capture_io = {
+	NULL,
+	moq_capture_write_record,
+	moq_capture_finish,
+};
+
+struct moq_capture *moq_capture_create(const char *path)
+{
+	FILE *file = os_fopen(path, "wb");
+	if (!file) {
+		LOG_ERROR("Failed to create capture file: %s", path);
+		return NULL;
+	}
+	setvbuf(file, NULL, _IOFBF, MOQ_CAPTURE_IO_BUFFER);
+	if (fwrite(MOQ_CAPTURE_MAGIC, 1, MOQ_CAPTURE_MAGIC_SIZE, file) != MOQ_CAPTURE_MAGIC_SIZE) {
+		LOG_ERROR("Failed to write capture file: %s", path);
+		fclose(file);
+		return NULL;
+	}
+
+	struct moq_capture *cap = new moq_capture();
+	cap->path = path;
+	cap->start_ns = os_gettime_ns();
+	cap->file = file;
+	cap->failed = false;
+	cap->dropping = false;
+	cap->dropped = 0;
+	cap->queue = moq_io_queue_create("moq-capture", &moq_capture_io, cap, MOQ_CAPTURE_MAX_QUEUED);
+	LOG_INFO("Capturing received video to %s", path);
+	return cap;
+}
+
+void moq_capture_destroy(struct moq_capture *cap)
+{
+	// cap belongs to the I/O thread from here on
+	moq_io_queue_close(cap->queue);
+}
+
+// Hands a record to the I/O thread. A frame that doesn't fit drops the rest of its group, so replay
+// resumes at a keyframe. Catalogs count for nothing against the limit, so they are always kept: the
+// frames after them refer to their tracks.
+static void moq_capture_queue(struct moq_capture *cap, std::vector<uint8_t> &&record, bool frame, bool keyframe)
+{
+	if (cap->failed) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(cap->mutex);
+	if (frame && keyframe) {
+		cap->dropping = false;
+	}
+	if (frame && cap->dropping) {
+		cap->dropped++;
+		return;
+	}
+	std::vector<uint8_t> *item = new std::vector<uint8_t>(std::move(record));
+	if (!moq_io_queue_push(cap->queue, item, frame ? item->size() : 0)) {
+		if (cap->dropped++ == 0) {
+			LOG_WARNING("Capture: disk can't keep up, dropping frames until the next keyframe");
+		}
+		cap->dropping = true;
+		delete item;
+	}
+}
+
+void moq_capture_write_catalog(struct moq_capture *cap, int32_t catalog)
+{
+	std::vector<uint8_t> record(MOQ_CAPTURE_RECORD_HEADER + 4, 0);
+	uint32_t count = 0;
+	struct moq_video_config config;
+	while (count < MOQ_CAPTURE_MAX_TRACKS && moq_consume_video_config(catalog, count, &config) >= 0) {
+		size_t name_len = config.name ? config.name_len : 0;
+		size_t codec_len = config.codec ? config.codec_len : 0;
+		size_t description_len = config.description ? config.description_len : 0;
+		moq_capture_put(record, name_len, 2);
+		record.insert(record.end(), config.name, config.name + name_len);
+		moq_capture_put(record, codec_len, 2);
+		record.insert(record.end(), config.codec, config.codec + codec_len);
+		moq_capture_put(record, description_len, 4);
+		record.insert(record.end(), config.description, config.description + description_len);
+		moq_capture_put(record, config.coded_width ? *config.coded_width : 0, 4);
+		moq_capture_put(record, config.coded_height ? *config.coded_height : 0, 4);
+		count++;
+	}
+	record[0] = MOQ_CAPTURE_CATALOG;
+	moq_capture_put_le(&record[1], record.size() - MOQ_CAPTURE_RECORD_HEADER, 4);
+	moq_capture_put_le(&record[MOQ_CAPTURE_RECORD_HEADER], count, 4);
+	moq_capture_queue(cap, std::move(record), false, false);
+}
+
+void moq_capture_write_frame(struct moq_capture *cap, uint32_t track, int32_t frame_id, const struct moq_frame *first,
+			     uint64_t arrival_ns)
+{
+	// Sized first, so the record is allocated once
+	size_t size = first->payload_size;
+	struct moq_frame chunk;
+	for (uint32_t i = 1; moq_consume_frame_chunk(frame_id, i, &chunk) >= 0; i++) {
+		size += chunk.payload_size;
+	}
+
+	std::vector<uint8_t> record(MOQ_CAPTURE_RECORD_HEADER + MOQ_CAPTURE_FRAME_HEADER);
+	record.reserve(record.size() + size);
+	record[0] = MOQ_CAPTURE_FRAME;
+	moq_capture_put_le(&record[1], MOQ_CAPTURE_FRAME_HEADER + size, 4);
+	moq_capture_put_le(&record[5], track, 4);
+	record[9] = first->keyframe ? 1 : 0;
+	moq_capture_put_le(&record[10], first->timestamp_us, 8);
+	moq_capture_put_le(&record[18], arrival_ns > cap->start_ns ? (arrival_ns - cap->start_ns) / 1000 : 0, 8);
+	record.insert(record.end(), first->payload, first->payload + first->payload_size);
+	for (uint32_t i = 1; moq_consume_frame_chunk(frame_id, i, &chunk) >= 0; i++) {
+		record.insert(record.end(), chunk.payload, chunk.payload + chunk.payload_size);
+	}
+	moq_capture_queue(cap, std::move(record), true, first->keyframe);
+}
+
+const char *moq_replay_file(const char *url)
+{
+	size_t scheme_len = strlen(MOQ_REPLAY_SCHEME);
+	if (!url || strncmp(url, MOQ_REPLAY_SCHEME, scheme_len) != 0) {
+		return NULL;
+	}
+	return url + scheme_len;
+}
+
+static bool moq_replay_read_record(FILE *file, uint8_t *type, std::vector<uint8_t> &body)
+{
+	uint8_t header[MOQ_CAPTURE_RECORD_HEADER];
+	if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+		return false;
+	}
+	*type = header[0];
+	body.resize((size_t)moq_capture_get_le(&header[1], 4));
+	return fread(body.data(), 1, body.size(), file) == body.size();
+}
+
+// Replaces the published tracks with those of a catalog record, unless they already match it
+static void moq_replay_set_catalog(struct moq_replay *replay, const std::vector<uint8_t> &body)
+{
+	if (body == replay->catalog) {
+		return;
+	}
+	replay->catalog = body;
+	for (int32_t track : replay->tracks) {
+		if (track >= 0) {
+			moq_publish_media_close(track);
+		}
+	}
+	replay->tracks.clear();
+
+	const uint8_t *data = body.data();
+	size_t size = body.size();
+	size_t pos = 4;
+	uint32_t count = size >= 4 ? (uint32_t)moq_capture_get_le(data, 4) : 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (pos + 2 > size) {
+			break;
+		}
+		size_t name_len = (size_t)moq_capture_get_le(data + pos, 2);
+		pos += 2 + name_len;
+		if (pos + 2 > size) {
+			break;
+		}
+		size_t codec_len = (size_t)moq_capture_get_le(data + pos, 2);
+		const char *codec = (const char *)data + pos + 2;
+		pos += 2 + codec_len;
+		if (pos + 4 > size) {
+			break;
+		}
+		size_t description_len = (size_t)moq_capture_get_le(data + pos, 4);
+		const uint8_t *description = data + pos + 4;
+		pos += 4 + description_len + 8;
+		if (pos > size) {
+			break;
+		}
+
+		// "avc1.64001f" is published as "avc1": the parameters are in the description
+		size_t format_len = 0;
+		while (format_len < codec_len && codec[format_len] != '.') {
+			format_len++;
+		}
+		int32_t track = moq_publish_media_ordered(replay->broadcast, codec, format_len,
+							  description_len ? description : NULL, description_len);
+		if (track < 0) {
+			LOG_ERROR("Replay: failed to publish track %u: %d", i, track);
+		}
+		// Kept even if it failed, so frames still find their track by index
+		replay->tracks.push_back(track);
+	}
+	LOG_INFO("Replay: publishing %zu video tracks", replay->tracks.size());
+}
+
+// Waits until due_ns, returns false if the replay is stopping
+static bool moq_replay_wait(struct moq_replay *replay, uint64_t due_ns)
+{
+	std::unique_lock<std::mutex> lock(replay->mutex);
+	while (!replay->stopping) {
+		uint64_t now = os_gettime_ns();
+		if (now >= due_ns) {
+			return true;
+		}
+		replay->cond.wait_for(lock, std::chrono::nanoseconds(due_ns - now));
+	}
+	return false;
+}
+
+static void moq_replay_thread(struct moq_replay *replay)
+{
+	os_set_thread_name("moq-replay");
+
+	std::vector<uint8_t> body;
+	uint64_t offset_us = 0; // Added to captured timestamps, so each pass continues the previous one
+	while (true) {
+		fseek(replay->file, MOQ_CAPTURE_MAGIC_SIZE, SEEK_SET);
+		uint64_t pass_start_ns = os_gettime_ns();
+		uint64_t frames = 0;
+		uint64_t first_arrival_us = 0;
+		uint64_t first_ts_us = 0;
+		uint64_t last_ts_us = 0;
+		uint64_t gap_us = MOQ_REPLAY_DEFAULT_GAP_US;
+
+		uint8_t type;
+		while (moq_replay_read_record(replay->file, &type, body)) {
+			if (type == MOQ_CAPTURE_CATALOG) {
+				moq_replay_set_catalog(replay, body);
+				continue;
+			}
+			if (type != MOQ_CAPTURE_FRAME || body.size() < MOQ_CAPTURE_FRAME_HEADER) {
+				continue;
+			}
+
+			// The keyframe flag is recorded for inspection; libmoq reads it from the bitstream again
+			uint32_t track = (uint32_t)moq_capture_get_le(&body[0], 4);
+			uint64_t timestamp_us = moq_capture_get_le(&body[5], 8);
+			uint64_t arrival_us = moq_capture_get_le(&body[13], 8);
+			if (frames == 0) {
+				first_arrival_us = arrival_us;
+				first_ts_us = timestamp_us;
+			} else if (timestamp_us > last_ts_us) {
+				gap_us = timestamp_us - last_ts_us;
+			}
+
+			// Arrival times reproduce the network's pacing, bursts and stalls included
+			uint64_t due_ns = pass_start_ns;
+			if (!replay->max_speed && arrival_us > first_arrival_us) {
+				due_ns += (arrival_us - first_arrival_us) * 1000;
+			}
+			if (!moq_replay_wait(replay, due_ns)) {
+				return;
+			}
+			if (track < replay->tracks.size() && replay->tracks[track] >= 0) {
+				const uint8_t *payload = &body[MOQ_CAPTURE_FRAME_HEADER];
+				size_t size = body.size() - MOQ_CAPTURE_FRAME_HEADER;
+				moq_publish_media_frame(replay->tracks[track], payload, size, timestamp_us + offset_us);
+			}
+			last_ts_us = timestamp_us;
+			frames++;
+		}
+
+		if (frames == 0) {
+			LOG_WARNING("Replay: no frames in %s", moq_replay_file(replay->url.c_str()));
+			return;
+		}
+		offset_us += last_ts_us - first_ts_us + gap_us;
+		LOG_DEBUG("Replay: %llu frames played, looping", (unsigned long long)frames);
+	}
+}
+
+struct moq_replay *moq_replay_create(const char *url, const char *broadcast, bool max_speed)
+{
+	const char *path = moq_replay_file(url);
+	FILE *file = path ? os_fopen(path, "rb") : NULL;
+	char magic[MOQ_CAPTURE_MAGIC_SIZE];
+	if (!file || fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+	    memcmp(magic, MOQ_CAPTURE_MAGIC, sizeof(magic)) != 0) {
+		LOG_ERROR("Not a capture file: %s", path ? path : "(null)");
+		if (file) {
+			fclose(file);
+		}
+		return NULL;
+	}
+
+	struct moq_replay *replay = new moq_replay();
+	replay->url = url;
+	replay->broadcast_path = broadcast;
+	replay->max_speed = max_speed;
+	replay->file = file;
+	replay->stopping = false;
+
+	replay->origin = moq_loopback_acquire(url);
+	replay->broadcast = moq_publish_create();
+	if (replay->origin < 0 || replay->broadcast < 0) {
+		LOG_ERROR("Failed to create replay broadcast: %d, %d", replay->origin, replay->broadcast);
+		moq_replay_destroy(replay);
+		return NULL;
+	}
+	int32_t result = moq_origin_publish(replay->origin, replay->broadcast_path.data(),
+					    replay->broadcast_path.size(), replay->broadcast);
+	if (result < 0) {
+		LOG_ERROR("Failed to publish replay broadcast: %d", result);
+		moq_replay_destroy(replay);
+		return NULL;
+	}
+
+	replay->thread = std::thread(moq_replay_thread, replay);
+	LOG_INFO("Replaying %s as '%s'%s", path, broadcast, max_speed ? " at maximum speed" : "");
+	return replay;
+}
+
+void moq_replay_destroy(struct moq_replay *replay)
+{
+	if (replay->thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(replay->mutex);
+			replay->stopping = true;
+		}
+		replay->cond.notify_one();
+		replay->thread.join();
+	}
+
+	for (int32_t track : replay->tracks) {
+		if (track >= 0) {
+			moq_publish_media_close(track);
+		}
+	}
+	if (replay->broadcast >= 0) {
+		moq_publish_close(replay->broadcast);
+	}
+	if (replay->origin >= 0) {
+		moq_loopback_release(replay->origin);
+	}
+	fclose(replay->file);
+	delete replay;
+}
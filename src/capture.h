@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+struct moq_frame;
+
+// Capture and replay of what a MoQ Source receives, to reproduce a misbehaving feed offline.
+//
+// A capture file is append-only: a header, then one record per catalog and per frame of the active
+// track, with the frame's payload, keyframe flag, timestamp_us and arrival time. A crash loses at
+// most the records still queued; replay stops at a truncated one.
+//
+// Replay publishes a capture into a loopback origin (see loopback.h) named after its URL,
+// "replay://<file>", so a MoQ Source consuming that URL gets it back through its usual on_catalog
+// and frame callbacks, with real libmoq handles.
+#define MOQ_REPLAY_SCHEME "replay://"
+
+struct moq_capture;
+struct moq_replay;
+
+// Starts a new capture file at path, replacing any file there. Returns NULL if it can't be created.
+// Records are written on the capture's own I/O thread (see io-queue.h), so callbacks never wait
+// on the disk.
+struct moq_capture *moq_capture_create(const char *path);
+
+// Returns at once; the I/O thread writes what is still queued, closes the file and frees cap
+void moq_capture_destroy(struct moq_capture *cap);
+
+// Records the video tracks of a catalog. Frames that follow refer to them by index.
+void moq_capture_write_catalog(struct moq_capture *cap, int32_t catalog);
+
+// Records every chunk of a frame of track, first being its chunk 0, copying them for the I/O thread.
+// If the disk falls behind, the rest of the group is dropped. Safe to call from several threads.
+void moq_capture_write_frame(struct moq_capture *cap, uint32_t track, int32_t frame_id, const struct moq_frame *first,
+			     uint64_t arrival_ns);
+
+// Capture file in a replay URL, or NULL if url isn't one
+const char *moq_replay_file(const char *url);
+
+// Publishes the capture in url's file as broadcast into the loopback origin named url, looping at the
+// end with timestamps carrying on. Frames are published at their original arrival times, or back to
+// back with max_speed. Returns NULL if the file can't be read.
+struct moq_replay *moq_replay_create(const char *url, const char *broadcast, bool max_speed);
+void moq_replay_destroy(struct moq_replay *replay);
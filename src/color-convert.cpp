@@ -0,0 +1,641 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+extern "C" {
+#include <libavutil/cpu.h>
+}
+
+#include "color-convert.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MOQ_CONVERT_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define MOQ_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang need per-function target attributes to emit SSE4.1/AVX2 code without
+// raising the baseline of the whole plugin. MSVC accepts the intrinsics unconditionally.
+#if defined(__GNUC__) || defined(__clang__)
+#define MOQ_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MOQ_TARGET(isa)
+#endif
+
+// Kernel table column for each supported source format
+enum convert_format {
+	CONVERT_FORMAT_I420,
+	CONVERT_FORMAT_NV12,
+	CONVERT_FORMAT_P010,
+	CONVERT_FORMAT_COUNT,
+};
+
+static int convert_format_index(enum AVPixelFormat pix_fmt)
+{
+	switch (pix_fmt) {
+	case AV_PIX_FMT_YUV420P:
+	case AV_PIX_FMT_YUVJ420P:
+		return CONVERT_FORMAT_I420;
+	case AV_PIX_FMT_NV12:
+		return CONVERT_FORMAT_NV12;
+	case AV_PIX_FMT_P010LE:
+		return CONVERT_FORMAT_P010;
+	default:
+		return -1;
+	}
+}
+
+void moq_yuv_coeffs_init(struct moq_yuv_coeffs *coeffs, enum AVPixelFormat pix_fmt, enum AVColorSpace colorspace,
+			 enum AVColorRange range)
+{
+	double kr;
+	double kb;
+
+	switch (colorspace) {
+	case AVCOL_SPC_BT709:
+		kr = 0.2126;
+		kb = 0.0722;
+		break;
+	case AVCOL_SPC_BT2020_NCL:
+	case AVCOL_SPC_BT2020_CL:
+		kr = 0.2627;
+		kb = 0.0593;
+		break;
+	case AVCOL_SPC_SMPTE240M:
+		kr = 0.212;
+		kb = 0.087;
+		break;
+	default:
+		// BT.601 - also what swscale assumes when nothing is signalled
+		kr = 0.299;
+		kb = 0.114;
+		break;
+	}
+
+	bool full_range = range == AVCOL_RANGE_JPEG ||
+			  (range == AVCOL_RANGE_UNSPECIFIED && pix_fmt == AV_PIX_FMT_YUVJ420P);
+	double y_scale = full_range ? 1.0 : 255.0 / 219.0;
+	double c_scale = full_range ? 1.0 : 255.0 / 224.0;
+	double kg = 1.0 - kr - kb;
+
+	coeffs->y_offset = full_range ? 0 : 16;
+	coeffs->y_mul = (int16_t)lround(y_scale * 64.0);
+	coeffs->v_r = (int16_t)lround(2.0 * (1.0 - kr) * c_scale * 64.0);
+	coeffs->u_g = (int16_t)lround(2.0 * (1.0 - kb) * kb / kg * c_scale * 64.0);
+	coeffs->v_g = (int16_t)lround(2.0 * (1.0 - kr) * kr / kg * c_scale * 64.0);
+	coeffs->u_b = (int16_t)lround(2.0 * (1.0 - kb) * c_scale * 64.0);
+}
+
+// Scalar reference, also used for the tail of every row in the SIMD kernels.
+// Produces bit-identical output to the vector paths.
+static inline uint8_t clamp_u8(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+static inline void yuv_to_rgba(const struct moq_yuv_coeffs *c, int y, int u, int v, uint8_t *dst)
+{
+	int yy = (y - c->y_offset) * c->y_mul;
+	u -= 128;
+	v -= 128;
+
+	dst[0] = clamp_u8((yy + v * c->v_r + 32) >> 6);
+	dst[1] = clamp_u8((yy - u * c->u_g - v * c->v_g + 32) >> 6);
+	dst[2] = clamp_u8((yy + u * c->u_b + 32) >> 6);
+	dst[3] = 255;
+}
+
+static inline void i420_row_c(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int x, int width,
+			      const struct moq_yuv_coeffs *c)
+{
+	for (; x < width; x++) {
+		yuv_to_rgba(c, y[x], u[x >> 1], v[x >> 1], dst + x * 4);
+	}
+}
+
+static inline void nv12_row_c(const uint8_t *y, const uint8_t *uv, uint8_t *dst, int x, int width,
+			      const struct moq_yuv_coeffs *c)
+{
+	for (; x < width; x++) {
+		int cx = x & ~1;
+		yuv_to_rgba(c, y[x], uv[cx], uv[cx + 1], dst + x * 4);
+	}
+}
+
+// P010 keeps 10 bits in the top of each 16-bit sample; the top 8 are all RGBA can hold
+static inline void p010_row_c(const uint16_t *y, const uint16_t *uv, uint8_t *dst, int x, int width,
+			      const struct moq_yuv_coeffs *c)
+{
+	for (; x < width; x++) {
+		int cx = x & ~1;
+		yuv_to_rgba(c, y[x] >> 8, uv[cx] >> 8, uv[cx + 1] >> 8, dst + x * 4);
+	}
+}
+
+// Row pointer helpers shared by all kernels
+static inline const uint8_t *plane_row(const uint8_t *const src[4], const int src_linesize[4], int plane, int row)
+{
+	return src[plane] + (ptrdiff_t)row * src_linesize[plane];
+}
+
+static inline const uint16_t *plane_row16(const uint8_t *const src[4], const int src_linesize[4], int plane, int row)
+{
+	return (const uint16_t *)plane_row(src, src_linesize, plane, row);
+}
+
+static void i420_rgba_c(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	for (int row = row_begin; row < row_end; row++) {
+		i420_row_c(plane_row(src, src_linesize, 0, row), plane_row(src, src_linesize, 1, row >> 1),
+			   plane_row(src, src_linesize, 2, row >> 1), dst + (ptrdiff_t)row * dst_linesize, 0, width,
+			   c);
+	}
+}
+
+static void nv12_rgba_c(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	for (int row = row_begin; row < row_end; row++) {
+		nv12_row_c(plane_row(src, src_linesize, 0, row), plane_row(src, src_linesize, 1, row >> 1),
+			   dst + (ptrdiff_t)row * dst_linesize, 0, width, c);
+	}
+}
+
+static void p010_rgba_c(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	for (int row = row_begin; row < row_end; row++) {
+		p010_row_c(plane_row16(src, src_linesize, 0, row), plane_row16(src, src_linesize, 1, row >> 1),
+			   dst + (ptrdiff_t)row * dst_linesize, 0, width, c);
+	}
+}
+
+#ifdef MOQ_CONVERT_X86
+
+// SSE4.1: 8 pixels per iteration in int16 lanes
+
+struct coeffs_sse41 {
+	__m128i y_offset, y_mul, v_r, u_g, v_g, u_b, chroma_bias, round;
+};
+
+MOQ_TARGET("sse4.1") static inline void coeffs_sse41_init(struct coeffs_sse41 *k, const struct moq_yuv_coeffs *c)
+{
+	k->y_offset = _mm_set1_epi16(c->y_offset);
+	k->y_mul = _mm_set1_epi16(c->y_mul);
+	k->v_r = _mm_set1_epi16(c->v_r);
+	k->u_g = _mm_set1_epi16(c->u_g);
+	k->v_g = _mm_set1_epi16(c->v_g);
+	k->u_b = _mm_set1_epi16(c->u_b);
+	k->chroma_bias = _mm_set1_epi16(128);
+	k->round = _mm_set1_epi16(32);
+}
+
+// Splits interleaved 16-bit U/V lanes into U and V with each sample duplicated for both pixels it covers
+MOQ_TARGET("sse4.1") static inline void split_uv_sse41(__m128i uv, __m128i *u, __m128i *v)
+{
+	const __m128i lo_mask = _mm_set1_epi32(0x0000FFFF);
+	*u = _mm_or_si128(_mm_and_si128(uv, lo_mask), _mm_slli_epi32(uv, 16));
+	*v = _mm_or_si128(_mm_srli_epi32(uv, 16), _mm_andnot_si128(lo_mask, uv));
+}
+
+MOQ_TARGET("sse4.1")
+static inline void store_rgba_sse41(__m128i y, __m128i u, __m128i v, const struct coeffs_sse41 *k, uint8_t *dst)
+{
+	y = _mm_mullo_epi16(_mm_sub_epi16(y, k->y_offset), k->y_mul);
+	u = _mm_sub_epi16(u, k->chroma_bias);
+	v = _mm_sub_epi16(v, k->chroma_bias);
+
+	// Saturation only kicks in far above 255 << 6, so packus clamps exactly like the scalar path
+	__m128i r = _mm_adds_epi16(y, _mm_mullo_epi16(v, k->v_r));
+	__m128i g = _mm_subs_epi16(_mm_subs_epi16(y, _mm_mullo_epi16(u, k->u_g)), _mm_mullo_epi16(v, k->v_g));
+	__m128i b = _mm_adds_epi16(y, _mm_mullo_epi16(u, k->u_b));
+
+	r = _mm_srai_epi16(_mm_adds_epi16(r, k->round), 6);
+	g = _mm_srai_epi16(_mm_adds_epi16(g, k->round), 6);
+	b = _mm_srai_epi16(_mm_adds_epi16(b, k->round), 6);
+
+	__m128i r8 = _mm_packus_epi16(r, r);
+	__m128i g8 = _mm_packus_epi16(g, g);
+	__m128i b8 = _mm_packus_epi16(b, b);
+
+	__m128i rg = _mm_unpacklo_epi8(r8, g8);
+	__m128i ba = _mm_unpacklo_epi8(b8, _mm_set1_epi8(-1));
+	_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(rg, ba));
+	_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(rg, ba));
+}
+
+MOQ_TARGET("sse4.1")
+static void i420_rgba_sse41(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			    int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	struct coeffs_sse41 k;
+	coeffs_sse41_init(&k, c);
+
+	for (int row = row_begin; row < row_end; row++) {
+		const uint8_t *y = plane_row(src, src_linesize, 0, row);
+		const uint8_t *u = plane_row(src, src_linesize, 1, row >> 1);
+		const uint8_t *v = plane_row(src, src_linesize, 2, row >> 1);
+		uint8_t *out = dst + (ptrdiff_t)row * dst_linesize;
+
+		int x = 0;
+		for (; x + 8 <= width; x += 8) {
+			int32_t u4;
+			int32_t v4;
+			memcpy(&u4, u + (x >> 1), sizeof(u4));
+			memcpy(&v4, v + (x >> 1), sizeof(v4));
+			__m128i uu = _mm_cvtsi32_si128(u4);
+			__m128i vv = _mm_cvtsi32_si128(v4);
+
+			store_rgba_sse41(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(y + x))),
+					 _mm_cvtepu8_epi16(_mm_unpacklo_epi8(uu, uu)),
+					 _mm_cvtepu8_epi16(_mm_unpacklo_epi8(vv, vv)), &k, out + x * 4);
+		}
+		i420_row_c(y, u, v, out, x, width, c);
+	}
+}
+
+MOQ_TARGET("sse4.1")
+static void nv12_rgba_sse41(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			    int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	struct coeffs_sse41 k;
+	coeffs_sse41_init(&k, c);
+
+	for (int row = row_begin; row < row_end; row++) {
+		const uint8_t *y = plane_row(src, src_linesize, 0, row);
+		const uint8_t *uv = plane_row(src, src_linesize, 1, row >> 1);
+		uint8_t *out = dst + (ptrdiff_t)row * dst_linesize;
+
+		int x = 0;
+		for (; x + 8 <= width; x += 8) {
+			__m128i u;
+			__m128i v;
+			split_uv_sse41(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(uv + x))), &u, &v);
+			store_rgba_sse41(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(y + x))), u, v, &k,
+					 out + x * 4);
+		}
+		nv12_row_c(y, uv, out, x, width, c);
+	}
+}
+
+MOQ_TARGET("sse4.1")
+static void p010_rgba_sse41(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			    int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	struct coeffs_sse41 k;
+	coeffs_sse41_init(&k, c);
+
+	for (int row = row_begin; row < row_end; row++) {
+		const uint16_t *y = plane_row16(src, src_linesize, 0, row);
+		const uint16_t *uv = plane_row16(src, src_linesize, 1, row >> 1);
+		uint8_t *out = dst + (ptrdiff_t)row * dst_linesize;
+
+		int x = 0;
+		for (; x + 8 <= width; x += 8) {
+			__m128i u;
+			__m128i v;
+			split_uv_sse41(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)(uv + x)), 8), &u, &v);
+			store_rgba_sse41(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)(y + x)), 8), u, v, &k,
+					 out + x * 4);
+		}
+		p010_row_c(y, uv, out, x, width, c);
+	}
+}
+
+// AVX2: 16 pixels per iteration, same arithmetic as SSE4.1
+
+struct coeffs_avx2 {
+	__m256i y_offset, y_mul, v_r, u_g, v_g, u_b, chroma_bias, round;
+};
+
+MOQ_TARGET("avx2") static inline void coeffs_avx2_init(struct coeffs_avx2 *k, const struct moq_yuv_coeffs *c)
+{
+	k->y_offset = _mm256_set1_epi16(c->y_offset);
+	k->y_mul = _mm256_set1_epi16(c->y_mul);
+	k->v_r = _mm256_set1_epi16(c->v_r);
+	k->u_g = _mm256_set1_epi16(c->u_g);
+	k->v_g = _mm256_set1_epi16(c->v_g);
+	k->u_b = _mm256_set1_epi16(c->u_b);
+	k->chroma_bias = _mm256_set1_epi16(128);
+	k->round = _mm256_set1_epi16(32);
+}
+
+MOQ_TARGET("avx2") static inline void split_uv_avx2(__m256i uv, __m256i *u, __m256i *v)
+{
+	const __m256i lo_mask = _mm256_set1_epi32(0x0000FFFF);
+	*u = _mm256_or_si256(_mm256_and_si256(uv, lo_mask), _mm256_slli_epi32(uv, 16));
+	*v = _mm256_or_si256(_mm256_srli_epi32(uv, 16), _mm256_andnot_si256(lo_mask, uv));
+}
+
+MOQ_TARGET("avx2")
+static inline void store_rgba_avx2(__m256i y, __m256i u, __m256i v, const struct coeffs_avx2 *k, uint8_t *dst)
+{
+	y = _mm256_mullo_epi16(_mm256_sub_epi16(y, k->y_offset), k->y_mul);
+	u = _mm256_sub_epi16(u, k->chroma_bias);
+	v = _mm256_sub_epi16(v, k->chroma_bias);
+
+	__m256i r = _mm256_adds_epi16(y, _mm256_mullo_epi16(v, k->v_r));
+	__m256i g = _mm256_subs_epi16(_mm256_subs_epi16(y, _mm256_mullo_epi16(u, k->u_g)),
+				      _mm256_mullo_epi16(v, k->v_g));
+	__m256i b = _mm256_adds_epi16(y, _mm256_mullo_epi16(u, k->u_b));
+
+	r = _mm256_srai_epi16(_mm256_adds_epi16(r, k->round), 6);
+	g = _mm256_srai_epi16(_mm256_adds_epi16(g, k->round), 6);
+	b = _mm256_srai_epi16(_mm256_adds_epi16(b, k->round), 6);
+
+	// Pack and unpack work per 128-bit lane: lo holds pixels 0-3 | 8-11, hi holds 4-7 | 12-15
+	__m256i r8 = _mm256_packus_epi16(r, r);
+	__m256i g8 = _mm256_packus_epi16(g, g);
+	__m256i b8 = _mm256_packus_epi16(b, b);
+
+	__m256i rg = _mm256_unpacklo_epi8(r8, g8);
+	__m256i ba = _mm256_unpacklo_epi8(b8, _mm256_set1_epi8(-1));
+	__m256i lo = _mm256_unpacklo_epi16(rg, ba);
+	__m256i hi = _mm256_unpackhi_epi16(rg, ba);
+
+	_mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+MOQ_TARGET("avx2")
+static void i420_rgba_avx2(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			   int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	struct coeffs_avx2 k;
+	coeffs_avx2_init(&k, c);
+
+	for (int row = row_begin; row < row_end; row++) {
+		const uint8_t *y = plane_row(src, src_linesize, 0, row);
+		const uint8_t *u = plane_row(src, src_linesize, 1, row >> 1);
+		const uint8_t *v = plane_row(src, src_linesize, 2, row >> 1);
+		uint8_t *out = dst + (ptrdiff_t)row * dst_linesize;
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16) {
+			__m128i uu = _mm_loadl_epi64((const __m128i *)(u + (x >> 1)));
+			__m128i vv = _mm_loadl_epi64((const __m128i *)(v + (x >> 1)));
+
+			store_rgba_avx2(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x))),
+					_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(uu, uu)),
+					_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(vv, vv)), &k, out + x * 4);
+		}
+		i420_row_c(y, u, v, out, x, width, c);
+	}
+}
+
+MOQ_TARGET("avx2")
+static void nv12_rgba_avx2(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			   int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	struct coeffs_avx2 k;
+	coeffs_avx2_init(&k, c);
+
+	for (int row = row_begin; row < row_end; row++) {
+		const uint8_t *y = plane_row(src, src_linesize, 0, row);
+		const uint8_t *uv = plane_row(src, src_linesize, 1, row >> 1);
+		uint8_t *out = dst + (ptrdiff_t)row * dst_linesize;
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16) {
+			__m256i u;
+			__m256i v;
+			split_uv_avx2(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(uv + x))), &u, &v);
+			store_rgba_avx2(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x))), u, v, &k,
+					out + x * 4);
+		}
+		nv12_row_c(y, uv, out, x, width, c);
+	}
+}
+
+MOQ_TARGET("avx2")
+static void p010_rgba_avx2(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			   int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	struct coeffs_avx2 k;
+	coeffs_avx2_init(&k, c);
+
+	for (int row = row_begin; row < row_end; row++) {
+		const uint16_t *y = plane_row16(src, src_linesize, 0, row);
+		const uint16_t *uv = plane_row16(src, src_linesize, 1, row >> 1);
+		uint8_t *out = dst + (ptrdiff_t)row * dst_linesize;
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16) {
+			__m256i u;
+			__m256i v;
+			split_uv_avx2(_mm256_srli_epi16(_mm256_loadu_si256((const __m256i *)(uv + x)), 8), &u, &v);
+			store_rgba_avx2(_mm256_srli_epi16(_mm256_loadu_si256((const __m256i *)(y + x)), 8), u, v, &k,
+					out + x * 4);
+		}
+		p010_row_c(y, uv, out, x, width, c);
+	}
+}
+
+#endif // MOQ_CONVERT_X86
+
+#ifdef MOQ_CONVERT_NEON
+
+// NEON: 16 pixels per iteration, split into two int16x8 halves
+
+struct coeffs_neon {
+	int16x8_t y_offset, y_mul, v_r, u_g, v_g, u_b, chroma_bias;
+};
+
+static inline void coeffs_neon_init(struct coeffs_neon *k, const struct moq_yuv_coeffs *c)
+{
+	k->y_offset = vdupq_n_s16(c->y_offset);
+	k->y_mul = vdupq_n_s16(c->y_mul);
+	k->v_r = vdupq_n_s16(c->v_r);
+	k->u_g = vdupq_n_s16(c->u_g);
+	k->v_g = vdupq_n_s16(c->v_g);
+	k->u_b = vdupq_n_s16(c->u_b);
+	k->chroma_bias = vdupq_n_s16(128);
+}
+
+static inline void yuv_half_neon(uint8x8_t y8, uint8x8_t u8, uint8x8_t v8, const struct coeffs_neon *k,
+				 uint8x8_t *r, uint8x8_t *g, uint8x8_t *b)
+{
+	int16x8_t y = vmulq_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(y8)), k->y_offset), k->y_mul);
+	int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), k->chroma_bias);
+	int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), k->chroma_bias);
+
+	// vqrshrun does the (x + 32) >> 6 rounding and the clamp to [0, 255] in one step
+	*r = vqrshrun_n_s16(vqaddq_s16(y, vmulq_s16(v, k->v_r)), 6);
+	*g = vqrshrun_n_s16(vqsubq_s16(vqsubq_s16(y, vmulq_s16(u, k->u_g)), vmulq_s16(v, k->v_g)), 6);
+	*b = vqrshrun_n_s16(vqaddq_s16(y, vmulq_s16(u, k->u_b)), 6);
+}
+
+// u and v hold one sample per pixel pair (8 samples for 16 pixels)
+static inline void store_rgba_neon(uint8x16_t y, uint8x8_t u, uint8x8_t v, const struct coeffs_neon *k,
+				   uint8_t *dst)
+{
+	uint8x8x2_t uu = vzip_u8(u, u);
+	uint8x8x2_t vv = vzip_u8(v, v);
+	uint8x8_t r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+
+	yuv_half_neon(vget_low_u8(y), uu.val[0], vv.val[0], k, &r_lo, &g_lo, &b_lo);
+	yuv_half_neon(vget_high_u8(y), uu.val[1], vv.val[1], k, &r_hi, &g_hi, &b_hi);
+
+	uint8x16x4_t rgba;
+	rgba.val[0] = vcombine_u8(r_lo, r_hi);
+	rgba.val[1] = vcombine_u8(g_lo, g_hi);
+	rgba.val[2] = vcombine_u8(b_lo, b_hi);
+	rgba.val[3] = vdupq_n_u8(255);
+	vst4q_u8(dst, rgba);
+}
+
+static void i420_rgba_neon(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			   int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	struct coeffs_neon k;
+	coeffs_neon_init(&k, c);
+
+	for (int row = row_begin; row < row_end; row++) {
+		const uint8_t *y = plane_row(src, src_linesize, 0, row);
+		const uint8_t *u = plane_row(src, src_linesize, 1, row >> 1);
+		const uint8_t *v = plane_row(src, src_linesize, 2, row >> 1);
+		uint8_t *out = dst + (ptrdiff_t)row * dst_linesize;
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16) {
+			store_rgba_neon(vld1q_u8(y + x), vld1_u8(u + (x >> 1)), vld1_u8(v + (x >> 1)), &k,
+					out + x * 4);
+		}
+		i420_row_c(y, u, v, out, x, width, c);
+	}
+}
+
+static void nv12_rgba_neon(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			   int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	struct coeffs_neon k;
+	coeffs_neon_init(&k, c);
+
+	for (int row = row_begin; row < row_end; row++) {
+		const uint8_t *y = plane_row(src, src_linesize, 0, row);
+		const uint8_t *uv = plane_row(src, src_linesize, 1, row >> 1);
+		uint8_t *out = dst + (ptrdiff_t)row * dst_linesize;
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16) {
+			uint8x8x2_t chroma = vld2_u8(uv + x);
+			store_rgba_neon(vld1q_u8(y + x), chroma.val[0], chroma.val[1], &k, out + x * 4);
+		}
+		nv12_row_c(y, uv, out, x, width, c);
+	}
+}
+
+static void p010_rgba_neon(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst, int dst_linesize,
+			   int width, int row_begin, int row_end, const struct moq_yuv_coeffs *c)
+{
+	struct coeffs_neon k;
+	coeffs_neon_init(&k, c);
+
+	for (int row = row_begin; row < row_end; row++) {
+		const uint16_t *y = plane_row16(src, src_linesize, 0, row);
+		const uint16_t *uv = plane_row16(src, src_linesize, 1, row >> 1);
+		uint8_t *out = dst + (ptrdiff_t)row * dst_linesize;
+
+		int x = 0;
+		for (; x + 16 <= width; x += 16) {
+			uint8x16_t luma =
+				vcombine_u8(vshrn_n_u16(vld1q_u16(y + x), 8), vshrn_n_u16(vld1q_u16(y + x + 8), 8));
+			uint16x8x2_t chroma = vld2q_u16(uv + x);
+			store_rgba_neon(luma, vshrn_n_u16(chroma.val[0], 8), vshrn_n_u16(chroma.val[1], 8), &k,
+					out + x * 4);
+		}
+		p010_row_c(y, uv, out, x, width, c);
+	}
+}
+
+#endif // MOQ_CONVERT_NEON
+
+static const moq_convert_func kernels[MOQ_CONVERT_ISA_COUNT][CONVERT_FORMAT_COUNT] = {
+	{i420_rgba_c, nv12_rgba_c, p010_rgba_c},
+#ifdef MOQ_CONVERT_X86
+	{i420_rgba_sse41, nv12_rgba_sse41, p010_rgba_sse41},
+	{i420_rgba_avx2, nv12_rgba_avx2, p010_rgba_avx2},
+#else
+	{NULL, NULL, NULL},
+	{NULL, NULL, NULL},
+#endif
+#ifdef MOQ_CONVERT_NEON
+	{i420_rgba_neon, nv12_rgba_neon, p010_rgba_neon},
+#else
+	{NULL, NULL, NULL},
+#endif
+};
+
+static bool isa_supported(enum moq_convert_isa isa)
+{
+	int flags = av_get_cpu_flags();
+
+	switch (isa) {
+	case MOQ_CONVERT_ISA_C:
+		return true;
+#ifdef MOQ_CONVERT_X86
+	case MOQ_CONVERT_ISA_SSE41:
+		return (flags & AV_CPU_FLAG_SSE4) != 0;
+	case MOQ_CONVERT_ISA_AVX2:
+		return (flags & AV_CPU_FLAG_AVX2) != 0;
+#endif
+#ifdef MOQ_CONVERT_NEON
+	case MOQ_CONVERT_ISA_NEON:
+		return (flags & AV_CPU_FLAG_NEON) != 0;
+#endif
+	default:
+		(void)flags;
+		return false;
+	}
+}
+
+enum moq_convert_isa moq_convert_best_isa(void)
+{
+	static const enum moq_convert_isa preference[] = {
+		MOQ_CONVERT_ISA_AVX2,
+		MOQ_CONVERT_ISA_NEON,
+		MOQ_CONVERT_ISA_SSE41,
+	};
+
+	for (enum moq_convert_isa isa : preference) {
+		if (isa_supported(isa)) {
+			return isa;
+		}
+	}
+	return MOQ_CONVERT_ISA_C;
+}
+
+const char *moq_convert_isa_name(enum moq_convert_isa isa)
+{
+	switch (isa) {
+	case MOQ_CONVERT_ISA_C:
+		return "c";
+	case MOQ_CONVERT_ISA_SSE41:
+		return "sse4.1";
+	case MOQ_CONVERT_ISA_AVX2:
+		return "avx2";
+	case MOQ_CONVERT_ISA_NEON:
+		return "neon";
+	default:
+		return "unknown";
+	}
+}
+
+moq_convert_func moq_convert_find_isa(enum AVPixelFormat pix_fmt, enum moq_convert_isa isa)
+{
+	int format = convert_format_index(pix_fmt);
+	if (format < 0 || isa < 0 || isa >= MOQ_CONVERT_ISA_COUNT || !isa_supported(isa)) {
+		return NULL;
+	}
+	return kernels[isa][format];
+}
+
+moq_convert_func moq_convert_find(enum AVPixelFormat pix_fmt)
+{
+	// CPU detection is cheap but the answer never changes, so do it once
+	static const enum moq_convert_isa best = moq_convert_best_isa();
+	return moq_convert_find_isa(pix_fmt, best);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+// Instruction sets a conversion kernel can be built for, slowest first
+enum moq_convert_isa {
+	MOQ_CONVERT_ISA_C,
+	MOQ_CONVERT_ISA_SSE41,
+	MOQ_CONVERT_ISA_AVX2,
+	MOQ_CONVERT_ISA_NEON,
+	MOQ_CONVERT_ISA_COUNT,
+};
+
+// Q6 fixed-point YUV -> RGB coefficients shared by every kernel.
+// Sized so that all intermediate products fit in int16 lanes.
+struct moq_yuv_coeffs {
+	int16_t y_offset;
+	int16_t y_mul;
+	int16_t v_r;
+	int16_t u_g;
+	int16_t v_g;
+	int16_t u_b;
+};
+
+// Converts rows [row_begin, row_end) of a 4:2:0 frame to packed RGBA.
+// src/src_linesize describe the whole frame and dst points at row 0 of the output,
+// so slices of one frame can be converted independently. row_begin must be even.
+typedef void (*moq_convert_func)(const uint8_t *const src[4], const int src_linesize[4], uint8_t *dst,
+				 int dst_linesize, int width, int row_begin, int row_end,
+				 const struct moq_yuv_coeffs *coeffs);
+
+// Fills coeffs for the given matrix and range. Unspecified values fall back to the
+// swscale defaults (BT.601, limited range unless the pixel format is a JPEG one).
+void moq_yuv_coeffs_init(struct moq_yuv_coeffs *coeffs, enum AVPixelFormat pix_fmt, enum AVColorSpace colorspace,
+			 enum AVColorRange range);
+
+// Best instruction set supported by both this build and the running CPU
+enum moq_convert_isa moq_convert_best_isa(void);
+const char *moq_convert_isa_name(enum moq_convert_isa isa);
+
+// Returns the kernel converting pix_fmt to RGBA for a specific instruction set,
+// or NULL if the format or instruction set is unavailable.
+moq_convert_func moq_convert_find_isa(enum AVPixelFormat pix_fmt, enum moq_convert_isa isa);
+
+// Returns the fastest kernel converting pix_fmt to RGBA on this CPU,
+// or NULL if the format has to go through swscale.
+moq_convert_func moq_convert_find(enum AVPixelFormat pix_fmt);
@@ -0,0 +1,167 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <string.h>
+
+#include <mutex>
+#include <vector>
+
+#include "decoder-cache.h"
+#include "logger.h"
+
+// Decoders with frame threads hold a few MB and threads each, so only keep a handful
+#define MOQ_DECODER_CACHE_SIZE 4
+// Decoders idle for longer than this aren't worth keeping
+#define MOQ_DECODER_CACHE_TTL_NS 120000000000ULL
+
+struct cache_entry {
+	struct moq_decoder_key key;
+	AVCodecContext *codec_ctx;
+	enum AVPixelFormat pix_fmt;
+	uint64_t last_used_ns;
+};
+
+static std::mutex cache_mutex;
+static std::vector<cache_entry> cache_entries; // Most recently used last
+
+static bool key_equal(const struct moq_decoder_key *a, const struct moq_decoder_key *b)
+{
+	return a->codec_id == b->codec_id && a->extradata_size == b->extradata_size &&
+	       a->extradata_hash == b->extradata_hash && a->width == b->width && a->height == b->height &&
+	       a->low_latency == b->low_latency;
+}
+
+// Removes expired entries; their decoders are returned in expired so they can be freed unlocked
+// NOTE: Caller must hold cache_mutex
+static void expire_locked(uint64_t now_ns, std::vector<AVCodecContext *> &expired)
+{
+	for (size_t i = 0; i < cache_entries.size();) {
+		if (now_ns - cache_entries[i].last_used_ns > MOQ_DECODER_CACHE_TTL_NS) {
+			expired.push_back(cache_entries[i].codec_ctx);
+			cache_entries.erase(cache_entries.begin() + i);
+		} else {
+			i++;
+		}
+	}
+}
+
+static void free_decoders(std::vector<AVCodecContext *> &decoders)
+{
+	for (AVCodecContext *codec_ctx : decoders) {
+		avcodec_free_context(&codec_ctx);
+	}
+}
+
+AVCodecContext *moq_decoder_open(const struct moq_decoder_key *key, const uint8_t *extradata)
+{
+	const AVCodec *codec = avcodec_find_decoder(key->codec_id);
+	if (!codec) {
+		LOG_ERROR("Decoder not found for codec ID: %d", key->codec_id);
+		return NULL;
+	}
+
+	AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+	if (!codec_ctx) {
+		LOG_ERROR("Failed to allocate codec context");
+		return NULL;
+	}
+
+	// Required for buffer allocation when the extradata doesn't give them
+	if (key->width > 0) {
+		codec_ctx->width = key->width;
+	}
+	if (key->height > 0) {
+		codec_ctx->height = key->height;
+	}
+
+	// The codec description (SPS/PPS for H.264, VPS/SPS/PPS for HEVC, etc.)
+	if (extradata && key->extradata_size > 0) {
+		codec_ctx->extradata = (uint8_t *)av_mallocz(key->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+		if (codec_ctx->extradata) {
+			memcpy(codec_ctx->extradata, extradata, key->extradata_size);
+			codec_ctx->extradata_size = (int)key->extradata_size;
+		}
+	}
+
+	// Frame threading adds a frame of delay per thread, so only slice threading is allowed
+	if (key->low_latency) {
+		codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+		codec_ctx->thread_type = FF_THREAD_SLICE;
+		codec_ctx->thread_count = 0;
+	}
+
+	if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
+		LOG_ERROR("Failed to open codec %s", codec->name);
+		avcodec_free_context(&codec_ctx);
+		return NULL;
+	}
+	return codec_ctx;
+}
+
+AVCodecContext *moq_decoder_cache_take(const struct moq_decoder_key *key, enum AVPixelFormat *pix_fmt)
+{
+	std::vector<AVCodecContext *> expired;
+	AVCodecContext *codec_ctx = NULL;
+	*pix_fmt = AV_PIX_FMT_NONE;
+
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		expire_locked(os_gettime_ns(), expired);
+
+		for (size_t i = cache_entries.size(); i-- > 0;) {
+			if (key_equal(&cache_entries[i].key, key)) {
+				codec_ctx = cache_entries[i].codec_ctx;
+				*pix_fmt = cache_entries[i].pix_fmt;
+				cache_entries.erase(cache_entries.begin() + i);
+				break;
+			}
+		}
+	}
+
+	free_decoders(expired);
+	return codec_ctx;
+}
+
+void moq_decoder_cache_put(const struct moq_decoder_key *key, AVCodecContext **codec_ctx, enum AVPixelFormat pix_fmt)
+{
+	if (!*codec_ctx) {
+		return;
+	}
+
+	// Drop buffered frames now, so the next user starts clean at its first keyframe
+	avcodec_flush_buffers(*codec_ctx);
+
+	std::vector<AVCodecContext *> expired;
+	uint64_t now_ns = os_gettime_ns();
+
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		expire_locked(now_ns, expired);
+
+		if (cache_entries.size() >= MOQ_DECODER_CACHE_SIZE) {
+			expired.push_back(cache_entries.front().codec_ctx);
+			cache_entries.erase(cache_entries.begin());
+		}
+		cache_entries.push_back({*key, *codec_ctx, pix_fmt, now_ns});
+	}
+
+	*codec_ctx = NULL;
+	free_decoders(expired);
+}
+
+void moq_decoder_cache_clear(void)
+{
+	std::vector<AVCodecContext *> decoders;
+
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		for (cache_entry &entry : cache_entries) {
+			decoders.push_back(entry.codec_ctx);
+		}
+		cache_entries.clear();
+	}
+
+	if (!decoders.empty()) {
+		LOG_DEBUG("Freeing %zu cached decoders", decoders.size());
+	}
+	free_decoders(decoders);
+}
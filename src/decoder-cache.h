@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Identifies decoders that can stand in for each other: same codec, extradata and coded size,
+// opened with the same flags
+struct moq_decoder_key {
+	enum AVCodecID codec_id;
+	size_t extradata_size;
+	uint64_t extradata_hash;
+	int width;
+	int height;
+	bool low_latency;
+};
+
+// Opens a new decoder for key, with extradata (key->extradata_size bytes, may be NULL) as the codec
+// description. Sizes of 0 are left for the decoder to find. A low_latency decoder outputs every frame
+// as soon as it's decodable and uses slice threads only. Returns NULL, having logged why, on failure.
+AVCodecContext *moq_decoder_open(const struct moq_decoder_key *key, const uint8_t *extradata);
+
+// Takes a decoder matching key out of the cache shared by all sources, or returns NULL.
+// pix_fmt receives the format it last decoded to, so output buffers can be sized before the first frame.
+AVCodecContext *moq_decoder_cache_take(const struct moq_decoder_key *key, enum AVPixelFormat *pix_fmt);
+
+// Flushes the decoder and keeps it for reuse, evicting the least recently used one when full.
+// Takes ownership of *codec_ctx and sets it to NULL.
+void moq_decoder_cache_put(const struct moq_decoder_key *key, AVCodecContext **codec_ctx, enum AVPixelFormat pix_fmt);
+
+// Frees every cached decoder; called on module unload
+void moq_decoder_cache_clear(void);
@@ -0,0 +1,213 @@
+#include <obs-module.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "flight-recorder.h"
+#include "io-queue.h"
+#include "logger.h"
+
+// Least time between two dumps of one recorder
+#define MOQ_FLIGHT_DUMP_INTERVAL_NS 30000000000ULL
+
+struct flight_event {
+	uint64_t time_ns;
+	uint64_t size;
+	uint64_t timestamp_us;
+	uint64_t duration_ns;
+	int32_t code;
+	uint8_t type;
+	bool keyframe;
+};
+
+// seq is the event's index plus one once written, 0 while a writer fills it in. The fields are atomics
+// only so that a dump reading a slot being rewritten is defined; seq tells it to drop the copy.
+struct flight_slot {
+	std::atomic<uint64_t> seq;
+	std::atomic<uint64_t> time_ns;
+	std::atomic<uint64_t> size;
+	std::atomic<uint64_t> timestamp_us;
+	std::atomic<uint64_t> duration_ns;
+	std::atomic<int32_t> code;
+	std::atomic<uint8_t> type;
+	std::atomic<bool> keyframe;
+};
+
+struct moq_flight_recorder {
+	std::string kind;
+	std::atomic<uint64_t> head; // Events recorded so far
+	std::atomic<uint64_t> last_dump_ns;
+	struct flight_slot slots[MOQ_FLIGHT_EVENTS];
+};
+
+static const char *flight_event_names[] = {"receive", "decode", "output", "drop",    "video",
+					   "audio",   "track",  "session", "connect"};
+
+struct moq_flight_recorder *moq_flight_create(const char *kind)
+{
+	struct moq_flight_recorder *fr = new moq_flight_recorder();
+	fr->kind = kind;
+	fr->head = 0;
+	fr->last_dump_ns = 0;
+	for (int i = 0; i < MOQ_FLIGHT_EVENTS; i++) {
+		fr->slots[i].seq = 0;
+	}
+	return fr;
+}
+
+void moq_flight_destroy(struct moq_flight_recorder *fr)
+{
+	delete fr;
+}
+
+void moq_flight_record(struct moq_flight_recorder *fr, enum moq_flight_event_type type, int32_t code, uint64_t size,
+		       uint64_t timestamp_us, uint64_t duration_ns, bool keyframe)
+{
+	if (!fr) {
+		return;
+	}
+
+	uint64_t index = fr->head.fetch_add(1, std::memory_order_relaxed);
+	struct flight_slot *slot = &fr->slots[index % MOQ_FLIGHT_EVENTS];
+	slot->seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->time_ns.store(os_gettime_ns(), std::memory_order_relaxed);
+	slot->size.store(size, std::memory_order_relaxed);
+	slot->timestamp_us.store(timestamp_us, std::memory_order_relaxed);
+	slot->duration_ns.store(duration_ns, std::memory_order_relaxed);
+	slot->code.store(code, std::memory_order_relaxed);
+	slot->type.store((uint8_t)type, std::memory_order_relaxed);
+	slot->keyframe.store(keyframe, std::memory_order_relaxed);
+	slot->seq.store(index + 1, std::memory_order_release);
+}
+
+// Events still in the ring, oldest first. Ones being written or overwritten meanwhile are left out.
+static void moq_flight_snapshot(struct moq_flight_recorder *fr, std::vector<flight_event> &events)
+{
+	uint64_t end = fr->head.load(std::memory_order_acquire);
+	uint64_t begin = end > MOQ_FLIGHT_EVENTS ? end - MOQ_FLIGHT_EVENTS : 0;
+	events.reserve((size_t)(end - begin));
+	for (uint64_t index = begin; index < end; index++) {
+		struct flight_slot *slot = &fr->slots[index % MOQ_FLIGHT_EVENTS];
+		uint64_t seq = slot->seq.load(std::memory_order_acquire);
+		struct flight_event event;
+		event.time_ns = slot->time_ns.load(std::memory_order_relaxed);
+		event.size = slot->size.load(std::memory_order_relaxed);
+		event.timestamp_us = slot->timestamp_us.load(std::memory_order_relaxed);
+		event.duration_ns = slot->duration_ns.load(std::memory_order_relaxed);
+		event.code = slot->code.load(std::memory_order_relaxed);
+		event.type = slot->type.load(std::memory_order_relaxed);
+		event.keyframe = slot->keyframe.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (seq == index + 1 && slot->seq.load(std::memory_order_relaxed) == seq) {
+			events.push_back(event);
+		}
+	}
+}
+
+// A dump on its way to disk, owned by the thread writing it
+struct flight_dump {
+	std::string kind;
+	std::string name;
+	std::string reason;
+	uint64_t now_ns;
+	std::vector<flight_event> events;
+};
+
+static void moq_flight_write(struct flight_dump *dump)
+{
+	char *dir = os_get_config_path_ptr("obs-studio/logs");
+	if (!dir) {
+		return;
+	}
+	os_mkdirs(dir);
+
+	// Source and output names are free text, flatten them into one file name
+	struct dstr format = {};
+	dstr_printf(&format, "moq-flight %s %s %%CCYY-%%MM-%%DD %%hh-%%mm-%%ss", dump->kind.c_str(),
+		    dump->name.c_str());
+	for (size_t i = 0; i < format.len; i++) {
+		if (strchr("/\\:*?\"<>|", format.array[i])) {
+			format.array[i] = '_';
+		}
+	}
+	char *file_name = os_generate_formatted_filename("txt", true, format.array);
+	struct dstr path = {};
+	dstr_printf(&path, "%s/%s", dir, file_name);
+	bfree(file_name);
+	dstr_free(&format);
+	bfree(dir);
+
+	FILE *file = os_fopen(path.array, "wb");
+	if (!file) {
+		LOG_ERROR("Failed to create flight recorder dump: %s", path.array);
+		dstr_free(&path);
+		return;
+	}
+
+	fprintf(file, "# MoQ %s '%s': %s\n", dump->kind.c_str(), dump->name.c_str(), dump->reason.c_str());
+	fprintf(file, "# %zu events, time_ms relative to the dump\n", dump->events.size());
+	fprintf(file, "time_ms\tevent\tcode\tsize\ttimestamp_us\tduration_us\tkeyframe\n");
+	for (const flight_event &event : dump->events) {
+		bool known = event.type < sizeof(flight_event_names) / sizeof(flight_event_names[0]);
+		fprintf(file, "%.3f\t%s\t%d\t%llu\t%llu\t%.1f\t%d\n",
+			((double)event.time_ns - (double)dump->now_ns) / 1000000.0,
+			known ? flight_event_names[event.type] : "?", event.code, (unsigned long long)event.size,
+			(unsigned long long)event.timestamp_us, event.duration_ns / 1000.0, event.keyframe ? 1 : 0);
+	}
+
+	if (fclose(file) == 0) {
+		LOG_WARNING("%s, wrote the last %zu frame events to %s", dump->reason.c_str(), dump->events.size(),
+			    path.array);
+	} else {
+		LOG_ERROR("Failed to write flight recorder dump: %s", path.array);
+	}
+	dstr_free(&path);
+}
+
+static void moq_flight_write_dump(void *, void *item)
+{
+	struct flight_dump *dump = (struct flight_dump *)item;
+	moq_flight_write(dump);
+	delete dump;
+}
+
+// A queue of one dump, closed as soon as it is queued: it only lends the dump a thread
+static const struct moq_io_callbacks moq_flight_io = {
+	NULL,
+	moq_flight_write_dump,
+	NULL,
+};
+
+bool moq_flight_dump(struct moq_flight_recorder *fr, const char *name, const char *reason)
+{
+	if (!fr) {
+		return false;
+	}
+
+	uint64_t now_ns = os_gettime_ns();
+	uint64_t last_ns = fr->last_dump_ns.load(std::memory_order_relaxed);
+	if ((last_ns && now_ns - last_ns < MOQ_FLIGHT_DUMP_INTERVAL_NS) ||
+	    !fr->last_dump_ns.compare_exchange_strong(last_ns, now_ns, std::memory_order_relaxed)) {
+		return false;
+	}
+
+	// Copied here, while the recorder is known to be alive; the file is written on a thread of its own
+	struct flight_dump *dump = new flight_dump();
+	dump->kind = fr->kind;
+	dump->name = name ? name : "";
+	dump->reason = reason;
+	dump->now_ns = now_ns;
+	moq_flight_snapshot(fr, dump->events);
+
+	struct moq_io_queue *queue = moq_io_queue_create("moq-flight", &moq_flight_io, NULL, 0);
+	moq_io_queue_push(queue, dump, 0);
+	moq_io_queue_close(queue);
+	return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Always-on record of the last few thousand frame events of one MoQ Source or MoQ Output, written to
+// the OBS log directory when something goes wrong (decode errors piling up, a session closing), so an
+// incident in the field comes with the frames that led up to it. Recording is lock-free and
+// allocation-free from any number of threads; the oldest events are overwritten.
+#define MOQ_FLIGHT_EVENTS 4096
+
+enum moq_flight_event_type {
+	MOQ_FLIGHT_RECEIVE, // Frame arrived: its first chunk's size
+	MOQ_FLIGHT_DECODE,  // code: what the decoder returned
+	MOQ_FLIGHT_OUTPUT,  // Picture handed to OBS or the sync group
+	MOQ_FLIGHT_DROP,    // code: the reason, as get_stats counts it
+	MOQ_FLIGHT_VIDEO,   // Video packet published, code: moq_publish_media_frame's result
+	MOQ_FLIGHT_AUDIO,   // Audio packet published, likewise
+	MOQ_FLIGHT_TRACK,   // Track subscribed or created, code: its handle or error
+	MOQ_FLIGHT_SESSION, // code: session status, 0 = connected
+	MOQ_FLIGHT_CONNECT, // Connection (re)started, code: generation or attempt number
+};
+
+struct moq_flight_recorder;
+
+// kind ("source", "output") goes into the dump's header and file name
+struct moq_flight_recorder *moq_flight_create(const char *kind);
+void moq_flight_destroy(struct moq_flight_recorder *fr);
+
+// Adds an event at the current time. duration_ns is 0 for events that aren't timed.
+void moq_flight_record(struct moq_flight_recorder *fr, enum moq_flight_event_type type, int32_t code, uint64_t size,
+		       uint64_t timestamp_us, uint64_t duration_ns, bool keyframe);
+
+// Copies the events and writes them to "moq-flight <kind> <name> <date>.txt" in the OBS log directory
+// on a thread of its own, so the caller never waits on the disk. reason says what went wrong. Dumps
+// closer than 30 s to the previous one are skipped, so an error repeating every frame writes one file.
+// Returns true if a dump was started.
+bool moq_flight_dump(struct moq_flight_recorder *fr, const char *name, const char *reason);
@@ -0,0 +1,167 @@
+#include <obs-module.h>
+#include <util/platform.h>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#include "frame-converter.h"
+#include "worker-pool.h"
+#include "trace.h"
+
+// Slices smaller than this cost more to hand off than they save (~4 slices at 1080p)
+#define MOQ_MIN_SLICE_ROWS 240
+
+// Per-frame state shared with the worker pool while a frame is converted
+struct convert_job {
+	struct moq_frame_converter *converter;
+	const AVFrame *frame;
+	struct moq_yuv_coeffs coeffs;
+	uint8_t *dst;
+	int dst_linesize;
+	uint64_t *slice_ns;
+	const void *trace_id;
+	uint64_t timestamp_us;
+};
+
+// Rows each plane is shifted by relative to luma (chroma planes of subsampled YUV formats)
+static int plane_row_shift(const AVPixFmtDescriptor *desc, int plane)
+{
+	bool chroma_plane = (plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+	return chroma_plane ? desc->log2_chroma_h : 0;
+}
+
+bool moq_frame_converter_init(struct moq_frame_converter *converter, int width, int height, int out_width,
+			      int out_height, enum AVPixelFormat pix_fmt)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+	if (!desc) {
+		return false;
+	}
+
+	if (out_width != width || out_height != height) {
+		// Scaling mixes neighbouring rows, so slices can't be scaled on their own. Only thumbnails
+		// are scaled, at one frame per group, so a single swscale pass is fine.
+		converter->sws_ctx[0] = sws_getContext(width, height, pix_fmt, out_width, out_height, AV_PIX_FMT_RGBA,
+						       SWS_BILINEAR, NULL, NULL, NULL);
+		if (!converter->sws_ctx[0]) {
+			return false;
+		}
+		converter->convert = NULL;
+		converter->slice_count = 1;
+		converter->slice_rows = height;
+		return true;
+	}
+
+	// Enough slices to keep the shared pool busy, each starting on a chroma row.
+	// Palette formats keep their palette in plane 1 and can't be sliced.
+	int slice_count = height / MOQ_MIN_SLICE_ROWS;
+	int max_slices = moq_worker_pool_concurrency();
+	if (max_slices > MOQ_MAX_SLICES) {
+		max_slices = MOQ_MAX_SLICES;
+	}
+	if (slice_count > max_slices) {
+		slice_count = max_slices;
+	}
+	if (slice_count < 1 || (desc->flags & AV_PIX_FMT_FLAG_PAL)) {
+		slice_count = 1;
+	}
+	int row_align = 1 << desc->log2_chroma_h;
+	int slice_rows = (height + slice_count - 1) / slice_count;
+	slice_rows = (slice_rows + row_align - 1) & ~(row_align - 1);
+	slice_count = (height + slice_rows - 1) / slice_rows;
+
+	// Prefer a hand-vectorised kernel for the common 4:2:0 formats; swscale handles the rest
+	converter->convert = moq_convert_find(pix_fmt);
+	if (!converter->convert) {
+		// Each slice gets a scaler that treats the slice as a complete picture,
+		// so slices can be converted concurrently and in any order
+		for (int i = 0; i < slice_count; i++) {
+			int rows = height - i * slice_rows < slice_rows ? height - i * slice_rows : slice_rows;
+			converter->sws_ctx[i] = sws_getContext(width, rows, pix_fmt, width, rows, AV_PIX_FMT_RGBA,
+							       SWS_BILINEAR, NULL, NULL, NULL);
+			if (!converter->sws_ctx[i]) {
+				moq_frame_converter_free(converter);
+				return false;
+			}
+		}
+	}
+
+	converter->slice_count = slice_count;
+	converter->slice_rows = slice_rows;
+	return true;
+}
+
+void moq_frame_converter_free(struct moq_frame_converter *converter)
+{
+	for (int i = 0; i < MOQ_MAX_SLICES; i++) {
+		if (converter->sws_ctx[i]) {
+			sws_freeContext(converter->sws_ctx[i]);
+			converter->sws_ctx[i] = NULL;
+		}
+	}
+	converter->convert = NULL;
+	converter->slice_count = 0;
+	converter->slice_rows = 0;
+}
+
+// Worker pool callback: converts one horizontal slice of job->frame into job->dst
+static void convert_slice(void *param, int slice, int slice_count)
+{
+	UNUSED_PARAMETER(slice_count);
+
+	struct convert_job *job = (struct convert_job *)param;
+	struct moq_frame_converter *converter = job->converter;
+	const AVFrame *frame = job->frame;
+	uint64_t start = job->slice_ns ? os_gettime_ns() : 0;
+	uint64_t trace_start = moq_trace_begin();
+
+	int row_begin = slice * converter->slice_rows;
+	int row_end = row_begin + converter->slice_rows < frame->height ? row_begin + converter->slice_rows
+									: frame->height;
+
+	if (converter->convert) {
+		converter->convert(frame->data, frame->linesize, job->dst, job->dst_linesize, frame->width, row_begin,
+				   row_end, &job->coeffs);
+	} else {
+		const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+		const uint8_t *src_data[4] = {NULL, NULL, NULL, NULL};
+		for (int plane = 0; plane < 4; plane++) {
+			if (frame->data[plane]) {
+				int row = row_begin >> plane_row_shift(desc, plane);
+				src_data[plane] = frame->data[plane] + (ptrdiff_t)row * frame->linesize[plane];
+			}
+		}
+		uint8_t *dst_data[4] = {job->dst + (ptrdiff_t)row_begin * job->dst_linesize, NULL, NULL, NULL};
+		int dst_linesizes[4] = {job->dst_linesize, 0, 0, 0};
+
+		sws_scale(converter->sws_ctx[slice], src_data, frame->linesize, 0, row_end - row_begin, dst_data,
+			  dst_linesizes);
+	}
+
+	if (job->slice_ns) {
+		job->slice_ns[slice] = os_gettime_ns() - start;
+	}
+	moq_trace_end("convert", "slice", trace_start, job->trace_id, job->timestamp_us);
+}
+
+void moq_frame_converter_run(struct moq_frame_converter *converter, const AVFrame *frame, uint8_t *dst,
+			     int dst_linesize, uint64_t slice_ns[MOQ_MAX_SLICES], const void *trace_id,
+			     uint64_t timestamp_us)
+{
+	struct convert_job job = {};
+	job.converter = converter;
+	job.frame = frame;
+	job.dst = dst;
+	job.dst_linesize = dst_linesize;
+	job.slice_ns = slice_ns;
+	job.trace_id = trace_id;
+	job.timestamp_us = timestamp_us;
+	if (converter->convert) {
+		// Colour matrix and range can change per frame, and deriving the coefficients is cheap
+		moq_yuv_coeffs_init(&job.coeffs, (enum AVPixelFormat)frame->format, frame->colorspace,
+				    frame->color_range);
+	}
+
+	moq_worker_pool_run(convert_slice, &job, converter->slice_count);
+}
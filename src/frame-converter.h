@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include "color-convert.h"
+
+// Upper bound on conversion slices per frame
+#define MOQ_MAX_SLICES 16
+
+// Converts decoded frames to packed RGBA for OBS. Frames are split into horizontal slices run
+// across the shared worker pool, with a SIMD kernel for the common 4:2:0 formats and one swscale
+// context per slice for the rest. Scaling (thumbnails) is done in a single swscale pass.
+struct moq_frame_converter {
+	struct SwsContext *sws_ctx[MOQ_MAX_SLICES]; // One scaler per slice, unused with a SIMD kernel
+	moq_convert_func convert;                    // SIMD kernel, NULL = use sws_ctx
+	int slice_count;                             // 0 until initialized
+	int slice_rows;                              // Rows per slice (the last one may be shorter)
+};
+
+// Picks the slice layout and creates the converters for width x height frames of pix_fmt,
+// scaled to out_width x out_height. NOTE: The converter must be freed (or zeroed) beforehand
+bool moq_frame_converter_init(struct moq_frame_converter *converter, int width, int height, int out_width,
+			      int out_height, enum AVPixelFormat pix_fmt);
+
+// Frees the converters, leaving slice_count at 0
+void moq_frame_converter_free(struct moq_frame_converter *converter);
+
+// Converts frame into dst, which holds out_height rows of dst_linesize bytes. Returns once every
+// slice is done; slice_ns, if not NULL, receives the time each slice took. Slices are traced with
+// trace_id and timestamp_us, the same as the other trace slices of the frame (see trace.h).
+void moq_frame_converter_run(struct moq_frame_converter *converter, const AVFrame *frame, uint8_t *dst,
+			     int dst_linesize, uint64_t slice_ns[MOQ_MAX_SLICES], const void *trace_id,
+			     uint64_t timestamp_us);
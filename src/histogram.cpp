@@ -0,0 +1,98 @@
+#include <math.h>
+
+#include <string>
+
+#include "histogram.h"
+
+static int moq_histogram_index(uint64_t value)
+{
+	if (value < MOQ_HISTOGRAM_SUB_BUCKETS) {
+		return (int)value;
+	}
+	if (value >> 32) {
+		return MOQ_HISTOGRAM_BUCKETS - 1;
+	}
+
+	// Position of the highest set bit, at least 3 here
+	int msb = 3;
+	while (value >> (msb + 1)) {
+		msb++;
+	}
+	return (msb - 2) * MOQ_HISTOGRAM_SUB_BUCKETS + (int)((value >> (msb - 3)) & (MOQ_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+// Middle of the values a bucket holds
+static uint64_t moq_histogram_value(int index)
+{
+	if (index < MOQ_HISTOGRAM_SUB_BUCKETS) {
+		return (uint64_t)index;
+	}
+	int shift = index / MOQ_HISTOGRAM_SUB_BUCKETS - 1;
+	uint64_t low = (uint64_t)(MOQ_HISTOGRAM_SUB_BUCKETS + index % MOQ_HISTOGRAM_SUB_BUCKETS) << shift;
+	return low + ((1ULL << shift) >> 1);
+}
+
+void moq_histogram_reset(struct moq_histogram *hist)
+{
+	for (int i = 0; i < MOQ_HISTOGRAM_BUCKETS; i++) {
+		hist->buckets[i].store(0, std::memory_order_relaxed);
+	}
+	hist->count.store(0, std::memory_order_relaxed);
+	hist->sum.store(0, std::memory_order_relaxed);
+	hist->max.store(0, std::memory_order_relaxed);
+}
+
+void moq_histogram_record(struct moq_histogram *hist, uint64_t value)
+{
+	hist->buckets[moq_histogram_index(value)].fetch_add(1, std::memory_order_relaxed);
+	hist->count.fetch_add(1, std::memory_order_relaxed);
+	hist->sum.fetch_add(value, std::memory_order_relaxed);
+	uint64_t max = hist->max.load(std::memory_order_relaxed);
+	while (value > max && !hist->max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+	}
+}
+
+uint64_t moq_histogram_percentile(const struct moq_histogram *hist, double fraction)
+{
+	// Counted from the buckets themselves, which a concurrent record may have updated before count
+	uint64_t counts[MOQ_HISTOGRAM_BUCKETS];
+	uint64_t total = 0;
+	for (int i = 0; i < MOQ_HISTOGRAM_BUCKETS; i++) {
+		counts[i] = hist->buckets[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+	if (!total) {
+		return 0;
+	}
+
+	uint64_t rank = (uint64_t)ceil(fraction * (double)total);
+	if (rank < 1) {
+		rank = 1;
+	}
+	uint64_t max = hist->max.load(std::memory_order_relaxed);
+	uint64_t seen = 0;
+	for (int i = 0; i < MOQ_HISTOGRAM_BUCKETS; i++) {
+		seen += counts[i];
+		if (seen >= rank && i < MOQ_HISTOGRAM_BUCKETS - 1) {
+			uint64_t value = moq_histogram_value(i);
+			return value < max ? value : max;
+		}
+	}
+	return max;
+}
+
+void moq_histogram_to_data(const struct moq_histogram *hist, obs_data_t *data, const char *name, double scale)
+{
+	uint64_t count = hist->count.load(std::memory_order_relaxed);
+	if (!count) {
+		return;
+	}
+
+	std::string key(name);
+	obs_data_set_double(data, (key + "_p50").c_str(), moq_histogram_percentile(hist, 0.50) * scale);
+	obs_data_set_double(data, (key + "_p95").c_str(), moq_histogram_percentile(hist, 0.95) * scale);
+	obs_data_set_double(data, (key + "_p99").c_str(), moq_histogram_percentile(hist, 0.99) * scale);
+	obs_data_set_double(data, (key + "_max").c_str(), hist->max.load(std::memory_order_relaxed) * scale);
+	obs_data_set_double(data, (key + "_mean").c_str(),
+			    (double)hist->sum.load(std::memory_order_relaxed) / (double)count * scale);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <obs-module.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// Lock-free distribution of a non-negative measurement (durations in microseconds, sizes, ...), for
+// stats polled while the frame path keeps recording. Buckets are log-linear: exact below 8, then 8 per
+// power of two, so a percentile is within 1/8 of the true value. Values of 2^32 and above share the
+// last bucket.
+#define MOQ_HISTOGRAM_SUB_BUCKETS 8
+#define MOQ_HISTOGRAM_BUCKETS (30 * MOQ_HISTOGRAM_SUB_BUCKETS)
+
+struct moq_histogram {
+	std::atomic<uint64_t> buckets[MOQ_HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+};
+
+// Empties the histogram. Samples recorded concurrently may be kept or lost.
+void moq_histogram_reset(struct moq_histogram *hist);
+
+// Safe from any number of threads at once
+void moq_histogram_record(struct moq_histogram *hist, uint64_t value);
+
+// Value below which the given fraction (0 to 1) of samples fall, or 0 if there are none
+uint64_t moq_histogram_percentile(const struct moq_histogram *hist, double fraction);
+
+// Sets "<name>_p50", "_p95", "_p99", "_max" and "_mean" in data, each value multiplied by scale
+// (e.g. 0.001 for microseconds reported as milliseconds). Sets nothing if there are no samples.
+void moq_histogram_to_data(const struct moq_histogram *hist, obs_data_t *data, const char *name, double scale);
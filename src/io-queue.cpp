@@ -0,0 +1,117 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "io-queue.h"
+
+// Queue threads still running, closed ones included, so unloading can wait for the last of them
+static std::mutex threads_mutex;
+static std::condition_variable threads_cond;
+static size_t thread_count;
+
+struct queued_item {
+	void *item;
+	size_t size;
+};
+
+struct moq_io_queue {
+	std::string thread_name;
+	const struct moq_io_callbacks *callbacks;
+	void *opaque;
+	size_t max_queued;
+
+	// Guarded by mutex
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<queued_item> items;
+	size_t queued;
+	bool closing;
+};
+
+static void moq_io_queue_thread(struct moq_io_queue *queue)
+{
+	os_set_thread_name(queue->thread_name.c_str());
+
+	if (queue->callbacks->start) {
+		queue->callbacks->start(queue->opaque);
+	}
+
+	std::unique_lock<std::mutex> lock(queue->mutex);
+	for (;;) {
+		queue->cond.wait(lock, [queue] { return queue->closing || !queue->items.empty(); });
+		if (queue->items.empty()) {
+			break; // Closing, and everything has been written
+		}
+		queued_item next = queue->items.front();
+		queue->items.pop_front();
+		queue->queued -= next.size;
+		lock.unlock();
+
+		queue->callbacks->write(queue->opaque, next.item);
+
+		lock.lock();
+	}
+	lock.unlock();
+
+	// moq_io_queue_close has already returned, the queue is this thread's alone now
+	if (queue->callbacks->finish) {
+		queue->callbacks->finish(queue->opaque);
+	}
+	delete queue;
+
+	std::lock_guard<std::mutex> threads_lock(threads_mutex);
+	thread_count--;
+	threads_cond.notify_all();
+}
+
+struct moq_io_queue *moq_io_queue_create(const char *thread_name, const struct moq_io_callbacks *callbacks,
+					 void *opaque, size_t max_queued)
+{
+	struct moq_io_queue *queue = new moq_io_queue();
+	queue->thread_name = thread_name;
+	queue->callbacks = callbacks;
+	queue->opaque = opaque;
+	queue->max_queued = max_queued;
+	queue->queued = 0;
+	queue->closing = false;
+
+	{
+		std::lock_guard<std::mutex> threads_lock(threads_mutex);
+		thread_count++;
+	}
+	// Never joined: the thread frees the queue once it has been closed and drained
+	std::thread(moq_io_queue_thread, queue).detach();
+	return queue;
+}
+
+bool moq_io_queue_push(struct moq_io_queue *queue, void *item, size_t size)
+{
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->queued + size > queue->max_queued) {
+		return false;
+	}
+	queue->items.push_back({item, size});
+	queue->queued += size;
+	queue->cond.notify_one();
+	return true;
+}
+
+void moq_io_queue_close(struct moq_io_queue *queue)
+{
+	// Notified under the lock: once it is released the thread may free the queue at any moment
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	queue->closing = true;
+	queue->cond.notify_one();
+}
+
+void moq_io_queue_shutdown(void)
+{
+	std::unique_lock<std::mutex> lock(threads_mutex);
+	threads_cond.wait(lock, [] { return thread_count == 0; });
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+
+// Disk I/O off the threads that must not wait for it. Each queue has a thread of its own that takes
+// items in order and hands them to the owner's callbacks; the producer only ever waits for the
+// queue's lock. Closing returns at once: the thread writes what is still queued, finishes and frees
+// itself, so a recording or capture can be stopped from a libmoq callback.
+struct moq_io_queue;
+
+// Run on the queue's thread, with opaque as given to moq_io_queue_create
+struct moq_io_callbacks {
+	void (*start)(void *opaque);             // First, before any item. May be NULL.
+	void (*write)(void *opaque, void *item); // Each item in turn; it's the callback's to free
+	void (*finish)(void *opaque);            // Last, after the final item; frees opaque if it should. May be NULL.
+};
+
+// Starts a queue holding at most max_queued, in the unit moq_io_queue_push counts items in.
+// thread_name names the thread. callbacks must outlive the queue.
+struct moq_io_queue *moq_io_queue_create(const char *thread_name, const struct moq_io_callbacks *callbacks,
+					 void *opaque, size_t max_queued);
+
+// Queues item, which counts as size against max_queued. Returns false, leaving item to the caller, if
+// it doesn't fit.
+bool moq_io_queue_push(struct moq_io_queue *queue, void *item, size_t size);
+
+// Returns at once; the thread writes what is still queued, calls finish and frees queue
+void moq_io_queue_close(struct moq_io_queue *queue);
+
+// Waits for every closed queue's thread to finish, before the module is unloaded
+void moq_io_queue_shutdown(void);
@@ -0,0 +1,71 @@
+#include <obs-module.h>
+#include <string.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "moq.h"
+}
+
+#include "loopback.h"
+#include "logger.h"
+
+struct loopback_origin {
+	std::string name;
+	int32_t origin;
+	uint32_t refs;
+};
+
+static std::mutex loopback_mutex;
+static std::vector<loopback_origin> loopback_origins;
+
+const char *moq_loopback_name(const char *url)
+{
+	size_t scheme_len = strlen(MOQ_LOOPBACK_SCHEME);
+	if (!url || strncmp(url, MOQ_LOOPBACK_SCHEME, scheme_len) != 0) {
+		return NULL;
+	}
+	return url + scheme_len;
+}
+
+int32_t moq_loopback_acquire(const char *name)
+{
+	std::lock_guard<std::mutex> lock(loopback_mutex);
+	for (loopback_origin &entry : loopback_origins) {
+		if (entry.name == name) {
+			entry.refs++;
+			return entry.origin;
+		}
+	}
+
+	int32_t origin = moq_origin_create();
+	if (origin < 0) {
+		LOG_ERROR("Failed to create loopback origin '%s': %d", name, origin);
+		return origin;
+	}
+	loopback_origins.push_back({name, origin, 1});
+	LOG_INFO("Loopback origin '%s' created", name);
+	return origin;
+}
+
+void moq_loopback_release(int32_t origin)
+{
+	{
+		std::lock_guard<std::mutex> lock(loopback_mutex);
+		for (size_t i = 0; i < loopback_origins.size(); i++) {
+			loopback_origin &entry = loopback_origins[i];
+			if (entry.origin != origin) {
+				continue;
+			}
+			if (--entry.refs > 0) {
+				return;
+			}
+			LOG_INFO("Loopback origin '%s' closed", entry.name.c_str());
+			loopback_origins.erase(loopback_origins.begin() + i);
+			break;
+		}
+	}
+	moq_origin_close(origin);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// Named MoQ origins shared within the process. MoQ Output publishes into one and MoQ Source consumes
+// from it directly, with no network session in between: a zero-network confidence monitor, and the
+// cheapest way to exercise publish -> decode on one machine. Either side selects one with a URL of
+// the form "loopback://<name>".
+#define MOQ_LOOPBACK_SCHEME "loopback://"
+
+// Origin name in a loopback URL, or NULL if url isn't one
+const char *moq_loopback_name(const char *url);
+
+// Origin registered under name, created on first use. Every successful call must be matched by a
+// moq_loopback_release. Returns a negative libmoq error if the origin can't be created.
+int32_t moq_loopback_acquire(const char *name);
+
+// Drops one reference to a loopback origin, closing it with the last one. Any other origin is
+// closed outright, so callers can release every origin they hold the same way.
+void moq_loopback_release(int32_t origin);
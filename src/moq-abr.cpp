@@ -0,0 +1,199 @@
+#include "moq-abr.h"
+
+// Length of one throughput/bitrate measurement
+#define MOQ_ABR_WINDOW_NS 1000000000ULL
+// Minimum time between two switches, so a new rendition gets measured before being judged
+#define MOQ_ABR_MIN_INTERVAL_NS 4000000000ULL
+// Queue delay above which we step down, and below which the link counts as idle
+#define MOQ_ABR_BEHIND_US 500000
+#define MOQ_ABR_IDLE_US 100000
+// The lag floor creeps up by this much per second, so clock drift between publisher and subscriber
+// doesn't build up into queue delay
+#define MOQ_ABR_FLOOR_RISE_US_PER_S 1000
+// Share of the measured throughput a rendition may use after a downswitch
+#define MOQ_ABR_SAFETY 0.8
+#define MOQ_ABR_PROBE_HOLD_NS 10000000000ULL
+#define MOQ_ABR_PROBE_HOLD_MAX_NS 120000000000ULL
+
+static uint64_t rendition_pixels(const struct moq_rendition *rendition)
+{
+	return (uint64_t)rendition->width * rendition->height;
+}
+
+// Tallest height worth playing: the smallest rendition that still fills max_height
+static uint32_t display_cap(const struct moq_rendition *renditions, size_t count, uint32_t max_height)
+{
+	uint32_t cap = 0;
+	bool fills = false;
+	for (size_t i = 0; i < count; i++) {
+		uint32_t height = renditions[i].height;
+		if (max_height && height >= max_height) {
+			if (!fills || height < cap) {
+				cap = height;
+			}
+			fills = true;
+		} else if (!fills && height > cap) {
+			cap = height;
+		}
+	}
+	return cap;
+}
+
+void moq_abr_reset(struct moq_abr *abr, uint64_t now_ns)
+{
+	*abr = {};
+	abr->last_switch_ns = now_ns;
+	abr->probe_target = -1;
+	abr->backoff_rendition = -1;
+}
+
+void moq_abr_on_frame(struct moq_abr *abr, size_t bytes, uint64_t timestamp_us, uint64_t arrival_ns)
+{
+	// Publisher and local clocks have an unknown offset, so only lag relative to the best seen means anything
+	int64_t lag_us = (int64_t)(arrival_ns / 1000) - (int64_t)timestamp_us;
+	if (abr->has_lag_floor && arrival_ns > abr->lag_floor_updated_ns) {
+		abr->lag_floor_us += (int64_t)((arrival_ns - abr->lag_floor_updated_ns) / 1000 *
+					       MOQ_ABR_FLOOR_RISE_US_PER_S / 1000000);
+	}
+	if (!abr->has_lag_floor || lag_us < abr->lag_floor_us) {
+		abr->lag_floor_us = lag_us;
+		abr->has_lag_floor = true;
+	}
+	if (arrival_ns > abr->lag_floor_updated_ns) {
+		abr->lag_floor_updated_ns = arrival_ns;
+	}
+	abr->queue_delay_us = lag_us - abr->lag_floor_us;
+
+	if (!abr->window_bytes) {
+		abr->window_start_ns = arrival_ns;
+		abr->window_start_ts_us = timestamp_us;
+	}
+	abr->window_bytes += bytes;
+	if (timestamp_us > abr->window_last_ts_us) {
+		abr->window_last_ts_us = timestamp_us;
+	}
+
+	uint64_t wall_ns = arrival_ns - abr->window_start_ns;
+	if (wall_ns < MOQ_ABR_WINDOW_NS) {
+		return;
+	}
+
+	double bits = (double)abr->window_bytes * 8.0;
+	double throughput = bits * 1e9 / (double)wall_ns;
+	abr->throughput_bps = abr->throughput_bps > 0 ? abr->throughput_bps * 0.7 + throughput * 0.3 : throughput;
+
+	if (abr->window_last_ts_us > abr->window_start_ts_us) {
+		double bitrate = bits * 1e6 / (double)(abr->window_last_ts_us - abr->window_start_ts_us);
+		abr->bitrate_bps = abr->bitrate_bps > 0 ? abr->bitrate_bps * 0.7 + bitrate * 0.3 : bitrate;
+	}
+
+	abr->window_bytes = 0;
+	abr->window_last_ts_us = 0;
+}
+
+int moq_abr_initial(const struct moq_rendition *renditions, size_t count, uint32_t max_height)
+{
+	uint32_t cap = display_cap(renditions, count, max_height);
+
+	int best = -1;
+	for (size_t i = 0; i < count; i++) {
+		if (renditions[i].height > cap) {
+			continue;
+		}
+		if (best < 0 || rendition_pixels(&renditions[i]) > rendition_pixels(&renditions[best])) {
+			best = (int)i;
+		}
+	}
+	return best < 0 ? 0 : best;
+}
+
+int moq_abr_select(struct moq_abr *abr, const struct moq_rendition *renditions, size_t count, int current,
+		   uint32_t max_height, uint64_t now_ns)
+{
+	if (count < 2 || current < 0 || (size_t)current >= count) {
+		return current;
+	}
+
+	uint64_t since_switch = now_ns - abr->last_switch_ns;
+	if (since_switch < MOQ_ABR_MIN_INTERVAL_NS) {
+		return current;
+	}
+
+	uint32_t cap = display_cap(renditions, count, max_height);
+	uint64_t current_pixels = rendition_pixels(&renditions[current]);
+	int next = current;
+
+	// A probe that stayed up for a full hold period has succeeded
+	if (abr->probe_target == current && since_switch >= MOQ_ABR_PROBE_HOLD_NS) {
+		abr->probe_target = -1;
+		if (abr->backoff_rendition == current) {
+			abr->backoff_rendition = -1;
+		}
+	}
+
+	if (abr->queue_delay_us > MOQ_ABR_BEHIND_US && abr->bitrate_bps > 0) {
+		// Falling behind: largest lower rendition whose estimated bitrate fits, else the smallest one
+		double budget = abr->throughput_bps * MOQ_ABR_SAFETY;
+		int smallest = current;
+		for (size_t i = 0; i < count; i++) {
+			uint64_t pixels = rendition_pixels(&renditions[i]);
+			if (pixels < rendition_pixels(&renditions[smallest])) {
+				smallest = (int)i;
+			}
+			if (pixels >= current_pixels) {
+				continue;
+			}
+			double estimate = abr->bitrate_bps * (double)pixels / (double)current_pixels;
+			if (estimate <= budget && (next == current || pixels > rendition_pixels(&renditions[next]))) {
+				next = (int)i;
+			}
+		}
+		if (next == current) {
+			next = smallest;
+		}
+
+		// The probe up to this rendition didn't hold, so wait longer before trying it again
+		if (next != current && abr->probe_target == current) {
+			if (abr->backoff_rendition == current) {
+				abr->backoff_ns *= 2;
+				if (abr->backoff_ns > MOQ_ABR_PROBE_HOLD_MAX_NS) {
+					abr->backoff_ns = MOQ_ABR_PROBE_HOLD_MAX_NS;
+				}
+			} else {
+				abr->backoff_rendition = current;
+				abr->backoff_ns = MOQ_ABR_PROBE_HOLD_NS * 2;
+			}
+		}
+	} else if (renditions[current].height > cap) {
+		// Bigger than the canvas needs, e.g. after the canvas was resized
+		next = moq_abr_initial(renditions, count, max_height);
+	} else if (abr->queue_delay_us < MOQ_ABR_IDLE_US) {
+		// Probe one step up
+		int up = current;
+		for (size_t i = 0; i < count; i++) {
+			uint64_t pixels = rendition_pixels(&renditions[i]);
+			if (pixels <= current_pixels || renditions[i].height > cap) {
+				continue;
+			}
+			if (up == current || pixels < rendition_pixels(&renditions[up])) {
+				up = (int)i;
+			}
+		}
+
+		uint64_t hold = up == abr->backoff_rendition ? abr->backoff_ns : MOQ_ABR_PROBE_HOLD_NS;
+		if (up != current && since_switch >= hold) {
+			next = up;
+		}
+	}
+
+	if (next != current) {
+		abr->probe_target = rendition_pixels(&renditions[next]) > current_pixels ? next : -1;
+		abr->last_switch_ns = now_ns;
+
+		// The bitrate measured so far belongs to the old rendition
+		abr->bitrate_bps = 0;
+		abr->window_bytes = 0;
+		abr->window_last_ts_us = 0;
+	}
+	return next;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One video track from the catalog
+struct moq_rendition {
+	char name[64];
+	char codec[32];
+	uint32_t width;
+	uint32_t height;
+	size_t description_size;   // Decoder extradata, compared by size and hash across catalog updates
+	uint64_t description_hash;
+};
+
+// Adaptive rendition selection for MoQ Source, evaluated at group boundaries.
+//
+// The catalog carries no bitrates, so each rendition's cost is estimated from the measured
+// bitrate of the one playing, scaled by pixel count. Two signals drive switches:
+//   - queue delay: how much later than the fastest delivery seen frames are arriving.
+//     A growing queue means the network can't keep up, and the measured delivery
+//     throughput then tells which rendition would fit.
+//   - stability: after a quiet period the next rendition up is probed. A probe that
+//     has to be undone doubles the wait before that rendition is tried again.
+// Renditions taller than needed to fill the canvas are never chosen.
+struct moq_abr {
+	uint64_t window_start_ns;    // Arrival time of the first frame in the measurement window
+	uint64_t window_start_ts_us; // Media timestamp of that frame
+	uint64_t window_last_ts_us;  // Latest media timestamp in the window
+	uint64_t window_bytes;
+	double bitrate_bps;    // Media bitrate of the playing rendition
+	double throughput_bps; // Delivery rate over wall-clock time
+
+	int64_t lag_floor_us; // Smallest arrival-minus-media offset seen, rising slowly since
+	bool has_lag_floor;
+	uint64_t lag_floor_updated_ns;
+	int64_t queue_delay_us; // Lag of the latest frame above the floor
+
+	uint64_t last_switch_ns;
+	int probe_target;      // Rendition being probed up to, -1 = none
+	int backoff_rendition; // Rendition whose last probe failed, -1 = none
+	uint64_t backoff_ns;   // Stable time required before probing it again
+};
+
+void moq_abr_reset(struct moq_abr *abr, uint64_t now_ns);
+
+// Feeds one received frame of the playing rendition
+void moq_abr_on_frame(struct moq_abr *abr, size_t bytes, uint64_t timestamp_us, uint64_t arrival_ns);
+
+// First rendition to play, before anything has been measured: the smallest one that fills
+// max_height (0 = unknown), or the largest one if none does.
+int moq_abr_initial(const struct moq_rendition *renditions, size_t count, uint32_t max_height);
+
+// Rendition to play next; returns current when no switch is warranted
+int moq_abr_select(struct moq_abr *abr, const struct moq_rendition *renditions, size_t count, int current,
+		   uint32_t max_height, uint64_t now_ns);
@@ -1,24 +1,55 @@
 #include <obs.hpp>
 
+#include <algorithm>
+#include <random>
+
 #include "moq-output.h"
+#include "bwtest.h"
+#include "flight-recorder.h"
+#include "loopback.h"
+#include "trace.h"
+#include "wallclock.h"
 #include "util/util_uint64.h"
+#include "util/platform.h"
 
 extern "C" {
 #include "moq.h"
 }
 
+// Period over which the send rate is measured
+#define MOQ_OUTPUT_RATE_WINDOW_NS 1000000000ULL
+// The send latency floor creeps up by this much per second, to follow encoder setting changes while
+// queueing that lasts minutes still shows
+#define MOQ_OUTPUT_FLOOR_RISE_NS_PER_S 1000000ULL
+// Queueing delay reported as full congestion
+#define MOQ_OUTPUT_CONGESTED_US 1000000ULL
+
 MoQOutput::MoQOutput(obs_data_t *, obs_output_t *output)
 	: output(output),
 	  server_url(),
 	  path(),
-	  total_bytes_sent(0),
 	  connect_time_ms(0),
+	  send_rate_bps(0),
+	  send_rate_updated_ns(0),
+	  rate_window_start_ns(0),
+	  rate_window_bytes(0),
+	  sessions(0),
+	  session_errors(0),
+	  session_up(false),
 	  origin(moq_origin_create()),
 	  broadcast(moq_publish_create()),
 	  session(0),
+	  loopback_origin(0),
 	  video(0),
-	  audio(0)
+	  audio(0),
+	  video_wallclock(false),
+	  video_hevc(false),
+	  flight(moq_flight_create("output")),
+	  bwtest(NULL),
+	  bwtest_ended(false)
 {
+	moq_histogram_reset(&video_stats.send_latency_us);
+	moq_histogram_reset(&audio_stats.send_latency_us);
 }
 
 MoQOutput::~MoQOutput()
@@ -27,6 +58,8 @@ MoQOutput::~MoQOutput()
 	moq_origin_close(origin);
 
 	Stop();
+	moq_bwtest_destroy(bwtest);
+	moq_flight_destroy(flight);
 }
 
 bool MoQOutput::Start()
@@ -55,8 +88,6 @@ bool MoQOutput::Start()
 		return false;
 	}
 
-	path = obs_service_get_connect_info(service, OBS_SERVICE_CONNECT_INFO_STREAM_KEY);
-
 	const obs_encoder_t *encoder = obs_output_get_video_encoder2(output, 0);
 
 	if (!encoder) {
@@ -64,6 +95,60 @@ bool MoQOutput::Start()
 		return false;
 	}
 
+	std::string broadcast_path = obs_service_get_connect_info(service, OBS_SERVICE_CONNECT_INFO_STREAM_KEY);
+	OBSDataAutoRelease service_settings = obs_service_get_settings(service);
+	bool bandwidth_test = obs_data_get_bool(service_settings, "bwtest");
+	if (bandwidth_test) {
+		// Under the stream key, which the relay authorizes, with a name nobody is watching.
+		// libmoq announces every broadcast it publishes, so this is as hidden as it gets.
+		std::random_device random;
+		char name[32];
+		snprintf(name, sizeof(name), "/bwtest-%08x%08x", random(), random());
+		broadcast_path += name;
+	}
+
+	if (!Connect(server_url, broadcast_path)) {
+		return false;
+	}
+
+	moq_bwtest_destroy(bwtest);
+	bwtest = bandwidth_test ? moq_bwtest_create(server_url.c_str(), path.c_str()) : NULL;
+	bwtest_ended = false;
+
+	obs_output_begin_data_capture(output, 0);
+
+	return true;
+}
+
+bool MoQOutput::Connect(const std::string &url, const std::string &broadcast_path)
+{
+	server_url = url;
+	path = broadcast_path;
+	uint32_t attempt = sessions.fetch_add(1, std::memory_order_relaxed) + 1;
+	moq_flight_record(flight, MOQ_FLIGHT_CONNECT, (int32_t)attempt, 0, 0, 0, false);
+
+	// A loopback URL publishes into an origin shared with MoQ Sources in this process, without a session
+	const char *loopback = moq_loopback_name(server_url.c_str());
+	if (loopback) {
+		loopback_origin = moq_loopback_acquire(loopback);
+		if (loopback_origin < 0) {
+			loopback_origin = 0;
+			return false;
+		}
+		connect_time_ms = 0;
+		session_up = true;
+
+		LOG_INFO("Publishing broadcast to loopback origin '%s': %s", loopback, path.c_str());
+		auto result = moq_origin_publish(loopback_origin, path.data(), path.size(), broadcast);
+		if (result < 0) {
+			LOG_ERROR("Failed to publish broadcast to loopback origin: %d", result);
+			moq_loopback_release(loopback_origin);
+			loopback_origin = 0;
+			return false;
+		}
+		return true;
+	}
+
 	LOG_INFO("Connecting to MoQ server: %s", server_url.c_str());
 
 	connect_start = std::chrono::steady_clock::now();
@@ -72,13 +157,18 @@ bool MoQOutput::Start()
 	auto session_connect_callback = [](void *user_data, int error_code) {
 		auto self = static_cast<MoQOutput *>(user_data);
 
+		moq_flight_record(self->flight, MOQ_FLIGHT_SESSION, error_code, 0, 0, 0, false);
 		if (error_code == 0) {
 			auto elapsed = std::chrono::steady_clock::now() - self->connect_start;
 			self->connect_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
-			LOG_INFO("MoQ session established (%d ms): %s", self->connect_time_ms,
+			self->session_up = true;
+			LOG_INFO("MoQ session established (%d ms): %s", self->connect_time_ms.load(),
 				 self->server_url.c_str());
 		} else {
+			self->session_up = false;
+			self->session_errors.fetch_add(1, std::memory_order_relaxed);
 			LOG_INFO("MoQ session closed (%d): %s", error_code, self->server_url.c_str());
+			self->DumpFlight("MoQ session closed");
 		}
 	};
 
@@ -100,19 +190,25 @@ bool MoQOutput::Start()
 		return false;
 	}
 
-	obs_output_begin_data_capture(output, 0);
-
 	return true;
 }
 
 void MoQOutput::Stop(bool signal)
 {
+	session_up = false;
+	moq_bwtest_stop(bwtest);
+
 	// Close the session
 	if (session > 0) {
 		moq_session_close(session);
 		session = 0;
 	}
 
+	if (loopback_origin > 0) {
+		moq_loopback_release(loopback_origin);
+		loopback_origin = 0;
+	}
+
 	if (video > 0) {
 		moq_publish_media_close(video);
 		video = 0;
@@ -123,7 +219,7 @@ void MoQOutput::Stop(bool signal)
 		audio = 0;
 	}
 
-	if (signal) {
+	if (signal && output) {
 		obs_output_signal_stop(output, OBS_OUTPUT_SUCCESS);
 	}
 
@@ -133,16 +229,32 @@ void MoQOutput::Stop(bool signal)
 void MoQOutput::Data(struct encoder_packet *packet)
 {
 	if (!packet) {
+		DumpFlight("Encoder error");
 		Stop(false);
 		obs_output_signal_stop(output, OBS_OUTPUT_ENCODE_ERROR);
 		return;
 	}
 
+	// A bandwidth test stops the output once it has its result, or can't get one
+	if (bwtest && !bwtest_ended && moq_bwtest_get_state(bwtest) != MOQ_BWTEST_RUNNING) {
+		bwtest_ended = true;
+		bool done = moq_bwtest_get_state(bwtest) == MOQ_BWTEST_DONE;
+		Stop(false);
+		if (output) {
+			obs_output_signal_stop(output, done ? OBS_OUTPUT_SUCCESS : OBS_OUTPUT_CONNECT_FAILED);
+		}
+	}
+	if (bwtest_ended) {
+		return;
+	}
+
+	uint64_t trace_start = moq_trace_begin();
 	if (packet->type == OBS_ENCODER_AUDIO) {
 		AudioData(packet);
 	} else if (packet->type == OBS_ENCODER_VIDEO) {
 		VideoData(packet);
 	}
+	moq_trace_end("output", "data", trace_start, this, 0);
 }
 
 void MoQOutput::AudioData(struct encoder_packet *packet)
@@ -153,18 +265,25 @@ void MoQOutput::AudioData(struct encoder_packet *packet)
 
 	if (audio < 0) {
 		// We failed to initialize the audio track, so we can't write any data.
+		audio_stats.dropped.fetch_add(1, std::memory_order_relaxed);
 		return;
 	}
 
 	auto pts = util_mul_div64(packet->pts, 1000000ULL * packet->timebase_num, packet->timebase_den);
 
+	uint64_t publish_start = os_gettime_ns();
+	uint64_t trace_start = moq_trace_begin();
 	auto result = moq_publish_media_frame(audio, packet->data, packet->size, pts);
+	moq_trace_end("output", "publish audio", trace_start, this, pts);
+	moq_flight_record(flight, MOQ_FLIGHT_AUDIO, result, packet->size, pts, os_gettime_ns() - publish_start, false);
 	if (result < 0) {
 		LOG_ERROR("Failed to write audio frame: %d", result);
+		DumpFlight("Failed to write audio frame");
+		audio_stats.dropped.fetch_add(1, std::memory_order_relaxed);
 		return;
 	}
 
-	total_bytes_sent += packet->size;
+	RecordSent(audio_stats, packet->size, packet->sys_dts_usec);
 }
 
 void MoQOutput::VideoData(struct encoder_packet *packet)
@@ -174,18 +293,162 @@ void MoQOutput::VideoData(struct encoder_packet *packet)
 	}
 
 	if (video < 0) {
+		video_stats.dropped.fetch_add(1, std::memory_order_relaxed);
 		return;
 	}
 
 	auto pts = util_mul_div64(packet->pts, 1000000ULL * packet->timebase_num, packet->timebase_den);
 
-	auto result = moq_publish_media_frame(video, packet->data, packet->size, pts);
+	const uint8_t *data = packet->data;
+	size_t size = packet->size;
+	if (video_wallclock && packet->keyframe) {
+		// sys_dts_usec is when the frame was captured on the os_gettime_ns clock; the wallclock then
+		// is now minus the time since. B-frames are shown pts - dts after their dts.
+		int64_t age_us = (int64_t)(os_gettime_ns() / 1000) - packet->sys_dts_usec;
+		int64_t reorder_us = (packet->pts - packet->dts) * 1000000LL * packet->timebase_num /
+				     packet->timebase_den;
+		struct moq_wallclock_ref ref;
+		ref.timestamp_us = pts;
+		ref.wallclock_us = moq_wallclock_now_us() - age_us + reorder_us;
+
+		video_buffer.resize(packet->size + MOQ_WALLCLOCK_SEI_MAX_SIZE);
+		size_t stamped =
+			moq_wallclock_insert(video_hevc, packet->data, packet->size, &ref, video_buffer.data());
+		if (stamped > 0) {
+			data = video_buffer.data();
+			size = stamped;
+		}
+	}
+
+	if (bwtest) {
+		// Filler NAL units that bring the track up to the rate the test is at; decoders skip them
+		size_t filler = moq_bwtest_next_frame(bwtest, size, pts);
+		if (filler > 0) {
+			bwtest_buffer.resize(size + filler);
+			memcpy(bwtest_buffer.data(), data, size);
+			moq_bwtest_write_filler(video_hevc, filler, bwtest_buffer.data() + size);
+			data = bwtest_buffer.data();
+			size += filler;
+		}
+	}
+
+	uint64_t publish_start = os_gettime_ns();
+	uint64_t trace_start = moq_trace_begin();
+	auto result = moq_publish_media_frame(video, data, size, pts);
+	moq_trace_end("output", "publish video", trace_start, this, pts);
+	moq_flight_record(flight, MOQ_FLIGHT_VIDEO, result, size, pts, os_gettime_ns() - publish_start,
+			  packet->keyframe);
 	if (result < 0) {
 		LOG_ERROR("Failed to write video frame: %d", result);
+		DumpFlight("Failed to write video frame");
+		video_stats.dropped.fetch_add(1, std::memory_order_relaxed);
 		return;
 	}
 
-	total_bytes_sent += packet->size;
+	RecordSent(video_stats, size, packet->sys_dts_usec);
+}
+
+void MoQOutput::RecordSent(TrackStats &track, size_t size, int64_t sys_dts_usec)
+{
+	track.bytes.fetch_add(size, std::memory_order_relaxed);
+	track.frames.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t now_ns = os_gettime_ns();
+	int64_t latency = (int64_t)(now_ns / 1000) - sys_dts_usec;
+	uint64_t latency_us = latency > 0 ? (uint64_t)latency : 0;
+	moq_histogram_record(&track.send_latency_us, latency_us);
+
+	// The floor is the encoder's own latency; what is above it waited in a queue on the way to libmoq
+	uint64_t latency_ns = latency_us * 1000;
+	if (track.latency_floor_updated_ns) {
+		track.latency_floor_ns += (now_ns - track.latency_floor_updated_ns) * MOQ_OUTPUT_FLOOR_RISE_NS_PER_S /
+					  1000000000ULL;
+	}
+	if (!track.latency_floor_updated_ns || latency_ns < track.latency_floor_ns) {
+		track.latency_floor_ns = latency_ns;
+	}
+	track.latency_floor_updated_ns = now_ns;
+	uint64_t delay = (latency_ns - track.latency_floor_ns) / 1000;
+	uint64_t old = track.queue_delay_us.load(std::memory_order_relaxed);
+	track.queue_delay_us.store(old - old / 8 + delay / 8, std::memory_order_relaxed);
+
+	if (!rate_window_start_ns) {
+		rate_window_start_ns = now_ns;
+	}
+	rate_window_bytes += size;
+	uint64_t elapsed_ns = now_ns - rate_window_start_ns;
+	if (elapsed_ns >= MOQ_OUTPUT_RATE_WINDOW_NS) {
+		send_rate_bps.store(rate_window_bytes * 8 * 1000000000ULL / elapsed_ns, std::memory_order_relaxed);
+		send_rate_updated_ns.store(now_ns, std::memory_order_relaxed);
+		rate_window_start_ns = now_ns;
+		rate_window_bytes = 0;
+	}
+}
+
+void MoQOutput::DumpFlight(const char *reason)
+{
+	moq_flight_dump(flight, output ? obs_output_get_name(output) : path.c_str(), reason);
+}
+
+float MoQOutput::GetCongestion()
+{
+	if (!session_up.load(std::memory_order_relaxed)) {
+		return 0.0f;
+	}
+	uint64_t delay = std::max(video_stats.queue_delay_us.load(std::memory_order_relaxed),
+				  audio_stats.queue_delay_us.load(std::memory_order_relaxed));
+	return delay >= MOQ_OUTPUT_CONGESTED_US ? 1.0f : (float)delay / MOQ_OUTPUT_CONGESTED_US;
+}
+
+void MoQOutput::GetStats(obs_data_t *stats)
+{
+	obs_data_set_bool(stats, "connected", session_up.load(std::memory_order_relaxed));
+	obs_data_set_int(stats, "connect_time_ms", connect_time_ms.load(std::memory_order_relaxed));
+	uint32_t count = sessions.load(std::memory_order_relaxed);
+	obs_data_set_int(stats, "reconnects", count > 1 ? count - 1 : 0);
+	obs_data_set_int(stats, "session_errors", session_errors.load(std::memory_order_relaxed));
+
+	obs_data_set_int(stats, "bytes_sent", (long long)GetTotalBytes());
+	obs_data_set_int(stats, "dropped_frames", GetDroppedFrames());
+	// A stalled output stops closing windows, so an old rate is stale rather than current
+	uint64_t updated_ns = send_rate_updated_ns.load(std::memory_order_relaxed);
+	bool rate_current = updated_ns && os_gettime_ns() - updated_ns < 3 * MOQ_OUTPUT_RATE_WINDOW_NS;
+	obs_data_set_double(stats, "send_kbps",
+			    rate_current ? send_rate_bps.load(std::memory_order_relaxed) / 1000.0 : 0.0);
+	obs_data_set_double(stats, "congestion", GetCongestion());
+
+	const char *names[] = {"video", "audio"};
+	const TrackStats *tracks[] = {&video_stats, &audio_stats};
+	for (int i = 0; i < 2; i++) {
+		obs_data_t *track = obs_data_create();
+		obs_data_set_int(track, "bytes", (long long)tracks[i]->bytes.load(std::memory_order_relaxed));
+		obs_data_set_int(track, "frames", (long long)tracks[i]->frames.load(std::memory_order_relaxed));
+		obs_data_set_int(track, "dropped", (long long)tracks[i]->dropped.load(std::memory_order_relaxed));
+		moq_histogram_to_data(&tracks[i]->send_latency_us, track, "send_latency_ms", 0.001);
+		obs_data_set_double(track, "queue_delay_ms",
+				    tracks[i]->queue_delay_us.load(std::memory_order_relaxed) / 1000.0);
+		obs_data_set_obj(stats, names[i], track);
+		obs_data_release(track);
+	}
+
+	if (bwtest) {
+		obs_data_t *test = obs_data_create();
+		moq_bwtest_get_stats(bwtest, test);
+		obs_data_set_obj(stats, "bwtest", test);
+		obs_data_release(test);
+	}
+}
+
+void MoQOutput::ResetStats()
+{
+	for (TrackStats *track : {&video_stats, &audio_stats}) {
+		track->bytes.store(0, std::memory_order_relaxed);
+		track->frames.store(0, std::memory_order_relaxed);
+		track->dropped.store(0, std::memory_order_relaxed);
+		moq_histogram_reset(&track->send_latency_us);
+	}
+	sessions.store(session_up.load(std::memory_order_relaxed) ? 1 : 0, std::memory_order_relaxed);
+	session_errors.store(0, std::memory_order_relaxed);
 }
 
 void MoQOutput::VideoInit()
@@ -218,26 +481,7 @@ void MoQOutput::VideoInit()
 		LOG_WARNING("Failed to get extra data");
 	}
 
-	const char *codec = obs_encoder_get_codec(encoder);
-
-	// Transform codec string for MoQ
-	const char *moq_codec = codec;
-	if (strcmp(codec, "h264") == 0) {
-		// H.264 with inline SPS/PPS
-		moq_codec = "avc3";
-	} else if (strcmp(codec, "hevc") == 0) {
-		// H.265 with inline VPS/SPS/PPS
-		moq_codec = "hev1";
-	}
-
-	// Intialize the media import module with the codec and initialization data.
-	video = moq_publish_media_ordered(broadcast, moq_codec, strlen(moq_codec), extra_data, extra_size);
-	if (video < 0) {
-		LOG_ERROR("Failed to initialize video track: %d", video);
-		return;
-	}
-
-	LOG_INFO("Video track initialized successfully");
+	InitTrack(OBS_ENCODER_VIDEO, obs_encoder_get_codec(encoder), extra_data, extra_size);
 }
 
 void MoQOutput::AudioInit()
@@ -268,15 +512,46 @@ void MoQOutput::AudioInit()
 		LOG_WARNING("Failed to get extra data");
 	}
 
-	const char *codec = obs_encoder_get_codec(encoder);
+	InitTrack(OBS_ENCODER_AUDIO, obs_encoder_get_codec(encoder), extra_data, extra_size);
+}
 
-	audio = moq_publish_media_ordered(broadcast, codec, strlen(codec), extra_data, extra_size);
-	if (audio < 0) {
-		LOG_ERROR("Failed to initialize audio track: %d", audio);
-		return;
+bool MoQOutput::InitTrack(enum obs_encoder_type type, const char *codec, const uint8_t *extra_data,
+			  size_t extra_size)
+{
+	if (type == OBS_ENCODER_AUDIO) {
+		audio = moq_publish_media_ordered(broadcast, codec, strlen(codec), extra_data, extra_size);
+		moq_flight_record(flight, MOQ_FLIGHT_TRACK, audio, extra_size, 0, 0, false);
+		if (audio < 0) {
+			LOG_ERROR("Failed to initialize audio track: %d", audio);
+			return false;
+		}
+
+		LOG_INFO("Audio track initialized successfully");
+		return true;
+	}
+
+	// Transform codec string for MoQ
+	const char *moq_codec = codec;
+	if (strcmp(codec, "h264") == 0) {
+		// H.264 with inline SPS/PPS
+		moq_codec = "avc3";
+	} else if (strcmp(codec, "hevc") == 0) {
+		// H.265 with inline VPS/SPS/PPS
+		moq_codec = "hev1";
 	}
+	video_hevc = strcmp(codec, "hevc") == 0;
+	video_wallclock = video_hevc || strcmp(codec, "h264") == 0;
 
-	LOG_INFO("Audio track initialized successfully");
+	// Intialize the media import module with the codec and initialization data.
+	video = moq_publish_media_ordered(broadcast, moq_codec, strlen(moq_codec), extra_data, extra_size);
+	moq_flight_record(flight, MOQ_FLIGHT_TRACK, video, extra_size, 0, 0, false);
+	if (video < 0) {
+		LOG_ERROR("Failed to initialize video track: %d", video);
+		return false;
+	}
+
+	LOG_INFO("Video track initialized successfully");
+	return true;
 }
 
 void register_moq_output()
@@ -294,7 +569,23 @@ void register_moq_output()
 		return "MoQ Output";
 	};
 	info.create = [](obs_data_t *settings, obs_output_t *output) -> void * {
-		return new MoQOutput(settings, output);
+		auto moq = new MoQOutput(settings, output);
+
+		proc_handler_t *ph = obs_output_get_proc_handler(output);
+		proc_handler_add(
+			ph, "void get_stats(out string json)",
+			[](void *data, calldata_t *cd) {
+				obs_data_t *stats = obs_data_create();
+				static_cast<MoQOutput *>(data)->GetStats(stats);
+				calldata_set_string(cd, "json", obs_data_get_json(stats));
+				obs_data_release(stats);
+			},
+			moq);
+		proc_handler_add(
+			ph, "void reset_stats()",
+			[](void *data, calldata_t *) { static_cast<MoQOutput *>(data)->ResetStats(); }, moq);
+		moq_trace_add_procs(ph);
+		return moq;
 	};
 	info.destroy = [](void *priv_data) {
 		delete static_cast<MoQOutput *>(priv_data);
@@ -314,6 +605,12 @@ void register_moq_output()
 	info.get_connect_time_ms = [](void *priv_data) -> int {
 		return static_cast<MoQOutput *>(priv_data)->GetConnectTime();
 	};
+	info.get_dropped_frames = [](void *priv_data) -> int {
+		return static_cast<MoQOutput *>(priv_data)->GetDroppedFrames();
+	};
+	info.get_congestion = [](void *priv_data) -> float {
+		return static_cast<MoQOutput *>(priv_data)->GetCongestion();
+	};
 	info.encoded_video_codecs = video_codecs;
 	info.encoded_audio_codecs = audio_codecs;
 	info.protocols = "MoQ";
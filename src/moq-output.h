@@ -1,8 +1,11 @@
 #pragma once
 #include <obs-module.h>
 
+#include <atomic>
 #include <chrono>
 #include <string>
+#include <vector>
+#include "histogram.h"
 #include "logger.h"
 
 class MoQOutput
@@ -15,36 +18,107 @@ class MoQOutput
     void Stop(bool signal = true);
     void Data(struct encoder_packet *packet);
 
-    inline size_t GetTotalBytes()
+    // Publishes the broadcast at path to url (or a loopback origin). Start does this with the service's
+    // settings; calling it directly, along with InitTrack, lets captured packets be replayed into Data
+    // without a service or encoders (see bench/publish-bench.cpp).
+    bool Connect(const std::string &url, const std::string &broadcast_path);
+
+    // Creates the track for packets of type from the encoder's codec name ("h264", "aac", ...) and
+    // initialization data. Data does this on the first packet, from the output's encoders.
+    bool InitTrack(enum obs_encoder_type type, const char *codec, const uint8_t *extra_data, size_t extra_size);
+
+    inline uint64_t GetTotalBytes()
     {
-        return total_bytes_sent;
+        return video_stats.bytes.load(std::memory_order_relaxed) + audio_stats.bytes.load(std::memory_order_relaxed);
     }
 
     inline int GetConnectTime()
     {
-        return connect_time_ms;
+        return connect_time_ms.load(std::memory_order_relaxed);
+    }
+
+    inline int GetDroppedFrames()
+    {
+        return (int)(video_stats.dropped.load(std::memory_order_relaxed) +
+                     audio_stats.dropped.load(std::memory_order_relaxed));
     }
 
+    // 0 to 1, from how far the send latency of either track has risen above its floor. That is
+    // queueing between the encoder and libmoq, which only builds up once sends fall behind; libmoq
+    // reports nothing about the network itself.
+    float GetCongestion();
+
+    // Adds the statistics reported by the "get_stats" procedure to stats
+    void GetStats(obs_data_t *stats);
+
+    // Zeroes the per-track totals, the send latency distribution and the session counts
+    void ResetStats();
+
       private:
+    // Written by the output thread, read by the UI and get_stats at any time
+    struct TrackStats {
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> dropped{0}; // Not published: no track, or libmoq refused them
+
+        // Packet capture (sys_dts_usec) to its hand-off to libmoq
+        struct moq_histogram send_latency_us;
+
+        // Send latency above the floor (the encoder's own), averaged with 1/8 weight. The floor is
+        // the lowest send latency seen, rising slowly since; it is only used by the output thread.
+        std::atomic<uint64_t> queue_delay_us{0};
+        uint64_t latency_floor_ns = 0;
+        uint64_t latency_floor_updated_ns = 0;
+    };
+
     void VideoInit();
     void VideoData(struct encoder_packet *packet);
     void AudioInit();
     void AudioData(struct encoder_packet *packet);
+    void RecordSent(TrackStats &track, size_t size, int64_t sys_dts_usec);
+    void DumpFlight(const char *reason);
 
     obs_output_t *output;
 
     std::string server_url;
     std::string path;
 
-    size_t total_bytes_sent;
-    int connect_time_ms;
+    std::atomic<int> connect_time_ms;
     std::chrono::steady_clock::time_point connect_start;
 
+    TrackStats video_stats;
+    TrackStats audio_stats;
+
+    // Over the last complete one-second window; the window itself belongs to the output thread
+    std::atomic<uint64_t> send_rate_bps;
+    std::atomic<uint64_t> send_rate_updated_ns;
+    uint64_t rate_window_start_ns;
+    uint64_t rate_window_bytes;
+
+    std::atomic<uint32_t> sessions;       // Connect calls, so restarts after the first are reconnects
+    std::atomic<uint32_t> session_errors; // Sessions libmoq closed with an error
+    std::atomic<bool> session_up;
+
     int origin;
     int session;
     int broadcast;
+    int loopback_origin; // Shared in-process origin published into instead of a session, 0 = none
     int video;
     int audio;
+
+    // Keyframes carry a wallclock reference (see wallclock.h) when the codec allows it
+    bool video_wallclock;
+    bool video_hevc;
+    std::vector<uint8_t> video_buffer;
+
+    // Recent packet and session events, written to the log directory when publishing fails
+    struct moq_flight_recorder *flight;
+
+    // Set while the service's "bwtest" setting is on: pads video and measures what comes back
+    // (see bwtest.h). Kept after the test ends, for get_stats.
+    struct moq_bwtest *bwtest;
+    bool bwtest_ended;
+    std::vector<uint8_t> bwtest_buffer;
 };
 
 void register_moq_output();
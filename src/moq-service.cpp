@@ -1,10 +1,19 @@
+#include <string.h>
+
 #include "moq-service.h"
 
 // TODO: Define supported codecs.
 const char *audio_codecs[] = {"aac", "opus", nullptr};
 const char *video_codecs[] = {"h264", "hevc", nullptr};
 
-MoQService::MoQService(obs_data_t *settings, obs_service_t *) : server(), path()
+static const MoQLatencyProfile latency_profiles[] = {
+	{"ultra_low", "Ultra-low (1 s groups, 250 ms buffer, zerolatency tune)", 1, 250, "zerolatency"},
+	{"low", "Low (2 s groups, 1 s buffer, zerolatency tune)", 2, 1000, "zerolatency"},
+	{"balanced", "Balanced (2 s groups, 2 s buffer, tune unchanged)", 2, 2000, NULL},
+};
+#define MOQ_DEFAULT_LATENCY_PROFILE "low"
+
+MoQService::MoQService(obs_data_t *settings, obs_service_t *) : server(), path(), bwtest(false), latency_profile()
 {
 	Update(settings);
 }
@@ -13,6 +22,27 @@ void MoQService::Update(obs_data_t *settings)
 {
 	server = obs_data_get_string(settings, "server");
 	path = obs_data_get_string(settings, "key");
+	bwtest = obs_data_get_bool(settings, "bwtest");
+	latency_profile = GetLatencyProfile(obs_data_get_string(settings, "latency_profile"))->name;
+}
+
+void MoQService::Defaults(obs_data_t *settings)
+{
+	obs_data_set_default_string(settings, "latency_profile", MOQ_DEFAULT_LATENCY_PROFILE);
+}
+
+const MoQLatencyProfile *MoQService::GetLatencyProfile(const char *name)
+{
+	const MoQLatencyProfile *fallback = NULL;
+	for (const MoQLatencyProfile &profile : latency_profiles) {
+		if (name && strcmp(profile.name, name) == 0) {
+			return &profile;
+		}
+		if (strcmp(profile.name, MOQ_DEFAULT_LATENCY_PROFILE) == 0) {
+			fallback = &profile;
+		}
+	}
+	return fallback;
 }
 
 obs_properties_t *MoQService::Properties()
@@ -23,6 +53,13 @@ obs_properties_t *MoQService::Properties()
 	// obs_property_t *obs_properties_add_text(obs_properties_t *props, const char *name, const char *desc, enum obs_text_type type)
 	obs_properties_add_text(ppts, "server", "URL", OBS_TEXT_DEFAULT);
 	obs_properties_add_text(ppts, "key", "Path", OBS_TEXT_DEFAULT);
+	obs_properties_add_bool(ppts, "bwtest", "Bandwidth test (measure, don't go live)");
+
+	obs_property_t *profile = obs_properties_add_list(ppts, "latency_profile", "Latency", OBS_COMBO_TYPE_LIST,
+							  OBS_COMBO_FORMAT_STRING);
+	for (const MoQLatencyProfile &entry : latency_profiles) {
+		obs_property_list_add_string(profile, entry.description, entry.name);
+	}
 
 	return ppts;
 }
@@ -36,10 +73,26 @@ void MoQService::ApplyEncoderSettings(obs_data_t *video_settings, obs_data_t *au
      if the front-end optionally calls.
      */
 
-	// Example:
+	// These are x264's setting names. keyint_sec and bf mean the same to most other encoders (FFmpeg,
+	// NVENC, QSV, AMF); settings an encoder doesn't have are ignored. Audio encoders only take a bitrate.
+	const MoQLatencyProfile *profile = GetLatencyProfile(latency_profile.c_str());
 	if (video_settings) {
+		// No B-frames whatever the profile: MoQ frames carry one timestamp, and the receive path
+		// (decoding, recording, restreaming) takes it as both presentation and decode time
 		obs_data_set_int(video_settings, "bf", 0);
 		obs_data_set_bool(video_settings, "repeat_headers", true);
+		obs_data_set_int(video_settings, "keyint_sec", profile->keyint_sec);
+
+		long long bitrate = obs_data_get_int(video_settings, "bitrate");
+		if (bitrate > 0) {
+			obs_data_set_bool(video_settings, "use_bufsize", true);
+			obs_data_set_int(video_settings, "buffer_size", bitrate * profile->buffer_ms / 1000);
+		}
+
+		// Only x264 has "x264opts"; hardware encoders have a "tune" of their own with other values
+		if (profile->x264_tune && obs_data_has_default_value(video_settings, "x264opts")) {
+			obs_data_set_string(video_settings, "tune", profile->x264_tune);
+		}
 	}
 
 	if (audio_settings) {
@@ -81,6 +134,9 @@ void register_moq_service()
 	info.update = [](void *priv_data, obs_data_t *settings) {
 		static_cast<MoQService *>(priv_data)->Update(settings);
 	};
+	info.get_defaults = [](obs_data_t *settings) {
+		MoQService::Defaults(settings);
+	};
 	info.get_properties = [](void *) -> obs_properties_t * {
 		return MoQService::Properties();
 	};
@@ -93,8 +149,8 @@ void register_moq_service()
 	info.get_output_type = [](void *) -> const char * {
 		return "moq_output";
 	};
-	info.apply_encoder_settings = [](void *, obs_data_t *video_settings, obs_data_t *audio_settings) {
-		MoQService::ApplyEncoderSettings(video_settings, audio_settings);
+	info.apply_encoder_settings = [](void *priv_data, obs_data_t *video_settings, obs_data_t *audio_settings) {
+		static_cast<MoQService *>(priv_data)->ApplyEncoderSettings(video_settings, audio_settings);
 	};
 	info.get_supported_video_codecs = [](void *) -> const char ** {
 		return video_codecs;
@@ -2,18 +2,34 @@
 #include <string>
 #include <obs-module.h>
 
+// One end-to-end latency target: the encoder settings that get there
+struct MoQLatencyProfile {
+    const char *name;        // Value of the "latency_profile" setting
+    const char *description; // Shown in the service's properties
+    int keyint_sec;          // Keyframe interval, which is also the MoQ group duration
+    int buffer_ms;           // Rate control buffer, as time at the encoder's bitrate
+    const char *x264_tune;   // NULL leaves the tune alone
+};
+
 struct MoQService {
     // TODO: Define needed params to connect to a relay
     std::string server;
     std::string path;
+    bool bwtest; // Measure the connection instead of going live, see bwtest.h
+    std::string latency_profile;
 
     MoQService(obs_data_t *settings, obs_service_t *service);
 
     void Update(obs_data_t *settings);
+    static void Defaults(obs_data_t *settings);
     static obs_properties_t *Properties();
-    static void ApplyEncoderSettings(obs_data_t *video_settings, obs_data_t *audio_settings);
+    void ApplyEncoderSettings(obs_data_t *video_settings, obs_data_t *audio_settings);
     bool CanTryToConnect();
     const char *GetConnectInfo(enum obs_service_connect_info type);
+
+    // Profile by setting value; the default one for an empty or unknown name, so service.json
+    // files written before profiles existed keep working
+    static const MoQLatencyProfile *GetLatencyProfile(const char *name);
 };
 
 void register_moq_service();
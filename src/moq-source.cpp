@@ -10,13 +10,53 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/pixdesc.h>
-#include <libswscale/swscale.h>
 #include "moq.h"
 }
 
 #include "moq-source.h"
+#include "moq-abr.h"
+#include "capture.h"
+#include "color-convert.h"
+#include "decoder-cache.h"
+#include "flight-recorder.h"
+#include "frame-converter.h"
+#include "histogram.h"
+#include "loopback.h"
+#include "packet-builder.h"
+#include "recorder.h"
+#include "restream.h"
+#include "sync-group.h"
+#include "wallclock.h"
+#include "timeshift.h"
+#include "trace.h"
+#include "worker-pool.h"
 #include "logger.h"
 
+// Upper bound on video renditions read from one catalog
+#define MOQ_MAX_RENDITIONS 8
+// A pending rendition that hasn't delivered a usable keyframe by then is dropped
+#define MOQ_SWITCH_TIMEOUT_NS 10000000000ULL
+// Output height in keyframes-only mode, enough for a multiview tile
+#define MOQ_THUMBNAIL_HEIGHT 360
+// Upper bound on the recording directory plus file name prefix
+#define MOQ_RECORD_PATH_MAX 512
+// Period over which the received bitrate and frame rates are measured
+#define MOQ_RATE_WINDOW_NS 1000000000ULL
+// How long a closed track's subscription token is kept, in case libmoq still calls back for it
+#define MOQ_SUBSCRIPTION_GRACE_NS 10000000000ULL
+
+// Why a frame of the active track wasn't shown, counted for get_stats
+enum moq_drop_reason {
+	MOQ_DROP_KEYFRAME_WAIT, // Decoder had no keyframe to start from
+	MOQ_DROP_ASSEMBLY,      // Chunks couldn't be gathered into a packet
+	MOQ_DROP_DECODE_ERROR,  // Decoder rejected the packet or returned an error
+	MOQ_DROP_SUPERSEDED,    // Pipeline was replaced while the frame was being decoded
+	MOQ_DROP_COUNT,
+};
+
+static const char *moq_drop_reason_names[MOQ_DROP_COUNT] = {"keyframe_wait", "assembly", "decode_error",
+                                                            "superseded"};
+
 // Map codec string from moq_video_config to FFmpeg codec ID
 static AVCodecID codec_string_to_id(const char *codec, size_t len)
 {
@@ -58,40 +98,235 @@ static AVCodecID codec_string_to_id(const char *codec, size_t len)
 	return AV_CODEC_ID_NONE;
 }
 
-struct moq_source {
-	obs_source_t *source;
+// Copies a catalog string, which may not be null-terminated, truncating it to fit
+static void moq_source_copy_string(char *dst, size_t dst_size, const char *src, size_t len)
+{
+	size_t copy_len = len < dst_size - 1 ? len : dst_size - 1;
+	memset(dst, 0, dst_size);
+	if (src && copy_len > 0) {
+		memcpy(dst, src, copy_len);
+	}
+}
 
-	// Settings - current active connection settings
-	char *url;
-	char *broadcast;
+// FNV-1a, used to tell whether a track's decoder extradata changed
+static uint64_t moq_source_hash(const uint8_t *data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
 
-	// Shutdown flag - set when destroy begins, callbacks should exit early
-	std::atomic<bool> shutting_down;
+// User data of one video track subscription. Frame callbacks only go on while it is still the
+// subscription of its slot in the published state; a late callback from a closed track is dropped
+// instead of reaching the pipeline that replaced it on the same slot.
+struct moq_subscription {
+	struct moq_source *ctx;
+	int slot;
+	uint64_t closed_ns; // When it left the published state, 0 = current. Guarded by ctx->mutex.
+};
 
-	// Session handles (all negative = invalid)
-	std::atomic<uint32_t> generation;  // Increments on reconnect
-	bool reconnect_in_progress;    // True while reconnect is happening
-	int32_t origin;
-	int32_t session;
-	int32_t consume;
-	int32_t catalog_handle;
-	int32_t video_track;
+// Decoder, converters and output frame for one subscribed video track.
+// Only that track's frame callbacks use it, so nothing in here is locked.
+struct moq_pipeline {
+	// Held by the frame callback using the pipeline, so frames of one track delivered on two
+	// threads don't decode at once
+	std::atomic<bool> busy;
 
 	// Decoder state
 	AVCodecContext *codec_ctx;
-	AVCodecID current_codec_id;            // Currently configured codec
-	enum AVPixelFormat current_pix_fmt;    // Current pixel format for sws_ctx
-	struct SwsContext *sws_ctx;
+	struct moq_decoder_key decoder_key;    // Identifies codec_ctx in the decoder cache
+	enum AVPixelFormat current_pix_fmt;    // Current pixel format for converter
+	struct moq_frame_converter converter;  // Decoded frames to frame_buffer, for current_pix_fmt
 	bool got_keyframe;
 	uint32_t frames_waiting_for_keyframe;  // Count of skipped frames while waiting
+	uint64_t keyframe_wait_start_ns;       // Arrival of the first frame skipped
 	uint32_t consecutive_decode_errors;    // Count of consecutive decode failures
 
+	// Compressed input - packet reused across frames, payload gathered into pooled padded buffers
+	AVPacket *packet;
+	struct moq_packet_builder packet_builder;
+
 	// Output frame buffer
 	struct obs_source_frame frame;
 	uint8_t *frame_buffer;
 
-	// Threading
+	// Rendition selection, run at group boundaries while this pipeline is the active one
+	struct moq_abr abr;
+	uint32_t abr_catalog_serial;           // Catalog the rendition indices in abr refer to
+
+	// Keyframes-only mode as applied to codec_ctx, and the decoded size the output is scaled from
+	bool thumbnail;
+	int decoded_width;
+	int decoded_height;
+
+	// Recently received frames, and playback from them while behind live
+	struct moq_timeshift timeshift;
+	int timeshift_mb;                  // Size timeshift was created with
+	bool timeshift_active;             // Output comes from timeshift instead of the live frame
+	bool timeshift_paused;
+	uint64_t timeshift_next_seq;       // Next timeshift frame to decode
+	int64_t timeshift_offset_us;       // Live timestamp minus playback timestamp
+	uint64_t timeshift_position_us;    // Timestamp of the last timeshift frame shown
+	uint64_t timeshift_skip_until_us;  // After a seek, earlier frames are decoded but not shown
+
+	// Passthrough recording of the received frames, and whether they are decoded at all
+	struct moq_recorder *recorder;
+	uint32_t record_serial;            // moq_state.record_serial recorder was started for
+	bool decode;
+
+	// Catalog codec name without its parameters, the track format for restreaming
+	char restream_format[8];
+
+	// Publisher wallclock reference from the latest keyframe that had one
+	bool has_wallclock;
+	struct moq_wallclock_ref wallclock;
+
+	// Received and output frames in the current rate window, while this pipeline is the active one
+	uint64_t rate_window_start_ns;
+	uint64_t rate_window_bytes;
+	uint32_t rate_window_frames;
+	uint32_t rate_window_output;
+};
+
+// Connection state seen by callbacks. A published state is never modified: writers copy it under
+// ctx->mutex, change the copy and swap the pointer. Frame callbacks only load the pointer, and a
+// replaced state (with any pipeline it alone referenced) is freed once no callback is in flight.
+struct moq_state {
+	// Session handles (all negative = invalid)
+	uint32_t generation;           // Increments on reconnect
+	bool reconnect_in_progress;    // True while reconnect is happening
+	int32_t origin;
+	int32_t session;
+	int32_t consume;
+	int32_t catalog_handle;
+
+	// Video subscriptions. Two slots, so a new rendition is subscribed and its decoder opened
+	// before the old one is dropped (make-before-break).
+	int32_t video_track[2];
+	int32_t slot_rendition[2];     // Catalog index subscribed on each slot, -1 = unused
+	struct moq_pipeline *pipeline[2];
+	struct moq_subscription *subscription[2]; // Set along with pipeline, before the track exists
+	int active_slot;               // Slot whose frames are decoded and output
+
+	// Pending rendition switch. The other slot's pipeline is promoted at that track's first
+	// keyframe newer than the last output frame, which is a group boundary on both tracks.
+	bool switch_in_progress;
+	uint32_t switch_id;            // Bumped when a switch is cancelled, invalidates in-flight setup
+	uint64_t switch_start_ns;
+
+	// Renditions - video tracks of the current catalog
+	uint32_t catalog_serial;       // Bumped whenever the rendition table changes
+	struct moq_rendition renditions[MOQ_MAX_RENDITIONS];
+	size_t rendition_count;
+
+	// Passthrough recording. The active pipeline writes to a file named record_path plus its start
+	// time; bumping record_serial closes that file.
+	char record_path[MOQ_RECORD_PATH_MAX]; // Directory and broadcast name, empty = not recording
+	char record_format[8];                 // "mkv" or "mp4"
+	uint32_t record_serial;
+
+	struct moq_restream *restream; // Republishes the active track elsewhere, NULL = off
+	struct moq_sync_member *sync;  // Genlocked playout with other sources, NULL = output right away
+	struct moq_capture *capture;   // Records the catalog and active track for replay, NULL = off
+	struct moq_replay *replay;     // Publishes the capture origin consumes from, NULL = live feed
+};
+
+struct moq_source {
+	obs_source_t *source;
+
+	// Settings - current active connection settings (url and broadcast are guarded by mutex)
+	char *url;
+	char *broadcast;
+	char *restream_url;
+	char *restream_broadcast;
+	char *sync_group;
+	uint32_t sync_latency_ms;
+	char *capture_path;
+	bool replay_max_speed;
+	std::atomic<bool> low_latency;    // Unbuffered output, low-delay decoder without frame threads
+	std::atomic<bool> thumbnail;      // Decode one keyframe per group, output at MOQ_THUMBNAIL_HEIGHT
+	std::atomic<int> rendition_setting; // Catalog index chosen by the user, -1 = automatic
+	std::atomic<bool> decode_video;   // Off leaves only recording and the timeshift buffer running
+
+	// Shutdown flag - set when destroy begins, callbacks should exit early
+	std::atomic<bool> shutting_down;
+
+	// Published connection state, never NULL
+	std::atomic<struct moq_state *> state;
+
+	// Read side of the state: callbacks running right now. States and pipelines replaced by a
+	// writer are kept until this has been zero at some point after the swap.
+	std::atomic<uint32_t> callbacks_in_flight;
+	std::atomic<bool> has_retired;
+	DARRAY(struct moq_state *) retired_states;
+	DARRAY(struct moq_pipeline *) retired_pipelines;
+	DARRAY(struct moq_restream *) retired_restreams;
+	DARRAY(struct moq_sync_member *) retired_syncs;
+	DARRAY(struct moq_capture *) retired_captures;
+	DARRAY(struct moq_replay *) retired_replays;
+
+	// Every subscription token handed to libmoq, until MOQ_SUBSCRIPTION_GRACE_NS after it closed
+	DARRAY(struct moq_subscription *) subscriptions;
+
+	std::atomic<uint64_t> last_output_us; // timestamp_us of the last frame output
+
+	// Timeshift size and media control requests, applied by the active pipeline at its next frame
+	std::atomic<int> timeshift_mb;
+	std::atomic<bool> timeshift_paused;
+	std::atomic<int64_t> timeshift_seek_us; // Timestamp to seek to, -1 = none
+	std::atomic<bool> timeshift_go_live;
+
+	// Timeshift window as last seen by the active pipeline, for the media callbacks and get_stats
+	std::atomic<uint64_t> timeshift_begin_us;
+	std::atomic<uint64_t> timeshift_live_us;
+	std::atomic<uint64_t> timeshift_position_us;
+
+	// Timings and ABR measurements reported by get_stats (written by the active frame callback)
+	std::atomic<uint32_t> stats_slice_count;
+	std::atomic<uint64_t> stats_convert_ns;
+	std::atomic<uint64_t> stats_slice_ns[MOQ_MAX_SLICES];
+	std::atomic<uint64_t> stats_throughput_bps;
+	std::atomic<uint64_t> stats_bitrate_bps;
+	std::atomic<uint64_t> stats_queue_delay_us;
+	std::atomic<uint64_t> stats_glass_latency_us;     // Publisher capture to output, if it sends wallclock
+	std::atomic<uint64_t> stats_glass_latency_max_us; // Worst since reset_stats
+
+	// Totals and distributions since the source was created or reset_stats was called
+	std::atomic<uint64_t> stats_bytes_received;
+	std::atomic<uint64_t> stats_frames_received;
+	std::atomic<uint64_t> stats_frames_output;
+	std::atomic<uint64_t> stats_frames_dropped[MOQ_DROP_COUNT];
+	std::atomic<uint32_t> stats_reconnects;
+	struct moq_histogram stats_decode_us;        // Packet sent to picture received
+	struct moq_histogram stats_convert_us;       // Whole frame, all slices
+	struct moq_histogram stats_keyframe_wait_us; // First frame skipped to the keyframe that ended the wait
+
+	// Rates over the last complete window, and when it ended
+	std::atomic<uint64_t> stats_received_bps;
+	std::atomic<uint32_t> stats_received_mfps; // Frames per 1000 seconds
+	std::atomic<uint32_t> stats_output_mfps;
+	std::atomic<uint64_t> stats_rate_updated_ns;
+
+	// Recent frame events, written to the log directory when decoding or the session fails
+	struct moq_flight_recorder *flight;
+
+	// Serializes state writers. Never taken on the frame path.
 	pthread_mutex_t mutex;
+
+	// Background thread for what libmoq callbacks must not wait for: rendition switches (see
+	// moq_source_start_switch_async) and freeing retired objects. Guarded by worker_mutex; a new
+	// switch request replaces one not started yet.
+	pthread_t worker_thread;
+	pthread_mutex_t worker_mutex;
+	pthread_cond_t worker_cond;
+	bool worker_stopping;
+	bool reclaim_requested;
+	bool switch_requested;
+	int switch_rendition;
+	bool switch_has_abr;
+	struct moq_abr switch_abr;
 };
 
 // Forward declarations
@@ -99,19 +334,78 @@ static void moq_source_update(void *data, obs_data_t *settings);
 static void moq_source_destroy(void *data);
 static obs_properties_t *moq_source_properties(void *data);
 static void moq_source_get_defaults(obs_data_t *settings);
+static void moq_source_get_stats(void *data, calldata_t *cd);
+static void moq_source_reset_stats(void *data, calldata_t *cd);
+static void moq_source_reset_stats_counters(struct moq_source *ctx);
+static void moq_source_format_stats(struct moq_source *ctx, struct dstr *text);
+static bool moq_source_refresh_stats(obs_properties_t *props, obs_property_t *property, void *data);
+
+// Media controls, operating on the timeshift buffer
+static void moq_source_media_play_pause(void *data, bool pause);
+static void moq_source_media_restart(void *data);
+static void moq_source_media_stop(void *data);
+static int64_t moq_source_media_get_duration(void *data);
+static int64_t moq_source_media_get_time(void *data);
+static void moq_source_media_set_time(void *data, int64_t milliseconds);
+static enum obs_media_state moq_source_media_get_state(void *data);
 
 // MoQ callbacks
 static void on_session_status(void *user_data, int32_t code);
 static void on_catalog(void *user_data, int32_t catalog);
 static void on_video_frame(void *user_data, int32_t frame_id);
 
+// State publication
+static void moq_state_init(struct moq_state *state);
+static struct moq_state *moq_source_edit_state_locked(struct moq_source *ctx);
+static void moq_source_publish_locked(struct moq_source *ctx, struct moq_state *next);
+static void moq_source_reclaim_locked(struct moq_source *ctx);
+static struct moq_subscription *moq_source_set_pipeline_locked(struct moq_source *ctx, struct moq_state *next,
+                                                               int slot, struct moq_pipeline *pipeline);
+static void moq_source_callback_enter(struct moq_source *ctx);
+static void moq_source_callback_exit(struct moq_source *ctx);
+
 // Helper functions
 static void moq_source_reconnect(struct moq_source *ctx);
-static void moq_source_disconnect_locked(struct moq_source *ctx);
+static void moq_source_disconnect_locked(struct moq_state *next);
 static void moq_source_blank_video(struct moq_source *ctx);
-static bool moq_source_init_decoder(struct moq_source *ctx, const struct moq_video_config *config);
-static void moq_source_destroy_decoder_locked(struct moq_source *ctx);
-static void moq_source_decode_frame(struct moq_source *ctx, int32_t frame_id);
+static void moq_source_update_recording_locked(struct moq_source *ctx, const char *dir, const char *format);
+static void moq_source_update_restream_locked(struct moq_source *ctx, const char *url, const char *broadcast);
+static void moq_source_update_sync_locked(struct moq_source *ctx, const char *name, uint32_t latency_ms);
+static void moq_source_update_capture_locked(struct moq_source *ctx, const char *path);
+static AVCodecContext *moq_source_open_decoder(struct moq_source *ctx, const struct moq_video_config *config,
+                                               struct moq_decoder_key *key, enum AVPixelFormat *pix_fmt);
+static struct moq_pipeline *moq_source_create_pipeline(struct moq_source *ctx,
+                                                       const struct moq_video_config *config);
+static size_t moq_source_read_renditions(int32_t catalog, struct moq_rendition *renditions);
+static int moq_source_update_catalog_locked(struct moq_state *next, int32_t catalog,
+                                           const struct moq_rendition *renditions, size_t rendition_count,
+                                           int wanted, uint32_t max_height);
+static uint32_t moq_source_display_height(struct moq_source *ctx);
+static int moq_source_pick_rendition(struct moq_source *ctx, const struct moq_state *state,
+                                     struct moq_pipeline *pipeline, uint64_t now_ns);
+static void moq_source_start_switch(struct moq_source *ctx, int rendition, const struct moq_abr *abr);
+static void moq_source_start_switch_async(struct moq_source *ctx, int rendition, const struct moq_abr *abr);
+static void *moq_source_worker_thread(void *data);
+static void moq_source_cancel_switch(struct moq_source *ctx, uint32_t switch_id);
+static void moq_source_cancel_switch_locked(struct moq_state *next);
+static void moq_source_pending_frame(struct moq_source *ctx, int slot, struct moq_pipeline *pipeline,
+                                     int32_t frame_id);
+static void moq_pipeline_destroy(struct moq_pipeline *pipeline);
+static void moq_pipeline_set_thumbnail(struct moq_pipeline *pipeline, bool thumbnail);
+static void moq_pipeline_set_timeshift(struct moq_pipeline *pipeline, int size_mb);
+static void moq_pipeline_update_recorder(const struct moq_state *state, struct moq_pipeline *pipeline,
+                                         bool keyframe);
+static bool moq_pipeline_prepare_output(struct moq_source *ctx, struct moq_pipeline *pipeline, int width,
+                                        int height, enum AVPixelFormat pix_fmt);
+static void moq_source_record_convert_stats(struct moq_source *ctx, const struct moq_pipeline *pipeline,
+                                            const uint64_t *slice_ns, uint64_t convert_ns);
+static void moq_source_measure_frame(struct moq_source *ctx, const struct moq_state *state,
+                                     struct moq_pipeline *pipeline, size_t bytes, uint64_t timestamp_us,
+                                     uint64_t arrival_ns);
+static void moq_source_record_glass_latency(struct moq_source *ctx, const struct moq_pipeline *pipeline,
+                                            uint64_t timestamp_us);
+static void moq_source_decode_frame(struct moq_source *ctx, const struct moq_state *state,
+                                    struct moq_pipeline *pipeline, int32_t frame_id);
 
 static void *moq_source_create(obs_data_t *settings, obs_source_t *source)
 {
@@ -120,34 +414,60 @@ static void *moq_source_create(obs_data_t *settings, obs_source_t *source)
 
 	// Initialize shutdown flag
 	ctx->shutting_down = false;
-
-	// Initialize handles to invalid values
-	ctx->generation = 0;
-	ctx->reconnect_in_progress = false;
-	ctx->origin = -1;
-	ctx->session = -1;
-	ctx->consume = -1;
-	ctx->catalog_handle = -1;
-	ctx->video_track = -1;
-
-	// Initialize decoder state
-	ctx->codec_ctx = NULL;
-	ctx->current_codec_id = AV_CODEC_ID_NONE;
-	ctx->current_pix_fmt = AV_PIX_FMT_NONE;
-	ctx->sws_ctx = NULL;
-	ctx->got_keyframe = false;
-	ctx->frames_waiting_for_keyframe = 0;
-	ctx->consecutive_decode_errors = 0;
-	ctx->frame_buffer = NULL;
+	ctx->low_latency = false;
+	ctx->thumbnail = false;
+	ctx->rendition_setting = -1;
+	ctx->decode_video = true;
+
+	// Initial state: no connection, handles invalid
+	struct moq_state *state = (struct moq_state *)bzalloc(sizeof(struct moq_state));
+	moq_state_init(state);
+	ctx->state = state;
+	ctx->callbacks_in_flight = 0;
+	ctx->has_retired = false;
+	da_init(ctx->retired_states);
+	da_init(ctx->retired_pipelines);
+	da_init(ctx->retired_restreams);
+	da_init(ctx->retired_syncs);
+	da_init(ctx->retired_captures);
+	da_init(ctx->retired_replays);
+	da_init(ctx->subscriptions);
+	ctx->last_output_us = 0;
+	ctx->timeshift_mb = 0;
+	ctx->timeshift_paused = false;
+	ctx->timeshift_seek_us = -1;
+	ctx->timeshift_go_live = false;
+	ctx->timeshift_begin_us = 0;
+	ctx->timeshift_live_us = 0;
+	ctx->timeshift_position_us = 0;
+
+	// Initialize stats
+	ctx->stats_slice_count = 0;
+	ctx->stats_convert_ns = 0;
+	for (int i = 0; i < MOQ_MAX_SLICES; i++) {
+		ctx->stats_slice_ns[i] = 0;
+	}
+	ctx->stats_throughput_bps = 0;
+	ctx->stats_bitrate_bps = 0;
+	ctx->stats_queue_delay_us = 0;
+	ctx->stats_glass_latency_us = 0;
+	ctx->stats_glass_latency_max_us = 0;
+	moq_source_reset_stats_counters(ctx);
+	ctx->flight = moq_flight_create("source");
 
 	// Initialize threading
 	pthread_mutex_init(&ctx->mutex, NULL);
-
-	// Initialize OBS frame structure - dimensions will be set dynamically from stream
-	ctx->frame.width = 0;
-	ctx->frame.height = 0;
-	ctx->frame.format = VIDEO_FORMAT_RGBA;
-	ctx->frame.linesize[0] = 0;
+	pthread_mutex_init(&ctx->worker_mutex, NULL);
+	pthread_cond_init(&ctx->worker_cond, NULL);
+	ctx->worker_stopping = false;
+	ctx->reclaim_requested = false;
+	ctx->switch_requested = false;
+	pthread_create(&ctx->worker_thread, NULL, moq_source_worker_thread, ctx);
+
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_stats(out string json)", moq_source_get_stats, ctx);
+	proc_handler_add(ph, "void reset_stats()", moq_source_reset_stats, ctx);
+	moq_trace_add_procs(ph);
 
 	// Load settings from OBS - this will auto-connect if settings are valid
 	// (moq_source_update detects settings changed from NULL and reconnects)
@@ -163,30 +483,63 @@ static void moq_source_destroy(void *data)
 	// Set shutdown flag first - callbacks will check this and exit early
 	pthread_mutex_lock(&ctx->mutex);
 	ctx->shutting_down = true;
-	moq_source_disconnect_locked(ctx);
+	struct moq_state *next = moq_source_edit_state_locked(ctx);
+	moq_source_disconnect_locked(next);
+	next->restream = NULL;
+	next->sync = NULL;
+	next->capture = NULL;
+	moq_source_publish_locked(ctx, next);
 	pthread_mutex_unlock(&ctx->mutex);
 
-	// Give MoQ callbacks time to drain - they check shutting_down and exit early.
-	// This prevents use-after-free when async callbacks fire after ctx is freed.
+	// A switch in progress sees shutting_down at its next step; retired objects are freed below
+	pthread_mutex_lock(&ctx->worker_mutex);
+	ctx->worker_stopping = true;
+	pthread_cond_signal(&ctx->worker_cond);
+	pthread_mutex_unlock(&ctx->worker_mutex);
+	pthread_join(ctx->worker_thread, NULL);
+
+	// Wait for callbacks that are already running; they see shutting_down and finish quickly
+	while (ctx->callbacks_in_flight.load() != 0) {
+		os_sleep_ms(1);
+	}
+
+	// Give MoQ callbacks that haven't started yet time to drain - they check shutting_down
+	// and exit early. This prevents use-after-free when async callbacks fire after ctx is freed.
 	//
 	// LIMITATION: This 100ms sleep is a timing-based workaround, not a synchronization
-	// guarantee. If a callback is mid-execution when shutting_down is set AND takes
-	// longer than 100ms to complete (after the mutex unlock), there is still a
-	// potential race condition. In practice, our callbacks are fast (< 1ms typically)
-	// and this delay provides sufficient margin. However, a more robust solution
-	// would use reference counting:
-	//   - Increment refcount when entering a callback
-	//   - Decrement when exiting
-	//   - Wait for refcount to reach zero before freeing ctx
-	// This could be implemented using std::shared_ptr or a manual atomic refcount
-	// with a condition variable for waiting.
+	// guarantee. libmoq may still invoke a callback for a closed handle after this point,
+	// which would touch freed memory. In practice closed handles stop calling back well
+	// within this margin.
 	os_sleep_ms(100);
 
+	pthread_mutex_lock(&ctx->mutex);
+	moq_source_reclaim_locked(ctx);
+	pthread_mutex_unlock(&ctx->mutex);
+
 	bfree(ctx->url);
 	bfree(ctx->broadcast);
-	// Note: frame_buffer is already freed by moq_source_disconnect_locked
+	bfree(ctx->restream_url);
+	bfree(ctx->restream_broadcast);
+	bfree(ctx->sync_group);
+	bfree(ctx->capture_path);
+	// Note: pipelines, the restream, the sync group membership, the capture and the replay were retired
+	// by the disconnect above and freed with the other retired state
+	bfree(ctx->state.load());
+	da_free(ctx->retired_states);
+	da_free(ctx->retired_pipelines);
+	da_free(ctx->retired_restreams);
+	da_free(ctx->retired_syncs);
+	da_free(ctx->retired_captures);
+	da_free(ctx->retired_replays);
+	for (size_t i = 0; i < ctx->subscriptions.num; i++) {
+		bfree(ctx->subscriptions.array[i]);
+	}
+	da_free(ctx->subscriptions);
+	moq_flight_destroy(ctx->flight);
 
 	pthread_mutex_destroy(&ctx->mutex);
+	pthread_cond_destroy(&ctx->worker_cond);
+	pthread_mutex_destroy(&ctx->worker_mutex);
 
 	bfree(ctx);
 }
@@ -197,6 +550,24 @@ static void moq_source_update(void *data, obs_data_t *settings)
 
 	const char *url = obs_data_get_string(settings, "url");
 	const char *broadcast = obs_data_get_string(settings, "broadcast");
+	bool low_latency = obs_data_get_bool(settings, "low_latency");
+	bool thumbnail = obs_data_get_bool(settings, "thumbnail");
+	int timeshift_mb = (int)obs_data_get_int(settings, "timeshift_mb");
+	int rendition = (int)obs_data_get_int(settings, "rendition");
+	bool decode = obs_data_get_bool(settings, "decode");
+	bool record = obs_data_get_bool(settings, "record");
+	const char *record_dir = obs_data_get_string(settings, "record_path");
+	const char *record_format = obs_data_get_string(settings, "record_format");
+	const char *restream_url = obs_data_get_string(settings, "restream_url");
+	const char *restream_broadcast = obs_data_get_string(settings, "restream_broadcast");
+	const char *sync_group = obs_data_get_string(settings, "sync_group");
+	uint32_t sync_latency_ms = (uint32_t)obs_data_get_int(settings, "sync_latency_ms");
+	const char *capture_path = obs_data_get_string(settings, "capture_path");
+	bool replay_max_speed = obs_data_get_bool(settings, "replay_max_speed");
+
+	// Unbuffered async video displays each frame as soon as it's output, instead of
+	// queueing frames and pacing them by timestamp. A sync group does its own pacing.
+	obs_source_set_async_unbuffered(ctx->source, low_latency || (sync_group && *sync_group));
 
 	pthread_mutex_lock(&ctx->mutex);
 
@@ -207,31 +578,58 @@ static void moq_source_update(void *data, obs_data_t *settings)
 	bool broadcast_changed = (!ctx->broadcast && broadcast && strlen(broadcast) > 0) ||
 	                         (ctx->broadcast && !broadcast) ||
 	                         (ctx->broadcast && broadcast && strcmp(ctx->broadcast, broadcast) != 0);
-	bool settings_changed = url_changed || broadcast_changed;
+	// Decoder flags are fixed at open time, so switching latency mode needs a fresh connection
+	bool low_latency_changed = low_latency != ctx->low_latency.load();
+	// A replay's pace is set when it starts
+	bool replay_changed = replay_max_speed != ctx->replay_max_speed && moq_replay_file(url);
+	bool settings_changed = url_changed || broadcast_changed || low_latency_changed || replay_changed;
+	// Renditions switch on the live connection
+	bool rendition_changed = rendition != ctx->rendition_setting.load();
 
 	// Store the new settings
 	bfree(ctx->url);
 	ctx->url = bstrdup(url);
 	bfree(ctx->broadcast);
 	ctx->broadcast = bstrdup(broadcast);
+	ctx->low_latency = low_latency;
+	ctx->replay_max_speed = replay_max_speed;
+	ctx->rendition_setting = rendition;
+	// Picked up by the active pipeline at its next frame, without reconnecting
+	ctx->thumbnail = thumbnail;
+	ctx->timeshift_mb = timeshift_mb;
+	bool decode_changed = decode != ctx->decode_video.exchange(decode);
 
 	// Check if new settings are valid for connection
 	bool valid = ctx->url && ctx->broadcast &&
 	             strlen(ctx->url) > 0 && strlen(ctx->broadcast) > 0;
 
+	moq_source_update_recording_locked(ctx, record && valid ? record_dir : NULL, record_format);
+	moq_source_update_restream_locked(ctx, restream_url, restream_broadcast);
+	moq_source_update_sync_locked(ctx, sync_group, sync_latency_ms);
+	moq_source_update_capture_locked(ctx, capture_path);
+
 	pthread_mutex_unlock(&ctx->mutex);
 
+	if (decode_changed && !decode) {
+		moq_source_blank_video(ctx);
+	}
+
 	// If settings changed and are valid, reconnect
 	if (settings_changed && valid) {
-		LOG_INFO("Settings changed, reconnecting (url=%s, broadcast=%s)",
-		         url ? url : "(null)", broadcast ? broadcast : "(null)");
+		LOG_INFO("Settings changed, reconnecting (url=%s, broadcast=%s, low_latency=%d)",
+		         url ? url : "(null)", broadcast ? broadcast : "(null)", low_latency);
 		moq_source_reconnect(ctx);
 	} else if (settings_changed && !valid) {
 		LOG_INFO("Settings changed but invalid - disconnecting");
 		pthread_mutex_lock(&ctx->mutex);
-		moq_source_disconnect_locked(ctx);
+		struct moq_state *next = moq_source_edit_state_locked(ctx);
+		moq_source_disconnect_locked(next);
+		moq_source_publish_locked(ctx, next);
 		pthread_mutex_unlock(&ctx->mutex);
 		moq_source_blank_video(ctx);
+	} else if (rendition_changed && rendition >= 0) {
+		// Automatic mode takes over at the next keyframe; a manual pick switches right away
+		moq_source_start_switch_async(ctx, rendition, NULL);
 	}
 }
 
@@ -239,20 +637,364 @@ static void moq_source_get_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_string(settings, "url", "http://localhost:4443");
 	obs_data_set_default_string(settings, "broadcast", "obs/test");
+	obs_data_set_default_bool(settings, "low_latency", false);
+	obs_data_set_default_bool(settings, "thumbnail", false);
+	obs_data_set_default_int(settings, "timeshift_mb", 0);
+	obs_data_set_default_int(settings, "rendition", -1);
+	obs_data_set_default_bool(settings, "decode", true);
+	obs_data_set_default_bool(settings, "record", false);
+	obs_data_set_default_string(settings, "record_format", "mkv");
+	obs_data_set_default_string(settings, "restream_url", "");
+	obs_data_set_default_string(settings, "restream_broadcast", "");
+	obs_data_set_default_string(settings, "sync_group", "");
+	obs_data_set_default_int(settings, "sync_latency_ms", 500);
+	obs_data_set_default_string(settings, "capture_path", "");
+	obs_data_set_default_bool(settings, "replay_max_speed", false);
 }
 
 static obs_properties_t *moq_source_properties(void *data)
 {
-	UNUSED_PARAMETER(data);
+	struct moq_source *ctx = (struct moq_source *)data;
 
 	obs_properties_t *props = obs_properties_create();
 
 	obs_properties_add_text(props, "url", "URL", OBS_TEXT_DEFAULT);
 	obs_properties_add_text(props, "broadcast", "Broadcast", OBS_TEXT_DEFAULT);
 
+	obs_property_t *low_latency = obs_properties_add_bool(props, "low_latency", "Low latency");
+	obs_property_set_long_description(low_latency,
+	                                  "Show each frame as soon as it is decoded. Uses more CPU per frame and "
+	                                  "may stutter on jittery networks.");
+
+	obs_property_t *thumbnail = obs_properties_add_bool(props, "thumbnail", "Keyframes only");
+	obs_property_set_long_description(thumbnail,
+	                                  "Decode only the first frame of each group and show it at reduced "
+	                                  "resolution, for monitoring many feeds at once. Turning it off resumes "
+	                                  "full decoding at the next keyframe.");
+
+	obs_property_t *timeshift = obs_properties_add_int(props, "timeshift_mb", "Timeshift buffer", 0, 2048, 16);
+	obs_property_int_set_suffix(timeshift, " MB");
+	obs_property_set_long_description(timeshift,
+	                                  "Memory kept for replaying the most recent part of the feed with the "
+	                                  "media controls. 0 disables timeshift. Changing rendition clears it.");
+
+	// Renditions come from the catalog, so the list is only filled once connected
+	obs_property_t *rendition = obs_properties_add_list(props, "rendition", "Rendition", OBS_COMBO_TYPE_LIST,
+	                                                    OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(rendition, "Automatic", -1);
+	if (ctx) {
+		// Holding the writer lock keeps the state from being replaced and freed
+		pthread_mutex_lock(&ctx->mutex);
+		const struct moq_state *state = ctx->state.load();
+		for (size_t i = 0; i < state->rendition_count; i++) {
+			const struct moq_rendition *r = &state->renditions[i];
+			struct dstr name = {};
+			dstr_printf(&name, "%ux%u (%s)", r->width, r->height, r->codec);
+			obs_property_list_add_int(rendition, name.array, (long long)i);
+			dstr_free(&name);
+		}
+		pthread_mutex_unlock(&ctx->mutex);
+	}
+	obs_property_set_long_description(rendition,
+	                                  "Automatic picks the largest rendition the connection sustains, "
+	                                  "up to the canvas height.");
+
+	obs_property_t *record = obs_properties_add_bool(props, "record", "Record to disk");
+	obs_property_set_long_description(record,
+	                                  "Write the received video to a file as is, without decoding or "
+	                                  "re-encoding it. A new file starts at every rendition change.");
+	obs_properties_add_path(props, "record_path", "Recording path", OBS_PATH_DIRECTORY, NULL, NULL);
+	obs_property_t *record_format = obs_properties_add_list(props, "record_format", "Recording format",
+	                                                        OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(record_format, "Matroska (.mkv)", "mkv");
+	obs_property_list_add_string(record_format, "Fragmented MP4 (.mp4)", "mp4");
+
+	obs_property_t *decode = obs_properties_add_bool(props, "decode", "Decode video");
+	obs_property_set_long_description(decode,
+	                                  "Turn off to only record the feed, which then costs almost no CPU. "
+	                                  "The source shows nothing and stays on its current rendition.");
+
+	obs_property_t *restream_url = obs_properties_add_text(props, "restream_url", "Restream URL",
+	                                                       OBS_TEXT_DEFAULT);
+	obs_property_set_long_description(restream_url,
+	                                  "Relay to republish the received video to, as is. Leave empty to turn "
+	                                  "restreaming off. The active rendition is forwarded, so pick a fixed one "
+	                                  "for a steady output.");
+	obs_properties_add_text(props, "restream_broadcast", "Restream broadcast", OBS_TEXT_DEFAULT);
+
+	obs_property_t *sync_group = obs_properties_add_text(props, "sync_group", "Sync group", OBS_TEXT_DEFAULT);
+	obs_property_set_long_description(sync_group,
+	                                  "Sources with the same sync group show frames captured at the same "
+	                                  "moment together, by publisher timestamp. The publishers must share a "
+	                                  "clock. Leave empty to show frames as soon as they are decoded.");
+	obs_property_t *sync_latency = obs_properties_add_int(props, "sync_latency_ms", "Sync latency", 0, 5000, 10);
+	obs_property_int_set_suffix(sync_latency, " ms");
+	obs_property_set_long_description(sync_latency,
+	                                  "Delay on top of the fastest feed, enough to cover the slowest one and "
+	                                  "its decoding. The group uses the largest latency of its sources.");
+
+	obs_property_t *capture = obs_properties_add_path(props, "capture_path", "Capture file", OBS_PATH_FILE_SAVE,
+	                                                  "MoQ capture (*.moqcap)", NULL);
+	obs_property_set_long_description(capture,
+	                                  "Debugging aid: records the catalog and every received frame with its "
+	                                  "arrival time. Use replay://<file> as the URL of a source to play a "
+	                                  "capture back. Leave empty to turn capturing off.");
+	obs_property_t *replay_max_speed = obs_properties_add_bool(props, "replay_max_speed",
+	                                                           "Replay at maximum speed");
+	obs_property_set_long_description(replay_max_speed,
+	                                  "With a replay:// URL, publish the captured frames back to back instead "
+	                                  "of at the times they originally arrived.");
+
+	// Read-only, as of when the properties were opened or last refreshed
+	if (ctx) {
+		struct dstr stats = {};
+		moq_source_format_stats(ctx, &stats);
+		obs_properties_add_text(props, "stats", stats.array, OBS_TEXT_INFO);
+		dstr_free(&stats);
+		obs_properties_add_button(props, "stats_refresh", "Refresh statistics", moq_source_refresh_stats);
+	}
+
 	return props;
 }
 
+// Starts republishing to url as broadcast, or stops if either is empty. Changing either starts a new
+// session; the previous one is closed once no frame callback uses it.
+// NOTE: Caller must hold ctx->mutex when calling this function
+static void moq_source_update_restream_locked(struct moq_source *ctx, const char *url, const char *broadcast)
+{
+	if (!url || !broadcast) {
+		url = broadcast = "";
+	}
+	if (strcmp(ctx->restream_url ? ctx->restream_url : "", url) == 0 &&
+	    strcmp(ctx->restream_broadcast ? ctx->restream_broadcast : "", broadcast) == 0) {
+		return;
+	}
+	bfree(ctx->restream_url);
+	ctx->restream_url = bstrdup(url);
+	bfree(ctx->restream_broadcast);
+	ctx->restream_broadcast = bstrdup(broadcast);
+
+	struct moq_state *next = moq_source_edit_state_locked(ctx);
+	next->restream = *url && *broadcast ? moq_restream_create(url, broadcast) : NULL;
+	moq_source_publish_locked(ctx, next);
+}
+
+// Joins the named sync group, or leaves the current one if name is empty. The old membership is left
+// once no frame callback uses it, dropping the frames it still had queued.
+// NOTE: Caller must hold ctx->mutex when calling this function
+static void moq_source_update_sync_locked(struct moq_source *ctx, const char *name, uint32_t latency_ms)
+{
+	if (!name) {
+		name = "";
+	}
+	if (strcmp(ctx->sync_group ? ctx->sync_group : "", name) == 0 && ctx->sync_latency_ms == latency_ms) {
+		return;
+	}
+	bfree(ctx->sync_group);
+	ctx->sync_group = bstrdup(name);
+	ctx->sync_latency_ms = latency_ms;
+
+	struct moq_state *next = moq_source_edit_state_locked(ctx);
+	next->sync = *name ? moq_sync_join(name, ctx->source, latency_ms) : NULL;
+	moq_source_publish_locked(ctx, next);
+}
+
+// Starts capturing to path, or stops if it is empty. A new file begins with the current catalog, if
+// there is one; the previous file is closed once no frame callback uses it.
+// NOTE: Caller must hold ctx->mutex when calling this function
+static void moq_source_update_capture_locked(struct moq_source *ctx, const char *path)
+{
+	if (!path) {
+		path = "";
+	}
+	if (strcmp(ctx->capture_path ? ctx->capture_path : "", path) == 0) {
+		return;
+	}
+	bfree(ctx->capture_path);
+	ctx->capture_path = bstrdup(path);
+
+	struct moq_state *next = moq_source_edit_state_locked(ctx);
+	next->capture = *path ? moq_capture_create(path) : NULL;
+	if (next->capture && next->catalog_handle >= 0) {
+		moq_capture_write_catalog(next->capture, next->catalog_handle);
+	}
+	moq_source_publish_locked(ctx, next);
+}
+
+// Publishes where the active pipeline records to: dir plus the broadcast name, or nowhere if dir is
+// NULL or empty. A change closes the current file; the next one starts at the next keyframe.
+// NOTE: Caller must hold ctx->mutex when calling this function
+static void moq_source_update_recording_locked(struct moq_source *ctx, const char *dir, const char *format)
+{
+	struct dstr path = {};
+	if (dir && *dir) {
+		os_mkdirs(dir);
+		dstr_copy(&path, dir);
+		dstr_cat_ch(&path, '/');
+		// The broadcast name is a path on the relay, flatten it into one file name
+		size_t name_start = path.len;
+		dstr_cat(&path, ctx->broadcast);
+		for (size_t i = name_start; i < path.len; i++) {
+			if (strchr("/\\:*?\"<>|", path.array[i])) {
+				path.array[i] = '_';
+			}
+		}
+	}
+	if (strcmp(format, "mp4") != 0) {
+		format = "mkv";
+	}
+
+	const struct moq_state *state = ctx->state.load();
+	const char *current = path.array ? path.array : "";
+	if (strcmp(state->record_path, current) != 0 || strcmp(state->record_format, format) != 0) {
+		struct moq_state *next = moq_source_edit_state_locked(ctx);
+		moq_source_copy_string(next->record_path, sizeof(next->record_path), current, strlen(current));
+		moq_source_copy_string(next->record_format, sizeof(next->record_format), format, strlen(format));
+		next->record_serial++;
+		moq_source_publish_locked(ctx, next);
+	}
+	dstr_free(&path);
+}
+
+static void moq_state_init(struct moq_state *state)
+{
+	memset(state, 0, sizeof(*state));
+	state->origin = -1;
+	state->session = -1;
+	state->consume = -1;
+	state->catalog_handle = -1;
+	for (int i = 0; i < 2; i++) {
+		state->video_track[i] = -1;
+		state->slot_rendition[i] = -1;
+	}
+}
+
+// Returns a copy of the published state for a writer to change and publish
+// NOTE: Caller must hold ctx->mutex when calling this function
+static struct moq_state *moq_source_edit_state_locked(struct moq_source *ctx)
+{
+	struct moq_state *next = (struct moq_state *)bmalloc(sizeof(struct moq_state));
+	*next = *ctx->state.load();
+	return next;
+}
+
+// Publishes next, retiring the state it replaces and any pipeline only that state used
+// NOTE: Caller must hold ctx->mutex when calling this function
+static void moq_source_publish_locked(struct moq_source *ctx, struct moq_state *next)
+{
+	struct moq_state *prev = ctx->state.exchange(next);
+
+	for (int i = 0; i < 2; i++) {
+		struct moq_pipeline *pipeline = prev->pipeline[i];
+		if (pipeline && pipeline != next->pipeline[0] && pipeline != next->pipeline[1]) {
+			da_push_back(ctx->retired_pipelines, &pipeline);
+		}
+	}
+	for (int i = 0; i < 2; i++) {
+		struct moq_subscription *subscription = prev->subscription[i];
+		if (subscription && subscription != next->subscription[i]) {
+			subscription->closed_ns = os_gettime_ns();
+		}
+	}
+	if (prev->restream && prev->restream != next->restream) {
+		da_push_back(ctx->retired_restreams, &prev->restream);
+	}
+	if (prev->sync && prev->sync != next->sync) {
+		da_push_back(ctx->retired_syncs, &prev->sync);
+	}
+	if (prev->capture && prev->capture != next->capture) {
+		da_push_back(ctx->retired_captures, &prev->capture);
+	}
+	if (prev->replay && prev->replay != next->replay) {
+		da_push_back(ctx->retired_replays, &prev->replay);
+	}
+	da_push_back(ctx->retired_states, &prev);
+	ctx->has_retired = true;
+
+	moq_source_reclaim_locked(ctx);
+}
+
+// Frees what writers retired, unless a callback may still hold a pointer to it
+// NOTE: Caller must hold ctx->mutex when calling this function
+static void moq_source_reclaim_locked(struct moq_source *ctx)
+{
+	// Callbacks starting after a swap load the new state, so once none are in flight
+	// nothing retired before this point can be referenced any more
+	if (!ctx->has_retired.load() || ctx->callbacks_in_flight.load() != 0) {
+		return;
+	}
+
+	for (size_t i = 0; i < ctx->retired_pipelines.num; i++) {
+		moq_pipeline_destroy(ctx->retired_pipelines.array[i]);
+	}
+	for (size_t i = 0; i < ctx->retired_restreams.num; i++) {
+		moq_restream_destroy(ctx->retired_restreams.array[i]);
+	}
+	for (size_t i = 0; i < ctx->retired_syncs.num; i++) {
+		moq_sync_leave(ctx->retired_syncs.array[i]);
+	}
+	for (size_t i = 0; i < ctx->retired_captures.num; i++) {
+		moq_capture_destroy(ctx->retired_captures.array[i]);
+	}
+	for (size_t i = 0; i < ctx->retired_replays.num; i++) {
+		moq_replay_destroy(ctx->retired_replays.array[i]);
+	}
+	for (size_t i = 0; i < ctx->retired_states.num; i++) {
+		bfree(ctx->retired_states.array[i]);
+	}
+	da_resize(ctx->retired_pipelines, 0);
+	da_resize(ctx->retired_restreams, 0);
+	da_resize(ctx->retired_syncs, 0);
+	da_resize(ctx->retired_captures, 0);
+	da_resize(ctx->retired_replays, 0);
+	da_resize(ctx->retired_states, 0);
+	ctx->has_retired = false;
+}
+
+// Installs pipeline on slot of next with a new subscription token, the user data to subscribe the
+// slot's track with
+// NOTE: Caller must hold ctx->mutex and publish next afterwards
+static struct moq_subscription *moq_source_set_pipeline_locked(struct moq_source *ctx, struct moq_state *next,
+                                                               int slot, struct moq_pipeline *pipeline)
+{
+	// Tokens closed long enough ago can't be called back with any more
+	uint64_t now_ns = os_gettime_ns();
+	for (size_t i = ctx->subscriptions.num; i > 0; i--) {
+		struct moq_subscription *old = ctx->subscriptions.array[i - 1];
+		if (old->closed_ns && now_ns - old->closed_ns >= MOQ_SUBSCRIPTION_GRACE_NS) {
+			bfree(old);
+			da_erase(ctx->subscriptions, i - 1);
+		}
+	}
+
+	struct moq_subscription *subscription = (struct moq_subscription *)bzalloc(sizeof(*subscription));
+	subscription->ctx = ctx;
+	subscription->slot = slot;
+	da_push_back(ctx->subscriptions, &subscription);
+	next->pipeline[slot] = pipeline;
+	next->subscription[slot] = subscription;
+	return subscription;
+}
+
+// Marks the start of a MoQ callback. The seq_cst increment orders the callback's state load after it,
+// which is what lets writers tell when a replaced state is no longer referenced.
+static void moq_source_callback_enter(struct moq_source *ctx)
+{
+	ctx->callbacks_in_flight.fetch_add(1);
+}
+
+static void moq_source_callback_exit(struct moq_source *ctx)
+{
+	// The last callback out has the worker thread free whatever writers retired while callbacks
+	// were running. Freeing joins threads and closes sessions, which a callback must not wait for.
+	if (ctx->callbacks_in_flight.fetch_sub(1) == 1 && ctx->has_retired.load()) {
+		pthread_mutex_lock(&ctx->worker_mutex);
+		ctx->reclaim_requested = true;
+		pthread_cond_signal(&ctx->worker_cond);
+		pthread_mutex_unlock(&ctx->worker_mutex);
+	}
+}
+
 // Forward declaration for use in callback
 static void moq_source_start_consume(struct moq_source *ctx, uint32_t expected_gen);
 
@@ -261,25 +1003,33 @@ static void on_session_status(void *user_data, int32_t code)
 {
 	struct moq_source *ctx = (struct moq_source *)user_data;
 
+	// Entered before anything else, so moq_source_destroy waits for this callback
+	moq_source_callback_enter(ctx);
+
 	// Fast path: check atomic flag before taking lock
 	if (ctx->shutting_down.load()) {
 		LOG_DEBUG("Ignoring session status callback - shutting down");
+		moq_source_callback_exit(ctx);
 		return;
 	}
 
 	pthread_mutex_lock(&ctx->mutex);
 	// Double-check after acquiring lock (may have changed)
+	const struct moq_state *state = ctx->state.load();
 	if (ctx->shutting_down.load()) {
 		pthread_mutex_unlock(&ctx->mutex);
+		moq_source_callback_exit(ctx);
 		return;
 	}
-	if (ctx->session < 0) {
+	if (state->session < 0) {
 		LOG_DEBUG("Ignoring session status callback - already disconnected");
 		pthread_mutex_unlock(&ctx->mutex);
+		moq_source_callback_exit(ctx);
 		return;
 	}
-	uint32_t current_gen = ctx->generation;
+	uint32_t current_gen = state->generation;
 
+	moq_flight_record(ctx->flight, MOQ_FLIGHT_SESSION, code, 0, 0, 0, false);
 	if (code == 0) {
 		pthread_mutex_unlock(&ctx->mutex);
 		LOG_INFO("MoQ session connected successfully (generation %u)", current_gen);
@@ -290,25 +1040,33 @@ static void on_session_status(void *user_data, int32_t code)
 		LOG_ERROR("MoQ session failed with code: %d (generation %u)", code, current_gen);
 
 		// Clean up failed session/origin to prevent further callbacks
-		if (ctx->session >= 0) {
-			moq_session_close(ctx->session);
-			ctx->session = -1;
+		struct moq_state *next = moq_source_edit_state_locked(ctx);
+		if (next->session >= 0) {
+			moq_session_close(next->session);
+			next->session = -1;
 		}
-		if (ctx->origin >= 0) {
-			moq_origin_close(ctx->origin);
-			ctx->origin = -1;
+		if (next->origin >= 0) {
+			moq_loopback_release(next->origin);
+			next->origin = -1;
 		}
+		moq_source_publish_locked(ctx, next);
 		pthread_mutex_unlock(&ctx->mutex);
 
+		moq_flight_dump(ctx->flight, obs_source_get_name(ctx->source), "MoQ session failed");
+
 		// Blank the video to show error state
 		moq_source_blank_video(ctx);
 	}
+	moq_source_callback_exit(ctx);
 }
 
 static void on_catalog(void *user_data, int32_t catalog)
 {
 	struct moq_source *ctx = (struct moq_source *)user_data;
 
+	// Entered before anything else, so moq_source_destroy waits for this callback
+	moq_source_callback_enter(ctx);
+
 	LOG_INFO("Catalog callback received: %d", catalog);
 
 	// Fast path: check atomic flag before taking lock
@@ -316,6 +1074,7 @@ static void on_catalog(void *user_data, int32_t catalog)
 		LOG_DEBUG("Ignoring catalog callback - shutting down");
 		if (catalog >= 0)
 			moq_consume_catalog_close(catalog);
+		moq_source_callback_exit(ctx);
 		return;
 	}
 
@@ -326,16 +1085,19 @@ static void on_catalog(void *user_data, int32_t catalog)
 		pthread_mutex_unlock(&ctx->mutex);
 		if (catalog >= 0)
 			moq_consume_catalog_close(catalog);
+		moq_source_callback_exit(ctx);
 		return;
 	}
 
 	// Check if this callback is still valid (not from a stale connection)
-	uint32_t current_gen = ctx->generation;
-	if (ctx->consume < 0) {
+	const struct moq_state *state = ctx->state.load();
+	uint32_t current_gen = state->generation;
+	if (state->consume < 0) {
 		// We've been disconnected, ignore this callback
 		pthread_mutex_unlock(&ctx->mutex);
 		if (catalog >= 0)
 			moq_consume_catalog_close(catalog);
+		moq_source_callback_exit(ctx);
 		return;
 	}
 
@@ -345,83 +1107,171 @@ static void on_catalog(void *user_data, int32_t catalog)
 		LOG_ERROR("Failed to get catalog: %d", catalog);
 		// Catalog failed (likely invalid broadcast) - blank video
 		moq_source_blank_video(ctx);
+		moq_source_callback_exit(ctx);
+		return;
+	}
+
+	// Every video track in the catalog is a rendition of the same picture
+	struct moq_rendition renditions[MOQ_MAX_RENDITIONS];
+	size_t rendition_count = moq_source_read_renditions(catalog, renditions);
+	if (rendition_count == 0) {
+		LOG_ERROR("Failed to get video config");
+		moq_consume_catalog_close(catalog);
+		moq_source_callback_exit(ctx);
+		return;
+	}
+
+	int wanted = ctx->rendition_setting.load();
+	if (wanted >= 0 && (size_t)wanted >= rendition_count) {
+		wanted = -1;
+	}
+
+	pthread_mutex_lock(&ctx->mutex);
+
+	// Catalog update on a running stream: keep whatever still matches
+	state = ctx->state.load();
+	if (state->catalog_handle >= 0 && state->pipeline[state->active_slot] && state->generation == current_gen) {
+		struct moq_state *next = moq_source_edit_state_locked(ctx);
+		int switch_to = moq_source_update_catalog_locked(next, catalog, renditions, rendition_count, wanted,
+		                                                 moq_source_display_height(ctx));
+		if (next->capture) {
+			moq_capture_write_catalog(next->capture, catalog);
+		}
+		moq_source_publish_locked(ctx, next);
+		pthread_mutex_unlock(&ctx->mutex);
+		if (switch_to >= 0) {
+			moq_source_start_switch_async(ctx, switch_to, NULL);
+		}
+		moq_source_callback_exit(ctx);
 		return;
 	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	int rendition = wanted;
+	if (rendition < 0) {
+		rendition = moq_abr_initial(renditions, rendition_count, moq_source_display_height(ctx));
+	}
 
 	// Get video configuration
 	struct moq_video_config video_config;
-	if (moq_consume_video_config(catalog, 0, &video_config) < 0) {
+	if (moq_consume_video_config(catalog, rendition, &video_config) < 0) {
 		LOG_ERROR("Failed to get video config");
 		moq_consume_catalog_close(catalog);
+		moq_source_callback_exit(ctx);
 		return;
 	}
 
-	// Initialize decoder with the video config (takes mutex internally)
-	if (!moq_source_init_decoder(ctx, &video_config)) {
+	// Open the decoder outside the lock
+	struct moq_pipeline *pipeline = moq_source_create_pipeline(ctx, &video_config);
+	if (!pipeline) {
 		LOG_ERROR("Failed to initialize decoder");
 		moq_consume_catalog_close(catalog);
+		moq_source_callback_exit(ctx);
+		return;
+	}
+
+	// Drop the previous catalog's subscriptions and start over on slot 0
+	pthread_mutex_lock(&ctx->mutex);
+	if (ctx->state.load()->generation != current_gen) {
+		pthread_mutex_unlock(&ctx->mutex);
+		moq_pipeline_destroy(pipeline);
+		moq_consume_catalog_close(catalog);
+		moq_source_callback_exit(ctx);
 		return;
 	}
+	struct moq_state *next = moq_source_edit_state_locked(ctx);
+	moq_source_cancel_switch_locked(next);
+	if (next->video_track[next->active_slot] >= 0) {
+		moq_consume_video_close(next->video_track[next->active_slot]);
+		next->video_track[next->active_slot] = -1;
+	}
+	next->pipeline[next->active_slot] = NULL;
+	next->subscription[next->active_slot] = NULL;
+	next->slot_rendition[next->active_slot] = -1;
+	memcpy(next->renditions, renditions, sizeof(renditions));
+	next->rendition_count = rendition_count;
+	next->catalog_serial++;
+	next->active_slot = 0;
+	next->slot_rendition[0] = rendition;
+	struct moq_subscription *subscription = moq_source_set_pipeline_locked(ctx, next, 0, pipeline);
+	pipeline->abr_catalog_serial = next->catalog_serial;
+	// Ahead of the subscription, so the catalog precedes the track's frames in the capture
+	if (next->capture) {
+		moq_capture_write_catalog(next->capture, catalog);
+	}
+	moq_source_publish_locked(ctx, next);
+	pthread_mutex_unlock(&ctx->mutex);
 
 	// Subscribe to video track with minimal buffering
 	// Note: moq_consume_video_ordered takes the catalog handle, not the consume handle
-	int32_t track = moq_consume_video_ordered(catalog, 0, 0, on_video_frame, ctx);
+	int32_t track = moq_consume_video_ordered(catalog, rendition, 0, on_video_frame, subscription);
+	moq_flight_record(ctx->flight, MOQ_FLIGHT_TRACK, track, 0, 0, 0, false);
 	if (track < 0) {
 		LOG_ERROR("Failed to subscribe to video track: %d", track);
 		moq_consume_catalog_close(catalog);
+		moq_source_callback_exit(ctx);
 		return;
 	}
 
 	pthread_mutex_lock(&ctx->mutex);
-	if (ctx->generation == current_gen) {
-		ctx->video_track = track;
-		ctx->catalog_handle = catalog;
+	if (ctx->state.load()->generation == current_gen) {
+		next = moq_source_edit_state_locked(ctx);
+		next->video_track[0] = track;
+		if (next->catalog_handle >= 0 && next->catalog_handle != catalog) {
+			moq_consume_catalog_close(next->catalog_handle);
+		}
+		next->catalog_handle = catalog;
+		moq_source_publish_locked(ctx, next);
 	} else {
 		// Generation changed while we were setting up, clean up the track
 		pthread_mutex_unlock(&ctx->mutex);
 		moq_consume_video_close(track);
 		moq_consume_catalog_close(catalog);
+		moq_source_callback_exit(ctx);
 		return;
 	}
 	pthread_mutex_unlock(&ctx->mutex);
 
-	LOG_INFO("Subscribed to video track successfully");
+	LOG_INFO("Subscribed to video track %d of %zu (%ux%u)", rendition, rendition_count,
+	         renditions[rendition].width, renditions[rendition].height);
+	moq_source_callback_exit(ctx);
 }
 
+// Hot path: one state load, no locks. The pipeline is only used by its own subscription's callbacks.
 static void on_video_frame(void *user_data, int32_t frame_id)
 {
-	struct moq_source *ctx = (struct moq_source *)user_data;
-
+	struct moq_subscription *subscription = (struct moq_subscription *)user_data;
+	struct moq_source *ctx = subscription->ctx;
+	int slot = subscription->slot;
 	if (frame_id < 0) {
 		LOG_ERROR("Video frame callback with error: %d", frame_id);
 		return;
 	}
 
-	// Fast path: check atomic flag before taking lock
-	if (ctx->shutting_down.load()) {
-		moq_consume_frame_close(frame_id);
-		return;
-	}
+	moq_source_callback_enter(ctx);
 
-	// Check if this callback is still valid using generation (not video_track)
-	// Note: We can't check video_track here because frames may arrive before
-	// the track handle is stored in on_catalog (race condition)
-	pthread_mutex_lock(&ctx->mutex);
-	// Double-check after acquiring lock (may have changed)
-	if (ctx->shutting_down.load()) {
-		pthread_mutex_unlock(&ctx->mutex);
+	// A subscription no longer in the state was closed, and its slot may already hold another
+	// track. Frames may arrive before the track handle is stored, so the token is what identifies it.
+	const struct moq_state *state = ctx->state.load();
+	struct moq_pipeline *pipeline = state->pipeline[slot];
+	if (ctx->shutting_down.load() || state->subscription[slot] != subscription || !pipeline ||
+	    pipeline->busy.exchange(true, std::memory_order_acquire)) {
 		moq_consume_frame_close(frame_id);
+		moq_source_callback_exit(ctx);
 		return;
 	}
-	if (ctx->consume < 0) {
-		// We've been disconnected, ignore this callback
-		pthread_mutex_unlock(&ctx->mutex);
-		moq_consume_frame_close(frame_id);
-		return;
+
+	uint64_t trace_start = moq_trace_begin();
+	if (slot == state->active_slot) {
+		moq_source_decode_frame(ctx, state, pipeline, frame_id);
+		moq_trace_end("source", "frame", trace_start, pipeline, 0);
+	} else {
+		moq_source_pending_frame(ctx, slot, pipeline, frame_id);
+		moq_trace_end("source", "pending frame", trace_start, pipeline, 0);
 	}
-	pthread_mutex_unlock(&ctx->mutex);
 
-	moq_source_decode_frame(ctx, frame_id);
+	pipeline->busy.store(false, std::memory_order_release);
+	moq_source_callback_exit(ctx);
 }
 
 // Helper function implementations
@@ -431,20 +1281,28 @@ static void moq_source_reconnect(struct moq_source *ctx)
 	pthread_mutex_lock(&ctx->mutex);
 
 	// Check if reconnect is already in progress
-	if (ctx->reconnect_in_progress) {
+	if (ctx->state.load()->reconnect_in_progress) {
 		LOG_DEBUG("Reconnect already in progress, skipping");
 		pthread_mutex_unlock(&ctx->mutex);
 		return;
 	}
 
-	ctx->reconnect_in_progress = true;
-	uint32_t new_gen = ctx->generation.load() + 1;
-	LOG_INFO("Reconnecting (generation %u -> %u)", ctx->generation.load(), new_gen);
-	ctx->generation.store(new_gen);
-	moq_source_disconnect_locked(ctx);
+	struct moq_state *next = moq_source_edit_state_locked(ctx);
+	uint32_t new_gen = next->generation + 1;
+	LOG_INFO("Reconnecting (generation %u -> %u)", next->generation, new_gen);
+	if (new_gen > 1) {
+		ctx->stats_reconnects.fetch_add(1, std::memory_order_relaxed);
+	}
+	moq_flight_record(ctx->flight, MOQ_FLIGHT_CONNECT, (int32_t)new_gen, 0, 0, 0, false);
+	next->generation = new_gen;
+	next->reconnect_in_progress = true;
+	moq_source_disconnect_locked(next);
+	moq_source_publish_locked(ctx, next);
 
 	// Copy URL while holding mutex for thread safety
 	char *url_copy = bstrdup(ctx->url);
+	char *broadcast_copy = bstrdup(ctx->broadcast);
+	bool replay_max_speed = ctx->replay_max_speed;
 	pthread_mutex_unlock(&ctx->mutex);
 
 	// Blank video while reconnecting to avoid showing stale frames
@@ -453,52 +1311,91 @@ static void moq_source_reconnect(struct moq_source *ctx)
 	// Small delay to allow MoQ library to fully clean up previous connection
 	os_sleep_ms(50);
 
-	// Create origin for consuming (outside mutex since it may block)
-	int32_t new_origin = moq_origin_create();
+	// A loopback origin already has the broadcast (or will), no session needed. A replay publishes the
+	// capture into a loopback origin named after its URL.
+	const char *loopback = moq_loopback_name(url_copy);
+	struct moq_replay *replay = NULL;
+	if (moq_replay_file(url_copy)) {
+		replay = moq_replay_create(url_copy, broadcast_copy, replay_max_speed);
+		loopback = replay ? url_copy : NULL;
+	}
+	bfree(broadcast_copy);
+
+	// Create origin for consuming (outside mutex since it may block). A replay that failed to start has none.
+	int32_t new_origin = -1;
+	if (loopback) {
+		new_origin = moq_loopback_acquire(loopback);
+	} else if (!moq_replay_file(url_copy)) {
+		new_origin = moq_origin_create();
+	}
 	if (new_origin < 0) {
 		LOG_ERROR("Failed to create origin: %d", new_origin);
 		bfree(url_copy);
+		if (replay) {
+			moq_replay_destroy(replay);
+		}
 		pthread_mutex_lock(&ctx->mutex);
-		ctx->reconnect_in_progress = false;
+		next = moq_source_edit_state_locked(ctx);
+		next->reconnect_in_progress = false;
+		moq_source_publish_locked(ctx, next);
 		pthread_mutex_unlock(&ctx->mutex);
 		return;
 	}
 
 	// Connect to MoQ server (consume will happen in on_session_status callback)
-	int32_t new_session = moq_session_connect(
+	int32_t new_session = loopback ? -1 : moq_session_connect(
 		url_copy, strlen(url_copy),
 		0, // origin_publish
 		new_origin, // origin_consume
 		on_session_status, ctx
 	);
-	bfree(url_copy);
 
-	if (new_session < 0) {
+	if (new_session < 0 && !loopback) {
 		LOG_ERROR("Failed to connect to MoQ server: %d", new_session);
-		moq_origin_close(new_origin);
+		bfree(url_copy);
+		moq_loopback_release(new_origin);
 		pthread_mutex_lock(&ctx->mutex);
-		ctx->reconnect_in_progress = false;
+		next = moq_source_edit_state_locked(ctx);
+		next->reconnect_in_progress = false;
+		moq_source_publish_locked(ctx, next);
 		pthread_mutex_unlock(&ctx->mutex);
 		return;
 	}
 
-	// Now update ctx with the new handles, checking if generation changed
+	// Now update the state with the new handles, checking if generation changed
 	pthread_mutex_lock(&ctx->mutex);
-	if (ctx->generation != new_gen) {
+	next = moq_source_edit_state_locked(ctx);
+	next->reconnect_in_progress = false;
+	if (next->generation != new_gen) {
 		// Another reconnect happened while we were creating origin/session
 		// Clean up our newly created resources
-		ctx->reconnect_in_progress = false;
+		moq_source_publish_locked(ctx, next);
 		pthread_mutex_unlock(&ctx->mutex);
 		LOG_INFO("Generation changed during reconnect setup, cleaning up stale resources");
-		moq_session_close(new_session);
-		moq_origin_close(new_origin);
+		if (new_session >= 0) {
+			moq_session_close(new_session);
+		}
+		moq_loopback_release(new_origin);
+		if (replay) {
+			moq_replay_destroy(replay);
+		}
+		bfree(url_copy);
 		return;
 	}
-	ctx->origin = new_origin;
-	ctx->session = new_session;
-	ctx->reconnect_in_progress = false;
-	LOG_INFO("Connecting to MoQ server (generation %u)", new_gen);
+	next->origin = new_origin;
+	next->session = new_session;
+	next->replay = replay;
+	moq_source_publish_locked(ctx, next);
 	pthread_mutex_unlock(&ctx->mutex);
+
+	if (loopback) {
+		LOG_INFO("Consuming from %s origin '%s' (generation %u)", replay ? "replay" : "loopback", loopback,
+		         new_gen);
+		moq_source_start_consume(ctx, new_gen);
+	} else {
+		LOG_INFO("Connecting to MoQ server (generation %u)", new_gen);
+	}
+	bfree(url_copy);
 }
 
 // Called after session is connected successfully
@@ -506,13 +1403,14 @@ static void moq_source_start_consume(struct moq_source *ctx, uint32_t expected_g
 {
 	// Check if origin is still valid and generation matches
 	pthread_mutex_lock(&ctx->mutex);
-	if (ctx->origin < 0 || ctx->generation != expected_gen) {
+	const struct moq_state *state = ctx->state.load();
+	if (state->origin < 0 || state->generation != expected_gen) {
 		pthread_mutex_unlock(&ctx->mutex);
 		LOG_INFO("Skipping stale consume (generation mismatch or invalid origin)");
 		return;
 	}
 	// Capture values while holding mutex
-	int32_t origin = ctx->origin;
+	int32_t origin = state->origin;
 	char *broadcast_copy = bstrdup(ctx->broadcast);
 	pthread_mutex_unlock(&ctx->mutex);
 
@@ -523,15 +1421,17 @@ static void moq_source_start_consume(struct moq_source *ctx, uint32_t expected_g
 		bfree(broadcast_copy);
 		// Failed to consume - clean up session/origin
 		pthread_mutex_lock(&ctx->mutex);
-		if (ctx->generation == expected_gen) {
-			if (ctx->session >= 0) {
-				moq_session_close(ctx->session);
-				ctx->session = -1;
+		if (ctx->state.load()->generation == expected_gen) {
+			struct moq_state *next = moq_source_edit_state_locked(ctx);
+			if (next->session >= 0) {
+				moq_session_close(next->session);
+				next->session = -1;
 			}
-			if (ctx->origin >= 0) {
-				moq_origin_close(ctx->origin);
-				ctx->origin = -1;
+			if (next->origin >= 0) {
+				moq_loopback_release(next->origin);
+				next->origin = -1;
 			}
+			moq_source_publish_locked(ctx, next);
 		}
 		pthread_mutex_unlock(&ctx->mutex);
 		moq_source_blank_video(ctx);
@@ -540,14 +1440,16 @@ static void moq_source_start_consume(struct moq_source *ctx, uint32_t expected_g
 
 	pthread_mutex_lock(&ctx->mutex);
 	// Verify generation hasn't changed while we were waiting
-	if (ctx->generation != expected_gen) {
+	if (ctx->state.load()->generation != expected_gen) {
 		pthread_mutex_unlock(&ctx->mutex);
 		LOG_INFO("Generation changed during consume setup, cleaning up");
 		moq_consume_close(consume);
 		bfree(broadcast_copy);
 		return;
 	}
-	ctx->consume = consume;
+	struct moq_state *next = moq_source_edit_state_locked(ctx);
+	next->consume = consume;
+	moq_source_publish_locked(ctx, next);
 	pthread_mutex_unlock(&ctx->mutex);
 
 	// Subscribe to catalog updates
@@ -557,19 +1459,21 @@ static void moq_source_start_consume(struct moq_source *ctx, uint32_t expected_g
 		bfree(broadcast_copy);
 		// Failed to get catalog - clean up
 		pthread_mutex_lock(&ctx->mutex);
-		if (ctx->generation == expected_gen) {
-			if (ctx->consume >= 0) {
-				moq_consume_close(ctx->consume);
-				ctx->consume = -1;
+		if (ctx->state.load()->generation == expected_gen) {
+			next = moq_source_edit_state_locked(ctx);
+			if (next->consume >= 0) {
+				moq_consume_close(next->consume);
+				next->consume = -1;
 			}
-			if (ctx->session >= 0) {
-				moq_session_close(ctx->session);
-				ctx->session = -1;
+			if (next->session >= 0) {
+				moq_session_close(next->session);
+				next->session = -1;
 			}
-			if (ctx->origin >= 0) {
-				moq_origin_close(ctx->origin);
-				ctx->origin = -1;
+			if (next->origin >= 0) {
+				moq_loopback_release(next->origin);
+				next->origin = -1;
 			}
+			moq_source_publish_locked(ctx, next);
 		}
 		pthread_mutex_unlock(&ctx->mutex);
 		moq_source_blank_video(ctx);
@@ -580,38 +1484,44 @@ static void moq_source_start_consume(struct moq_source *ctx, uint32_t expected_g
 	bfree(broadcast_copy);
 }
 
-// NOTE: Caller must hold ctx->mutex when calling this function
-static void moq_source_disconnect_locked(struct moq_source *ctx)
+// Closes every handle in next and drops its pipelines; they're freed once next is published
+// and no callback is using them.
+// NOTE: Caller must hold ctx->mutex and publish next afterwards
+static void moq_source_disconnect_locked(struct moq_state *next)
 {
-	if (ctx->video_track >= 0) {
-		moq_consume_video_close(ctx->video_track);
-		ctx->video_track = -1;
+	moq_source_cancel_switch_locked(next);
+	if (next->video_track[next->active_slot] >= 0) {
+		moq_consume_video_close(next->video_track[next->active_slot]);
+		next->video_track[next->active_slot] = -1;
 	}
-
-	if (ctx->catalog_handle >= 0) {
-		moq_consume_catalog_close(ctx->catalog_handle);
-		ctx->catalog_handle = -1;
+	next->slot_rendition[next->active_slot] = -1;
+	next->pipeline[next->active_slot] = NULL;
+	next->subscription[next->active_slot] = NULL;
+	next->rendition_count = 0;
+	next->catalog_serial++;
+
+	if (next->catalog_handle >= 0) {
+		moq_consume_catalog_close(next->catalog_handle);
+		next->catalog_handle = -1;
 	}
 
-	if (ctx->consume >= 0) {
-		moq_consume_close(ctx->consume);
-		ctx->consume = -1;
+	if (next->consume >= 0) {
+		moq_consume_close(next->consume);
+		next->consume = -1;
 	}
 
-	if (ctx->session >= 0) {
-		moq_session_close(ctx->session);
-		ctx->session = -1;
+	if (next->session >= 0) {
+		moq_session_close(next->session);
+		next->session = -1;
 	}
 
-	if (ctx->origin >= 0) {
-		moq_origin_close(ctx->origin);
-		ctx->origin = -1;
+	if (next->origin >= 0) {
+		moq_loopback_release(next->origin);
+		next->origin = -1;
 	}
 
-	moq_source_destroy_decoder_locked(ctx);
-	ctx->got_keyframe = false;
-	ctx->frames_waiting_for_keyframe = 0;
-	ctx->consecutive_decode_errors = 0;
+	// Stopped once the state is retired
+	next->replay = NULL;
 }
 
 // Blanks the video preview by outputting a NULL frame
@@ -622,291 +1532,958 @@ static void moq_source_blank_video(struct moq_source *ctx)
 	LOG_DEBUG("Video preview blanked");
 }
 
-static bool moq_source_init_decoder(struct moq_source *ctx, const struct moq_video_config *config)
+// Opens a decoder for a catalog video track, without touching any pipeline.
+// A warm one from the decoder cache is used when available; pix_fmt then receives the format it last
+// decoded to, otherwise AV_PIX_FMT_NONE.
+static AVCodecContext *moq_source_open_decoder(struct moq_source *ctx, const struct moq_video_config *config,
+                                               struct moq_decoder_key *key, enum AVPixelFormat *pix_fmt)
 {
+	// Log the codec string for debugging (may not be null-terminated)
+	char codec_str[64];
+	moq_source_copy_string(codec_str, sizeof(codec_str), config->codec, config->codec_len);
+
 	// Map codec string to FFmpeg codec ID dynamically
 	AVCodecID codec_id = codec_string_to_id(config->codec, config->codec_len);
 	if (codec_id == AV_CODEC_ID_NONE) {
-		// Log the codec string for debugging (may not be null-terminated)
-		char codec_str[64] = {0};
-		size_t copy_len = config->codec_len < sizeof(codec_str) - 1 ? config->codec_len : sizeof(codec_str) - 1;
-		if (config->codec && copy_len > 0) {
-			memcpy(codec_str, config->codec, copy_len);
-		}
 		LOG_ERROR("Unknown or unsupported codec: '%s'", codec_str);
-		return false;
+		return NULL;
 	}
 
-	// Find decoder for the codec
-	const AVCodec *codec = avcodec_find_decoder(codec_id);
-	if (!codec) {
-		LOG_ERROR("Decoder not found for codec ID: %d", codec_id);
-		return false;
+	bool low_latency = ctx->low_latency.load();
+	*key = {};
+	key->codec_id = codec_id;
+	key->extradata_size = config->description ? config->description_len : 0;
+	key->extradata_hash = moq_source_hash(config->description, key->extradata_size);
+	key->width = config->coded_width ? (int)*config->coded_width : 0;
+	key->height = config->coded_height ? (int)*config->coded_height : 0;
+	key->low_latency = low_latency;
+
+	// Skips find/alloc/open, which takes tens of milliseconds for frame-threaded HEVC/AV1
+	AVCodecContext *cached = moq_decoder_cache_take(key, pix_fmt);
+	if (cached) {
+		LOG_INFO("Reusing cached decoder: codec=%s, dimensions=%dx%d, low_latency=%d", codec_str, cached->width,
+		         cached->height, low_latency);
+		return cached;
 	}
 
-	// Create codec context (can be done outside mutex)
-	AVCodecContext *new_codec_ctx = avcodec_alloc_context3(codec);
+	// Opened by the helper the decode benchmark uses too, so both run with the same flags
+	AVCodecContext *new_codec_ctx = moq_decoder_open(key, config->description);
 	if (!new_codec_ctx) {
-		LOG_ERROR("Failed to allocate codec context");
-		return false;
+		return NULL;
 	}
 
-	// Get dimensions from config - required for buffer allocation
-	uint32_t width = 0;
-	uint32_t height = 0;
+	// Dimensions missing from the config may have been parsed from extradata by now
+	LOG_INFO("Decoder initialized: codec=%s, dimensions=%dx%d, low_latency=%d (may be refined on first frame)",
+	         codec_str, new_codec_ctx->width, new_codec_ctx->height, low_latency);
+
+	return new_codec_ctx;
+}
 
-	if (config->coded_width && *config->coded_width > 0) {
-		new_codec_ctx->width = *config->coded_width;
-		width = *config->coded_width;
+// Opens a decoder for a catalog video track and wraps it in a pipeline ready to be published.
+// Scalers and the frame buffer are created on the first decoded frame, unless a cached decoder
+// already knows its output format.
+static struct moq_pipeline *moq_source_create_pipeline(struct moq_source *ctx, const struct moq_video_config *config)
+{
+	struct moq_decoder_key key;
+	enum AVPixelFormat cached_pix_fmt = AV_PIX_FMT_NONE;
+	AVCodecContext *codec_ctx = moq_source_open_decoder(ctx, config, &key, &cached_pix_fmt);
+	if (!codec_ctx) {
+		return NULL;
 	}
-	if (config->coded_height && *config->coded_height > 0) {
-		new_codec_ctx->height = *config->coded_height;
-		height = *config->coded_height;
+	int width = codec_ctx->width > 0 ? codec_ctx->width : 0;
+	int height = codec_ctx->height > 0 ? codec_ctx->height : 0;
+
+	struct moq_pipeline *pipeline = (struct moq_pipeline *)bzalloc(sizeof(struct moq_pipeline));
+	pipeline->busy = false;
+	pipeline->codec_ctx = codec_ctx;
+	pipeline->decoder_key = key;
+	pipeline->current_pix_fmt = AV_PIX_FMT_NONE; // Will be set on first frame
+	pipeline->packet = av_packet_alloc();
+	moq_packet_builder_init(&pipeline->packet_builder);
+	moq_abr_reset(&pipeline->abr, os_gettime_ns());
+	moq_timeshift_init(&pipeline->timeshift, 0);
+	pipeline->decode = ctx->decode_video.load();
+	// "avc1.64001f" is published as "avc1": the parameters are in the description
+	size_t format_len = 0;
+	while (format_len < config->codec_len && config->codec[format_len] != '.') {
+		format_len++;
 	}
-
-	// Use codec description as extradata (contains SPS/PPS for H.264, VPS/SPS/PPS for HEVC, etc.)
-	if (config->description && config->description_len > 0) {
-		new_codec_ctx->extradata = (uint8_t *)av_mallocz(config->description_len + AV_INPUT_BUFFER_PADDING_SIZE);
-		if (new_codec_ctx->extradata) {
-			memcpy(new_codec_ctx->extradata, config->description, config->description_len);
-			new_codec_ctx->extradata_size = config->description_len;
-		}
+	moq_source_copy_string(pipeline->restream_format, sizeof(pipeline->restream_format), config->codec,
+	                       format_len);
+
+	// Initialize OBS frame structure - dimensions are refined from the first decoded frame
+	pipeline->frame.width = width;
+	pipeline->frame.height = height;
+	pipeline->frame.linesize[0] = width * 4;
+	pipeline->frame.format = VIDEO_FORMAT_RGBA;
+
+	if (!pipeline->packet) {
+		LOG_ERROR("Failed to allocate packet");
+		moq_pipeline_destroy(pipeline);
+		return NULL;
 	}
 
-	// Open codec
-	if (avcodec_open2(new_codec_ctx, codec, NULL) < 0) {
-		LOG_ERROR("Failed to open codec");
-		avcodec_free_context(&new_codec_ctx);
-		return false;
+	if (ctx->thumbnail.load()) {
+		moq_pipeline_set_thumbnail(pipeline, true);
+	}
+	if (ctx->timeshift_mb.load() > 0) {
+		moq_pipeline_set_timeshift(pipeline, ctx->timeshift_mb.load());
 	}
 
-	// If dimensions weren't in config, try to get them from the opened codec context
-	// (may have been parsed from extradata)
-	if (width == 0 && new_codec_ctx->width > 0) {
-		width = new_codec_ctx->width;
+	// A cached decoder knows its output format, so the converters are ready before the first frame
+	if (cached_pix_fmt != AV_PIX_FMT_NONE && width > 0 && height > 0) {
+		moq_pipeline_prepare_output(ctx, pipeline, width, height, cached_pix_fmt);
 	}
-	if (height == 0 && new_codec_ctx->height > 0) {
-		height = new_codec_ctx->height;
+
+	return pipeline;
+}
+// Reads up to MOQ_MAX_RENDITIONS video tracks from the catalog, returns how many it found
+static size_t moq_source_read_renditions(int32_t catalog, struct moq_rendition *renditions)
+{
+	size_t count = 0;
+	struct moq_video_config config;
+	while (count < MOQ_MAX_RENDITIONS && moq_consume_video_config(catalog, count, &config) >= 0) {
+		struct moq_rendition *r = &renditions[count++];
+		moq_source_copy_string(r->name, sizeof(r->name), config.name, config.name_len);
+		moq_source_copy_string(r->codec, sizeof(r->codec), config.codec, config.codec_len);
+		r->width = config.coded_width ? *config.coded_width : 0;
+		r->height = config.coded_height ? *config.coded_height : 0;
+		r->description_size = config.description ? config.description_len : 0;
+		r->description_hash = moq_source_hash(config.description, r->description_size);
 	}
+	return count;
+}
 
-	// Now take the mutex and swap in the new decoder state
-	pthread_mutex_lock(&ctx->mutex);
+// Applies an updated catalog without touching the active pipeline when its track is unchanged.
+// Returns the rendition to switch to, or -1 to keep playing the active one.
+// NOTE: Caller must hold ctx->mutex and publish next afterwards
+static int moq_source_update_catalog_locked(struct moq_state *next, int32_t catalog,
+                                           const struct moq_rendition *renditions, size_t rendition_count,
+                                           int wanted, uint32_t max_height)
+{
+	// Tracks are matched by name; indices may shift when tracks are added or removed
+	int active = next->slot_rendition[next->active_slot];
+	int match = -1;
+	bool same_decoder = false;
+	if (active >= 0 && (size_t)active < next->rendition_count) {
+		const struct moq_rendition *old = &next->renditions[active];
+		for (size_t i = 0; i < rendition_count; i++) {
+			if (strcmp(renditions[i].name, old->name) == 0) {
+				match = (int)i;
+				same_decoder = strcmp(renditions[match].codec, old->codec) == 0 &&
+				               renditions[match].description_size == old->description_size &&
+				               renditions[match].description_hash == old->description_hash;
+				break;
+			}
+		}
+	}
 
-	// Destroy old decoder state
-	if (ctx->sws_ctx) {
-		sws_freeContext(ctx->sws_ctx);
-	}
-	if (ctx->codec_ctx) {
-		avcodec_free_context(&ctx->codec_ctx);
-	}
-	if (ctx->frame_buffer) {
-		bfree(ctx->frame_buffer);
-	}
-
-	// Install new decoder state
-	// Note: sws_ctx, frame_buffer, and frame dimensions will be initialized
-	// dynamically on first decoded frame when we know the actual pixel format
-	ctx->codec_ctx = new_codec_ctx;
-	ctx->current_codec_id = codec_id;
-	ctx->current_pix_fmt = AV_PIX_FMT_NONE;  // Will be set on first frame
-	ctx->sws_ctx = NULL;  // Will be created on first frame with actual pixel format
-	ctx->frame_buffer = NULL;  // Will be allocated on first frame with actual dimensions
-	ctx->frame.width = width;
-	ctx->frame.height = height;
-	ctx->frame.linesize[0] = width * 4;
-	ctx->frame.data[0] = NULL;
-	ctx->frame.format = VIDEO_FORMAT_RGBA;
-	ctx->frame.timestamp = 0;
-	ctx->got_keyframe = false;
-	ctx->frames_waiting_for_keyframe = 0;
-	ctx->consecutive_decode_errors = 0;
+	// A pending switch refers to the old catalog's indices
+	moq_source_cancel_switch_locked(next);
 
-	pthread_mutex_unlock(&ctx->mutex);
+	if (next->catalog_handle != catalog) {
+		moq_consume_catalog_close(next->catalog_handle);
+		next->catalog_handle = catalog;
+	}
+	memcpy(next->renditions, renditions, rendition_count * sizeof(*renditions));
+	next->rendition_count = rendition_count;
+	// Resets the active pipeline's ABR at its next frame
+	next->catalog_serial++;
+
+	if (same_decoder) {
+		// Subscription and decoder carry on, only the index may have moved
+		next->slot_rendition[next->active_slot] = match;
+		LOG_INFO("Catalog updated (%zu video tracks), keeping track '%s'", rendition_count,
+		         renditions[match].name);
+		return wanted >= 0 && wanted != match ? wanted : -1;
+	}
 
-	// Log codec name for debugging
-	char codec_str[64] = {0};
-	size_t copy_len = config->codec_len < sizeof(codec_str) - 1 ? config->codec_len : sizeof(codec_str) - 1;
-	if (config->codec && copy_len > 0) {
-		memcpy(codec_str, config->codec, copy_len);
+	// The active track is gone or needs a new decoder. Its frames keep being output (flagged as
+	// outside the catalog) until the replacement reaches a keyframe.
+	next->slot_rendition[next->active_slot] = MOQ_MAX_RENDITIONS;
+	int switch_to = wanted;
+	if (switch_to < 0) {
+		switch_to = match >= 0 ? match
+		                       : moq_abr_initial(renditions, rendition_count, max_height);
 	}
-	LOG_INFO("Decoder initialized: codec=%s, dimensions=%ux%u (may be refined on first frame)",
-	         codec_str, width, height);
-	return true;
+	LOG_INFO("Catalog updated (%zu video tracks), active track %s, switching to track %d", rendition_count,
+	         match >= 0 ? "reconfigured" : "removed", switch_to);
+	return switch_to;
 }
 
-// NOTE: Caller must hold ctx->mutex when calling this function
-static void moq_source_destroy_decoder_locked(struct moq_source *ctx)
+// Height the source is displayed at. The scene item scale isn't known to a source,
+// so the canvas height is the upper bound, or the thumbnail height in keyframes-only mode.
+static uint32_t moq_source_display_height(struct moq_source *ctx)
 {
-	if (ctx->sws_ctx) {
-		sws_freeContext(ctx->sws_ctx);
-		ctx->sws_ctx = NULL;
+	if (ctx->thumbnail.load()) {
+		return MOQ_THUMBNAIL_HEIGHT;
 	}
 
-	if (ctx->codec_ctx) {
-		avcodec_free_context(&ctx->codec_ctx);
-		ctx->codec_ctx = NULL;
+	struct obs_video_info ovi;
+	return obs_get_video_info(&ovi) ? ovi.base_height : 0;
+}
+
+// Rendition to switch to at this group boundary of the active track, -1 to stay.
+// state is the one the frame was decoded under, with pipeline as its active pipeline.
+static int moq_source_pick_rendition(struct moq_source *ctx, const struct moq_state *state,
+                                     struct moq_pipeline *pipeline, uint64_t now_ns)
+{
+	if (state->switch_in_progress) {
+		if (now_ns - state->switch_start_ns > MOQ_SWITCH_TIMEOUT_NS) {
+			LOG_WARNING("Rendition %d never delivered a usable keyframe, staying on %d",
+			            state->slot_rendition[1 - state->active_slot],
+			            state->slot_rendition[state->active_slot]);
+			moq_source_cancel_switch(ctx, state->switch_id);
+		}
+		return -1;
 	}
 
-	if (ctx->frame_buffer) {
-		bfree(ctx->frame_buffer);
-		ctx->frame_buffer = NULL;
-		ctx->frame.data[0] = NULL;
+	int current = state->slot_rendition[state->active_slot];
+	if (current < 0 || state->rendition_count == 0) {
+		return -1;
 	}
 
-	// Reset dynamic format tracking
-	ctx->current_codec_id = AV_CODEC_ID_NONE;
-	ctx->current_pix_fmt = AV_PIX_FMT_NONE;
+	int next = ctx->rendition_setting.load();
+	if (next < 0 || (size_t)next >= state->rendition_count) {
+		uint32_t max_height = moq_source_display_height(ctx);
+		if ((size_t)current >= state->rendition_count) {
+			// Still playing a track the catalog dropped, the replacement failed to start
+			next = moq_abr_initial(state->renditions, state->rendition_count, max_height);
+		} else {
+			next = moq_abr_select(&pipeline->abr, state->renditions, state->rendition_count, current,
+			                      max_height, now_ns);
+		}
+	}
+	return next == current ? -1 : next;
 }
 
-static void moq_source_decode_frame(struct moq_source *ctx, int32_t frame_id)
+// Has the worker thread run moq_source_start_switch. Opening a decoder that isn't cached takes tens
+// of milliseconds for hardware or frame-threaded ones, and the callers are libmoq callbacks (the
+// active track's own, for ABR) or the UI thread, which must keep going meanwhile.
+static void moq_source_start_switch_async(struct moq_source *ctx, int rendition, const struct moq_abr *abr)
 {
-	// Fast path: check atomic flag before taking lock
-	if (ctx->shutting_down.load()) {
-		moq_consume_frame_close(frame_id);
-		return;
+	pthread_mutex_lock(&ctx->worker_mutex);
+	ctx->switch_requested = true;
+	ctx->switch_rendition = rendition;
+	ctx->switch_has_abr = abr != NULL;
+	if (abr) {
+		ctx->switch_abr = *abr;
 	}
+	pthread_cond_signal(&ctx->worker_cond);
+	pthread_mutex_unlock(&ctx->worker_mutex);
+}
 
-	pthread_mutex_lock(&ctx->mutex);
+static void *moq_source_worker_thread(void *data)
+{
+	struct moq_source *ctx = (struct moq_source *)data;
+	os_set_thread_name("moq-source: worker");
 
-	// Double-check after acquiring lock (may have changed)
-	if (ctx->shutting_down.load()) {
+	pthread_mutex_lock(&ctx->worker_mutex);
+	for (;;) {
+		while (!ctx->worker_stopping && !ctx->reclaim_requested && !ctx->switch_requested) {
+			pthread_cond_wait(&ctx->worker_cond, &ctx->worker_mutex);
+		}
+		if (ctx->worker_stopping) {
+			break;
+		}
+
+		if (ctx->reclaim_requested) {
+			ctx->reclaim_requested = false;
+			pthread_mutex_unlock(&ctx->worker_mutex);
+			pthread_mutex_lock(&ctx->mutex);
+			moq_source_reclaim_locked(ctx);
+			pthread_mutex_unlock(&ctx->mutex);
+			pthread_mutex_lock(&ctx->worker_mutex);
+			continue;
+		}
+
+		int rendition = ctx->switch_rendition;
+		bool has_abr = ctx->switch_has_abr;
+		struct moq_abr abr = ctx->switch_abr;
+		ctx->switch_requested = false;
+		pthread_mutex_unlock(&ctx->worker_mutex);
+
+		moq_source_start_switch(ctx, rendition, has_abr ? &abr : NULL);
+
+		pthread_mutex_lock(&ctx->worker_mutex);
+	}
+	pthread_mutex_unlock(&ctx->worker_mutex);
+	return NULL;
+}
+
+// Subscribes the idle slot to a rendition with its own pipeline. Frames of the active track keep
+// being output until the new track reaches a keyframe, see moq_source_pending_frame.
+// abr seeds the new pipeline's rendition selection so its history carries over, NULL starts afresh.
+static void moq_source_start_switch(struct moq_source *ctx, int rendition, const struct moq_abr *abr)
+{
+	pthread_mutex_lock(&ctx->mutex);
+	const struct moq_state *state = ctx->state.load();
+	if (ctx->shutting_down.load() || state->catalog_handle < 0 || state->switch_in_progress ||
+	    (size_t)rendition >= state->rendition_count || rendition == state->slot_rendition[state->active_slot]) {
 		pthread_mutex_unlock(&ctx->mutex);
-		moq_consume_frame_close(frame_id);
 		return;
 	}
+	int32_t catalog = state->catalog_handle;
+	uint32_t current_gen = state->generation;
+	uint32_t switch_id = state->switch_id;
+	int slot = 1 - state->active_slot;
+
+	struct moq_state *next = moq_source_edit_state_locked(ctx);
+	next->switch_in_progress = true;
+	next->switch_start_ns = os_gettime_ns();
+	moq_source_publish_locked(ctx, next);
+	pthread_mutex_unlock(&ctx->mutex);
+
+	// Open the decoder before subscribing, so it's ready for the first keyframe
+	struct moq_video_config video_config;
+	struct moq_pipeline *pipeline = NULL;
+	if (moq_consume_video_config(catalog, rendition, &video_config) >= 0) {
+		pipeline = moq_source_create_pipeline(ctx, &video_config);
+	}
+	if (pipeline && abr) {
+		pipeline->abr = *abr;
+	}
+
+	pthread_mutex_lock(&ctx->mutex);
+	state = ctx->state.load();
+	if (state->generation != current_gen || state->switch_id != switch_id) {
+		// Cancelled by a disconnect or a new catalog while the decoder was opening
+		pthread_mutex_unlock(&ctx->mutex);
+		if (pipeline) {
+			moq_pipeline_destroy(pipeline);
+		}
+		return;
+	}
+	next = moq_source_edit_state_locked(ctx);
+	if (!pipeline) {
+		LOG_ERROR("Failed to initialize decoder for rendition %d", rendition);
+		next->switch_in_progress = false;
+		moq_source_publish_locked(ctx, next);
+		pthread_mutex_unlock(&ctx->mutex);
+		return;
+	}
+	pipeline->abr_catalog_serial = next->catalog_serial;
+	struct moq_subscription *subscription = moq_source_set_pipeline_locked(ctx, next, slot, pipeline);
+	next->slot_rendition[slot] = rendition;
+	moq_source_publish_locked(ctx, next);
+	pthread_mutex_unlock(&ctx->mutex);
 
-	// Check if decoder is still valid (may have been destroyed during reconnect)
-	// Note: sws_ctx and frame_buffer may be NULL on first frame - they're created dynamically
-	if (!ctx->codec_ctx) {
+	int32_t track = moq_consume_video_ordered(catalog, rendition, 0, on_video_frame, subscription);
+	moq_flight_record(ctx->flight, MOQ_FLIGHT_TRACK, track, 0, 0, 0, false);
+
+	pthread_mutex_lock(&ctx->mutex);
+	state = ctx->state.load();
+	if (state->generation != current_gen || state->switch_id != switch_id) {
 		pthread_mutex_unlock(&ctx->mutex);
-		moq_consume_frame_close(frame_id);
+		if (track >= 0) {
+			moq_consume_video_close(track);
+		}
 		return;
 	}
+	next = moq_source_edit_state_locked(ctx);
+	if (track < 0) {
+		LOG_ERROR("Failed to subscribe to video track %d: %d", rendition, track);
+		moq_source_cancel_switch_locked(next);
+	} else {
+		// The switch may already have completed if frames arrived before the handle did
+		next->video_track[slot] = track;
+	}
+	moq_source_publish_locked(ctx, next);
+	pthread_mutex_unlock(&ctx->mutex);
 
-	// Get frame data
+	if (track >= 0) {
+		LOG_INFO("Subscribed to rendition %d (%ux%u), switching at its next keyframe", rendition,
+		         video_config.coded_width ? *video_config.coded_width : 0,
+		         video_config.coded_height ? *video_config.coded_height : 0);
+	}
+}
+
+// Cancels the pending switch, unless it already completed or was replaced by another one
+static void moq_source_cancel_switch(struct moq_source *ctx, uint32_t switch_id)
+{
+	pthread_mutex_lock(&ctx->mutex);
+	const struct moq_state *state = ctx->state.load();
+	if (state->switch_in_progress && state->switch_id == switch_id) {
+		struct moq_state *next = moq_source_edit_state_locked(ctx);
+		moq_source_cancel_switch_locked(next);
+		moq_source_publish_locked(ctx, next);
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+// Drops the idle slot's subscription and pipeline
+// NOTE: Caller must hold ctx->mutex and publish next afterwards
+static void moq_source_cancel_switch_locked(struct moq_state *next)
+{
+	int slot = 1 - next->active_slot;
+	if (next->video_track[slot] >= 0) {
+		moq_consume_video_close(next->video_track[slot]);
+		next->video_track[slot] = -1;
+	}
+	next->slot_rendition[slot] = -1;
+	next->pipeline[slot] = NULL;
+	next->subscription[slot] = NULL;
+	next->switch_in_progress = false;
+	next->switch_id++;
+}
+
+// Frame from the pending slot. Everything before its first keyframe newer than the output is dropped;
+// that keyframe promotes the slot and is decoded as the first frame of the new rendition.
+static void moq_source_pending_frame(struct moq_source *ctx, int slot, struct moq_pipeline *pipeline,
+                                     int32_t frame_id)
+{
 	struct moq_frame frame_data;
-	if (moq_consume_frame_chunk(frame_id, 0, &frame_data) < 0) {
-		LOG_ERROR("Failed to get frame data");
+	if (moq_consume_frame_chunk(frame_id, 0, &frame_data) < 0 || !frame_data.keyframe ||
+	    frame_data.timestamp_us <= ctx->last_output_us.load()) {
+		moq_consume_frame_close(frame_id);
+		return;
+	}
+
+	pthread_mutex_lock(&ctx->mutex);
+	const struct moq_state *state = ctx->state.load();
+	if (ctx->shutting_down.load() || slot == state->active_slot || state->pipeline[slot] != pipeline) {
 		pthread_mutex_unlock(&ctx->mutex);
 		moq_consume_frame_close(frame_id);
 		return;
 	}
 
+	// Break: the old track has output everything before this keyframe. Its pipeline is retired,
+	// and the decoder returns to the cache in case ABR switches back.
+	struct moq_state *next = moq_source_edit_state_locked(ctx);
+	int old_slot = next->active_slot;
+	int old_rendition = next->slot_rendition[old_slot];
+	if (next->video_track[old_slot] >= 0) {
+		moq_consume_video_close(next->video_track[old_slot]);
+		next->video_track[old_slot] = -1;
+	}
+	next->slot_rendition[old_slot] = -1;
+	next->pipeline[old_slot] = NULL;
+	next->subscription[old_slot] = NULL;
+	next->active_slot = slot;
+	next->switch_in_progress = false;
+	moq_source_publish_locked(ctx, next);
+
+	LOG_INFO("Switched rendition %d -> %d at %llu us", old_rendition, next->slot_rendition[slot],
+	         (unsigned long long)frame_data.timestamp_us);
+	pthread_mutex_unlock(&ctx->mutex);
+
+	// Still in flight, so next can't be reclaimed before this returns.
+	// Scalers and the frame buffer follow the new dimensions on the first decoded frame.
+	moq_source_decode_frame(ctx, next, pipeline, frame_id);
+}
+
+static void moq_pipeline_destroy(struct moq_pipeline *pipeline)
+{
+	moq_frame_converter_free(&pipeline->converter);
+
+	// Kept warm for a reconnect, a switch back or another source playing the same feed
+	if (pipeline->codec_ctx) {
+		pipeline->codec_ctx->skip_frame = AVDISCARD_DEFAULT;
+	}
+	moq_decoder_cache_put(&pipeline->decoder_key, &pipeline->codec_ctx, pipeline->current_pix_fmt);
+
+	if (pipeline->frame_buffer) {
+		bfree(pipeline->frame_buffer);
+	}
+	av_packet_free(&pipeline->packet);
+	moq_packet_builder_free(&pipeline->packet_builder);
+	moq_timeshift_free(&pipeline->timeshift);
+	if (pipeline->recorder) {
+		moq_recorder_destroy(pipeline->recorder);
+	}
+
+	bfree(pipeline);
+}
+
+// Switches between full and keyframes-only decoding. Either way the decoder's references no longer
+// match the stream, so it restarts at the next keyframe; leaving the mode costs at most one group.
+static void moq_pipeline_set_thumbnail(struct moq_pipeline *pipeline, bool thumbnail)
+{
+	// Belt and braces: non-keyframes aren't sent in this mode, but a decoder that is handed one
+	// anyway then skips it without decoding
+	pipeline->codec_ctx->skip_frame = thumbnail ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+	avcodec_flush_buffers(pipeline->codec_ctx);
+	pipeline->thumbnail = thumbnail;
+	pipeline->got_keyframe = false;
+
+	// The output size depends on the mode
+	moq_frame_converter_free(&pipeline->converter);
+}
+
+// Creates the converters and RGBA frame buffer for decoded frames of this size and format
+static bool moq_pipeline_prepare_output(struct moq_source *ctx, struct moq_pipeline *pipeline, int width,
+                                        int height, enum AVPixelFormat pix_fmt)
+{
+	const char *pix_fmt_name = av_get_pix_fmt_name(pix_fmt) ? av_get_pix_fmt_name(pix_fmt) : "unknown";
+
+	// Thumbnails keep the aspect ratio, with an even width for the scaler
+	int out_width = width;
+	int out_height = height;
+	if (pipeline->thumbnail && height > MOQ_THUMBNAIL_HEIGHT) {
+		out_height = MOQ_THUMBNAIL_HEIGHT;
+		out_width = (int)(((int64_t)width * MOQ_THUMBNAIL_HEIGHT / height + 1) & ~1);
+	}
+
+	// Replace the old scalers with ones for the actual pixel format of the decoded frame
+	moq_frame_converter_free(&pipeline->converter);
+	if (!moq_frame_converter_init(&pipeline->converter, width, height, out_width, out_height, pix_fmt)) {
+		LOG_ERROR("Failed to create scaling context for %dx%d pix_fmt=%d (%s)", width, height, pix_fmt,
+		          pix_fmt_name);
+		return false;
+	}
+
+	// Reallocate frame buffer for new dimensions (width * height * 4 for RGBA)
+	size_t new_buffer_size = (size_t)out_width * (size_t)out_height * 4;
+	uint8_t *new_frame_buffer = (uint8_t *)bmalloc(new_buffer_size);
+	if (!new_frame_buffer) {
+		LOG_ERROR("Failed to allocate frame buffer for %dx%d (%zu bytes)", out_width, out_height,
+		          new_buffer_size);
+		moq_frame_converter_free(&pipeline->converter);
+		return false;
+	}
+
+	// Free old frame buffer
+	if (pipeline->frame_buffer) {
+		bfree(pipeline->frame_buffer);
+	}
+
+	// Install new state
+	pipeline->current_pix_fmt = pix_fmt;
+	pipeline->decoded_width = width;
+	pipeline->decoded_height = height;
+	pipeline->frame_buffer = new_frame_buffer;
+	pipeline->frame.width = out_width;
+	pipeline->frame.height = out_height;
+	pipeline->frame.linesize[0] = out_width * 4;
+	pipeline->frame.data[0] = new_frame_buffer;
+
+	// Old per-slice averages describe a different layout
+	ctx->stats_slice_count.store(pipeline->converter.slice_count, std::memory_order_relaxed);
+	for (int i = 0; i < MOQ_MAX_SLICES; i++) {
+		ctx->stats_slice_ns[i].store(0, std::memory_order_relaxed);
+	}
+
+	LOG_INFO("Scaler initialized for %dx%d pix_fmt=%s -> %dx%d (%s, %d slices)", width, height, pix_fmt_name,
+	         out_width, out_height,
+	         pipeline->converter.convert ? moq_convert_isa_name(moq_convert_best_isa()) : "swscale",
+	         pipeline->converter.slice_count);
+	return true;
+}
+
+// Folds a sample into a moving average (1/8 weight), seeding it with the first sample
+static void moq_source_stats_average(std::atomic<uint64_t> &average, uint64_t sample)
+{
+	uint64_t old = average.load(std::memory_order_relaxed);
+	average.store(old ? old - old / 8 + sample / 8 : sample, std::memory_order_relaxed);
+}
+
+static void moq_source_record_convert_stats(struct moq_source *ctx, const struct moq_pipeline *pipeline,
+                                            const uint64_t *slice_ns, uint64_t convert_ns)
+{
+	moq_source_stats_average(ctx->stats_convert_ns, convert_ns);
+	moq_histogram_record(&ctx->stats_convert_us, convert_ns / 1000);
+	for (int i = 0; i < pipeline->converter.slice_count; i++) {
+		moq_source_stats_average(ctx->stats_slice_ns[i], slice_ns[i]);
+	}
+}
+
+// Whether the published rates describe the feed now, rather than before it stopped
+static bool moq_source_stats_rates_current(struct moq_source *ctx)
+{
+	uint64_t updated_ns = ctx->stats_rate_updated_ns.load(std::memory_order_relaxed);
+	return updated_ns && os_gettime_ns() - updated_ns < 3 * MOQ_RATE_WINDOW_NS;
+}
+
+// Summary of the live statistics shown in the properties
+static void moq_source_format_stats(struct moq_source *ctx, struct dstr *text)
+{
+	bool rates_current = moq_source_stats_rates_current(ctx);
+	dstr_printf(text, "Received: %.0f kbps, %.1f fps\nShown: %.1f fps\n",
+	            rates_current ? ctx->stats_received_bps.load(std::memory_order_relaxed) / 1000.0 : 0.0,
+	            rates_current ? ctx->stats_received_mfps.load(std::memory_order_relaxed) / 1000.0 : 0.0,
+	            rates_current ? ctx->stats_output_mfps.load(std::memory_order_relaxed) / 1000.0 : 0.0);
+	dstr_catf(text, "Decode: %.1f ms median, %.1f ms p99\n",
+	          moq_histogram_percentile(&ctx->stats_decode_us, 0.50) / 1000.0,
+	          moq_histogram_percentile(&ctx->stats_decode_us, 0.99) / 1000.0);
+	dstr_catf(text, "Convert: %.1f ms median, %.1f ms p99\n",
+	          moq_histogram_percentile(&ctx->stats_convert_us, 0.50) / 1000.0,
+	          moq_histogram_percentile(&ctx->stats_convert_us, 0.99) / 1000.0);
+
+	dstr_cat(text, "Dropped frames:");
+	for (int i = 0; i < MOQ_DROP_COUNT; i++) {
+		dstr_catf(text, "%s %s %llu", i ? "," : "", moq_drop_reason_names[i],
+		          (unsigned long long)ctx->stats_frames_dropped[i].load(std::memory_order_relaxed));
+	}
+	dstr_catf(text, "\nKeyframe waits: %llu, longest %.0f ms\nReconnects: %u",
+	          (unsigned long long)ctx->stats_keyframe_wait_us.count.load(std::memory_order_relaxed),
+	          ctx->stats_keyframe_wait_us.max.load(std::memory_order_relaxed) / 1000.0,
+	          ctx->stats_reconnects.load(std::memory_order_relaxed));
+}
+
+// Properties button: rebuilding the properties refreshes the statistics shown
+static bool moq_source_refresh_stats(obs_properties_t *props, obs_property_t *property, void *data)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(property);
+	UNUSED_PARAMETER(data);
+	return true;
+}
+
+// Proc handler: "void get_stats(out string json)"
+static void moq_source_get_stats(void *data, calldata_t *cd)
+{
+	struct moq_source *ctx = (struct moq_source *)data;
+
+	obs_data_t *stats = obs_data_create();
+	uint32_t slice_count = ctx->stats_slice_count.load(std::memory_order_relaxed);
+	obs_data_set_int(stats, "convert_slices", slice_count);
+	obs_data_set_double(stats, "convert_ms", ctx->stats_convert_ns.load(std::memory_order_relaxed) / 1000000.0);
+
+	obs_data_array_t *slices = obs_data_array_create();
+	for (uint32_t i = 0; i < slice_count && i < MOQ_MAX_SLICES; i++) {
+		obs_data_t *slice = obs_data_create();
+		obs_data_set_int(slice, "slice", i);
+		obs_data_set_double(slice, "ms", ctx->stats_slice_ns[i].load(std::memory_order_relaxed) / 1000000.0);
+		obs_data_array_push_back(slices, slice);
+		obs_data_release(slice);
+	}
+	obs_data_set_array(stats, "convert_slice_ms", slices);
+	obs_data_array_release(slices);
+
+	// Holding the writer lock keeps the state from being replaced and freed
+	pthread_mutex_lock(&ctx->mutex);
+	const struct moq_state *state = ctx->state.load();
+	obs_data_set_int(stats, "rendition", state->slot_rendition[state->active_slot]);
+	obs_data_set_int(stats, "rendition_count", (long long)state->rendition_count);
+	if (state->restream) {
+		struct moq_restream_stats restream;
+		moq_restream_get_stats(state->restream, &restream);
+		obs_data_set_bool(stats, "restream_connected", restream.connected);
+		obs_data_set_int(stats, "restream_frames", (long long)restream.frames);
+		obs_data_set_int(stats, "restream_bytes", (long long)restream.bytes);
+		obs_data_set_double(stats, "restream_latency_ms", restream.latency_ns / 1000000.0);
+		obs_data_set_double(stats, "restream_max_latency_ms", restream.max_latency_ns / 1000000.0);
+	}
+	if (state->sync) {
+		struct moq_sync_stats sync;
+		moq_sync_get_stats(state->sync, &sync);
+		obs_data_set_int(stats, "sync_latency_ms", sync.latency_ms);
+		obs_data_set_int(stats, "sync_late_frames", (long long)sync.late_frames);
+		obs_data_set_int(stats, "sync_queued_frames", (long long)sync.queued_frames);
+		obs_data_set_double(stats, "sync_delay_ms", sync.delay_us / 1000.0);
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+	obs_data_set_bool(stats, "rendition_auto", ctx->rendition_setting.load() < 0);
+	obs_data_set_double(stats, "throughput_kbps",
+	                    ctx->stats_throughput_bps.load(std::memory_order_relaxed) / 1000.0);
+	obs_data_set_double(stats, "bitrate_kbps", ctx->stats_bitrate_bps.load(std::memory_order_relaxed) / 1000.0);
+	obs_data_set_double(stats, "queue_delay_ms",
+	                    ctx->stats_queue_delay_us.load(std::memory_order_relaxed) / 1000.0);
+
+	if (ctx->stats_glass_latency_us.load(std::memory_order_relaxed)) {
+		obs_data_set_double(stats, "glass_to_glass_ms",
+		                    ctx->stats_glass_latency_us.load(std::memory_order_relaxed) / 1000.0);
+		obs_data_set_double(stats, "glass_to_glass_max_ms",
+		                    ctx->stats_glass_latency_max_us.load(std::memory_order_relaxed) / 1000.0);
+	}
+
+	uint64_t live_us = ctx->timeshift_live_us.load(std::memory_order_relaxed);
+	uint64_t position_us = ctx->timeshift_position_us.load(std::memory_order_relaxed);
+	obs_data_set_double(stats, "timeshift_ms", live_us > position_us ? (live_us - position_us) / 1000.0 : 0.0);
+	obs_data_set_double(stats, "timeshift_window_ms", moq_source_media_get_duration(ctx));
+
+	obs_data_set_int(stats, "bytes_received", (long long)ctx->stats_bytes_received.load(std::memory_order_relaxed));
+	obs_data_set_int(stats, "frames_received",
+	                 (long long)ctx->stats_frames_received.load(std::memory_order_relaxed));
+	obs_data_set_int(stats, "frames_output", (long long)ctx->stats_frames_output.load(std::memory_order_relaxed));
+	obs_data_set_int(stats, "reconnects", ctx->stats_reconnects.load(std::memory_order_relaxed));
+	bool rates_current = moq_source_stats_rates_current(ctx);
+	obs_data_set_double(stats, "received_kbps",
+	                    rates_current ? ctx->stats_received_bps.load(std::memory_order_relaxed) / 1000.0 : 0.0);
+	obs_data_set_double(stats, "received_fps",
+	                    rates_current ? ctx->stats_received_mfps.load(std::memory_order_relaxed) / 1000.0 : 0.0);
+	obs_data_set_double(stats, "output_fps",
+	                    rates_current ? ctx->stats_output_mfps.load(std::memory_order_relaxed) / 1000.0 : 0.0);
+
+	obs_data_t *dropped = obs_data_create();
+	for (int i = 0; i < MOQ_DROP_COUNT; i++) {
+		obs_data_set_int(dropped, moq_drop_reason_names[i],
+		                 (long long)ctx->stats_frames_dropped[i].load(std::memory_order_relaxed));
+	}
+	obs_data_set_obj(stats, "frames_dropped", dropped);
+	obs_data_release(dropped);
+
+	moq_histogram_to_data(&ctx->stats_decode_us, stats, "decode_ms", 0.001);
+	moq_histogram_to_data(&ctx->stats_convert_us, stats, "convert_ms", 0.001);
+	obs_data_set_int(stats, "keyframe_waits",
+	                 (long long)ctx->stats_keyframe_wait_us.count.load(std::memory_order_relaxed));
+	moq_histogram_to_data(&ctx->stats_keyframe_wait_us, stats, "keyframe_wait_ms", 0.001);
+
+	calldata_set_string(cd, "json", obs_data_get_json(stats));
+	obs_data_release(stats);
+}
+
+// Zeroes the totals, distributions and worst cases; rates and averages carry on
+static void moq_source_reset_stats_counters(struct moq_source *ctx)
+{
+	ctx->stats_bytes_received.store(0, std::memory_order_relaxed);
+	ctx->stats_frames_received.store(0, std::memory_order_relaxed);
+	ctx->stats_frames_output.store(0, std::memory_order_relaxed);
+	for (int i = 0; i < MOQ_DROP_COUNT; i++) {
+		ctx->stats_frames_dropped[i].store(0, std::memory_order_relaxed);
+	}
+	ctx->stats_reconnects.store(0, std::memory_order_relaxed);
+	ctx->stats_glass_latency_max_us.store(0, std::memory_order_relaxed);
+	moq_histogram_reset(&ctx->stats_decode_us);
+	moq_histogram_reset(&ctx->stats_convert_us);
+	moq_histogram_reset(&ctx->stats_keyframe_wait_us);
+}
+
+// Proc handler: "void reset_stats()"
+static void moq_source_reset_stats(void *data, calldata_t *cd)
+{
+	UNUSED_PARAMETER(cd);
+	struct moq_source *ctx = (struct moq_source *)data;
+	moq_source_reset_stats_counters(ctx);
+
+	// Holding the writer lock keeps the restream from being retired and freed
+	pthread_mutex_lock(&ctx->mutex);
+	const struct moq_state *state = ctx->state.load();
+	if (state->restream) {
+		moq_restream_reset_stats(state->restream);
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+// Age of a frame when it's handed to OBS: the wallclock now minus when the publisher captured it,
+// extrapolated from the latest reference. Only meaningful with NTP-synced clocks on both ends.
+static void moq_source_record_glass_latency(struct moq_source *ctx, const struct moq_pipeline *pipeline,
+                                            uint64_t timestamp_us)
+{
+	int64_t captured_us = (int64_t)pipeline->wallclock.wallclock_us +
+	                      ((int64_t)timestamp_us - (int64_t)pipeline->wallclock.timestamp_us);
+	int64_t latency_us = (int64_t)moq_wallclock_now_us() - captured_us;
+	// A clock ahead of ours would make it negative
+	uint64_t sample = latency_us > 0 ? (uint64_t)latency_us : 0;
+
+	moq_source_stats_average(ctx->stats_glass_latency_us, sample);
+	uint64_t max = ctx->stats_glass_latency_max_us.load(std::memory_order_relaxed);
+	while (sample > max && !ctx->stats_glass_latency_max_us.compare_exchange_weak(max, sample)) {
+	}
+}
+
+// Counts a received frame of the active track, and publishes the rates once the window is complete
+static void moq_source_count_frame(struct moq_source *ctx, struct moq_pipeline *pipeline, size_t bytes,
+                                   uint64_t arrival_ns)
+{
+	ctx->stats_bytes_received.fetch_add(bytes, std::memory_order_relaxed);
+	ctx->stats_frames_received.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t elapsed_ns = arrival_ns - pipeline->rate_window_start_ns;
+	if (!pipeline->rate_window_start_ns || elapsed_ns > 10 * MOQ_RATE_WINDOW_NS) {
+		// First frame, or the feed stalled: the window starts over
+		elapsed_ns = 0;
+		pipeline->rate_window_start_ns = arrival_ns;
+		pipeline->rate_window_bytes = 0;
+		pipeline->rate_window_frames = 0;
+		pipeline->rate_window_output = 0;
+	}
+	pipeline->rate_window_bytes += bytes;
+	pipeline->rate_window_frames++;
+	if (elapsed_ns < MOQ_RATE_WINDOW_NS) {
+		return;
+	}
+
+	// The frame that closes the window arrived at its end, so it's not counted in the rates
+	double seconds = elapsed_ns / 1000000000.0;
+	ctx->stats_received_bps.store((uint64_t)((pipeline->rate_window_bytes - bytes) * 8 / seconds),
+	                              std::memory_order_relaxed);
+	ctx->stats_received_mfps.store((uint32_t)((pipeline->rate_window_frames - 1) * 1000 / seconds),
+	                               std::memory_order_relaxed);
+	ctx->stats_output_mfps.store((uint32_t)(pipeline->rate_window_output * 1000 / seconds),
+	                             std::memory_order_relaxed);
+	ctx->stats_rate_updated_ns.store(arrival_ns, std::memory_order_relaxed);
+
+	pipeline->rate_window_start_ns = arrival_ns;
+	pipeline->rate_window_bytes = bytes;
+	pipeline->rate_window_frames = 1;
+	pipeline->rate_window_output = 0;
+}
+
+// Counts a frame of the active track that won't be shown, and notes it in the flight recorder
+static void moq_source_drop_frame(struct moq_source *ctx, enum moq_drop_reason reason, uint64_t size,
+                                  uint64_t timestamp_us)
+{
+	ctx->stats_frames_dropped[reason].fetch_add(1, std::memory_order_relaxed);
+	moq_flight_record(ctx->flight, MOQ_FLIGHT_DROP, reason, size, timestamp_us, 0, false);
+}
+
+// Feeds a received frame of the active track to rendition selection and publishes the figures for get_stats
+static void moq_source_measure_frame(struct moq_source *ctx, const struct moq_state *state,
+                                     struct moq_pipeline *pipeline, size_t bytes, uint64_t timestamp_us,
+                                     uint64_t arrival_ns)
+{
+	// Rendition indices in the ABR history are only meaningful for the catalog they came from
+	if (pipeline->abr_catalog_serial != state->catalog_serial) {
+		moq_abr_reset(&pipeline->abr, arrival_ns);
+		pipeline->abr_catalog_serial = state->catalog_serial;
+	}
+	moq_abr_on_frame(&pipeline->abr, bytes, timestamp_us, arrival_ns);
+	moq_source_count_frame(ctx, pipeline, bytes, arrival_ns);
+	ctx->stats_throughput_bps.store((uint64_t)pipeline->abr.throughput_bps, std::memory_order_relaxed);
+	ctx->stats_bitrate_bps.store((uint64_t)pipeline->abr.bitrate_bps, std::memory_order_relaxed);
+	ctx->stats_queue_delay_us.store(
+		pipeline->abr.queue_delay_us > 0 ? (uint64_t)pipeline->abr.queue_delay_us : 0,
+		std::memory_order_relaxed);
+}
+
+// Tracks whether the decoder has the keyframe a frame depends on. Returns false for frames to skip.
+static bool moq_pipeline_accept_frame(struct moq_source *ctx, struct moq_pipeline *pipeline, bool keyframe,
+                                      size_t payload_size, uint64_t timestamp_us)
+{
 	// Skip non-keyframes until we get the first one
-	if (!ctx->got_keyframe && !frame_data.keyframe) {
-		ctx->frames_waiting_for_keyframe++;
-		if (ctx->frames_waiting_for_keyframe == 1 ||
-		    (ctx->frames_waiting_for_keyframe % 30) == 0) {
+	if (!pipeline->got_keyframe && !keyframe) {
+		pipeline->frames_waiting_for_keyframe++;
+		moq_source_drop_frame(ctx, MOQ_DROP_KEYFRAME_WAIT, payload_size, timestamp_us);
+		if (pipeline->frames_waiting_for_keyframe == 1) {
+			pipeline->keyframe_wait_start_ns = os_gettime_ns();
+		}
+		if (pipeline->frames_waiting_for_keyframe == 1 ||
+		    (pipeline->frames_waiting_for_keyframe % 30) == 0) {
 			LOG_INFO("Waiting for keyframe... (skipped %u frames so far)",
-			         ctx->frames_waiting_for_keyframe);
+			         pipeline->frames_waiting_for_keyframe);
 		}
-		pthread_mutex_unlock(&ctx->mutex);
-		moq_consume_frame_close(frame_id);
-		return;
+		return false;
 	}
 
 	// Mark that we've received a keyframe from the stream
-	if (frame_data.keyframe) {
-		if (!ctx->got_keyframe) {
+	if (keyframe) {
+		if (!pipeline->got_keyframe) {
 			LOG_INFO("Got keyframe after waiting for %u frames, payload_size=%zu",
-			         ctx->frames_waiting_for_keyframe, frame_data.payload_size);
+			         pipeline->frames_waiting_for_keyframe, payload_size);
+			if (pipeline->frames_waiting_for_keyframe) {
+				moq_histogram_record(&ctx->stats_keyframe_wait_us,
+				                     (os_gettime_ns() - pipeline->keyframe_wait_start_ns) / 1000);
+			}
 			// Flush decoder to ensure clean state when starting from keyframe
-			avcodec_flush_buffers(ctx->codec_ctx);
+			avcodec_flush_buffers(pipeline->codec_ctx);
 		}
-		ctx->got_keyframe = true;
-		ctx->frames_waiting_for_keyframe = 0;
-		ctx->consecutive_decode_errors = 0;
+		pipeline->got_keyframe = true;
+		pipeline->frames_waiting_for_keyframe = 0;
+		pipeline->consecutive_decode_errors = 0;
 	}
+	return true;
+}
 
-	// Create AVPacket from frame data
-	AVPacket *packet = av_packet_alloc();
-	if (!packet) {
-		pthread_mutex_unlock(&ctx->mutex);
-		moq_consume_frame_close(frame_id);
-		return;
+// Decodes an assembled packet and, if show is set, outputs the picture with timestamp_us.
+// Returns true if a picture was output. The packet is unreferenced either way.
+static bool moq_source_decode_packet(struct moq_source *ctx, struct moq_pipeline *pipeline, AVPacket *packet,
+                                     uint64_t timestamp_us, bool show)
+{
+	// Send packet to decoder. The packet is refcounted, so the decoder keeps a reference instead of copying.
+	uint64_t decode_start = os_gettime_ns();
+	uint64_t trace_start = moq_trace_begin();
+	uint64_t packet_size = (uint64_t)packet->size;
+	bool keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+	int ret = avcodec_send_packet(pipeline->codec_ctx, packet);
+	av_packet_unref(packet);
+
+	// A frame-threaded decoder holds each frame back until more packets arrive, which would be groups
+	// later in keyframes-only mode. Every packet is a keyframe then, so draining after each loses nothing.
+	if (ret >= 0 && pipeline->thumbnail) {
+		avcodec_send_packet(pipeline->codec_ctx, NULL);
 	}
 
-	packet->data = (uint8_t *)frame_data.payload;
-	packet->size = frame_data.payload_size;
-	packet->pts = frame_data.timestamp_us / 1000; // Convert to milliseconds
-	packet->dts = packet->pts;
-
-	// Send packet to decoder
-	int ret = avcodec_send_packet(ctx->codec_ctx, packet);
-	av_packet_free(&packet);
-
 	if (ret < 0) {
 		if (ret != AVERROR(EAGAIN)) {
-			ctx->consecutive_decode_errors++;
+			pipeline->consecutive_decode_errors++;
+			moq_flight_record(ctx->flight, MOQ_FLIGHT_DECODE, ret, packet_size, timestamp_us,
+			                  os_gettime_ns() - decode_start, keyframe);
+			moq_source_drop_frame(ctx, MOQ_DROP_DECODE_ERROR, packet_size, timestamp_us);
 			char errbuf[AV_ERROR_MAX_STRING_SIZE];
 			av_strerror(ret, errbuf, sizeof(errbuf));
 
 			// If too many consecutive errors, flush decoder and wait for next keyframe
-			if (ctx->consecutive_decode_errors >= 5) {
+			if (pipeline->consecutive_decode_errors >= 5) {
 				LOG_WARNING("Too many send errors (%u), flushing decoder and waiting for keyframe",
-				            ctx->consecutive_decode_errors);
-				avcodec_flush_buffers(ctx->codec_ctx);
-				ctx->got_keyframe = false;
-				ctx->consecutive_decode_errors = 0;
-			} else if (ctx->consecutive_decode_errors == 1) {
+				            pipeline->consecutive_decode_errors);
+				moq_flight_dump(ctx->flight, obs_source_get_name(ctx->source),
+				                "Too many decoder errors");
+				avcodec_flush_buffers(pipeline->codec_ctx);
+				pipeline->got_keyframe = false;
+				pipeline->consecutive_decode_errors = 0;
+			} else if (pipeline->consecutive_decode_errors == 1) {
 				LOG_ERROR("Error sending packet to decoder: %s", errbuf);
 			}
 		}
-		pthread_mutex_unlock(&ctx->mutex);
-		moq_consume_frame_close(frame_id);
-		return;
+		return false;
 	}
 
 	// Receive decoded frames
 	AVFrame *frame = av_frame_alloc();
 	if (!frame) {
-		pthread_mutex_unlock(&ctx->mutex);
-		moq_consume_frame_close(frame_id);
-		return;
+		return false;
 	}
 
-	ret = avcodec_receive_frame(ctx->codec_ctx, frame);
+	ret = avcodec_receive_frame(pipeline->codec_ctx, frame);
+	if (pipeline->thumbnail) {
+		// Leave draining mode, ready for the next keyframe
+		avcodec_flush_buffers(pipeline->codec_ctx);
+	}
+	moq_trace_end("source", "decode", trace_start, pipeline, timestamp_us);
+	moq_flight_record(ctx->flight, MOQ_FLIGHT_DECODE, ret, packet_size, timestamp_us,
+	                  os_gettime_ns() - decode_start, keyframe);
 	if (ret < 0) {
 		if (ret != AVERROR(EAGAIN)) {
-			ctx->consecutive_decode_errors++;
+			pipeline->consecutive_decode_errors++;
+			moq_source_drop_frame(ctx, MOQ_DROP_DECODE_ERROR, packet_size, timestamp_us);
 			char errbuf[AV_ERROR_MAX_STRING_SIZE];
 			av_strerror(ret, errbuf, sizeof(errbuf));
 
 			// If too many consecutive errors, flush decoder and wait for next keyframe
-			if (ctx->consecutive_decode_errors >= 5) {
+			if (pipeline->consecutive_decode_errors >= 5) {
 				LOG_WARNING("Too many decode errors (%u), flushing decoder and waiting for keyframe",
-				            ctx->consecutive_decode_errors);
-				avcodec_flush_buffers(ctx->codec_ctx);
-				ctx->got_keyframe = false;
-				ctx->consecutive_decode_errors = 0;
-			} else if (ctx->consecutive_decode_errors == 1) {
+				            pipeline->consecutive_decode_errors);
+				moq_flight_dump(ctx->flight, obs_source_get_name(ctx->source),
+				                "Too many decoder errors");
+				avcodec_flush_buffers(pipeline->codec_ctx);
+				pipeline->got_keyframe = false;
+				pipeline->consecutive_decode_errors = 0;
+			} else if (pipeline->consecutive_decode_errors == 1) {
 				// Only log first error in a sequence
 				LOG_ERROR("Error receiving frame from decoder: %s", errbuf);
 			}
 		}
 		av_frame_free(&frame);
-		pthread_mutex_unlock(&ctx->mutex);
-		moq_consume_frame_close(frame_id);
-		return;
+		return false;
 	}
 
 	// Successfully decoded a frame - reset error counter
-	ctx->consecutive_decode_errors = 0;
+	pipeline->consecutive_decode_errors = 0;
+	moq_histogram_record(&ctx->stats_decode_us, (os_gettime_ns() - decode_start) / 1000);
+
+	// Catching up after a seek: the picture is only needed as a reference
+	if (!show) {
+		av_frame_free(&frame);
+		return false;
+	}
 
 	// Check if we need to (re)initialize the scaler - either first frame, dimension change, or pixel format change
 	enum AVPixelFormat decoded_pix_fmt = (enum AVPixelFormat)frame->format;
-	bool dimensions_changed = (frame->width != (int)ctx->frame.width || frame->height != (int)ctx->frame.height);
-	bool pix_fmt_changed = (decoded_pix_fmt != ctx->current_pix_fmt);
-	bool need_reinit = (!ctx->sws_ctx || !ctx->frame_buffer || dimensions_changed || pix_fmt_changed);
+	bool dimensions_changed = (frame->width != pipeline->decoded_width ||
+	                           frame->height != pipeline->decoded_height);
+	bool pix_fmt_changed = (decoded_pix_fmt != pipeline->current_pix_fmt);
+	bool need_reinit = (pipeline->converter.slice_count == 0 || !pipeline->frame_buffer || dimensions_changed ||
+	                    pix_fmt_changed);
 
 	if (need_reinit) {
 		if (dimensions_changed) {
-			LOG_INFO("Decoded frame dimensions changed: %ux%u -> %dx%d",
-			         ctx->frame.width, ctx->frame.height, frame->width, frame->height);
+			LOG_INFO("Decoded frame dimensions changed: %dx%d -> %dx%d",
+			         pipeline->decoded_width, pipeline->decoded_height, frame->width, frame->height);
 		}
 		if (pix_fmt_changed) {
 			LOG_INFO("Decoded frame pixel format changed: %d -> %d (%s)",
-			         ctx->current_pix_fmt, decoded_pix_fmt,
+			         pipeline->current_pix_fmt, decoded_pix_fmt,
 			         av_get_pix_fmt_name(decoded_pix_fmt) ? av_get_pix_fmt_name(decoded_pix_fmt) : "unknown");
 		}
 
@@ -915,88 +2492,482 @@ static void moq_source_decode_frame(struct moq_source *ctx, int32_t frame_id)
 		    frame->width > 16384 || frame->height > 16384) {
 			LOG_ERROR("Invalid decoded frame dimensions: %dx%d", frame->width, frame->height);
 			av_frame_free(&frame);
-			pthread_mutex_unlock(&ctx->mutex);
-			moq_consume_frame_close(frame_id);
-			return;
+			return false;
 		}
 
 		// Validate pixel format is supported by swscale
 		if (decoded_pix_fmt == AV_PIX_FMT_NONE) {
 			LOG_ERROR("Invalid decoded frame pixel format: %d", decoded_pix_fmt);
 			av_frame_free(&frame);
-			pthread_mutex_unlock(&ctx->mutex);
-			moq_consume_frame_close(frame_id);
-			return;
-		}
-
-		// Free old sws context
-		if (ctx->sws_ctx) {
-			sws_freeContext(ctx->sws_ctx);
-			ctx->sws_ctx = NULL;
-		}
-
-		// Create new scaling context with the actual pixel format from the decoded frame
-		struct SwsContext *new_sws_ctx = sws_getContext(
-			frame->width, frame->height, decoded_pix_fmt,
-			frame->width, frame->height, AV_PIX_FMT_RGBA,
-			SWS_BILINEAR, NULL, NULL, NULL
-		);
-		if (!new_sws_ctx) {
-			LOG_ERROR("Failed to create scaling context for %dx%d pix_fmt=%d (%s)",
-			          frame->width, frame->height, decoded_pix_fmt,
-			          av_get_pix_fmt_name(decoded_pix_fmt) ? av_get_pix_fmt_name(decoded_pix_fmt) : "unknown");
-			av_frame_free(&frame);
-			pthread_mutex_unlock(&ctx->mutex);
-			moq_consume_frame_close(frame_id);
-			return;
+			return false;
 		}
 
-		// Reallocate frame buffer for new dimensions (width * height * 4 for RGBA)
-		size_t new_buffer_size = (size_t)frame->width * (size_t)frame->height * 4;
-		uint8_t *new_frame_buffer = (uint8_t *)bmalloc(new_buffer_size);
-		if (!new_frame_buffer) {
-			LOG_ERROR("Failed to allocate frame buffer for %dx%d (%zu bytes)",
-			          frame->width, frame->height, new_buffer_size);
-			sws_freeContext(new_sws_ctx);
+		if (!moq_pipeline_prepare_output(ctx, pipeline, frame->width, frame->height, decoded_pix_fmt)) {
 			av_frame_free(&frame);
-			pthread_mutex_unlock(&ctx->mutex);
-			moq_consume_frame_close(frame_id);
-			return;
+			return false;
 		}
+	}
+
+	// Convert the decoded frame to RGBA, one horizontal slice per worker
+	uint64_t slice_ns[MOQ_MAX_SLICES] = {};
+	uint64_t convert_start = os_gettime_ns();
+	trace_start = moq_trace_begin();
+	moq_frame_converter_run(&pipeline->converter, frame, pipeline->frame_buffer,
+	                        (int)pipeline->frame.linesize[0], slice_ns, pipeline, timestamp_us);
+	moq_trace_end("source", "convert", trace_start, pipeline, timestamp_us);
+	moq_source_record_convert_stats(ctx, pipeline, slice_ns, os_gettime_ns() - convert_start);
+	av_frame_free(&frame);
+
+	// A writer may have dropped this pipeline while it was decoding, e.g. a reconnect that
+	// blanked the preview. Its frame must not reappear after that.
+	const struct moq_state *current = ctx->state.load();
+	if (current->pipeline[current->active_slot] != pipeline) {
+		moq_source_drop_frame(ctx, MOQ_DROP_SUPERSEDED, 0, timestamp_us);
+		return false;
+	}
+
+	// Update OBS frame timestamp and output; a sync group holds it until its playout time
+	pipeline->frame.timestamp = timestamp_us;
+	trace_start = moq_trace_begin();
+	if (current->sync) {
+		moq_sync_output(current->sync, &pipeline->frame, timestamp_us,
+		                pipeline->has_wallclock ? &pipeline->wallclock : NULL);
+	} else {
+		obs_source_output_video(ctx->source, &pipeline->frame);
+	}
+	moq_trace_end("source", "output", trace_start, pipeline, timestamp_us);
+	ctx->stats_frames_output.fetch_add(1, std::memory_order_relaxed);
+	pipeline->rate_window_output++;
+	moq_flight_record(ctx->flight, MOQ_FLIGHT_OUTPUT, 0, 0, timestamp_us, 0, false);
+	ctx->last_output_us = timestamp_us;
+	return true;
+}
+
+// Resizes the timeshift buffer to the configured size, dropping what it held
+static void moq_pipeline_set_timeshift(struct moq_pipeline *pipeline, int size_mb)
+{
+	moq_timeshift_free(&pipeline->timeshift);
+	moq_timeshift_init(&pipeline->timeshift, (size_t)size_mb * 1024 * 1024);
+	if (size_mb > 0 && !pipeline->timeshift.capacity) {
+		LOG_ERROR("Failed to allocate %d MB timeshift buffer", size_mb);
+	}
+	pipeline->timeshift_mb = size_mb;
+
+	if (pipeline->timeshift_active) {
+		// Whatever was being replayed is gone, resume live at the next keyframe
+		pipeline->timeshift_active = false;
+		pipeline->got_keyframe = false;
+	}
+}
+
+// Applies pause, seek and go-live requests from the media controls, before live_ts_us is recorded
+static void moq_source_control_timeshift(struct moq_source *ctx, struct moq_pipeline *pipeline, uint64_t live_ts_us)
+{
+	struct moq_timeshift *ts = &pipeline->timeshift;
+
+	if (ctx->timeshift_go_live.exchange(false) && pipeline->timeshift_active) {
+		LOG_INFO("Timeshift: back to live");
+		pipeline->timeshift_active = false;
+		pipeline->got_keyframe = false;
+	}
 
-		// Free old frame buffer
-		if (ctx->frame_buffer) {
-			bfree(ctx->frame_buffer);
+	int64_t seek_us = ctx->timeshift_seek_us.exchange(-1);
+	if (seek_us >= 0 && moq_timeshift_begin(ts) < moq_timeshift_end(ts)) {
+		if ((uint64_t)seek_us >= live_ts_us) {
+			if (pipeline->timeshift_active) {
+				pipeline->timeshift_active = false;
+				pipeline->got_keyframe = false;
+			}
+		} else {
+			// Decode from the keyframe before the target, showing only the frame at the target
+			pipeline->timeshift_active = true;
+			pipeline->timeshift_next_seq = moq_timeshift_find_keyframe(ts, (uint64_t)seek_us);
+			pipeline->timeshift_offset_us = (int64_t)(live_ts_us - (uint64_t)seek_us);
+			pipeline->timeshift_position_us = (uint64_t)seek_us;
+			pipeline->timeshift_skip_until_us = (uint64_t)seek_us;
+			pipeline->got_keyframe = false;
+			LOG_INFO("Timeshift: seeking %lld ms behind live",
+			         (long long)pipeline->timeshift_offset_us / 1000);
 		}
+	}
 
-		// Install new state
-		ctx->sws_ctx = new_sws_ctx;
-		ctx->current_pix_fmt = decoded_pix_fmt;
-		ctx->frame_buffer = new_frame_buffer;
-		ctx->frame.width = frame->width;
-		ctx->frame.height = frame->height;
-		ctx->frame.linesize[0] = frame->width * 4;
-		ctx->frame.data[0] = new_frame_buffer;
+	bool paused = ctx->timeshift_paused.load();
+	if (paused && !pipeline->timeshift_paused) {
+		if (!pipeline->timeshift_active) {
+			// Hold the last live picture; the live frames that follow are recorded for later
+			pipeline->timeshift_active = ts->capacity > 0;
+			pipeline->timeshift_next_seq = moq_timeshift_end(ts);
+			pipeline->timeshift_position_us = ctx->last_output_us.load();
+			pipeline->timeshift_skip_until_us = 0;
+		}
+		pipeline->timeshift_paused = true;
+	} else if (!paused && pipeline->timeshift_paused) {
+		pipeline->timeshift_paused = false;
+		if (pipeline->timeshift_active) {
+			pipeline->timeshift_offset_us = (int64_t)(live_ts_us - pipeline->timeshift_position_us);
+		} else {
+			// Paused without a buffer: nothing was kept, so live resumes at the next keyframe
+			pipeline->got_keyframe = false;
+		}
+	}
+}
 
-		LOG_INFO("Scaler initialized for %dx%d pix_fmt=%s",
-		         frame->width, frame->height,
-		         av_get_pix_fmt_name(decoded_pix_fmt) ? av_get_pix_fmt_name(decoded_pix_fmt) : "unknown");
+// Plays timeshift frames up to the playback position that corresponds to live_ts_us.
+// Playback is paced by the live frames, so it needs no thread or timer of its own.
+static void moq_source_play_timeshift(struct moq_source *ctx, struct moq_pipeline *pipeline, uint64_t live_ts_us)
+{
+	struct moq_timeshift *ts = &pipeline->timeshift;
+
+	uint64_t target_us = pipeline->timeshift_paused ? pipeline->timeshift_position_us
+	                                                : live_ts_us - (uint64_t)pipeline->timeshift_offset_us;
+
+	uint64_t seq = pipeline->timeshift_next_seq;
+	if (seq < moq_timeshift_begin(ts)) {
+		// Fell out of the window: continue from the oldest group still retained
+		LOG_WARNING("Timeshift position was evicted, skipping ahead to the oldest buffered keyframe");
+		seq = moq_timeshift_begin(ts);
+		pipeline->got_keyframe = false;
 	}
 
-	// Convert YUV420P to RGBA
-	uint8_t *dst_data[4] = {ctx->frame_buffer, NULL, NULL, NULL};
-	int dst_linesize[4] = {static_cast<int>(ctx->frame.width * 4), 0, 0, 0};
+	uint64_t end = moq_timeshift_end(ts);
+	while (seq < end) {
+		const uint8_t *payload;
+		const struct moq_timeshift_frame *frame = moq_timeshift_get(ts, seq, &payload);
+		if (frame->timestamp_us > target_us) {
+			break;
+		}
+		seq++;
+
+		if (!moq_pipeline_accept_frame(ctx, pipeline, frame->keyframe, frame->size, frame->timestamp_us) ||
+		    (pipeline->thumbnail && !frame->keyframe)) {
+			continue;
+		}
 
-	sws_scale(ctx->sws_ctx, (const uint8_t *const *)frame->data, frame->linesize,
-	          0, ctx->frame.height, dst_data, dst_linesize);
+		// While catching up to a seek target only the last frame before it is shown
+		const uint8_t *next_payload;
+		const struct moq_timeshift_frame *next = moq_timeshift_get(ts, seq, &next_payload);
+		bool show = frame->timestamp_us >= pipeline->timeshift_skip_until_us || !next ||
+		            next->timestamp_us > target_us;
 
-	// Update OBS frame timestamp and output
-	ctx->frame.timestamp = frame_data.timestamp_us;
-	obs_source_output_video(ctx->source, &ctx->frame);
+		AVPacket *packet = pipeline->packet;
+		if (!moq_packet_builder_copy(&pipeline->packet_builder, payload, frame->size, packet)) {
+			LOG_ERROR("Failed to assemble frame data");
+			continue;
+		}
+		packet->pts = frame->timestamp_us / 1000; // Convert to milliseconds
+		packet->dts = packet->pts;
+		packet->flags = frame->keyframe ? AV_PKT_FLAG_KEY : 0;
+
+		// Shifted onto the live timeline, so OBS paces replayed frames like live ones
+		if (moq_source_decode_packet(ctx, pipeline, packet,
+		                             frame->timestamp_us + (uint64_t)pipeline->timeshift_offset_us, show)) {
+			pipeline->timeshift_position_us = frame->timestamp_us;
+		}
+	}
+	pipeline->timeshift_next_seq = seq;
+
+	if (seq == end && !pipeline->timeshift_paused) {
+		// Caught up with the frame that just arrived, which the decoder now holds: carry on live
+		LOG_INFO("Timeshift: caught up with live");
+		pipeline->timeshift_active = false;
+	}
+}
+
+// Starts and stops recording as state says. Files start at a keyframe, so each one (a new rendition
+// gets its own) begins with a group that plays on its own.
+static void moq_pipeline_update_recorder(const struct moq_state *state, struct moq_pipeline *pipeline,
+                                         bool keyframe)
+{
+	if (pipeline->record_serial != state->record_serial) {
+		if (pipeline->recorder) {
+			moq_recorder_destroy(pipeline->recorder);
+			pipeline->recorder = NULL;
+		}
+		pipeline->record_serial = state->record_serial;
+	}
+	if (pipeline->recorder || !state->record_path[0] || !keyframe) {
+		return;
+	}
+
+	AVCodecParameters *par = avcodec_parameters_alloc();
+	if (!par || avcodec_parameters_from_context(par, pipeline->codec_ctx) < 0) {
+		avcodec_parameters_free(&par);
+		return;
+	}
+	// The decoder may not know the size before its first frame
+	if (par->width <= 0 || par->height <= 0) {
+		par->width = pipeline->frame.width;
+		par->height = pipeline->frame.height;
+	}
+
+	struct dstr format = {};
+	dstr_printf(&format, " %%CCYY-%%MM-%%DD %%hh-%%mm-%%ss %dp", par->height);
+	char *name = os_generate_formatted_filename(state->record_format, true, format.array);
+	struct dstr path = {};
+	dstr_printf(&path, "%s%s", state->record_path, name);
+	pipeline->recorder = moq_recorder_create(path.array, state->record_format, par);
+	bfree(name);
+	dstr_free(&path);
+	dstr_free(&format);
+	avcodec_parameters_free(&par);
+}
+
+// Assembles the frame into pipeline->packet, unless that already happened for another consumer
+static bool moq_pipeline_gather(struct moq_pipeline *pipeline, int32_t frame_id, const struct moq_frame *first,
+                                bool *gathered)
+{
+	if (!*gathered) {
+		uint64_t trace_start = moq_trace_begin();
+		*gathered = moq_packet_builder_gather(&pipeline->packet_builder, frame_id, first, pipeline->packet);
+		moq_trace_end("source", "gather", trace_start, pipeline, first->timestamp_us);
+	}
+	return *gathered;
+}
+
+// Republishes a frame of the active track. A frame in one chunk, the usual case, is handed over
+// straight from libmoq's buffer; one in several chunks is assembled into pipeline->packet first, and
+// true is returned so the rest of the frame path reuses that copy.
+static bool moq_source_forward_frame(const struct moq_state *state, struct moq_pipeline *pipeline, int32_t frame_id,
+                                     const struct moq_frame *frame_data, uint64_t arrival_ns)
+{
+	const uint8_t *payload = frame_data->payload;
+	size_t size = frame_data->payload_size;
+	bool gathered = false;
+
+	struct moq_frame chunk;
+	if (moq_consume_frame_chunk(frame_id, 1, &chunk) >= 0) {
+		if (!moq_pipeline_gather(pipeline, frame_id, frame_data, &gathered)) {
+			return false;
+		}
+		payload = pipeline->packet->data;
+		size = (size_t)pipeline->packet->size;
+	}
+
+	AVCodecContext *codec_ctx = pipeline->codec_ctx;
+	moq_restream_write(state->restream, pipeline->restream_format, codec_ctx->extradata,
+	                   codec_ctx->extradata_size > 0 ? (size_t)codec_ctx->extradata_size : 0, payload, size,
+	                   frame_data->timestamp_us, frame_data->keyframe, arrival_ns);
+	return gathered;
+}
+
+// Handles a frame of the active track: records it in the timeshift buffer, then decodes and outputs
+// either it or the timeshifted frame due now. Runs without locks: the pipeline belongs to the
+// calling frame callback, and state stays valid until the callback exits.
+static void moq_source_decode_frame(struct moq_source *ctx, const struct moq_state *state,
+                                    struct moq_pipeline *pipeline, int32_t frame_id)
+{
+	uint64_t arrival_ns = os_gettime_ns();
+
+	// Get frame data
+	struct moq_frame frame_data;
+	if (moq_consume_frame_chunk(frame_id, 0, &frame_data) < 0) {
+		LOG_ERROR("Failed to get frame data");
+		moq_consume_frame_close(frame_id);
+		return;
+	}
+
+	// Mode changes are applied by the only thread that uses the decoder
+	bool thumbnail = ctx->thumbnail.load(std::memory_order_relaxed);
+	if (thumbnail != pipeline->thumbnail) {
+		LOG_INFO("%s keyframes-only decoding", thumbnail ? "Starting" : "Stopping");
+		moq_pipeline_set_thumbnail(pipeline, thumbnail);
+	}
+	int timeshift_mb = ctx->timeshift_mb.load(std::memory_order_relaxed);
+	if (timeshift_mb != pipeline->timeshift_mb) {
+		moq_pipeline_set_timeshift(pipeline, timeshift_mb);
+	}
+	bool decode = ctx->decode_video.load(std::memory_order_relaxed);
+	if (decode != pipeline->decode) {
+		// Frames skipped meanwhile broke the reference chain, so resume at the next keyframe
+		pipeline->decode = decode;
+		pipeline->got_keyframe = false;
+	}
+	moq_flight_record(ctx->flight, MOQ_FLIGHT_RECEIVE, frame_id, frame_data.payload_size,
+	                  frame_data.timestamp_us, 0, frame_data.keyframe);
+	moq_pipeline_update_recorder(state, pipeline, frame_data.keyframe);
+	if (state->capture) {
+		moq_capture_write_frame(state->capture, (uint32_t)state->slot_rendition[state->active_slot], frame_id,
+		                        &frame_data, arrival_ns);
+	}
+
+	// Forwarded before anything else, so the hop adds as little latency as possible
+	bool gathered = state->restream &&
+	                moq_source_forward_frame(state, pipeline, frame_id, &frame_data, arrival_ns);
+	// Publishers stamp keyframes with their wallclock ahead of the first slice, see wallclock.h
+	enum AVCodecID codec_id = pipeline->codec_ctx->codec_id;
+	if (frame_data.keyframe && (codec_id == AV_CODEC_ID_H264 || codec_id == AV_CODEC_ID_HEVC) &&
+	    moq_wallclock_find(codec_id == AV_CODEC_ID_HEVC, frame_data.payload, frame_data.payload_size,
+	                       &pipeline->wallclock)) {
+		pipeline->has_wallclock = true;
+	}
+	if (state->sync) {
+		moq_sync_observe(state->sync, frame_data.timestamp_us, arrival_ns,
+		                 pipeline->has_wallclock ? &pipeline->wallclock : NULL);
+	}
+
+	moq_source_control_timeshift(ctx, pipeline, frame_data.timestamp_us);
+
+	struct moq_timeshift *ts = &pipeline->timeshift;
+	bool recorded = moq_timeshift_append(ts, frame_id, &frame_data);
+	if (ts->capacity) {
+		ctx->timeshift_begin_us.store(moq_timeshift_begin(ts) < moq_timeshift_end(ts)
+		                                      ? ts->frames.array[ts->first].timestamp_us
+		                                      : frame_data.timestamp_us,
+		                              std::memory_order_relaxed);
+	}
+	ctx->timeshift_live_us.store(frame_data.timestamp_us, std::memory_order_relaxed);
+
+	if (pipeline->timeshift_active && !recorded && ts->capacity) {
+		// The buffer couldn't keep this frame, so replay can't continue past it
+		pipeline->timeshift_active = false;
+		pipeline->timeshift_paused = false;
+		pipeline->got_keyframe = false;
+	}
+
+	if (pipeline->timeshift_active || pipeline->timeshift_paused) {
+		// The recording follows live, not playback
+		if (pipeline->recorder && moq_pipeline_gather(pipeline, frame_id, &frame_data, &gathered)) {
+			moq_recorder_write(pipeline->recorder, pipeline->packet, frame_data.timestamp_us,
+			                   frame_data.keyframe);
+		}
+		if (gathered) {
+			av_packet_unref(pipeline->packet);
+		}
+
+		// The live frame only counts towards throughput, by its recorded size if it has one
+		uint64_t end = moq_timeshift_end(ts);
+		const uint8_t *payload;
+		const struct moq_timeshift_frame *last = recorded ? moq_timeshift_get(ts, end - 1, &payload) : NULL;
+		moq_source_measure_frame(ctx, state, pipeline, last ? last->size : frame_data.payload_size,
+		                         frame_data.timestamp_us, arrival_ns);
+		if (pipeline->timeshift_active) {
+			moq_source_play_timeshift(ctx, pipeline, frame_data.timestamp_us);
+		}
+		ctx->timeshift_position_us.store(pipeline->timeshift_position_us, std::memory_order_relaxed);
+		moq_consume_frame_close(frame_id);
+		return;
+	}
+	ctx->timeshift_position_us.store(frame_data.timestamp_us, std::memory_order_relaxed);
+
+	if (!moq_pipeline_accept_frame(ctx, pipeline, frame_data.keyframe, frame_data.payload_size,
+	                               frame_data.timestamp_us)) {
+		if (gathered) {
+			av_packet_unref(pipeline->packet);
+		}
+		moq_source_count_frame(ctx, pipeline, frame_data.payload_size, arrival_ns);
+		moq_consume_frame_close(frame_id);
+		return;
+	}
+
+	// Keyframes-only skips the rest of the group, and with decoding off nothing is decoded. Frames that
+	// aren't recorded either aren't even assembled; they only count towards the throughput measurement
+	// (by their first chunk, which is usually all of it).
+	decode = pipeline->decode && (!pipeline->thumbnail || frame_data.keyframe);
+	if (!decode && !pipeline->recorder) {
+		if (gathered) {
+			av_packet_unref(pipeline->packet);
+		}
+		moq_source_measure_frame(ctx, state, pipeline, frame_data.payload_size, frame_data.timestamp_us,
+		                         arrival_ns);
+		moq_consume_frame_close(frame_id);
+		return;
+	}
+
+	// Create AVPacket from all chunks of the frame, padded as FFmpeg requires
+	AVPacket *packet = pipeline->packet;
+	if (!packet || !moq_pipeline_gather(pipeline, frame_id, &frame_data, &gathered)) {
+		LOG_ERROR("Failed to assemble frame data");
+		moq_source_drop_frame(ctx, MOQ_DROP_ASSEMBLY, frame_data.payload_size, frame_data.timestamp_us);
+		moq_consume_frame_close(frame_id);
+		return;
+	}
+
+	packet->pts = frame_data.timestamp_us / 1000; // Convert to milliseconds
+	packet->dts = packet->pts;
+	packet->flags = frame_data.keyframe ? AV_PKT_FLAG_KEY : 0;
+	moq_source_measure_frame(ctx, state, pipeline, packet->size, frame_data.timestamp_us, arrival_ns);
+
+	// The recorder takes its own reference to the gathered buffer, the decoder shares it
+	if (pipeline->recorder) {
+		moq_recorder_write(pipeline->recorder, packet, frame_data.timestamp_us, frame_data.keyframe);
+	}
+	if (!decode) {
+		av_packet_unref(packet);
+		moq_consume_frame_close(frame_id);
+		return;
+	}
+
+	bool output = moq_source_decode_packet(ctx, pipeline, packet, frame_data.timestamp_us, true);
+	if (output && pipeline->has_wallclock) {
+		moq_source_record_glass_latency(ctx, pipeline, frame_data.timestamp_us);
+	}
+
+	// Renditions only change at group boundaries
+	int switch_to = output && frame_data.keyframe ? moq_source_pick_rendition(ctx, state, pipeline,
+	                                                                          os_gettime_ns())
+	                                              : -1;
 
-	av_frame_free(&frame);
-	pthread_mutex_unlock(&ctx->mutex);
 	moq_consume_frame_close(frame_id);
+
+	if (switch_to >= 0) {
+		moq_source_start_switch_async(ctx, switch_to, &pipeline->abr);
+	}
+}
+
+// Pausing holds the picture while the timeshift buffer keeps recording; playing resumes from there
+static void moq_source_media_play_pause(void *data, bool pause)
+{
+	struct moq_source *ctx = (struct moq_source *)data;
+	ctx->timeshift_paused = pause;
+}
+
+// Replays from the oldest buffered keyframe
+static void moq_source_media_restart(void *data)
+{
+	struct moq_source *ctx = (struct moq_source *)data;
+	ctx->timeshift_seek_us = (int64_t)ctx->timeshift_begin_us.load();
+	ctx->timeshift_paused = false;
+}
+
+// A live feed can't stop; this returns to the live edge instead
+static void moq_source_media_stop(void *data)
+{
+	struct moq_source *ctx = (struct moq_source *)data;
+	ctx->timeshift_go_live = true;
+	ctx->timeshift_paused = false;
+}
+
+// Length of the buffered window, which ends at the live edge
+static int64_t moq_source_media_get_duration(void *data)
+{
+	struct moq_source *ctx = (struct moq_source *)data;
+	uint64_t begin = ctx->timeshift_begin_us.load(std::memory_order_relaxed);
+	uint64_t live = ctx->timeshift_live_us.load(std::memory_order_relaxed);
+	return live > begin ? (int64_t)((live - begin) / 1000) : 0;
+}
+
+static int64_t moq_source_media_get_time(void *data)
+{
+	struct moq_source *ctx = (struct moq_source *)data;
+	uint64_t begin = ctx->timeshift_begin_us.load(std::memory_order_relaxed);
+	uint64_t position = ctx->timeshift_position_us.load(std::memory_order_relaxed);
+	return position > begin ? (int64_t)((position - begin) / 1000) : 0;
+}
+
+static void moq_source_media_set_time(void *data, int64_t milliseconds)
+{
+	struct moq_source *ctx = (struct moq_source *)data;
+	if (ctx->timeshift_mb.load() <= 0) {
+		return;
+	}
+	uint64_t begin = ctx->timeshift_begin_us.load(std::memory_order_relaxed);
+	ctx->timeshift_seek_us = (int64_t)(begin + (uint64_t)(milliseconds > 0 ? milliseconds : 0) * 1000);
+}
+
+static enum obs_media_state moq_source_media_get_state(void *data)
+{
+	struct moq_source *ctx = (struct moq_source *)data;
+	return ctx->timeshift_paused.load() ? OBS_MEDIA_STATE_PAUSED : OBS_MEDIA_STATE_PLAYING;
 }
 
 // Registration function
@@ -1005,7 +2976,7 @@ void register_moq_source()
 	struct obs_source_info info = {};
 	info.id = "moq_source";
 	info.type = OBS_SOURCE_TYPE_INPUT;
-	info.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_DO_NOT_DUPLICATE;
+	info.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_DO_NOT_DUPLICATE | OBS_SOURCE_CONTROLLABLE_MEDIA;
 	info.get_name = [](void *) -> const char * {
 		return "Moq Source (MoQ)";
 	};
@@ -1014,6 +2985,13 @@ void register_moq_source()
 	info.update = moq_source_update;
 	info.get_defaults = moq_source_get_defaults;
 	info.get_properties = moq_source_properties;
+	info.media_play_pause = moq_source_media_play_pause;
+	info.media_restart = moq_source_media_restart;
+	info.media_stop = moq_source_media_stop;
+	info.media_get_duration = moq_source_media_get_duration;
+	info.media_get_time = moq_source_media_get_time;
+	info.media_set_time = moq_source_media_set_time;
+	info.media_get_state = moq_source_media_get_state;
 
 	obs_register_source(&info);
 }
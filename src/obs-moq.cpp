@@ -21,6 +21,10 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #include "moq-output.h"
 #include "moq-service.h"
 #include "moq-source.h"
+#include "decoder-cache.h"
+#include "io-queue.h"
+#include "worker-pool.h"
+#include "trace.h"
 
 extern "C" {
 #include "moq.h"
@@ -38,6 +42,7 @@ bool obs_module_load(void)
 	// Use RUST_LOG env var for more verbose output
 	// The second argument is the string length of the first argument.
 	moq_log_level("info", 4);
+	moq_trace_init();
 
 	register_moq_output();
 	register_moq_service();
@@ -45,3 +50,11 @@ bool obs_module_load(void)
 
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	moq_decoder_cache_clear();
+	moq_io_queue_shutdown();
+	moq_worker_pool_shutdown();
+	moq_trace_shutdown();
+}
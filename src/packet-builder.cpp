@@ -0,0 +1,118 @@
+#include <obs-module.h>
+#include <limits.h>
+#include <string.h>
+
+#include "packet-builder.h"
+#include "logger.h"
+
+// Smallest pool buffer; doubles until the largest frame fits
+#define MOQ_PACKET_POOL_MIN_SIZE (64 * 1024)
+
+void moq_packet_builder_init(struct moq_packet_builder *builder)
+{
+	builder->pool = NULL;
+	builder->pool_size = 0;
+	da_init(builder->chunks);
+}
+
+void moq_packet_builder_free(struct moq_packet_builder *builder)
+{
+	// Packets still holding pooled buffers keep them alive until they are unreferenced
+	av_buffer_pool_uninit(&builder->pool);
+	builder->pool_size = 0;
+	da_free(builder->chunks);
+}
+
+static bool moq_packet_builder_reserve(struct moq_packet_builder *builder, size_t size)
+{
+	if (builder->pool && size <= builder->pool_size) {
+		return true;
+	}
+
+	size_t pool_size = builder->pool_size ? builder->pool_size : MOQ_PACKET_POOL_MIN_SIZE;
+	while (pool_size < size) {
+		pool_size *= 2;
+	}
+
+	av_buffer_pool_uninit(&builder->pool);
+	builder->pool = av_buffer_pool_init(pool_size + AV_INPUT_BUFFER_PADDING_SIZE, NULL);
+	if (!builder->pool) {
+		builder->pool_size = 0;
+		return false;
+	}
+
+	builder->pool_size = pool_size;
+	LOG_DEBUG("Packet pool resized to %zu bytes", pool_size);
+	return true;
+}
+
+// Pooled buffer with room for size payload bytes plus padding, NULL on failure
+static AVBufferRef *moq_packet_builder_get(struct moq_packet_builder *builder, size_t size)
+{
+	if (size > (size_t)(INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)) {
+		LOG_ERROR("Frame too large to decode: %zu bytes", size);
+		return NULL;
+	}
+
+	if (!moq_packet_builder_reserve(builder, size)) {
+		LOG_ERROR("Failed to allocate packet pool for %zu bytes", size);
+		return NULL;
+	}
+
+	return av_buffer_pool_get(builder->pool);
+}
+
+bool moq_packet_builder_gather(struct moq_packet_builder *builder, int32_t frame_id, const struct moq_frame *first,
+			       AVPacket *packet)
+{
+	// Collect the chunk list first so the buffer can be sized before copying
+	da_resize(builder->chunks, 0);
+	da_push_back(builder->chunks, first);
+	size_t total = first->payload_size;
+
+	for (uint32_t index = 1;; index++) {
+		struct moq_frame chunk;
+		if (moq_consume_frame_chunk(frame_id, index, &chunk) < 0) {
+			break;
+		}
+		da_push_back(builder->chunks, &chunk);
+		total += chunk.payload_size;
+	}
+
+	AVBufferRef *buf = moq_packet_builder_get(builder, total);
+	if (!buf) {
+		return false;
+	}
+
+	uint8_t *dst = buf->data;
+	for (size_t i = 0; i < builder->chunks.num; i++) {
+		const struct moq_frame *chunk = &builder->chunks.array[i];
+		if (chunk->payload_size > 0) {
+			memcpy(dst, chunk->payload, chunk->payload_size);
+			dst += chunk->payload_size;
+		}
+	}
+	// Pooled buffers are recycled, so the padding has to be cleared every time
+	memset(dst, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+	packet->buf = buf;
+	packet->data = buf->data;
+	packet->size = (int)total;
+	return true;
+}
+
+bool moq_packet_builder_copy(struct moq_packet_builder *builder, const uint8_t *data, size_t size, AVPacket *packet)
+{
+	AVBufferRef *buf = moq_packet_builder_get(builder, size);
+	if (!buf) {
+		return false;
+	}
+
+	memcpy(buf->data, data, size);
+	memset(buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+	packet->buf = buf;
+	packet->data = buf->data;
+	packet->size = (int)size;
+	return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <util/darray.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include "moq.h"
+}
+
+// Reassembles MoQ frames into refcounted AVPackets with the AV_INPUT_BUFFER_PADDING_SIZE
+// zeroed bytes FFmpeg's bitstream readers expect. Buffers come from an AVBufferPool sized
+// to the largest frame seen so far, so steady-state decoding doesn't allocate.
+struct moq_packet_builder {
+	AVBufferPool *pool;
+	size_t pool_size; // Payload bytes each pooled buffer holds, excluding padding
+	DARRAY(struct moq_frame) chunks;
+};
+
+void moq_packet_builder_init(struct moq_packet_builder *builder);
+void moq_packet_builder_free(struct moq_packet_builder *builder);
+
+// Gathers every chunk of frame_id into packet with a single copy per chunk.
+// first is chunk 0, which the caller has already read for its keyframe flag and timestamp.
+// On success packet owns a reference to the pooled buffer.
+bool moq_packet_builder_gather(struct moq_packet_builder *builder, int32_t frame_id, const struct moq_frame *first,
+			       AVPacket *packet);
+
+// Copies an already assembled payload into a pooled padded buffer, e.g. one kept by the timeshift buffer
+bool moq_packet_builder_copy(struct moq_packet_builder *builder, const uint8_t *data, size_t size, AVPacket *packet);
@@ -0,0 +1,240 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <string>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "recorder.h"
+#include "io-queue.h"
+#include "logger.h"
+
+// Bytes gathered before each write to the file
+#define MOQ_RECORDER_IO_BUFFER (4 * 1024 * 1024)
+// Frames that may wait for the I/O thread, several seconds of video at any common frame rate
+#define MOQ_RECORDER_MAX_QUEUED 1024
+
+struct moq_recorder {
+	std::string path;
+	std::string format;
+	AVCodecParameters *par;
+
+	// Producer side, frame callback only
+	bool started;         // A keyframe has been queued
+	bool dropping;        // Skipping to the next keyframe after the queue overflowed
+	uint64_t first_ts_us; // Timestamp written as 0
+	uint64_t dropped;
+
+	struct moq_io_queue *queue; // Of AVPacket references
+
+	// I/O thread only
+	FILE *file;
+	AVFormatContext *fmt;
+	bool open; // Header written, and no write has failed since
+	uint64_t written;
+};
+
+static int moq_recorder_io_write(void *opaque, const uint8_t *buf, int size)
+{
+	struct moq_recorder *rec = (struct moq_recorder *)opaque;
+	return fwrite(buf, 1, (size_t)size, rec->file) == (size_t)size ? size : AVERROR(EIO);
+}
+
+static int64_t moq_recorder_io_seek(void *opaque, int64_t offset, int whence)
+{
+	struct moq_recorder *rec = (struct moq_recorder *)opaque;
+	if (whence == AVSEEK_SIZE) {
+		return -1;
+	}
+	if (os_fseeki64(rec->file, offset, whence & ~AVSEEK_FORCE) != 0) {
+		return AVERROR(EIO);
+	}
+	return os_ftelli64(rec->file);
+}
+
+// Frees whatever moq_recorder_open got to
+static void moq_recorder_close(struct moq_recorder *rec)
+{
+	if (rec->fmt) {
+		if (rec->fmt->pb) {
+			av_free(rec->fmt->pb->buffer);
+			avio_context_free(&rec->fmt->pb);
+		}
+		avformat_free_context(rec->fmt);
+		rec->fmt = NULL;
+	}
+	if (rec->file) {
+		fclose(rec->file);
+		rec->file = NULL;
+	}
+}
+
+static bool moq_recorder_open(struct moq_recorder *rec)
+{
+	const char *muxer = rec->format == "mp4" ? "mp4" : "matroska";
+	if (avformat_alloc_output_context2(&rec->fmt, NULL, muxer, rec->path.c_str()) < 0 || !rec->fmt) {
+		LOG_ERROR("Recording: no %s muxer", muxer);
+		return false;
+	}
+
+	AVStream *stream = avformat_new_stream(rec->fmt, NULL);
+	if (!stream || avcodec_parameters_copy(stream->codecpar, rec->par) < 0) {
+		LOG_ERROR("Recording: failed to create video stream");
+		moq_recorder_close(rec);
+		return false;
+	}
+	stream->time_base = {1, 1000000};
+
+	rec->file = os_fopen(rec->path.c_str(), "wb");
+	if (!rec->file) {
+		LOG_ERROR("Recording: failed to create '%s'", rec->path.c_str());
+		moq_recorder_close(rec);
+		return false;
+	}
+
+	// Our own AVIO with a large buffer, so the disk sees few big writes
+	uint8_t *buffer = (uint8_t *)av_malloc(MOQ_RECORDER_IO_BUFFER);
+	if (buffer) {
+		rec->fmt->pb = avio_alloc_context(buffer, MOQ_RECORDER_IO_BUFFER, 1, rec, NULL, moq_recorder_io_write,
+						  moq_recorder_io_seek);
+	}
+	if (!rec->fmt->pb) {
+		av_free(buffer);
+		moq_recorder_close(rec);
+		return false;
+	}
+
+	AVDictionary *options = NULL;
+	if (rec->format == "mp4") {
+		// Every fragment is self-contained, so the file stays playable if OBS exits without finalizing it
+		av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+	}
+	int ret = avformat_write_header(rec->fmt, &options);
+	av_dict_free(&options);
+	if (ret < 0) {
+		char errbuf[AV_ERROR_MAX_STRING_SIZE];
+		av_strerror(ret, errbuf, sizeof(errbuf));
+		LOG_ERROR("Recording: failed to write header for '%s': %s", rec->path.c_str(), errbuf);
+		moq_recorder_close(rec);
+		return false;
+	}
+
+	LOG_INFO("Recording to '%s'", rec->path.c_str());
+	return true;
+}
+
+static void moq_recorder_start(void *opaque)
+{
+	struct moq_recorder *rec = (struct moq_recorder *)opaque;
+	rec->open = moq_recorder_open(rec);
+}
+
+static void moq_recorder_write_packet(void *opaque, void *item)
+{
+	struct moq_recorder *rec = (struct moq_recorder *)opaque;
+	AVPacket *packet = (AVPacket *)item;
+	if (rec->open) {
+		AVStream *stream = rec->fmt->streams[0];
+		av_packet_rescale_ts(packet, {1, 1000000}, stream->time_base);
+		packet->stream_index = stream->index;
+		int ret = av_write_frame(rec->fmt, packet);
+		if (ret < 0) {
+			char errbuf[AV_ERROR_MAX_STRING_SIZE];
+			av_strerror(ret, errbuf, sizeof(errbuf));
+			LOG_ERROR("Recording: write failed, stopping: %s", errbuf);
+			rec->open = false;
+		} else {
+			rec->written++;
+		}
+	}
+	av_packet_free(&packet);
+}
+
+static void moq_recorder_finish(void *opaque)
+{
+	struct moq_recorder *rec = (struct moq_recorder *)opaque;
+	if (rec->fmt && rec->fmt->pb) {
+		av_write_trailer(rec->fmt);
+		avio_flush(rec->fmt->pb);
+		LOG_INFO("Recording finished: '%s', %llu frames", rec->path.c_str(), (unsigned long long)rec->written);
+	}
+	moq_recorder_close(rec);
+
+	if (rec->dropped) {
+		LOG_WARNING("Recording: %llu frames dropped in total", (unsigned long long)rec->dropped);
+	}
+	avcodec_parameters_free(&rec->par);
+	delete rec;
+}
+
+static const struct moq_io_callbacks moq_recorder_io = {
+	moq_recorder_start,
+	moq_recorder_write_packet,
+	moq_recorder_finish,
+};
+
+struct moq_recorder *moq_recorder_create(const char *path, const char *format, const AVCodecParameters *par)
+{
+	struct moq_recorder *rec = new moq_recorder();
+	rec->path = path;
+	rec->format = format;
+	rec->par = avcodec_parameters_alloc();
+	if (!rec->par || avcodec_parameters_copy(rec->par, par) < 0) {
+		avcodec_parameters_free(&rec->par);
+		delete rec;
+		return NULL;
+	}
+	rec->started = false;
+	rec->dropping = false;
+	rec->first_ts_us = 0;
+	rec->dropped = 0;
+	rec->file = NULL;
+	rec->fmt = NULL;
+	rec->open = false;
+	rec->written = 0;
+	rec->queue = moq_io_queue_create("moq-recorder", &moq_recorder_io, rec, MOQ_RECORDER_MAX_QUEUED);
+	return rec;
+}
+
+void moq_recorder_write(struct moq_recorder *rec, const AVPacket *packet, uint64_t timestamp_us, bool keyframe)
+{
+	if (keyframe) {
+		if (!rec->started) {
+			rec->first_ts_us = timestamp_us;
+		}
+		rec->started = true;
+		rec->dropping = false;
+	}
+	if (!rec->started || rec->dropping || timestamp_us < rec->first_ts_us) {
+		return;
+	}
+
+	// A new reference to the pooled buffer; the payload itself isn't copied again
+	AVPacket *ref = av_packet_clone(packet);
+	if (!ref) {
+		return;
+	}
+	ref->pts = (int64_t)(timestamp_us - rec->first_ts_us);
+	ref->dts = ref->pts;
+	if (keyframe) {
+		ref->flags |= AV_PKT_FLAG_KEY;
+	}
+
+	if (!moq_io_queue_push(rec->queue, ref, 1)) {
+		// Frames after this one depend on it, so drop the rest of the group
+		if (rec->dropped++ == 0) {
+			LOG_WARNING("Recording: disk can't keep up, dropping frames until the next keyframe");
+		}
+		rec->dropping = true;
+		av_packet_free(&ref);
+	}
+}
+
+void moq_recorder_destroy(struct moq_recorder *rec)
+{
+	// rec belongs to the I/O thread from here on
+	moq_io_queue_close(rec->queue);
+}
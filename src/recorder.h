@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Writes received compressed video straight into a fragmented MP4 or Matroska file, without
+// decoding. Packets are queued by reference and muxed on the recorder's own I/O thread (see
+// io-queue.h) through a large write buffer, so the frame callback never waits on the disk.
+struct moq_recorder;
+
+// Starts recording one video track described by par to path. format is "mp4" (fragmented, playable
+// even if never finalized) or "mkv". The file is opened on the I/O thread; failures are logged there.
+struct moq_recorder *moq_recorder_create(const char *path, const char *format, const AVCodecParameters *par);
+
+// Queues a reference to packet, timestamped in microseconds. Recording starts at the first keyframe.
+// If the disk falls behind and the queue fills up, the rest of the group is dropped and recording
+// resumes at the next keyframe.
+void moq_recorder_write(struct moq_recorder *rec, const AVPacket *packet, uint64_t timestamp_us, bool keyframe);
+
+// Returns at once; the I/O thread writes what is still queued, finalizes the file and frees rec.
+// Safe to call from the frame callback.
+void moq_recorder_destroy(struct moq_recorder *rec);
@@ -0,0 +1,299 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "moq.h"
+}
+
+#include "restream.h"
+#include "logger.h"
+
+// Wait before the first reconnect, doubled after each attempt that doesn't connect
+#define MOQ_RESTREAM_BACKOFF_MS 1000
+#define MOQ_RESTREAM_BACKOFF_MAX_MS 30000
+
+struct moq_restream;
+
+// One per session, the user_data of its status callback, so a late status of a replaced session is
+// told apart from the current one. Kept until destroy, as the callback may still be on its way.
+struct moq_restream_session {
+	struct moq_restream *rs;
+	uint32_t generation;
+};
+
+struct moq_restream {
+	std::string url;
+	std::string broadcast_path;
+	int32_t origin;
+
+	// Session, broadcast, video track and the configuration it was created with, guarded by mutex
+	std::mutex mutex;
+	std::condition_variable cond;
+	int32_t session;
+	int32_t broadcast;
+	int32_t video;
+	std::string format;
+	std::vector<uint8_t> init;
+	uint64_t last_timestamp_us;
+	bool waiting_for_keyframe; // The track is being replaced
+	uint32_t generation;       // Of the current session
+	std::vector<std::unique_ptr<moq_restream_session>> sessions;
+	bool closed;       // The current session closed, the reconnect thread replaces it
+	bool stopping;     // Destroy was called
+	uint32_t backoff_ms;
+	std::thread reconnect_thread;
+
+	std::atomic<bool> connected;
+	std::atomic<uint64_t> frames;
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> latency_ns;
+	std::atomic<uint64_t> max_latency_ns;
+};
+
+static void moq_restream_on_status(void *user_data, int32_t code)
+{
+	struct moq_restream_session *token = (struct moq_restream_session *)user_data;
+	struct moq_restream *rs = token->rs;
+
+	std::lock_guard<std::mutex> lock(rs->mutex);
+	if (token->generation != rs->generation || rs->stopping) {
+		return;
+	}
+	if (code == 0) {
+		LOG_INFO("Restream session established: %s", rs->url.c_str());
+		rs->connected = true;
+		rs->backoff_ms = MOQ_RESTREAM_BACKOFF_MS;
+	} else {
+		LOG_INFO("Restream session closed (%d), reconnecting in %u ms: %s", code, rs->backoff_ms,
+			 rs->url.c_str());
+		rs->connected = false;
+		rs->closed = true;
+		rs->cond.notify_one();
+	}
+}
+
+// Closes the session, broadcast and track, if any, then connects a new session and publishes a new
+// broadcast on it. The track is created again at the next keyframe.
+// NOTE: Caller must hold rs->mutex
+static bool moq_restream_connect_locked(struct moq_restream *rs)
+{
+	if (rs->video >= 0) {
+		moq_publish_media_close(rs->video);
+		rs->video = -1;
+	}
+	if (rs->session >= 0) {
+		moq_session_close(rs->session);
+		rs->session = -1;
+	}
+	if (rs->broadcast >= 0) {
+		moq_publish_close(rs->broadcast);
+		rs->broadcast = -1;
+	}
+	rs->waiting_for_keyframe = true;
+	rs->connected = false;
+
+	rs->broadcast = moq_publish_create();
+	if (rs->broadcast < 0) {
+		LOG_ERROR("Failed to create restream broadcast: %d", rs->broadcast);
+		return false;
+	}
+
+	rs->generation++;
+	rs->sessions.emplace_back(new moq_restream_session{rs, rs->generation});
+	rs->session = moq_session_connect(rs->url.data(), rs->url.size(), rs->origin, 0, moq_restream_on_status,
+					  rs->sessions.back().get());
+	if (rs->session < 0) {
+		LOG_ERROR("Failed to connect restream session: %d", rs->session);
+		return false;
+	}
+
+	int32_t result = moq_origin_publish(rs->origin, rs->broadcast_path.data(), rs->broadcast_path.size(),
+					    rs->broadcast);
+	if (result < 0) {
+		LOG_ERROR("Failed to publish restream broadcast: %d", result);
+		return false;
+	}
+	return true;
+}
+
+// Replaces a closed session, waiting longer after each attempt until one connects
+static void moq_restream_reconnect_thread(struct moq_restream *rs)
+{
+	os_set_thread_name("moq-restream");
+
+	std::unique_lock<std::mutex> lock(rs->mutex);
+	for (;;) {
+		rs->cond.wait(lock, [rs] { return rs->closed || rs->stopping; });
+		if (rs->cond.wait_for(lock, std::chrono::milliseconds(rs->backoff_ms), [rs] { return rs->stopping; })) {
+			break;
+		}
+		rs->backoff_ms = std::min(rs->backoff_ms * 2, (uint32_t)MOQ_RESTREAM_BACKOFF_MAX_MS);
+		LOG_INFO("Reconnecting restream session: %s", rs->url.c_str());
+		// A failed attempt is retried like a closed session
+		rs->closed = !moq_restream_connect_locked(rs);
+	}
+}
+
+struct moq_restream *moq_restream_create(const char *url, const char *broadcast)
+{
+	struct moq_restream *rs = new moq_restream();
+	rs->url = url;
+	rs->broadcast_path = broadcast;
+	rs->session = -1;
+	rs->broadcast = -1;
+	rs->video = -1;
+	rs->last_timestamp_us = 0;
+	rs->waiting_for_keyframe = true;
+	rs->generation = 0;
+	rs->closed = false;
+	rs->stopping = false;
+	rs->backoff_ms = MOQ_RESTREAM_BACKOFF_MS;
+	rs->connected = false;
+	rs->frames = 0;
+	rs->bytes = 0;
+	rs->latency_ns = 0;
+	rs->max_latency_ns = 0;
+
+	rs->origin = moq_origin_create();
+	if (rs->origin < 0) {
+		LOG_ERROR("Failed to create restream origin: %d", rs->origin);
+		moq_restream_destroy(rs);
+		return NULL;
+	}
+
+	bool connected;
+	{
+		std::lock_guard<std::mutex> lock(rs->mutex);
+		connected = moq_restream_connect_locked(rs);
+	}
+	if (!connected) {
+		moq_restream_destroy(rs);
+		return NULL;
+	}
+
+	rs->reconnect_thread = std::thread(moq_restream_reconnect_thread, rs);
+	LOG_INFO("Restreaming to %s as '%s'", url, broadcast);
+	return rs;
+}
+
+void moq_restream_destroy(struct moq_restream *rs)
+{
+	{
+		std::lock_guard<std::mutex> lock(rs->mutex);
+		rs->stopping = true;
+		rs->cond.notify_one();
+	}
+	if (rs->reconnect_thread.joinable()) {
+		rs->reconnect_thread.join();
+	}
+
+	if (rs->session >= 0) {
+		moq_session_close(rs->session);
+	}
+	if (rs->video >= 0) {
+		moq_publish_media_close(rs->video);
+	}
+	if (rs->broadcast >= 0) {
+		moq_publish_close(rs->broadcast);
+	}
+	if (rs->origin >= 0) {
+		moq_origin_close(rs->origin);
+	}
+	delete rs;
+}
+
+// Replaces the video track if format or init differ from the current one
+// NOTE: Caller must hold rs->mutex
+static bool moq_restream_prepare_track_locked(struct moq_restream *rs, const char *format, const uint8_t *init,
+					      size_t init_size, bool keyframe)
+{
+	bool same = rs->video >= 0 && rs->format == format && rs->init.size() == init_size &&
+		    (init_size == 0 || memcmp(rs->init.data(), init, init_size) == 0);
+	if (same && !rs->waiting_for_keyframe) {
+		return true;
+	}
+	if (!keyframe) {
+		// Replacing the track, wait for a frame the new one can start with
+		rs->waiting_for_keyframe = true;
+		return false;
+	}
+
+	if (rs->video >= 0 && !same) {
+		moq_publish_media_close(rs->video);
+		rs->video = -1;
+	}
+	if (rs->video < 0) {
+		rs->video = moq_publish_media_ordered(rs->broadcast, format, strlen(format), init, init_size);
+		if (rs->video < 0) {
+			LOG_ERROR("Failed to create restream video track (%s): %d", format, rs->video);
+			return false;
+		}
+		rs->format = format;
+		rs->init.assign(init, init + init_size);
+		LOG_INFO("Restream video track created (%s, %zu byte description)", format, init_size);
+	}
+	rs->waiting_for_keyframe = false;
+	return true;
+}
+
+void moq_restream_write(struct moq_restream *rs, const char *format, const uint8_t *init, size_t init_size,
+			const uint8_t *payload, size_t size, uint64_t timestamp_us, bool keyframe,
+			uint64_t received_ns)
+{
+	{
+		std::lock_guard<std::mutex> lock(rs->mutex);
+		// No broadcast while a failed reconnect waits for its next attempt
+		if (rs->broadcast < 0 || timestamp_us < rs->last_timestamp_us ||
+		    !moq_restream_prepare_track_locked(rs, format, init, init_size, keyframe)) {
+			return;
+		}
+
+		int32_t result = moq_publish_media_frame(rs->video, payload, size, timestamp_us);
+		if (result < 0) {
+			LOG_ERROR("Failed to restream video frame: %d", result);
+			rs->waiting_for_keyframe = true;
+			return;
+		}
+		rs->last_timestamp_us = timestamp_us;
+	}
+
+	uint64_t latency_ns = os_gettime_ns() - received_ns;
+	rs->frames.fetch_add(1, std::memory_order_relaxed);
+	rs->bytes.fetch_add(size, std::memory_order_relaxed);
+
+	// Exponential moving average over roughly the last 16 frames
+	uint64_t average = rs->latency_ns.load(std::memory_order_relaxed);
+	rs->latency_ns.store(average ? average - average / 16 + latency_ns / 16 : latency_ns,
+			     std::memory_order_relaxed);
+	uint64_t max = rs->max_latency_ns.load(std::memory_order_relaxed);
+	while (latency_ns > max && !rs->max_latency_ns.compare_exchange_weak(max, latency_ns)) {
+	}
+}
+
+void moq_restream_get_stats(struct moq_restream *rs, struct moq_restream_stats *stats)
+{
+	stats->connected = rs->connected.load();
+	stats->frames = rs->frames.load(std::memory_order_relaxed);
+	stats->bytes = rs->bytes.load(std::memory_order_relaxed);
+	stats->latency_ns = rs->latency_ns.load(std::memory_order_relaxed);
+	stats->max_latency_ns = rs->max_latency_ns.load(std::memory_order_relaxed);
+}
+
+void moq_restream_reset_stats(struct moq_restream *rs)
+{
+	rs->frames.store(0, std::memory_order_relaxed);
+	rs->bytes.store(0, std::memory_order_relaxed);
+	rs->max_latency_ns.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Republishes the video a MoQ Source receives as a broadcast on another relay, without decoding it.
+// Frames go out through libmoq's media import as soon as they arrive, with their original timestamps.
+// A session that closes is replaced after a backoff, and publishing resumes at the next keyframe.
+struct moq_restream;
+
+struct moq_restream_stats {
+	bool connected;
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t latency_ns;     // Average time from receiving a frame to having published it
+	uint64_t max_latency_ns; // Worst case since the restream was created or its stats reset
+};
+
+// Connects to url and publishes broadcast there. Returns NULL if the session can't be started.
+struct moq_restream *moq_restream_create(const char *url, const char *broadcast);
+void moq_restream_destroy(struct moq_restream *rs);
+
+// Publishes one frame. format and init describe the track (libmoq format name and codec description);
+// when they change, e.g. after a rendition switch, the track is replaced at the next keyframe.
+// Frames older than the last one published are dropped, so a late frame of the previous track can't
+// interleave. received_ns is os_gettime_ns() when the frame was handed over by libmoq.
+// Safe to call from several threads.
+void moq_restream_write(struct moq_restream *rs, const char *format, const uint8_t *init, size_t init_size,
+			const uint8_t *payload, size_t size, uint64_t timestamp_us, bool keyframe,
+			uint64_t received_ns);
+
+void moq_restream_get_stats(struct moq_restream *rs, struct moq_restream_stats *stats);
+
+// Zeroes frames, bytes and max_latency_ns; the average carries on
+void moq_restream_reset_stats(struct moq_restream *rs);
@@ -0,0 +1,352 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sync-group.h"
+#include "wallclock.h"
+#include "logger.h"
+
+// A frame this much later than the clock expects means its publisher restarted its timestamps, and a
+// wallclock this far from the group's means the publisher's clock isn't synced with the others
+#define MOQ_SYNC_REANCHOR_NS 5000000000LL
+// The clock slips later by this much per second, so it follows clock drift and slower routes
+// instead of holding on to the fastest transit it ever saw
+#define MOQ_SYNC_RELAX_NS_PER_S 1000000
+// Frames one member may have waiting; more means the latency is far larger than intended
+#define MOQ_SYNC_MAX_QUEUED 64
+
+struct sync_group;
+
+// Maps a timeline onto os_gettime_ns()
+struct sync_clock {
+	bool anchored;
+	int64_t offset_ns;        // Arrival time minus timeline time of the fastest frame, relaxed over time
+	uint64_t last_observe_ns; // Latest arrival seen
+};
+
+struct moq_sync_member {
+	struct sync_group *group;
+	obs_source_t *source;
+	uint32_t latency_ms;
+
+	// Guarded by group->mutex
+	size_t queued;
+	struct sync_clock clock; // Of its own timestamps, while it doesn't use the group's
+	bool use_wallclock;      // Its frames are placed by capture wallclock, on the group's clock
+	bool wallclock_off;      // Its wallclock disagreed with the group's, already logged
+
+	std::atomic<uint64_t> late_frames;
+	std::atomic<int64_t> delay_us;
+};
+
+struct sync_entry {
+	uint64_t due_ns;
+	struct moq_sync_member *member;
+	struct obs_source_frame frame;
+	uint8_t *buffer;
+	size_t capacity;
+};
+
+struct sync_group {
+	std::string name;
+
+	// Guarded by mutex
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::vector<struct moq_sync_member *> members;
+	uint32_t latency_ms;
+	struct sync_clock clock; // Of capture wallclock, shared by the members whose publishers send it
+	std::vector<sync_entry> queue; // By due_ns
+	std::vector<sync_entry> free_buffers;
+	struct moq_sync_member *outputting; // Member whose frame the playout thread is outputting
+	bool stopping;
+
+	std::thread thread;
+};
+
+static std::mutex groups_mutex;
+static std::vector<struct sync_group *> groups;
+
+static void sync_group_thread(struct sync_group *group)
+{
+	os_set_thread_name("moq-sync");
+
+	std::unique_lock<std::mutex> lock(group->mutex);
+	while (!group->stopping) {
+		if (group->queue.empty()) {
+			group->cond.wait(lock);
+			continue;
+		}
+		uint64_t now_ns = os_gettime_ns();
+		if (group->queue.front().due_ns > now_ns) {
+			group->cond.wait_for(lock, std::chrono::nanoseconds(group->queue.front().due_ns - now_ns));
+			continue;
+		}
+
+		sync_entry entry = group->queue.front();
+		group->queue.erase(group->queue.begin());
+		entry.member->queued--;
+
+		// Output unlocked, so members keep queueing; leaving waits for outputting to clear
+		group->outputting = entry.member;
+		lock.unlock();
+		obs_source_output_video(entry.member->source, &entry.frame);
+		lock.lock();
+		group->outputting = NULL;
+		group->free_buffers.push_back(entry);
+		group->cond.notify_all();
+	}
+}
+
+// NOTE: Caller must hold group->mutex
+static void sync_group_update_latency_locked(struct sync_group *group)
+{
+	group->latency_ms = 0;
+	for (struct moq_sync_member *member : group->members) {
+		if (member->latency_ms > group->latency_ms) {
+			group->latency_ms = member->latency_ms;
+		}
+	}
+}
+
+struct moq_sync_member *moq_sync_join(const char *name, obs_source_t *source, uint32_t latency_ms)
+{
+	struct moq_sync_member *member = new moq_sync_member();
+	member->source = source;
+	member->latency_ms = latency_ms;
+	member->queued = 0;
+	member->clock = {};
+	member->use_wallclock = false;
+	member->wallclock_off = false;
+	member->late_frames = 0;
+	member->delay_us = 0;
+
+	std::lock_guard<std::mutex> groups_lock(groups_mutex);
+	struct sync_group *group = NULL;
+	for (struct sync_group *existing : groups) {
+		if (existing->name == name) {
+			group = existing;
+			break;
+		}
+	}
+	if (!group) {
+		group = new sync_group();
+		group->name = name;
+		group->latency_ms = 0;
+		group->clock = {};
+		group->outputting = NULL;
+		group->stopping = false;
+		group->thread = std::thread(sync_group_thread, group);
+		groups.push_back(group);
+		LOG_INFO("Sync group '%s' created", name);
+	}
+	member->group = group;
+
+	std::lock_guard<std::mutex> lock(group->mutex);
+	group->members.push_back(member);
+	sync_group_update_latency_locked(group);
+	LOG_INFO("Joined sync group '%s' (%zu members, %u ms latency)", name, group->members.size(),
+		 group->latency_ms);
+	return member;
+}
+
+void moq_sync_leave(struct moq_sync_member *member)
+{
+	struct sync_group *group = member->group;
+	std::unique_lock<std::mutex> groups_lock(groups_mutex);
+	std::unique_lock<std::mutex> lock(group->mutex);
+
+	for (size_t i = 0; i < group->queue.size();) {
+		if (group->queue[i].member == member) {
+			group->free_buffers.push_back(group->queue[i]);
+			group->queue.erase(group->queue.begin() + i);
+		} else {
+			i++;
+		}
+	}
+	group->cond.wait(lock, [group, member] { return group->outputting != member; });
+
+	for (size_t i = 0; i < group->members.size(); i++) {
+		if (group->members[i] == member) {
+			group->members.erase(group->members.begin() + i);
+			break;
+		}
+	}
+	sync_group_update_latency_locked(group);
+	bool empty = group->members.empty();
+	delete member;
+
+	if (!empty) {
+		return;
+	}
+
+	// Last one out stops the playout thread
+	for (size_t i = 0; i < groups.size(); i++) {
+		if (groups[i] == group) {
+			groups.erase(groups.begin() + i);
+			break;
+		}
+	}
+	group->stopping = true;
+	group->cond.notify_all();
+	lock.unlock();
+	groups_lock.unlock();
+
+	group->thread.join();
+	for (sync_entry &entry : group->free_buffers) {
+		bfree(entry.buffer);
+	}
+	LOG_INFO("Sync group '%s' closed", group->name.c_str());
+	delete group;
+}
+
+// Timeline a member's frame is placed on: its capture wallclock when it uses the group's clock,
+// its own timestamps otherwise
+// NOTE: Caller must hold group->mutex
+static int64_t sync_member_time_ns_locked(struct moq_sync_member *member, uint64_t timestamp_us,
+					  const struct moq_wallclock_ref *wallclock)
+{
+	if (member->use_wallclock && wallclock) {
+		return ((int64_t)wallclock->wallclock_us + (int64_t)timestamp_us - (int64_t)wallclock->timestamp_us) *
+		       1000;
+	}
+	return (int64_t)(timestamp_us * 1000);
+}
+
+// NOTE: Caller must hold group->mutex
+static struct sync_clock *sync_member_clock_locked(struct moq_sync_member *member,
+						   const struct moq_wallclock_ref *wallclock)
+{
+	return member->use_wallclock && wallclock ? &member->group->clock : &member->clock;
+}
+
+// NOTE: Caller must hold group->mutex
+static void sync_clock_observe_locked(struct sync_group *group, struct sync_clock *clock, int64_t time_ns,
+				      uint64_t arrival_ns)
+{
+	int64_t sample_ns = (int64_t)arrival_ns - time_ns;
+	if (clock->anchored) {
+		// Tracks call back on different threads, so arrivals may be seen slightly out of order
+		int64_t elapsed_ns = (int64_t)(arrival_ns - clock->last_observe_ns);
+		if (elapsed_ns > 0) {
+			clock->offset_ns += (int64_t)(elapsed_ns / 1000000000.0 * MOQ_SYNC_RELAX_NS_PER_S);
+		}
+	}
+	if (!clock->anchored || sample_ns < clock->offset_ns) {
+		clock->offset_ns = sample_ns;
+	} else if (sample_ns - clock->offset_ns > MOQ_SYNC_REANCHOR_NS) {
+		LOG_WARNING("Sync group '%s': timestamps jumped by %lld ms, re-anchoring the playout clock",
+			    group->name.c_str(), (long long)(sample_ns - clock->offset_ns) / 1000000);
+		clock->offset_ns = sample_ns;
+	}
+	if (!clock->anchored || arrival_ns > clock->last_observe_ns) {
+		clock->last_observe_ns = arrival_ns;
+	}
+	clock->anchored = true;
+}
+
+void moq_sync_observe(struct moq_sync_member *member, uint64_t timestamp_us, uint64_t arrival_ns,
+		      const struct moq_wallclock_ref *wallclock)
+{
+	struct sync_group *group = member->group;
+
+	std::lock_guard<std::mutex> lock(group->mutex);
+	member->use_wallclock = false;
+	if (wallclock) {
+		// A publisher whose clock is off would drag every member's playout with it, so it keeps to its own
+		member->use_wallclock = true;
+		int64_t sample_ns = (int64_t)arrival_ns - sync_member_time_ns_locked(member, timestamp_us, wallclock);
+		int64_t skew_ns = sample_ns - group->clock.offset_ns;
+		if (group->clock.anchored && (skew_ns > MOQ_SYNC_REANCHOR_NS || skew_ns < -MOQ_SYNC_REANCHOR_NS)) {
+			if (!member->wallclock_off) {
+				LOG_WARNING("Sync group '%s': a publisher's clock is %lld ms off the others, "
+					    "aligning it on its own arrival times",
+					    group->name.c_str(), (long long)skew_ns / 1000000);
+				member->wallclock_off = true;
+			}
+			member->use_wallclock = false;
+		}
+	}
+
+	int64_t time_ns = sync_member_time_ns_locked(member, timestamp_us, wallclock);
+	struct sync_clock *clock = sync_member_clock_locked(member, wallclock);
+	sync_clock_observe_locked(group, clock, time_ns, arrival_ns);
+
+	int64_t playout_ns = time_ns + clock->offset_ns + group->latency_ms * 1000000LL;
+	member->delay_us.store((playout_ns - (int64_t)arrival_ns) / 1000, std::memory_order_relaxed);
+}
+
+void moq_sync_output(struct moq_sync_member *member, const struct obs_source_frame *frame, uint64_t timestamp_us,
+		     const struct moq_wallclock_ref *wallclock)
+{
+	struct sync_group *group = member->group;
+	size_t size = (size_t)frame->linesize[0] * frame->height;
+
+	// Reuse a buffer from an output frame; only the copy itself runs unlocked
+	sync_entry entry = {};
+	{
+		std::lock_guard<std::mutex> lock(group->mutex);
+		for (size_t i = group->free_buffers.size(); i > 0; i--) {
+			if (group->free_buffers[i - 1].capacity >= size) {
+				entry = group->free_buffers[i - 1];
+				group->free_buffers.erase(group->free_buffers.begin() + (i - 1));
+				break;
+			}
+		}
+	}
+	if (!entry.buffer) {
+		entry.buffer = (uint8_t *)bmalloc(size);
+		entry.capacity = size;
+	}
+	memcpy(entry.buffer, frame->data[0], size);
+	entry.frame = *frame;
+	entry.frame.data[0] = entry.buffer;
+	entry.member = member;
+
+	std::lock_guard<std::mutex> lock(group->mutex);
+	if (member->queued >= MOQ_SYNC_MAX_QUEUED) {
+		member->late_frames.fetch_add(1, std::memory_order_relaxed);
+		group->free_buffers.push_back(entry);
+		return;
+	}
+
+	uint64_t now_ns = os_gettime_ns();
+	const struct sync_clock *clock = sync_member_clock_locked(member, wallclock);
+	int64_t due_ns = sync_member_time_ns_locked(member, timestamp_us, wallclock) + clock->offset_ns +
+			 group->latency_ms * 1000000LL;
+	if (!clock->anchored || due_ns < (int64_t)now_ns) {
+		if (clock->anchored) {
+			member->late_frames.fetch_add(1, std::memory_order_relaxed);
+		}
+		due_ns = (int64_t)now_ns;
+	}
+	entry.due_ns = (uint64_t)due_ns;
+	entry.frame.timestamp = entry.due_ns;
+
+	size_t pos = group->queue.size();
+	while (pos > 0 && group->queue[pos - 1].due_ns > entry.due_ns) {
+		pos--;
+	}
+	group->queue.insert(group->queue.begin() + pos, entry);
+	member->queued++;
+	group->cond.notify_all();
+}
+
+void moq_sync_get_stats(struct moq_sync_member *member, struct moq_sync_stats *stats)
+{
+	stats->late_frames = member->late_frames.load(std::memory_order_relaxed);
+	stats->delay_us = member->delay_us.load(std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(member->group->mutex);
+	stats->latency_ms = member->group->latency_ms;
+	stats->queued_frames = member->queued;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <obs-module.h>
+#include <stdint.h>
+
+// Genlocked playout for MoQ Sources pulled from several publishers. Sources in the same named group
+// share one playout clock: a frame is shown at the wallclock time its publisher captured it (see
+// wallclock.h), mapped onto os_gettime_ns() by the smallest transit delay seen across the group, plus
+// a common latency. Frames captured at the same instant on different cameras thus reach OBS together,
+// whatever each network path adds, given publishers with synced clocks. A member whose publisher sends
+// no wallclock, or one too far off the others', is mapped by its own fastest transit instead.
+struct moq_sync_member;
+struct moq_wallclock_ref;
+
+// Adds source to the group called name, created on first use. The group's latency is the largest
+// asked for by any member, so every member has at least the headroom it wants.
+struct moq_sync_member *moq_sync_join(const char *name, obs_source_t *source, uint32_t latency_ms);
+
+// Removes the member and drops its queued frames. Returns once none of its frames is being output.
+void moq_sync_leave(struct moq_sync_member *member);
+
+// Feeds the clock with a frame as it arrives from the network. wallclock is the latest reference
+// its publisher sent, or NULL if it sends none.
+void moq_sync_observe(struct moq_sync_member *member, uint64_t timestamp_us, uint64_t arrival_ns,
+		      const struct moq_wallclock_ref *wallclock);
+
+// Queues a copy of frame to be output at the playout time of timestamp_us, with the same wallclock
+// reference as it was observed with. A frame already past its time is output as soon as possible and
+// counted as late.
+void moq_sync_output(struct moq_sync_member *member, const struct obs_source_frame *frame, uint64_t timestamp_us,
+		     const struct moq_wallclock_ref *wallclock);
+
+struct moq_sync_stats {
+	uint64_t late_frames;
+	uint64_t queued_frames; // Waiting for their playout time
+	uint32_t latency_ms; // The group's, which may be more than this member asked for
+	int64_t delay_us;    // Playout time minus arrival time of the last frame observed
+};
+
+void moq_sync_get_stats(struct moq_sync_member *member, struct moq_sync_stats *stats);
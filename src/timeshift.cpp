@@ -0,0 +1,151 @@
+#include <obs-module.h>
+#include <string.h>
+
+#include "timeshift.h"
+#include "logger.h"
+
+// Evicted index entries are compacted away once they make up half the index, and at least this many
+#define MOQ_TIMESHIFT_COMPACT_MIN 256
+
+void moq_timeshift_init(struct moq_timeshift *ts, size_t capacity)
+{
+	ts->data = capacity ? (uint8_t *)bmalloc(capacity) : NULL;
+	ts->capacity = ts->data ? capacity : 0;
+	ts->write_offset = 0;
+	da_init(ts->frames);
+	ts->first = 0;
+	ts->first_seq = 0;
+	da_init(ts->chunks);
+}
+
+void moq_timeshift_free(struct moq_timeshift *ts)
+{
+	bfree(ts->data);
+	ts->data = NULL;
+	ts->capacity = 0;
+	da_free(ts->frames);
+	da_free(ts->chunks);
+}
+
+void moq_timeshift_clear(struct moq_timeshift *ts)
+{
+	ts->first_seq += ts->frames.num - ts->first;
+	da_resize(ts->frames, 0);
+	ts->first = 0;
+}
+
+// Drops the oldest group: its keyframe and every delta frame up to the next keyframe
+static void moq_timeshift_evict_group(struct moq_timeshift *ts)
+{
+	do {
+		ts->first++;
+		ts->first_seq++;
+	} while (ts->first < ts->frames.num && !ts->frames.array[ts->first].keyframe);
+
+	if (ts->first == ts->frames.num) {
+		da_resize(ts->frames, 0);
+		ts->first = 0;
+	} else if (ts->first >= MOQ_TIMESHIFT_COMPACT_MIN && ts->first * 2 >= ts->frames.num) {
+		da_erase_range(ts->frames, 0, ts->first);
+		ts->first = 0;
+	}
+}
+
+bool moq_timeshift_append(struct moq_timeshift *ts, int32_t frame_id, const struct moq_frame *first)
+{
+	if (!ts->capacity) {
+		return false;
+	}
+
+	// A delta frame is useless without the keyframe it follows
+	bool empty = ts->first == ts->frames.num;
+	if (empty && !first->keyframe) {
+		return false;
+	}
+
+	da_resize(ts->chunks, 0);
+	da_push_back(ts->chunks, first);
+	size_t size = first->payload_size;
+	for (uint32_t index = 1;; index++) {
+		struct moq_frame chunk;
+		if (moq_consume_frame_chunk(frame_id, index, &chunk) < 0) {
+			break;
+		}
+		da_push_back(ts->chunks, &chunk);
+		size += chunk.payload_size;
+	}
+
+	if (size > ts->capacity) {
+		// Can't be kept, and the frames after it can't be decoded without it
+		LOG_WARNING("Frame of %zu bytes doesn't fit the %zu byte timeshift buffer", size, ts->capacity);
+		moq_timeshift_clear(ts);
+		return false;
+	}
+
+	// Payloads are contiguous: one that would straddle the end of the ring starts over at the beginning
+	uint64_t offset = ts->write_offset;
+	size_t pos = (size_t)(offset % ts->capacity);
+	if (pos + size > ts->capacity) {
+		offset += ts->capacity - pos;
+		pos = 0;
+	}
+
+	while (ts->first < ts->frames.num && offset + size - ts->frames.array[ts->first].offset > ts->capacity) {
+		moq_timeshift_evict_group(ts);
+	}
+	if (ts->first == ts->frames.num && !first->keyframe) {
+		// Evicting made room by dropping the group this frame belongs to
+		return false;
+	}
+
+	uint8_t *dst = ts->data + pos;
+	for (size_t i = 0; i < ts->chunks.num; i++) {
+		const struct moq_frame *chunk = &ts->chunks.array[i];
+		if (chunk->payload_size > 0) {
+			memcpy(dst, chunk->payload, chunk->payload_size);
+			dst += chunk->payload_size;
+		}
+	}
+
+	struct moq_timeshift_frame *frame = da_push_back_new(ts->frames);
+	frame->offset = offset;
+	frame->size = size;
+	frame->timestamp_us = first->timestamp_us;
+	frame->keyframe = first->keyframe;
+	ts->write_offset = offset + size;
+	return true;
+}
+
+uint64_t moq_timeshift_begin(const struct moq_timeshift *ts)
+{
+	return ts->first_seq;
+}
+
+uint64_t moq_timeshift_end(const struct moq_timeshift *ts)
+{
+	return ts->first_seq + (ts->frames.num - ts->first);
+}
+
+const struct moq_timeshift_frame *moq_timeshift_get(const struct moq_timeshift *ts, uint64_t seq,
+						    const uint8_t **payload)
+{
+	if (seq < moq_timeshift_begin(ts) || seq >= moq_timeshift_end(ts)) {
+		return NULL;
+	}
+
+	const struct moq_timeshift_frame *frame = &ts->frames.array[ts->first + (size_t)(seq - ts->first_seq)];
+	*payload = ts->data + (size_t)(frame->offset % ts->capacity);
+	return frame;
+}
+
+uint64_t moq_timeshift_find_keyframe(const struct moq_timeshift *ts, uint64_t timestamp_us)
+{
+	// Newest first: seeks usually land near the live edge
+	for (size_t i = ts->frames.num; i > ts->first; i--) {
+		const struct moq_timeshift_frame *frame = &ts->frames.array[i - 1];
+		if (frame->keyframe && frame->timestamp_us <= timestamp_us) {
+			return ts->first_seq + (i - 1 - ts->first);
+		}
+	}
+	return ts->first < ts->frames.num ? ts->first_seq : moq_timeshift_end(ts);
+}
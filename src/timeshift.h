@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <util/darray.h>
+
+extern "C" {
+#include "moq.h"
+}
+
+// One compressed frame retained by the timeshift buffer
+struct moq_timeshift_frame {
+	uint64_t offset; // Position of the payload in everything written so far, modulo capacity in data
+	size_t size;
+	uint64_t timestamp_us;
+	bool keyframe;
+};
+
+// Memory-bounded window of recently received compressed frames, for replaying a live feed.
+// Payloads are copied back to back into one ring allocation made up front, so recording doesn't
+// allocate per frame. When the next frame doesn't fit, whole groups are evicted from the front,
+// so the window always starts at a keyframe. Frames are addressed by a sequence number that
+// keeps counting across evictions.
+struct moq_timeshift {
+	uint8_t *data;
+	size_t capacity;
+	uint64_t write_offset; // Where the next payload goes, in the same units as moq_timeshift_frame.offset
+
+	// Index of the retained frames: frames.array[first..num), the first of which has sequence first_seq
+	DARRAY(struct moq_timeshift_frame) frames;
+	size_t first;
+	uint64_t first_seq;
+
+	DARRAY(struct moq_frame) chunks; // Scratch list of the frame being appended
+};
+
+// A capacity of 0 leaves the buffer disabled: nothing is appended
+void moq_timeshift_init(struct moq_timeshift *ts, size_t capacity);
+void moq_timeshift_free(struct moq_timeshift *ts);
+
+// Drops every retained frame. Sequence numbers keep counting.
+void moq_timeshift_clear(struct moq_timeshift *ts);
+
+// Copies every chunk of frame_id into the buffer, evicting old groups to make room.
+// first is chunk 0, which the caller has already read. Returns false if the frame wasn't kept:
+// the buffer is disabled or too small for it, or the frame is a delta frame with nothing to refer to.
+bool moq_timeshift_append(struct moq_timeshift *ts, int32_t frame_id, const struct moq_frame *first);
+
+// Sequence numbers of the oldest retained frame and one past the newest
+uint64_t moq_timeshift_begin(const struct moq_timeshift *ts);
+uint64_t moq_timeshift_end(const struct moq_timeshift *ts);
+
+// Retained frame with sequence number seq and its payload, NULL if it was evicted or not written yet
+const struct moq_timeshift_frame *moq_timeshift_get(const struct moq_timeshift *ts, uint64_t seq,
+						    const uint8_t **payload);
+
+// Sequence number of the newest keyframe at or before timestamp_us; the oldest retained frame (always a
+// keyframe) when timestamp_us is older than the window. Returns moq_timeshift_end() when empty.
+uint64_t moq_timeshift_find_keyframe(const struct moq_timeshift *ts, uint64_t timestamp_us);
@@ -0,0 +1,248 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+#include "logger.h"
+
+// Slices kept per thread, several seconds of every trace point at 60 fps
+#define MOQ_TRACE_RING_EVENTS 8192
+#define MOQ_TRACE_THREAD_NAME_MAX 32
+
+struct trace_event {
+	const char *category;
+	const char *name;
+	uint64_t start_ns;
+	uint64_t duration_ns;
+	const void *id;
+	uint64_t timestamp_us;
+};
+
+// Written only by the thread that owns it; moq_trace_dump reads it concurrently
+struct trace_ring {
+	uint32_t tid; // Track in the trace, numbered in order of first use
+	char thread_name[MOQ_TRACE_THREAD_NAME_MAX];
+	std::atomic<uint64_t> head; // Slices written so far, the ring holds the latest
+	std::atomic<bool> owned;    // A running thread writes to it
+	trace_event events[MOQ_TRACE_RING_EVENTS];
+};
+
+// Gives the calling thread's ring back when the thread exits, for the next new thread to reuse
+struct trace_owner {
+	trace_ring *ring = NULL;
+	char thread_name[MOQ_TRACE_THREAD_NAME_MAX] = {};
+	~trace_owner()
+	{
+		if (ring) {
+			ring->owned.store(false, std::memory_order_release);
+		}
+	}
+};
+
+static std::atomic<bool> trace_enabled(false);
+static std::string trace_exit_path; // OBS_MOQ_TRACE
+
+static std::mutex rings_mutex;
+static std::vector<trace_ring *> rings;
+static thread_local trace_owner owner;
+
+void moq_trace_init(void)
+{
+	const char *path = getenv("OBS_MOQ_TRACE");
+	if (path && *path) {
+		trace_exit_path = path;
+		moq_trace_enable(true);
+	}
+}
+
+void moq_trace_shutdown(void)
+{
+	if (!trace_exit_path.empty()) {
+		moq_trace_enable(false);
+		moq_trace_dump(trace_exit_path.c_str());
+	}
+
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	for (trace_ring *ring : rings) {
+		// Threads still running (libmoq's) must not touch a freed ring
+		if (!ring->owned.load(std::memory_order_acquire)) {
+			delete ring;
+		}
+	}
+	rings.clear();
+}
+
+void moq_trace_enable(bool enable)
+{
+	if (trace_enabled.exchange(enable) != enable) {
+		LOG_INFO("Tracing %s", enable ? "started" : "stopped");
+	}
+}
+
+uint64_t moq_trace_begin(void)
+{
+	return trace_enabled.load(std::memory_order_relaxed) ? os_gettime_ns() : 0;
+}
+
+// Ring for the calling thread: a new one, or one a thread that exited left behind. The slices of that
+// thread stay until the new one overwrites them.
+static trace_ring *moq_trace_acquire_ring(void)
+{
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	trace_ring *ring = NULL;
+	for (trace_ring *candidate : rings) {
+		if (!candidate->owned.load(std::memory_order_acquire)) {
+			ring = candidate;
+			break;
+		}
+	}
+	if (!ring) {
+		ring = new trace_ring();
+		ring->tid = (uint32_t)rings.size() + 1;
+		rings.push_back(ring);
+	}
+	ring->owned.store(true, std::memory_order_relaxed);
+	if (owner.thread_name[0]) {
+		memcpy(ring->thread_name, owner.thread_name, sizeof(ring->thread_name));
+	} else {
+		snprintf(ring->thread_name, sizeof(ring->thread_name), "thread %u", ring->tid);
+	}
+	return ring;
+}
+
+void moq_trace_end(const char *category, const char *name, uint64_t start_ns, const void *id, uint64_t timestamp_us)
+{
+	if (!start_ns) {
+		return;
+	}
+	uint64_t end_ns = os_gettime_ns();
+
+	trace_ring *ring = owner.ring;
+	if (!ring) {
+		ring = owner.ring = moq_trace_acquire_ring();
+	}
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	trace_event *event = &ring->events[head % MOQ_TRACE_RING_EVENTS];
+	event->category = category;
+	event->name = name;
+	event->start_ns = start_ns;
+	event->duration_ns = end_ns - start_ns;
+	event->id = id;
+	event->timestamp_us = timestamp_us;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void moq_trace_set_thread_name(const char *name)
+{
+	snprintf(owner.thread_name, sizeof(owner.thread_name), "%s", name);
+	if (owner.ring) {
+		memcpy(owner.ring->thread_name, owner.thread_name, sizeof(owner.thread_name));
+	}
+}
+
+// Copies the slices a ring holds. Ones its thread may have overwritten during the copy are dropped.
+static void moq_trace_snapshot(trace_ring *ring, std::vector<trace_event> &events)
+{
+	uint64_t end = ring->head.load(std::memory_order_acquire);
+	uint64_t begin = end > MOQ_TRACE_RING_EVENTS ? end - MOQ_TRACE_RING_EVENTS : 0;
+	size_t first = events.size();
+	for (uint64_t i = begin; i < end; i++) {
+		events.push_back(ring->events[i % MOQ_TRACE_RING_EVENTS]);
+	}
+
+	uint64_t now = ring->head.load(std::memory_order_acquire);
+	uint64_t valid_from = now >= MOQ_TRACE_RING_EVENTS ? now - MOQ_TRACE_RING_EVENTS + 1 : 0;
+	if (valid_from > begin) {
+		size_t stale = (size_t)(valid_from - begin < end - begin ? valid_from - begin : end - begin);
+		events.erase(events.begin() + first, events.begin() + first + stale);
+	}
+}
+
+// JSON string contents; the names come from code, so only quotes and backslashes need escaping
+static void moq_trace_write_string(FILE *file, const char *text)
+{
+	for (; *text; text++) {
+		if (*text == '"' || *text == '\\') {
+			fputc('\\', file);
+		}
+		fputc(*text, file);
+	}
+}
+
+bool moq_trace_dump(const char *path)
+{
+	FILE *file = os_fopen(path, "wb");
+	if (!file) {
+		LOG_ERROR("Failed to create trace file: %s", path);
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	size_t count = 0;
+	std::vector<trace_event> events;
+
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	for (trace_ring *ring : rings) {
+		events.clear();
+		moq_trace_snapshot(ring, events);
+
+		fprintf(file, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"",
+			first ? "" : ",\n", ring->tid);
+		moq_trace_write_string(file, ring->thread_name);
+		fprintf(file, "\"}}");
+		first = false;
+
+		for (const trace_event &event : events) {
+			fprintf(file,
+				",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"cat\":\"%s\",\"name\":\"%s\","
+				"\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"id\":\"%p\"",
+				ring->tid, event.category, event.name, event.start_ns / 1000.0,
+				event.duration_ns / 1000.0, event.id);
+			if (event.timestamp_us) {
+				fprintf(file, ",\"timestamp_us\":%llu", (unsigned long long)event.timestamp_us);
+			}
+			fprintf(file, "}}");
+		}
+		count += events.size();
+	}
+	fprintf(file, "\n]}\n");
+
+	bool ok = fclose(file) == 0;
+	if (ok) {
+		LOG_INFO("Wrote %zu trace slices from %zu threads to %s", count, rings.size(), path);
+	} else {
+		LOG_ERROR("Failed to write trace file: %s", path);
+	}
+	return ok;
+}
+
+static void moq_trace_proc_start(void *, calldata_t *)
+{
+	moq_trace_enable(true);
+}
+
+static void moq_trace_proc_stop(void *, calldata_t *)
+{
+	moq_trace_enable(false);
+}
+
+static void moq_trace_proc_dump(void *, calldata_t *cd)
+{
+	const char *path = calldata_string(cd, "path");
+	calldata_set_bool(cd, "success", path && *path && moq_trace_dump(path));
+}
+
+void moq_trace_add_procs(struct proc_handler *ph)
+{
+	proc_handler_add(ph, "void trace_start()", moq_trace_proc_start, NULL);
+	proc_handler_add(ph, "void trace_stop()", moq_trace_proc_stop, NULL);
+	proc_handler_add(ph, "void trace_dump(in string path, out bool success)", moq_trace_proc_dump, NULL);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+// Timing of the frame paths of every MoQ Source and MoQ Output, exported as a Chrome/Perfetto JSON
+// trace (open it in ui.perfetto.dev or chrome://tracing). Each thread appends slices to a ring of its
+// own, with no lock or allocation once the ring exists; the oldest slices are overwritten. While
+// tracing is off a trace point costs one relaxed atomic load.
+//
+// Setting OBS_MOQ_TRACE to a file path traces from module load and writes the trace there on unload.
+// Sources and outputs also have procedures to do it on demand, see moq_trace_add_procs.
+
+struct proc_handler;
+
+// Reads OBS_MOQ_TRACE; called on module load
+void moq_trace_init(void);
+
+// Writes the trace to OBS_MOQ_TRACE if it is set; called on module unload
+void moq_trace_shutdown(void);
+
+// Starts or stops recording. Stopping keeps what was recorded for moq_trace_dump.
+void moq_trace_enable(bool enable);
+
+// Start time to pass to moq_trace_end, or 0 while tracing is off
+uint64_t moq_trace_begin(void);
+
+// Records a slice from start_ns to now on the calling thread. category and name must be string
+// literals; only the pointers are kept. id tells apart the objects sharing a name (a source's
+// pipeline, or an output), and timestamp_us, if not 0, is the media timestamp of the frame being
+// handled. Every slice of one frame carries the same id. Does nothing if start_ns is 0.
+void moq_trace_end(const char *category, const char *name, uint64_t start_ns, const void *id, uint64_t timestamp_us);
+
+// Names the calling thread in the trace. Threads that don't are shown by number.
+void moq_trace_set_thread_name(const char *name);
+
+// Writes what the rings hold as a JSON trace. Returns false if path can't be written.
+bool moq_trace_dump(const char *path);
+
+// Adds "void trace_start()", "void trace_stop()" and "void trace_dump(in string path, out bool success)"
+// to a source's or output's procedures. They act on the trace shared by all of them.
+void moq_trace_add_procs(struct proc_handler *ph);
@@ -0,0 +1,223 @@
+#include <obs-module.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "wallclock.h"
+
+// SEI payload: the UUID, then the media timestamp and the wallclock time, both big-endian
+#define MOQ_WALLCLOCK_PAYLOAD_SIZE 32
+#define MOQ_SEI_USER_DATA_UNREGISTERED 5
+// Bytes of a SEI NAL unit examined when looking for ours
+#define MOQ_SEI_SCAN_MAX 256
+
+// "obs-moq-wallclk1", tells our user data apart from any other
+static const uint8_t moq_wallclock_uuid[16] = {0x6f, 0x62, 0x73, 0x2d, 0x6d, 0x6f, 0x71, 0x2d,
+					       0x77, 0x61, 0x6c, 0x6c, 0x63, 0x6c, 0x6b, 0x31};
+
+uint64_t moq_wallclock_now_us(void)
+{
+	auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(since_epoch).count();
+}
+
+static int moq_nal_type(bool hevc, uint8_t header)
+{
+	return hevc ? (header >> 1) & 0x3f : header & 0x1f;
+}
+
+static bool moq_nal_is_slice(bool hevc, int type)
+{
+	return hevc ? type < 32 : type >= 1 && type <= 5;
+}
+
+static bool moq_nal_is_sei(bool hevc, int type)
+{
+	return hevc ? type == 39 : type == 6;
+}
+
+// Offset of the next Annex B start code at or after pos and its length, size if there is none
+static size_t moq_find_start_code(const uint8_t *data, size_t size, size_t pos, size_t *code_len)
+{
+	for (size_t i = pos; i + 3 <= size; i++) {
+		if (data[i] != 0 || data[i + 1] != 0) {
+			continue;
+		}
+		if (data[i + 2] == 1) {
+			*code_len = 3;
+			return i;
+		}
+		if (data[i + 2] == 0 && i + 4 <= size && data[i + 3] == 1) {
+			*code_len = 4;
+			return i;
+		}
+	}
+	return size;
+}
+
+static void moq_put_be64(uint8_t *dst, uint64_t value)
+{
+	for (int i = 7; i >= 0; i--) {
+		dst[i] = (uint8_t)value;
+		value >>= 8;
+	}
+}
+
+static uint64_t moq_get_be64(const uint8_t *src)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++) {
+		value = (value << 8) | src[i];
+	}
+	return value;
+}
+
+// Writes the SEI NAL unit with its start code, returns its size
+static size_t moq_wallclock_write_sei(bool hevc, const struct moq_wallclock_ref *ref, uint8_t *out)
+{
+	uint8_t rbsp[2 + MOQ_WALLCLOCK_PAYLOAD_SIZE];
+	rbsp[0] = MOQ_SEI_USER_DATA_UNREGISTERED;
+	rbsp[1] = MOQ_WALLCLOCK_PAYLOAD_SIZE;
+	memcpy(rbsp + 2, moq_wallclock_uuid, sizeof(moq_wallclock_uuid));
+	moq_put_be64(rbsp + 18, ref->timestamp_us);
+	moq_put_be64(rbsp + 26, ref->wallclock_us);
+
+	size_t n = 0;
+	out[n++] = 0;
+	out[n++] = 0;
+	out[n++] = 0;
+	out[n++] = 1;
+	if (hevc) {
+		out[n++] = 39 << 1; // PREFIX_SEI_NUT
+		out[n++] = 1;       // nuh_temporal_id_plus1
+	} else {
+		out[n++] = 6;
+	}
+
+	// Emulation prevention: no 00 00 0x with x <= 3 inside the NAL unit
+	int zeros = 0;
+	for (size_t i = 0; i < sizeof(rbsp); i++) {
+		if (zeros >= 2 && rbsp[i] <= 3) {
+			out[n++] = 3;
+			zeros = 0;
+		}
+		out[n++] = rbsp[i];
+		zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+	}
+	out[n++] = 0x80; // rbsp_trailing_bits
+	return n;
+}
+
+size_t moq_wallclock_insert(bool hevc, const uint8_t *data, size_t size, const struct moq_wallclock_ref *ref,
+			    uint8_t *out)
+{
+	size_t code_len;
+	size_t pos = moq_find_start_code(data, size, 0, &code_len);
+	while (pos < size && pos + code_len < size) {
+		size_t header = pos + code_len;
+		if (moq_nal_is_slice(hevc, moq_nal_type(hevc, data[header]))) {
+			memcpy(out, data, pos);
+			size_t n = pos + moq_wallclock_write_sei(hevc, ref, out + pos);
+			memcpy(out + n, data + pos, size - pos);
+			return n + size - pos;
+		}
+		pos = moq_find_start_code(data, size, header, &code_len);
+	}
+	return 0;
+}
+
+// Reads our user data from a SEI NAL unit, header included
+static bool moq_wallclock_parse_sei(bool hevc, const uint8_t *nal, size_t size, struct moq_wallclock_ref *ref)
+{
+	// Undo emulation prevention; our message comes first, so the start of the unit is enough
+	uint8_t rbsp[MOQ_SEI_SCAN_MAX];
+	size_t len = 0;
+	int zeros = 0;
+	for (size_t i = hevc ? 2 : 1; i < size && len < sizeof(rbsp); i++) {
+		if (zeros >= 2 && nal[i] == 3) {
+			zeros = 0;
+			continue;
+		}
+		rbsp[len++] = nal[i];
+		zeros = nal[i] == 0 ? zeros + 1 : 0;
+	}
+
+	size_t pos = 0;
+	while (pos < len && rbsp[pos] != 0x80) {
+		size_t type = 0;
+		while (pos < len && rbsp[pos] == 0xff) {
+			type += rbsp[pos++];
+		}
+		if (pos >= len) {
+			return false;
+		}
+		type += rbsp[pos++];
+
+		size_t payload_size = 0;
+		while (pos < len && rbsp[pos] == 0xff) {
+			payload_size += rbsp[pos++];
+		}
+		if (pos >= len) {
+			return false;
+		}
+		payload_size += rbsp[pos++];
+		if (payload_size > len - pos) {
+			return false;
+		}
+
+		if (type == MOQ_SEI_USER_DATA_UNREGISTERED && payload_size >= MOQ_WALLCLOCK_PAYLOAD_SIZE &&
+		    memcmp(rbsp + pos, moq_wallclock_uuid, sizeof(moq_wallclock_uuid)) == 0) {
+			ref->timestamp_us = moq_get_be64(rbsp + pos + 16);
+			ref->wallclock_us = moq_get_be64(rbsp + pos + 24);
+			return true;
+		}
+		pos += payload_size;
+	}
+	return false;
+}
+
+bool moq_wallclock_find(bool hevc, const uint8_t *data, size_t size, struct moq_wallclock_ref *ref)
+{
+	bool annexb = size >= 4 && data[0] == 0 && data[1] == 0 && (data[2] == 1 || (data[2] == 0 && data[3] == 1));
+
+	size_t code_len = 0;
+	size_t pos = annexb ? moq_find_start_code(data, size, 0, &code_len) : 0;
+	while (pos < size) {
+		size_t nal;
+		size_t nal_size;
+		size_t next;
+		if (annexb) {
+			nal = pos + code_len;
+			if (nal >= size) {
+				return false;
+			}
+			// Checked before looking for its end, so the slice itself is never scanned
+			if (moq_nal_is_slice(hevc, moq_nal_type(hevc, data[nal]))) {
+				return false;
+			}
+			next = moq_find_start_code(data, size, nal, &code_len);
+			nal_size = next - nal;
+		} else {
+			if (size - pos < 4) {
+				return false;
+			}
+			nal_size = ((size_t)data[pos] << 24) | ((size_t)data[pos + 1] << 16) |
+				   ((size_t)data[pos + 2] << 8) | data[pos + 3];
+			nal = pos + 4;
+			if (nal_size == 0 || nal_size > size - nal) {
+				return false;
+			}
+			if (moq_nal_is_slice(hevc, moq_nal_type(hevc, data[nal]))) {
+				return false;
+			}
+			next = nal + nal_size;
+		}
+
+		if (nal_size > 0 && moq_nal_is_sei(hevc, moq_nal_type(hevc, data[nal])) &&
+		    moq_wallclock_parse_sei(hevc, data + nal, nal_size, ref)) {
+			return true;
+		}
+		pos = next;
+	}
+	return false;
+}
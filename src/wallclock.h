@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Producer reference time: MoQ Output stamps keyframes with the wallclock time at which their timestamp
+// was captured, so a subscriber can tell how old each frame is (glass to glass, given NTP-synced clocks).
+// libmoq has no catalog metadata or data tracks to carry it, so it travels in-band as an H.264/HEVC
+// "user data unregistered" SEI that decoders ignore.
+struct moq_wallclock_ref {
+	uint64_t timestamp_us; // Media timestamp, as published
+	uint64_t wallclock_us; // Unix time at which that timestamp was captured
+};
+
+// Upper bound on what moq_wallclock_insert adds to an access unit
+#define MOQ_WALLCLOCK_SEI_MAX_SIZE 64
+
+// Current Unix time in microseconds
+uint64_t moq_wallclock_now_us(void);
+
+// Copies the Annex B access unit data to out with a SEI carrying ref in front of its first slice.
+// out must hold size + MOQ_WALLCLOCK_SEI_MAX_SIZE bytes. Returns the size written, or 0 if the access
+// unit has no slice in Annex B format to insert in front of.
+size_t moq_wallclock_insert(bool hevc, const uint8_t *data, size_t size, const struct moq_wallclock_ref *ref,
+			    uint8_t *out);
+
+// Looks for a SEI written by moq_wallclock_insert ahead of the first slice of an access unit,
+// either Annex B or with 4-byte NAL lengths. Returns false if there is none.
+bool moq_wallclock_find(bool hevc, const uint8_t *data, size_t size, struct moq_wallclock_ref *ref);
@@ -0,0 +1,132 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "worker-pool.h"
+#include "trace.h"
+#include "logger.h"
+
+// More threads than this only adds hand-off overhead for per-frame work
+#define MOQ_WORKER_POOL_MAX_THREADS 15
+
+struct pool_job {
+	moq_slice_func func;
+	void *param;
+	int slice_count;
+	int next_slice; // Next slice to hand out, guarded by pool_mutex
+	int pending;    // Slices not finished yet, guarded by pool_mutex
+};
+
+static std::mutex pool_mutex;
+static std::condition_variable work_cond;
+static std::condition_variable done_cond;
+static std::deque<pool_job *> pool_jobs; // Jobs that still have slices to hand out
+static std::vector<std::thread> pool_threads;
+static bool pool_stopping = false;
+
+static int pool_thread_target()
+{
+	int cores = os_get_logical_cores();
+	return std::clamp(cores - 1, 0, MOQ_WORKER_POOL_MAX_THREADS);
+}
+
+// NOTE: Caller must hold pool_mutex
+static int claim_slice_locked(pool_job *job)
+{
+	int slice = job->next_slice++;
+	if (job->next_slice == job->slice_count) {
+		pool_jobs.erase(std::find(pool_jobs.begin(), pool_jobs.end(), job));
+	}
+	return slice;
+}
+
+// NOTE: Called with lock held, returns with lock held
+static void run_slice(std::unique_lock<std::mutex> &lock, pool_job *job)
+{
+	int slice = claim_slice_locked(job);
+	lock.unlock();
+	job->func(job->param, slice, job->slice_count);
+	lock.lock();
+	if (--job->pending == 0) {
+		done_cond.notify_all();
+	}
+}
+
+static void worker_thread()
+{
+	os_set_thread_name("moq-worker");
+	moq_trace_set_thread_name("moq-worker");
+
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	for (;;) {
+		work_cond.wait(lock, [] { return pool_stopping || !pool_jobs.empty(); });
+		if (pool_stopping) {
+			return;
+		}
+		run_slice(lock, pool_jobs.front());
+	}
+}
+
+// NOTE: Caller must hold pool_mutex
+static void start_threads_locked()
+{
+	if (!pool_threads.empty() || pool_stopping) {
+		return;
+	}
+
+	int count = pool_thread_target();
+	for (int i = 0; i < count; i++) {
+		pool_threads.emplace_back(worker_thread);
+	}
+	LOG_INFO("Worker pool started with %d threads", count);
+}
+
+void moq_worker_pool_run(moq_slice_func func, void *param, int slice_count)
+{
+	if (slice_count <= 1 || pool_thread_target() == 0) {
+		for (int slice = 0; slice < slice_count; slice++) {
+			func(param, slice, slice_count);
+		}
+		return;
+	}
+
+	pool_job job = {func, param, slice_count, 0, slice_count};
+
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	start_threads_locked();
+	pool_jobs.push_back(&job);
+	work_cond.notify_all();
+
+	// Work on our own job rather than sleeping, then wait for slices still running elsewhere
+	while (job.next_slice < job.slice_count) {
+		run_slice(lock, &job);
+	}
+	done_cond.wait(lock, [&job] { return job.pending == 0; });
+}
+
+int moq_worker_pool_concurrency(void)
+{
+	return pool_thread_target() + 1;
+}
+
+void moq_worker_pool_shutdown(void)
+{
+	std::vector<std::thread> threads;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		pool_stopping = true;
+		threads.swap(pool_threads);
+	}
+	work_cond.notify_all();
+
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+}
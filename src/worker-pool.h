@@ -0,0 +1,14 @@
+#pragma once
+
+// Called once per slice, with slice in [0, slice_count)
+typedef void (*moq_slice_func)(void *param, int slice, int slice_count);
+
+// Runs func for every slice across the worker pool shared by all sources.
+// The calling thread works on its own job too, and the call returns once every slice has finished.
+void moq_worker_pool_run(moq_slice_func func, void *param, int slice_count);
+
+// Number of threads that can work on one job at once, including the caller
+int moq_worker_pool_concurrency(void);
+
+// Joins the worker threads; called on module unload
+void moq_worker_pool_shutdown(void);